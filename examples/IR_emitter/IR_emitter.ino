@@ -18,18 +18,25 @@
 
 /*
  *   IR LED   Pro Micro
- *   DATA     pin 5, Timer 10-bits High Speed
+ *   DATA     pin 9 (OC1A) with PF_TRANSMITTER (global.h),
+ *            otherwise pin 5, Timer 10-bits High Speed (IRremote)
  *   -        VCC (3.3V)
  *   GND      GND
  *
  *   IR LED is connected to VCC via 1K resistance and GND via the collector of a
  *   2N3904 transistor.
- *   The transistor base is driven via pin 5 through a 330 ohms resistance.
+ *   The transistor base is driven via the DATA pin through a 330 ohms resistance.
  *
  *   Pro Micro:
  *   Serial: UART via USB
  *   Serial1: pin 1 (TX), pin 0 (RX)
  */
+#include "MyOwnBricks.h"
+
+#ifdef PF_TRANSMITTER
+// Non-blocking transmitter of the library: 5 repetitions in the background
+#define sendPF(value)    PFIRTransmitter.send(value)
+#else
 // IRremote 3.5.x configuration
 // See defines in ~/Arduino/libraries/IRremote/IRremote.hpp
 // See pin alternatives: https://github.com/Arduino-IRremote/Arduino-IRremote#hardware-pwm-signal-generation-for-sending
@@ -41,10 +48,13 @@
 #define NO_DECODER
 
 #include <IRremote.hpp>
-#include "ColorDistanceSensor.h"
 
 // Init IR sender
 IRsend              irsend;
+// Blocking: 1 transmission only
+#define sendPF(value)    irsend.sendLegoPowerFunctions(value, false)
+#endif
+
 // Init sensor
 ColorDistanceSensor myDevice;
 bool                connection_status;
@@ -59,7 +69,7 @@ void IRCallback(const uint16_t value) {
     Serial.println(value, HEX);
 #endif
 
-    irsend.sendLegoPowerFunctions(value, false);
+    sendPF(value);
 }
 
 
@@ -73,6 +83,10 @@ void setup() {
     }
 #endif
 
+#ifdef PF_TRANSMITTER
+    PFIRTransmitter.begin();
+#endif
+
     // Device config
     myDevice.setIRCallback(&IRCallback);
     connection_status = false;
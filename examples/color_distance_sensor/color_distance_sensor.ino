@@ -38,6 +38,25 @@
 #define MANHATTAN
 #include "MyOwnBricks.h"
 #include <VL6180X.h>
+
+// Uncomment to time the parts of loop() (see utilities/profiler.hpp);
+// the stats are printed on Serial (USB CDC) when 'p' is received.
+//#define PROFILE_LOOP
+#ifdef PROFILE_LOOP
+ProfileSection rgbProfile("handleRGBSensorData");
+ProfileSection detectColorProfile("detectColor");
+ProfileSection distProfile("handleDistSensorData");
+ProfileSection processProfile("process");
+#define PROFILE(section)    MOB_PROFILE(section)
+#else
+#define PROFILE(section)    void()
+#endif
+
+// Ambient light measured by the ALS of the VL6180X, interleaved with the
+// ranging and read with the range (see distance_sensor.hpp); comment to
+// compute it from the channels of the TCS34725.
+#define DIST_SENSOR_ALS
+
 #include "distance_sensor.hpp"
 #include "rgb_sensor.hpp"
 
@@ -52,7 +71,7 @@
 uint8_t       sensorColor;
 uint8_t       reflectedLight;
 uint8_t       ambientLight;
-uint16_t      red, green, blue, clear, lux;
+uint16_t      red, green, blue, clear;
 uint16_t      sensorRGB[3];
 uint8_t       sensorDistance;
 bool          connection_status;
@@ -60,7 +79,7 @@ uint8_t       previousDistStatus;
 volatile bool rgbSensorReady;
 volatile bool distSensorReady;
 
-// Default settings: TCS34725_GAIN_4X,  TCS34725_INTEGRATIONTIME_154MS
+// Gain & integration time are set by rgbAutoRange (see rgb_sensor.hpp)
 TCS34725            rgb_sensor;
 VL6180X             dist_sensor;
 ColorDistanceSensor myDevice;
@@ -102,71 +121,126 @@ void LEDColorChanged(uint8_t color) {
 }
 
 
+#ifdef COLOR_DISTANCE_CONFIG
 /**
- * @brief Map lux/reflected light values to percentages
- *    Weights of the equation must be calculated empirically
- *    Map equation: y = ax + b
- *    System to solve:
- *      100% = MaxRawValue * a + b
- *      0% = MinRawValue * a + b
+ * @brief Callback for the acquisition settings written by the hub (mode 11).
+ *      Enable COLOR_DISTANCE_CONFIG in global.h.
+ *
+ *      Pybricks example:
+ *          sensor = PUPDevice(Port.A)
+ *          # 50ms, strength 1, 101ms max, 2 detections
+ *          sensor.write(11, (50, 1, 101, 2))
  */
-uint8_t getPercentage(const uint16_t rawValue, const float& a_coef, const float& b_coef) {
-    int8_t percent = static_cast<int8_t>(rawValue * a_coef + b_coef);
-    if (percent > 100)
-        return 100;
-    if (percent < 0)
-        return 0;
-    return static_cast<uint8_t>(percent);
+void acquisitionConfigChanged(const AcquisitionConfig& config) {
+    if (config.samplePeriod)
+        setDistSensorPeriod(config.samplePeriod);
+    configureRGBSensor(min(config.filterStrength, 8),
+                       config.integrationTime,
+                       constrain(config.colorHysteresis, 1, 255));
+#ifdef DIST_SENSOR_ALS
+    alsFilter.setStrength(min(config.filterStrength, 8));
+#endif
 }
+#endif
 
 
 /**
- * @brief Workaround to solve the problem of the 2 sensors with the same address.
+ * Startup sequence of the sensors, run during the handshake with the hub.
+ *
+ * Workaround to solve the problem of the 2 sensors with the same address.
  *    - TCS34725: No way to change address nor shutdown, but can send Power Off command.
  *    - VL6180X: Can change address and assert/deassert Chip Enable pin.
  *
- *    - Shutdown distance sensor to start rgb sensor on the same address.
+ *    - Shutdown distance sensor to start rgb sensor on the same address (setup()).
  *    - Disable rgb sensor to configure distance sensor (and change its address).
+ *
+ * The steps poll the status of the chips instead of waiting fixed delays.
  */
-void i2cSameAddressWorkaround() {
-    // Shutdown distance sensor
-    pinMode(DIST_SHUTDOWN_PIN, OUTPUT);
-    digitalWrite(DIST_SHUTDOWN_PIN, LOW);
-
-    // Start RGB sensor
-    while (!rgb_sensor.begin()) {
-        INFO_PRINTLN(F("TCS34725 NOT found"));
-        delay(200);
+#define VL6180X_BOOT_TIME         2   // Firmware boot after CE release (ms, datasheet: 1.4)
+#define VL6180X_IDLE_TIMEOUT      300 // End of the single-shot measurement (ms)
+#define DEVICE_RETRY_PERIOD       200 // Period of the messages for a missing device (ms)
+
+StepResult startRGBSensor(unsigned long elapsed) {
+    if (rgb_sensor.begin()) {
+        INFO_PRINTLN(F("Found sensor"));
+        // Disable rgb sensor
+        rgb_sensor.tcs.disable();
+        // Restart distance sensor
+        // Let's float the shutdown pin
+        pinMode(DIST_SHUTDOWN_PIN, INPUT);
+        return STEP_DONE;
     }
-    INFO_PRINTLN(F("Found sensor"));
-
-    // Disable rgb sensor
-    rgb_sensor.tcs.disable();
-    delay(5);
-
-    // Restart distance sensor
-    // Let's float the shutdown pin
-    pinMode(DIST_SHUTDOWN_PIN, INPUT);
+    if (elapsed < DEVICE_RETRY_PERIOD)
+        return STEP_WAIT;
+    INFO_PRINTLN(F("TCS34725 NOT found"));
+    return STEP_RETRY;
+}
 
-    // Configure distance sensor (and change its address)
+StepResult addressDistSensor(unsigned long elapsed) {
+    // The chip can't be polled yet: the TCS34725 answers on the same address
+    if (elapsed < VL6180X_BOOT_TIME)
+        return STEP_WAIT;
+    // Change the address of the distance sensor
     // For some reason, init() MUST be called twice.
     // The first time, the device is not configured (commands go on the TCS's registers ?)
     // The second time (after changing the address) config is effective.
-    //Wire.begin();
     dist_sensor.init();
     dist_sensor.setAddress(0x39);
+    return STEP_DONE;
+}
+
+StepResult configureDistSensor(unsigned long elapsed) {
+    // Alone on its new address: wait until it answers
+    dist_sensor.readReg(VL6180X::SYSTEM__FRESH_OUT_OF_RESET);
+    if (dist_sensor.last_status != 0) {
+        if (elapsed < DEVICE_RETRY_PERIOD)
+            return STEP_WAIT;
+        INFO_PRINTLN(F("VL6180X NOT found"));
+        return STEP_RETRY;
+    }
     initDistSensor();
-    delay(5);
+    return STEP_DONE;
+}
 
-    // Restart rgb sensor
+StepResult startSensors(unsigned long elapsed) {
+    if (!isDistSensorIdle() && elapsed < VL6180X_IDLE_TIMEOUT)
+        return STEP_WAIT;
+    startDistSensor();
+
+    // Restart rgb sensor with the settings of the auto-ranging
+    rgb_sensor.tcs.write8(TCS34725_ATIME, rgbAutoRange.getATime());
+    rgb_sensor.tcs.write8(TCS34725_CONTROL, rgbAutoRange.getControl());
     rgb_sensor.tcs.enable();
+    // Set persistence filter to generate an interrupt for every RGB Cycle,
+    // regardless of the integration limits
+    rgb_sensor.tcs.write8(TCS34725_PERS, TCS34725_PERS_NONE);
+    // RGBC interrupt enable. When asserted, permits RGBC interrupts to be generated.
+    rgb_sensor.tcs.setInterrupt(true);
+
+    // From now, the sensors are read asynchronously (see AsyncI2C.h);
+    // Wire must not be used anymore while I2CEngine is not idle.
+    I2CEngine.begin();
+    I2CEngine.attach(rgbChip);
+    I2CEngine.attach(distChip);
+    return STEP_DONE;
+}
+
+const StartupStep   startupSteps[] = { startRGBSensor, addressDistSensor, configureDistSensor, startSensors };
+StartupSequencer<4> sensorsStartup(startupSteps);
+
+
+/**
+ * @brief Idle callback of the handshake with the hub.
+ */
+void bringUpSensors() {
+    sensorsStartup.poll();
 }
 
 
 void setup() {
     pinMode(LED_BUILTIN, OUTPUT);
 
-#if (defined(INFO) || defined(DEBUG))
+#if (defined(INFO) || defined(DEBUG) || defined(PROFILE_LOOP))
     Serial.begin(115200); // USB CDC
     while (!Serial) {
         // Wait for serial port to connect.
@@ -180,7 +254,13 @@ void setup() {
     myDevice.setSensorAmbientLight(&ambientLight);
     myDevice.setSensorRGB(sensorRGB);
     myDevice.setSensorDistance(&sensorDistance);
+#ifdef COLOR_DISTANCE_COUNTER
+    myDevice.setDetectionCounter(&detectionCounter);
+#endif
     // myDevice.setLEDColorCallback(&LEDColorChanged); // See notes
+#ifdef COLOR_DISTANCE_CONFIG
+    myDevice.setConfigCallback(&acquisitionConfigChanged);
+#endif
     connection_status = false;
     rgbSensorReady    = false;
     distSensorReady   = false;
@@ -211,23 +291,40 @@ void setup() {
     attachInterrupt(digitalPinToInterrupt(DIST_SENSOR_INTERRUPT_PIN), ISR_sensor, FALLING);
     sei(); // Enable all interrupts
 
-    i2cSameAddressWorkaround();
-
-    // Set persistence filter to generate an interrupt for every RGB Cycle,
-    // regardless of the integration limits
-    rgb_sensor.tcs.write8(TCS34725_PERS, TCS34725_PERS_NONE);
-    // RGBC interrupt enable. When asserted, permits RGBC interrupts to be generated.
-    rgb_sensor.tcs.setInterrupt(true);
+    // Shutdown distance sensor until the rgb sensor is started (see startRGBSensor())
+    pinMode(DIST_SHUTDOWN_PIN, OUTPUT);
+    digitalWrite(DIST_SHUTDOWN_PIN, LOW);
+    // The sensors are brought up during the handshake with the hub
+    myDevice.setIdleCallback(bringUpSensors);
 }
 
 
 void loop()
 {
-    handleRGBSensorData();
-    handleDistSensorData();
+    if (sensorsStartup.poll()) {
+        // Advance the I2C transactions; never blocks
+        I2CEngine.poll();
+        {
+            PROFILE(rgbProfile);
+            handleRGBSensorData();
+        }
+        {
+            PROFILE(distProfile);
+            handleDistSensorData();
+        }
+    }
 
     // Send data to PoweredUp Hub
-    myDevice.process();
+    {
+        PROFILE(processProfile);
+        myDevice.process();
+    }
+#ifdef PROFILE_LOOP
+    if (Serial.read() == 'p') {
+        ProfileSection::dumpAll(Serial);
+        ProfileSection::resetAll();
+    }
+#endif
 
     if (myDevice.isConnected()) {
         // Already connected ?
@@ -238,6 +335,17 @@ void loop()
 
             connection_status = true;
         }
+#ifdef INFO
+        // Boot time: power-on to sensors ready / to first data sent to the hub
+        static bool bootTimeReported = false;
+        if (!bootTimeReported && myDevice.getFirstDataTime()) {
+            INFO_PRINT(F("Sensors ready (ms): "));
+            INFO_PRINTLN(sensorsStartup.getDoneTime());
+            INFO_PRINT(F("First data (ms): "));
+            INFO_PRINTLN(myDevice.getFirstDataTime());
+            bootTimeReported = true;
+        }
+#endif
     } else {
         INFO_PRINTLN(F("Not Connected !"));
         pinMode(LED_BUILTIN_TX, OUTPUT);
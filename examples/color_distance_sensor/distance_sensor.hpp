@@ -16,84 +16,228 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 extern uint8_t       sensorDistance;
+extern uint8_t       ambientLight;
 extern uint8_t       previousDistStatus;
 extern VL6180X       dist_sensor;
 extern volatile bool distSensorReady;
-extern uint8_t getPercentage(const uint16_t, const float&, const float&);
-
-#define DISTANCE_TO_PERCENTAGE(val)    (getPercentage(val, 0.543, -8.152))
 
+#define DISTANCE_TO_PERCENTAGE(val)    (MOB_RANGE_MAPPER(0.543, -8.152)::map(val))
+
+#ifdef DIST_SENSOR_ALS
+// Interleaved mode: an ALS measurement then a ranging in each period.
+// The period must be longer than the integration time + the ranging (~15ms).
+#define DIST_ALS_INTEGRATION_TIME      50  // ms
+#define DIST_ALS_PERIOD                100 // ms
+// Lux: 0.32 per count for an integration of 100ms at gain 1 (datasheet);
+// same mapping to 0-100 as the lux of the TCS34725 (see rgb_sensor.hpp)
+#define ALS_TO_PERCENTAGE(val) \
+    (MOB_RANGE_MAPPER(0.0105 * 0.32 * 100 / DIST_ALS_INTEGRATION_TIME, -0.0843)::map(val))
+// Registers of the continuous measurements
+#define DIST_START_REG                 VL6180X::SYSALS__START
+#define DIST_PERIOD_REG                VL6180X::SYSALS__INTERMEASUREMENT_PERIOD
+#define DIST_PERIOD_MIN                DIST_ALS_PERIOD
+// Burst read of the results, from the range status to the range
+#define DIST_RESULTS_SIZE              (VL6180X::RESULT__RANGE_VAL - VL6180X::RESULT__RANGE_STATUS + 1)
+#define DIST_RESULT_INDEX(reg)         (VL6180X::reg - VL6180X::RESULT__RANGE_STATUS)
+#else
+#define DIST_START_REG                 VL6180X::SYSRANGE__START
+#define DIST_PERIOD_REG                VL6180X::SYSRANGE__INTERMEASUREMENT_PERIOD
+#define DIST_PERIOD_MIN                10
+#endif
+
+// Streaming filter (see utilities/filters.hpp): median of 3 samples removes
+// isolated wrong ranges (edges of objects, reflections).
+MovingMedian<uint16_t, 3> distanceFilter;
+#ifdef DIST_SENSOR_ALS
+ExponentialAverage<uint16_t> alsFilter;
+#endif
+#ifdef COLOR_DISTANCE_COUNTER
+// Objects passing below 5cm (mode 2), 1cm of hysteresis; every sample is read
+ProximityCounter detectionCounter(50, 60);
+#endif
+
+// Asynchronous reads (see AsyncI2C.h); address changed in i2cSameAddressWorkaround()
+I2CDevice      distChip(0x39, true); // 16 bits registers
+#ifdef DIST_SENSOR_ALS
+I2CTransaction distResultsRead;
+uint8_t        distResults[DIST_RESULTS_SIZE];
+uint8_t        distClearValue = 0x03; // Range & ALS interrupts
+#else
+I2CTransaction distStatusRead;
+I2CTransaction distRangeRead;
+uint8_t        distStatus;
+uint8_t        distRange;
+uint8_t        distClearValue = 0x01;
+#endif
+I2CTransaction distInterruptClear;
+volatile bool  distDataAvailable;
+// Change of the period of the measurements (see setDistSensorPeriod())
+I2CTransaction distRangeStop;
+I2CTransaction distPeriodWrite;
+I2CTransaction distRangeStart;
+uint8_t        distStopValue  = 0x01;
+uint8_t        distStartValue = 0x03;
+uint8_t        distPeriod;
+bool           distPeriodChanged;
+
+
+#ifdef DIST_SENSOR_ALS
 /**
- * @brief Read reading of range;
- *    Must be called after the interrupt has been triggered
+ * @brief Completion of the burst read of the range & ALS results.
  */
-uint8_t readRangeNonBlocking() {
-    uint8_t range = dist_sensor.readReg(VL6180X::RESULT__RANGE_VAL);
-
-    dist_sensor.writeReg(VL6180X::SYSTEM__INTERRUPT_CLEAR, 0x01);
-    return range;
+void onRangeRead(I2CTransaction& transaction) {
+    distDataAvailable = (transaction.status == I2CTransaction::I2C_DONE);
 }
-
-
+#else
 /**
- * @brief Convert raw range value to millimeters.
- *    Mostly useful when the scale factor is modified to increase the measuring range.
+ * @brief Completion of the reading of the range (status is read before).
  */
-uint16_t readRangeNonBlockingMillimeters() {
-    return static_cast<uint16_t>(readRangeNonBlocking() * dist_sensor.getScaling());
+void onRangeRead(I2CTransaction& transaction) {
+    distDataAvailable = (transaction.status == I2CTransaction::I2C_DONE) &&
+                        (distStatusRead.status == I2CTransaction::I2C_DONE);
 }
+#endif
 
 
 /**
- * @brief Init registers of VL6180X sensor and put it online.
+ * @brief Init registers of VL6180X sensor.
+ *      The measurements are started by startDistSensor() once isDistSensorIdle().
  */
 void initDistSensor() {
     dist_sensor.init();
     dist_sensor.configureDefault();
     dist_sensor.setTimeout(100);
 
-    // If scaling is modified, do not forget to update weights in getDistancePercent()
+    // If scaling is modified, do not forget to update weights in DISTANCE_TO_PERCENTAGE()
     // a = 0.3401, b = -5.4422
     //dist_sensor.setScaling(2);
 
     // stop continuous mode if already active
     dist_sensor.stopContinuous();
-    // in case stopContinuous() triggered a single-shot
-    // measurement, wait for it to complete
-    delay(300); // TODO: check this! Can be too long for reboot actions
+}
+
 
+/**
+ * @brief stopContinuous() can trigger a single-shot measurement; a new
+ *      measurement can only be started once it is complete.
+ * @return true if the sensor is ready (range_device_ready bit).
+ */
+bool isDistSensorIdle() {
+    return dist_sensor.readReg(VL6180X::RESULT__RANGE_STATUS) & 0x01;
+}
+
+
+/**
+ * @brief Put the sensor online: continuous measurements signaled on GPIO1.
+ *      With DIST_SENSOR_ALS, the ambient light is measured before each
+ *      ranging (interleaved mode); GPIO1 is asserted once both are done.
+ */
+void startDistSensor() {
     // enable interrupt output on GPIO1
     dist_sensor.writeReg(VL6180X::SYSTEM__MODE_GPIO1, 0x10);
+#ifdef DIST_SENSOR_ALS
+    // Interrupt on new range sample only (configureDefault(): range & ALS)
+    dist_sensor.writeReg(VL6180X::SYSTEM__INTERRUPT_CONFIG_GPIO, 0x04);
+    dist_sensor.writeReg16Bit(VL6180X::SYSALS__INTEGRATION_PERIOD, DIST_ALS_INTEGRATION_TIME - 1);
+#endif
     // clear any existing interrupts
     dist_sensor.writeReg(VL6180X::SYSTEM__INTERRUPT_CLEAR, 0x03);
 
+#ifdef DIST_SENSOR_ALS
+    dist_sensor.startInterleavedContinuous(DIST_ALS_PERIOD);
+#else
     dist_sensor.startRangeContinuous(); // default period = 100ms
+#endif
+}
+
+
+/**
+ * @brief Change the period of the continuous measurements.
+ *      The ranging is restarted with the new period once the current
+ *      measurement is read (see handleDistSensorData()).
+ * @param period Period in ms (10 to 2550, 10ms steps; DIST_ALS_PERIOD min
+ *      with DIST_SENSOR_ALS).
+ */
+void setDistSensorPeriod(uint16_t period) {
+    // Same conversion as VL6180X::startRangeContinuous()
+    int16_t period_reg = _(int16_t)(period / 10) - 1;
+    distPeriod        = constrain(period_reg, DIST_PERIOD_MIN / 10 - 1, 254);
+    distPeriodChanged = true;
 }
 
 
 /**
- * @brief Process raw values from sensor and convert them for the PoweredUp hub,
+ * @brief Queue the reading of the range when a measure is ready;
+ *      Process the raw values once read and convert them for the PoweredUp hub,
  *      if needed.
  */
 void handleDistSensorData() {
-    if (!distSensorReady)
+#ifdef DIST_SENSOR_ALS
+    if (distSensorReady && !distResultsRead.isPending()) {
+#else
+    if (distSensorReady && !distRangeRead.isPending()) {
+#endif
+        distSensorReady = false;
+        EIFR &= ~(1 << INTF6); // clear interrupt flag in case of bounce
+
+#ifdef DIST_SENSOR_ALS
+        // Range status to range in 1 burst (ALS status & value are between)
+        distResultsRead.setRead(VL6180X::RESULT__RANGE_STATUS, distResults, DIST_RESULTS_SIZE);
+        distResultsRead.callback = onRangeRead;
+        I2CEngine.submit(distChip, distResultsRead);
+#else
+        // Error status, range, then clear the interrupt of the sensor
+        distStatusRead.setRead(VL6180X::RESULT__RANGE_STATUS, &distStatus, 1);
+        I2CEngine.submit(distChip, distStatusRead);
+        distRangeRead.setRead(VL6180X::RESULT__RANGE_VAL, &distRange, 1);
+        distRangeRead.callback = onRangeRead;
+        I2CEngine.submit(distChip, distRangeRead);
+#endif
+        distInterruptClear.setWrite(VL6180X::SYSTEM__INTERRUPT_CLEAR, &distClearValue, 1);
+        I2CEngine.submit(distChip, distInterruptClear);
+
+        if (distPeriodChanged && !distRangeStart.isPending()) {
+            // Between 2 measurements: stop, set the period & restart
+            distPeriodChanged = false;
+            distRangeStop.setWrite(DIST_START_REG, &distStopValue, 1);
+            I2CEngine.submit(distChip, distRangeStop);
+            distPeriodWrite.setWrite(DIST_PERIOD_REG, &distPeriod, 1);
+            I2CEngine.submit(distChip, distPeriodWrite);
+            distRangeStart.setWrite(DIST_START_REG, &distStartValue, 1);
+            I2CEngine.submit(distChip, distRangeStart);
+        }
         return;
+    }
+    if (!distDataAvailable)
+        return;
+    distDataAvailable = false;
+
+#ifdef DIST_SENSOR_ALS
+    const uint8_t distRange  = distResults[DIST_RESULT_INDEX(RESULT__RANGE_VAL)];
+    const uint8_t distStatus = distResults[DIST_RESULT_INDEX(RESULT__RANGE_STATUS)];
 
-    // Get distance
-    uint16_t raw_distance = readRangeNonBlockingMillimeters(); // 1ms
+    // Ambient light; updated even if the ranging failed
+    if (!(distResults[DIST_RESULT_INDEX(RESULT__ALS_STATUS)] >> 4)) {
+        // 16 bits, MSB first
+        const uint8_t *alsValue = &distResults[DIST_RESULT_INDEX(RESULT__ALS_VAL)];
+        ambientLight = ALS_TO_PERCENTAGE(alsFilter.update(_(uint16_t)((alsValue[0] << 8) | alsValue[1])));
+    }
+#endif
+
+    // Get distance in millimeters
+    // (scaling is useful when the scale factor is modified to increase the measuring range)
+    uint16_t raw_distance = _(uint16_t)(distRange * dist_sensor.getScaling());
     // Get error status
-    uint8_t status = dist_sensor.readRangeStatus();
+    uint8_t status = distStatus >> 4;
 
     if (status == VL6180X_ERROR_NONE) {
         // Correct detection occured
         // Set distance percentage to the vision sensor
-        sensorDistance = DISTANCE_TO_PERCENTAGE(raw_distance);
+        sensorDistance = DISTANCE_TO_PERCENTAGE(distanceFilter.update(raw_distance));
 
-        // If previous status is 0 and this one is != 0: target is gone
-        // If previous status is != 0 and this one is 0: target appears
-        //    => increment detection count
-        //if (previousStatus != status && raw_distance <= 50)
-        //  detectionCount++;
+#ifdef COLOR_DISTANCE_COUNTER
+        detectionCounter.update(raw_distance);
+#endif
 
         previousDistStatus = status;
 
@@ -101,10 +245,11 @@ void handleDistSensorData() {
         INFO_PRINTLN(raw_distance);
         INFO_PRINTLN(sensorDistance);
     } else {
+#ifdef COLOR_DISTANCE_COUNTER
+        // No target (or error)
+        detectionCounter.update(PROXIMITY_COUNTER_FAR);
+#endif
         DEBUG_PRINT("Status: ");
         DEBUG_PRINTLN(status);
     }
-
-    distSensorReady = false;
-    EIFR &= ~(1 << INTF6); // clear interrupt flag in case of bounce
 }
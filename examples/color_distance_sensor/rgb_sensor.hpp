@@ -15,88 +15,192 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+extern uint8_t       sensorColor;
 extern uint8_t       reflectedLight;
 extern uint8_t       ambientLight;
+extern uint16_t      red, green, blue, clear;
 extern uint16_t      sensorRGB[3];
-extern TCS34725      rgb_sensor;
 extern volatile bool rgbSensorReady;
-extern uint8_t getPercentage(const uint16_t, const float&, const float&);
 
-#define LUX_TO_PERCENTAGE(val)                (getPercentage(val, 0.0105, -0.0843))
-#define REFLECTED_LIGHT_TO_PERCENTAGE(val)    (getPercentage(val, 0.0017, -8))
+#define LUX_TO_PERCENTAGE(val)                (MOB_RANGE_MAPPER(0.0105, -0.0843)::map(val))
+#define REFLECTED_LIGHT_TO_PERCENTAGE(val)    (MOB_RANGE_MAPPER(0.0017, -8)::map(val))
+
+// TCS34725 registers for the asynchronous reads (see AsyncI2C.h)
+#define TCS_COMMAND_BIT           0x80
+#define TCS_AUTO_INCREMENT        0x20
+#define TCS_CDATAL                0x14
+#define TCS_CLEAR_INTERRUPT       0x66
+// Counts per lux for the reference settings of the readings (gain 4x,
+// integration time 154ms; see TCS34725AutoRange::scale()):
+// (ATIME_ms * AGAINx) / (GA * DF); see TCS34725 DN40 application note
+#define TCS_CPL                   ((154.0 * 4) / (1.0 * 310))
+// Max lux at the reference settings (same formula as TCS34725::maxlux)
+#define TCS_MAXLUX                (_(uint16_t)(65535 / (TCS_CPL * 3)))
+
+I2CDevice      rgbChip(0x29);
+I2CTransaction rgbcRead;
+I2CTransaction rgbInterruptClear;
+I2CTransaction rgbATimeWrite;
+I2CTransaction rgbControlWrite;
+uint8_t        rgbcBuffer[8];
+uint8_t        rgbATime;
+uint8_t        rgbControl;
+volatile bool  rgbDataAvailable;
+
+// Gain & integration time follow the light level (see utilities/tcs34725_autorange.hpp)
+TCS34725AutoRange rgbAutoRange;
+
+// Streaming filters (see utilities/filters.hpp)
+// RGB channels: median of 3 samples to remove spikes, then a light average
+typedef FilterChain<MovingMedian<uint16_t, 3>, ExponentialAverage<uint16_t> > ChannelFilter;
+ChannelFilter                redFilter, greenFilter, blueFilter;
+ExponentialAverage<uint16_t> clearFilter;
+ExponentialAverage<uint16_t> luxFilter;
+// The detected color must be seen 3 times in a row before being sent to the hub
+ColorHysteresis<uint8_t>     colorFilter(COLOR_NONE, 3);
+
+
+/**
+ * @brief Apply the acquisition settings written by the hub
+ *      (see ColorDistanceSensor::setConfigCallback()).
+ *      The new integration time cap is applied by the next reading.
+ */
+void configureRGBSensor(uint8_t filterStrength, uint16_t integrationTime, uint8_t colorHysteresis) {
+    redFilter.second.setStrength(filterStrength);
+    greenFilter.second.setStrength(filterStrength);
+    blueFilter.second.setStrength(filterStrength);
+    clearFilter.setStrength(filterStrength);
+    luxFilter.setStrength(filterStrength);
+    colorFilter.setThreshold(colorHysteresis);
+    rgbAutoRange.setMaxIntegrationTime(integrationTime);
+}
 
 
 /**
- * @brief Process raw values from sensor and convert them for the PoweredUp hub,
+ * @brief Completion of the burst read of the RGBC channels.
+ */
+void onRGBCRead(I2CTransaction& transaction) {
+    rgbDataAvailable = (transaction.status == I2CTransaction::I2C_DONE);
+}
+
+
+/**
+ * @brief Queue the reading of the channels when a measure is ready;
+ *      Process the values once read and convert them for the PoweredUp hub,
  *      if needed.
  */
 void handleRGBSensorData() {
-    if (!rgbSensorReady)
+    if (rgbSensorReady && !rgbcRead.isPending()) {
+        rgbSensorReady = false;
+        PCIFR         &= ~(1 << PCIF0); // clear PC interrupt flag in case of bounce
+
+        // Burst read of the 8 bytes of the channels (C, R, G, B), then clear
+        // the interrupt of the sensor; the bus is shared with the distance sensor
+        rgbcRead.setRead(TCS_COMMAND_BIT | TCS_AUTO_INCREMENT | TCS_CDATAL, rgbcBuffer, 8);
+        rgbcRead.callback = onRGBCRead;
+        I2CEngine.submit(rgbChip, rgbcRead);
+        rgbInterruptClear.setWrite(TCS_COMMAND_BIT | TCS_CLEAR_INTERRUPT, nullptr, 0);
+        I2CEngine.submit(rgbChip, rgbInterruptClear);
         return;
+    }
+    if (!rgbDataAvailable)
+        return;
+    rgbDataAvailable = false;
 
-    // Data measurement
-    boolean status = rgb_sensor.updateData(true);
-
-    if (status) {
-        // Ambient light (lux) computation
-        rgb_sensor.updateLux();
-
-        int16_t lux = lround(rgb_sensor.lux);
-
-        // Sometimes lux values are below 0; this coincides with erroneous data
-        // Moreover, we discard data taken below 40 lux.
-        if ((lux >= 40) && (static_cast<uint16_t>(lux) <= rgb_sensor.maxlux)) {
-            // Set ambient light (lux) - map 0-100
-            //ambientLight = map(rgb_sensor.lux, 0, rgb_sensor.maxlux, 0, 100);
-            ambientLight = LUX_TO_PERCENTAGE(lux); // cast ?
-
-            // RGBC Channels are usable
-            // Map values to max ~440;
-            // Continuous values from 0-65535 (16bits) to 0-1023 (10bits)
-            // Note: 440 gives ~28000 (which is the quasi maximum value observed in the channels)
-            red   = rgb_sensor.r_comp >> 6,
-            green = rgb_sensor.g_comp >> 6,
-            blue  = rgb_sensor.b_comp >> 6,
-
-            // Set clear channel as reflected light - map 0-100
-            reflectedLight = REFLECTED_LIGHT_TO_PERCENTAGE(rgb_sensor.c_comp);
-
-            // Set RGB channels
-            sensorRGB[0] = red;
-            sensorRGB[1] = green;
-            sensorRGB[2] = blue;
-
-            // Set detected color
-            sensorColor = detectColor(red, green, blue);
-        } else {
-            sensorColor = COLOR_NONE;
+    uint16_t c_raw = rgbcBuffer[0] | (rgbcBuffer[1] << 8);
+
+    if (rgbAutoRange.update(c_raw)) {
+        // Apply the new settings from the next integration
+        // (buffers are read when the transactions are sent)
+        rgbATime   = rgbAutoRange.getATime();
+        rgbControl = rgbAutoRange.getControl();
+        if (!rgbATimeWrite.isPending()) {
+            rgbATimeWrite.setWrite(TCS_COMMAND_BIT | TCS_AUTORANGE_ATIME_REG, &rgbATime, 1);
+            I2CEngine.submit(rgbChip, rgbATimeWrite);
         }
-#if (defined(INFO) || defined(DEBUG))
-        clear = rgb_sensor.c_comp >> 6;
-        /*
-        // Human readable debugging
-        Serial.print("Lux: "); Serial.print(rgb_sensor.lux, DEC);
-        Serial.print("; max: "); Serial.print(rgb_sensor.maxlux);
-        Serial.print("; R: "); Serial.print(red, DEC);
-        Serial.print("; G: "); Serial.print(green, DEC);
-        Serial.print("; B: "); Serial.print(blue, DEC);
-        Serial.print("; C: "); Serial.println(clear, DEC);
-        */
-
-        // Spreadsheet debugging
-        Serial.print(rgb_sensor.lux, DEC); Serial.print(";");
-        Serial.print(rgb_sensor.maxlux); Serial.print(";");
-        Serial.print(red, DEC); Serial.print(";");
-        Serial.print(green, DEC); Serial.print(";");
-        Serial.print(blue, DEC); Serial.print(";");
-        Serial.println(clear, DEC);
+        if (!rgbControlWrite.isPending()) {
+            rgbControlWrite.setWrite(TCS_COMMAND_BIT | TCS_AUTORANGE_CONTROL_REG, &rgbControl, 1);
+            I2CEngine.submit(rgbChip, rgbControlWrite);
+        }
+    }
+
+    // Readings at the reference settings
+    c_raw          = rgbAutoRange.scale(c_raw);
+    uint16_t r_raw = rgbAutoRange.scale(rgbcBuffer[2] | (rgbcBuffer[3] << 8));
+    uint16_t g_raw = rgbAutoRange.scale(rgbcBuffer[4] | (rgbcBuffer[5] << 8));
+    uint16_t b_raw = rgbAutoRange.scale(rgbcBuffer[6] | (rgbcBuffer[7] << 8));
+
+    if (!rgbAutoRange.isValid()) {
+        // Saturated, too dark, too bright for the reference settings,
+        // or taken during a change of settings
+        sensorColor = colorFilter.update(COLOR_NONE);
+        return;
+    }
+
+    // IR compensation (DN40)
+    uint32_t sum    = _(uint32_t)(r_raw) + g_raw + b_raw;
+    uint16_t ir     = (sum > c_raw) ? (sum - c_raw) / 2 : 0;
+    uint16_t r_comp = (r_raw > ir) ? r_raw - ir : 0;
+    uint16_t g_comp = (g_raw > ir) ? g_raw - ir : 0;
+    uint16_t b_comp = (b_raw > ir) ? b_raw - ir : 0;
+    uint16_t c_comp = (c_raw > ir) ? c_raw - ir : 0;
+
+#if (!defined(DIST_SENSOR_ALS) || defined(INFO) || defined(DEBUG))
+    // Ambient light (lux) computation
+    int16_t lux = lround((0.136 * r_comp + 1.0 * g_comp - 0.444 * b_comp) / TCS_CPL);
 #endif
+#ifdef DIST_SENSOR_ALS
+    // Ambient light is measured by the VL6180X (see distance_sensor.hpp);
+    // only the sign of the lux equation above is needed, in integers
+    const bool channelsValid = 136UL * r_comp + 1000UL * g_comp >= 444UL * b_comp;
+#else
+    const bool channelsValid = lux >= 0;
+#endif
+
+    // Sometimes lux values are below 0; this coincides with erroneous data
+    // (the range of the channels is checked by rgbAutoRange)
+    if (channelsValid) {
+#ifndef DIST_SENSOR_ALS
+        // Set ambient light (lux) - map 0-100
+        ambientLight = LUX_TO_PERCENTAGE(luxFilter.update(lux));
+#endif
+
+        // RGBC Channels are usable
+        // Map values to max ~440;
+        // Continuous values from 0-65535 (16bits) to 0-1023 (10bits)
+        // Note: 440 gives ~28000 (which is the quasi maximum value observed in the channels)
+        red   = redFilter.update(_(uint16_t)(r_comp >> 6));
+        green = greenFilter.update(_(uint16_t)(g_comp >> 6));
+        blue  = blueFilter.update(_(uint16_t)(b_comp >> 6));
+
+        // Set clear channel as reflected light - map 0-100
+        reflectedLight = REFLECTED_LIGHT_TO_PERCENTAGE(clearFilter.update(c_comp));
+
+        // Set RGB channels
+        sensorRGB[0] = red;
+        sensorRGB[1] = green;
+        sensorRGB[2] = blue;
+
+        // Set detected color
+        uint8_t color;
+        {
+            PROFILE(detectColorProfile);
+            color = detectColor(red, green, blue);
+        }
+        sensorColor = colorFilter.update(color);
     } else {
-        sensorColor = COLOR_NONE;
-        INFO_PRINTLN(F("not valid data! wait next measure"));
+        sensorColor = colorFilter.update(COLOR_NONE);
     }
-    // Interrupt tear down
-    rgb_sensor.tcs.clearInterrupt();
-    rgbSensorReady = false;
-    PCIFR &= ~(1 << PCIF0); // clear PC interrupt flag in case of bounce
+#if (defined(INFO) || defined(DEBUG))
+    clear = c_comp >> 6;
+
+    // Spreadsheet debugging
+    Serial.print(lux, DEC); Serial.print(";");
+    Serial.print(TCS_MAXLUX); Serial.print(";");
+    Serial.print(red, DEC); Serial.print(";");
+    Serial.print(green, DEC); Serial.print(";");
+    Serial.print(blue, DEC); Serial.print(";");
+    Serial.print(clear, DEC); Serial.print(";");
+    Serial.println(rgbAutoRange.getIntegrationTime());
+#endif
 }
@@ -41,8 +41,8 @@
 // Equivalent of digitalRead but for PORTB pins & much more quicker for a use in an ISR
 // https://www.arduino.cc/en/Reference/PortManipulation
 #define tstPin(b)                             ((PINB & (1 << (b))) != 0)
-#define LUX_TO_PERCENTAGE(val)                (getPercentage(val, 0.0105, -0.0843))
-#define REFLECTED_LIGHT_TO_PERCENTAGE(val)    (getPercentage(val, 0.0017, -8))
+#define LUX_TO_PERCENTAGE(val)                (MOB_RANGE_MAPPER(0.0105, -0.0843)::map(val))
+#define REFLECTED_LIGHT_TO_PERCENTAGE(val)    (MOB_RANGE_MAPPER(0.0017, -8)::map(val))
 
 uint8_t       sensorColor;
 uint8_t       reflectedLight;
@@ -85,24 +85,6 @@ void LEDColorChanged(uint8_t color) {
 }
 
 
-/**
- * @brief Map lux/reflected light values to percentages
- *    Weights of the equation must be calculated empirically
- *    Map equation: y = ax + b
- *    System to solve:
- *      100% = MaxRawValue * a + b
- *      0% = MinRawValue * a + b
- */
-uint8_t getPercentage(const uint16_t rawValue, const float& a_coef, const float& b_coef) {
-    int8_t percent = static_cast<int8_t>(rawValue * a_coef + b_coef);
-    if (percent > 100)
-        return 100;
-    if (percent < 0)
-        return 0;
-    return static_cast<uint8_t>(percent);
-}
-
-
 void setup() {
     pinMode(LED_BUILTIN, OUTPUT);
 
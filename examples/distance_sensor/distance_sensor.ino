@@ -30,17 +30,24 @@
  */
 #include <Wire.h>
 #include <VL6180X.h>
-#include "ColorDistanceSensor.h"
+#include "MyOwnBricks.h"
 
 #define SENSOR_INTERRUPT_PIN    7
-uint8_t       sensorDistance;
+// Map distance to percentages; see utilities/range_mapper.hpp
+// Weights must be calculated empirically:
+//    For scale factor 1 (default): a = 0.543, b = -8.152
+//    For scale factor 2: a = 0.3401, b = -5.4422
+#define DISTANCE_TO_PERCENTAGE(val)    (MOB_RANGE_MAPPER(0.543, -8.152)::map(val))
 bool          connection_status;
 volatile bool distSensorReady;
-uint16_t      detectionCount;
 uint8_t       previousDistStatus;
 
 VL6180X             distSensor;
 ColorDistanceSensor myDevice;
+#ifdef COLOR_DISTANCE_COUNTER
+// Objects passing below 5cm (mode 2), 1cm of hysteresis
+ProximityCounter    detectionCounter(50, 60);
+#endif
 
 
 /**
@@ -72,38 +79,23 @@ uint16_t readRangeNonBlockingMillimeters() {
 }
 
 
-/**
- * @brief Map values to percentages
- *    Weights of the equation must be calculated empirically
- *    Equation: y = ax + b
- *
- *    For scale factor 1 (default): a = 0.543, b = -8.152
- *    For scale factor 2: a = 0.3401, b = -5.4422
- */
-uint8_t getDistancePercent(uint16_t& rawValue) {
-    int8_t percent = static_cast<int8_t>(rawValue * 0.543 - 8.152);
-    if (percent > 100)
-        return 100;
-    if (percent < 0)
-        return 0;
-    return static_cast<uint8_t>(percent);
-}
-
-
 void initDistSensor() {
     distSensor.init();
     distSensor.configureDefault();
     distSensor.setTimeout(100);
 
-    // If scaling is modified, do not forget to update weights in getDistancePercent()
+    // If scaling is modified, do not forget to update weights in DISTANCE_TO_PERCENTAGE()
     // a = 0.3401, b = -5.4422
     //sensor.setScaling(2);
 
     // stop continuous mode if already active
     distSensor.stopContinuous();
     // in case stopContinuous() triggered a single-shot
-    // measurement, wait for it to complete
-    delay(300); // TODO: check this! Can be too long for reboot actions
+    // measurement, wait for it to complete (range_device_ready bit)
+    unsigned long starttime = millis();
+    while (!(distSensor.readReg(VL6180X::RESULT__RANGE_STATUS) & 0x01) &&
+           millis() - starttime < 300) {
+    }
 
     // enable interrupt output on GPIO1
     distSensor.writeReg(VL6180X::SYSTEM__MODE_GPIO1, 0x10);
@@ -125,7 +117,9 @@ void setup() {
 #endif
 
     // Device config
-    myDevice.setSensorDistance(&sensorDistance);
+#ifdef COLOR_DISTANCE_COUNTER
+    myDevice.setDetectionCounter(&detectionCounter);
+#endif
     connection_status = false;
     distSensorReady   = false;
 
@@ -156,19 +150,21 @@ void loop() {
         if (status == VL6180X_ERROR_NONE) {
             // Correct detection occured
             // Set distance percentage to the vision sensor
-            sensorDistance = getDistancePercent(raw_distance);
+            myDevice.setDistance(DISTANCE_TO_PERCENTAGE(raw_distance));
 
-            // If previous status is 0 and this one is != 0: target is gone
-            // If previous status is != 0 and this one is 0: target appears
-            //    => increment detection count
-            //if (previousDistStatus != status && raw_distance <= 50)
-            //  detectionCount++;
+#ifdef COLOR_DISTANCE_COUNTER
+            detectionCounter.update(raw_distance);
+#endif
 
             previousDistStatus = status;
 
             INFO_PRINT("Distance (mm): ");
             INFO_PRINTLN(raw_distance);
         } else {
+#ifdef COLOR_DISTANCE_COUNTER
+            // No target (or error)
+            detectionCounter.update(PROXIMITY_COUNTER_FAR);
+#endif
             DEBUG_PRINT("Status: ");
             DEBUG_PRINTLN(status);
         }
@@ -0,0 +1,171 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ *   Sensor   ESP32
+ *   SCL      GPIO22
+ *   SDA      GPIO21
+ *   VIN      3.3V
+ *   GND      GND
+ *
+ *   ESP32 (ESP32_SERIAL2 or UART_EVENT_SERIAL enabled in global.h):
+ *   Serial: UART via USB (debugging)
+ *   Serial2: GPIO17 (TX), GPIO16 (RX) (hub)
+ *
+ *   Dual core split:
+ *   - Core 0: LUMP protocol task (BaseSensor::startProtocolTask()), high priority.
+ *   - Core 1: Arduino loop: I2C acquisitions, lux computation, color detection.
+ *   The loop publishes its samples in a lock-free Snapshot; the protocol task
+ *   copies the latest one into the variables of the sensor before answering
+ *   the hub. A slow acquisition can't delay a response anymore.
+ *
+ *   Enable NACK_LATENCY_STATS in global.h to print the distribution
+ *   of the NACK response latencies every 10 seconds.
+ */
+#include <Wire.h>
+#include "tcs34725.h"
+#define MANHATTAN
+#include "MyOwnBricks.h"
+
+#if !defined(ESP32_SERIAL2) && !defined(UART_EVENT_SERIAL)
+#error "Enable ESP32_SERIAL2 in global.h: Serial is used for debugging here"
+#endif
+
+#define LUX_TO_PERCENTAGE(val)                (MOB_RANGE_MAPPER(0.0105, -0.0843)::map(val))
+#define REFLECTED_LIGHT_TO_PERCENTAGE(val)    (MOB_RANGE_MAPPER(0.0017, -8)::map(val))
+
+/**
+ * @brief Data produced by the acquisition loop.
+ */
+struct ColorSample {
+    uint8_t  color;
+    uint8_t  reflectedLight;
+    uint8_t  ambientLight;
+    uint16_t rgb[3];
+};
+
+// Only accessed by the protocol task (see syncSensorData())
+uint8_t       sensorColor;
+uint8_t       reflectedLight;
+uint8_t       ambientLight;
+uint16_t      sensorRGB[3];
+
+Snapshot<ColorSample> colorSnapshot;
+bool                  connection_status;
+
+// Default settings: TCS34725_GAIN_4X,  TCS34725_INTEGRATIONTIME_154MS
+TCS34725            rgb_sensor;
+ColorDistanceSensor myDevice;
+
+
+/**
+ * @brief Called by the protocol task before handling the queries of the hub:
+ *      copy the latest sample (if any) to the variables of the sensor.
+ */
+void syncSensorData() {
+    ColorSample sample;
+    if (!colorSnapshot.read(sample))
+        return;
+    sensorColor    = sample.color;
+    reflectedLight = sample.reflectedLight;
+    ambientLight   = sample.ambientLight;
+    sensorRGB[0]   = sample.rgb[0];
+    sensorRGB[1]   = sample.rgb[1];
+    sensorRGB[2]   = sample.rgb[2];
+}
+
+
+#ifdef NACK_LATENCY_STATS
+/**
+ * @brief Print the histogram of NACK response latencies and reset it.
+ */
+void printNackLatencyStats() {
+    NackLatencyStats stats = myDevice.getNackLatencyStats();
+    myDevice.resetNackLatencyStats();
+
+    Serial.print(F("NACK latencies: ")); Serial.print(stats.count);
+    Serial.print(F(", max (us): ")); Serial.println(stats.maxUs);
+    for (uint8_t i = 0; i < NACK_LATENCY_BUCKETS; i++) {
+        if (!stats.buckets[i])
+            continue;
+        Serial.print(F("  < ")); Serial.print(1UL << (i + 6));
+        Serial.print(F(" us: ")); Serial.println(stats.buckets[i]);
+    }
+}
+#endif
+
+
+void setup() {
+    Serial.begin(115200);
+
+    // Device config
+    sensorColor = COLOR_NONE;
+    myDevice.setSensorColor(&sensorColor);
+    myDevice.setSensorReflectedLight(&reflectedLight);
+    myDevice.setSensorAmbientLight(&ambientLight);
+    myDevice.setSensorRGB(sensorRGB);
+    connection_status = false;
+
+    while (!rgb_sensor.begin()) {
+        INFO_PRINTLN(F("TCS34725 NOT found"));
+        delay(200);
+    }
+    INFO_PRINTLN(F("Found sensor"));
+
+    // From now, myDevice.process() is called by the protocol task only
+    if (!myDevice.startProtocolTask(syncSensorData)) {
+        INFO_PRINTLN(F("Protocol task NOT started"));
+    }
+}
+
+
+void loop()
+{
+    // Acquisition: blocking I2C reads are allowed here
+    ColorSample sample = {};
+    sample.color = COLOR_NONE;
+
+    if (rgb_sensor.updateData(true)) {
+        rgb_sensor.updateLux();
+        int16_t lux = lround(rgb_sensor.lux);
+
+        if ((lux >= 40) && (static_cast<uint16_t>(lux) <= rgb_sensor.maxlux)) {
+            sample.ambientLight   = LUX_TO_PERCENTAGE(lux);
+            sample.reflectedLight = REFLECTED_LIGHT_TO_PERCENTAGE(rgb_sensor.c_comp);
+            sample.rgb[0]         = rgb_sensor.r_comp >> 6;
+            sample.rgb[1]         = rgb_sensor.g_comp >> 6;
+            sample.rgb[2]         = rgb_sensor.b_comp >> 6;
+            sample.color          = detectColor(sample.rgb[0], sample.rgb[1], sample.rgb[2]);
+        }
+        // Only publish fresh samples
+        colorSnapshot.write(sample);
+    }
+
+    if (myDevice.isConnected() != connection_status) {
+        connection_status = !connection_status;
+        INFO_PRINTLN((connection_status) ? F("Connected !") : F("Not Connected !"));
+    }
+
+#ifdef NACK_LATENCY_STATS
+    static unsigned long lastStatsTick = 0;
+    if (millis() - lastStatsTick > 10000) {
+        printNackLatencyStats();
+        lastStatsTick = millis();
+    }
+#endif
+}
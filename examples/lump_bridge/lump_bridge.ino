@@ -0,0 +1,156 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ *   LEGO Color & Distance sensor + VL6180X on 1 port of the hub.
+ *   The real sensor is proxied by LumpBridge; the distance in mm is added
+ *   as a new mode (mode 11 for this sensor: "DIST MM").
+ *
+ *   Sensor     ESP32
+ *   VL6180X    SCL GPIO22, SDA GPIO21, VIN 3.3V
+ *   LEGO RX    GPIO26 (Serial1 TX)
+ *   LEGO TX    GPIO25 (Serial1 RX)
+ *   LEGO VCC   3.3V, GND GND (+ M1/M2 of the hub for the LEDs)
+ *
+ *   ESP32:
+ *   Serial: UART via USB (debugging)
+ *   Serial1: LEGO device (see above)
+ *   Serial2: GPIO17 (TX), GPIO16 (RX) (hub)
+ *
+ *   Dual core split:
+ *   - Core 1: Arduino loop: LumpBridge::process() only, never blocked.
+ *   - Core 0: acquisition task: blocking I2C reads of the VL6180X;
+ *     the distance is published in a lock-free Snapshot.
+ *
+ *   The latencies added by the bridge are printed every 10 seconds.
+ *
+ *   Pybricks example:
+ *      sensor = PUPDevice(Port.A)
+ *      print(sensor.read(11))  # (distance in mm, range status)
+ */
+#include <Wire.h>
+#include "MyOwnBricks.h"
+#include <VL6180X.h>
+
+#define DEVICE_RX_PIN    25
+#define DEVICE_TX_PIN    26
+
+/**
+ * @brief Data produced by the acquisition task.
+ */
+struct DistanceSample {
+    uint16_t distance;
+    uint16_t status;
+};
+
+Snapshot<DistanceSample> distanceSnapshot;
+DistanceSample           distanceSample;
+
+VL6180X    dist_sensor;
+LumpBridge bridge(Serial1, Serial2);
+bool       connection_status;
+
+// Added mode: distance in mm & range status (2 int16)
+const LumpModeInfo distanceMode = {
+    "DIST MM", { 0, 255 }, { 0, 100 }, { 0, 255 }, "MM",
+    0x10, 0x00, 2, LUMP_DATA_TYPE_DATA16, 4, 0
+};
+
+
+/**
+ * @brief Read callback of the added mode; called by the bridge on the
+ *      NACKs of the hub when the mode is selected.
+ */
+uint8_t readDistance(uint8_t *payload) {
+    distanceSnapshot.read(distanceSample);
+    payload[0] = distanceSample.distance & 0xFF;
+    payload[1] = distanceSample.distance >> 8;
+    payload[2] = distanceSample.status & 0xFF;
+    payload[3] = distanceSample.status >> 8;
+    return 4;
+}
+
+
+/**
+ * @brief Acquisition task: continuous ranging of the VL6180X.
+ */
+void acquisitionTask(void *) {
+    Wire.begin();
+    dist_sensor.init();
+    dist_sensor.configureDefault();
+    dist_sensor.setTimeout(100);
+    dist_sensor.startRangeContinuous(50);
+
+    DistanceSample sample;
+    while (true) {
+        // Blocks until the next measurement
+        sample.distance = dist_sensor.readRangeContinuousMillimeters();
+        sample.status   = dist_sensor.readReg(VL6180X::RESULT__RANGE_STATUS) >> 4;
+        distanceSnapshot.write(sample);
+    }
+}
+
+
+/**
+ * @brief Print the histograms of the added latencies and reset them.
+ */
+void printLatencyStats() {
+    const char *names[] = { "To hub", "To device" };
+
+    for (uint8_t direction = 0; direction < 2; direction++) {
+        BridgeLatencyStats stats = bridge.getLatencyStats(direction);
+        Serial.print(names[direction]); Serial.print(F(" frames: ")); Serial.print(stats.count);
+        Serial.print(F(", max (us): ")); Serial.println(stats.maxUs);
+        for (uint8_t i = 0; i < LUMP_BRIDGE_LATENCY_BUCKETS; i++) {
+            if (!stats.buckets[i])
+                continue;
+            Serial.print(F("  < ")); Serial.print(1UL << (i + 5));
+            Serial.print(F(" us: ")); Serial.println(stats.buckets[i]);
+        }
+    }
+    bridge.resetLatencyStats();
+}
+
+
+void setup() {
+    Serial.begin(115200);
+    // Pins of the device; the bridge changes the speed only
+    Serial1.begin(2400, SERIAL_8N1, DEVICE_RX_PIN, DEVICE_TX_PIN);
+
+    bridge.addMode(&distanceMode, readDistance, nullptr);
+    connection_status = false;
+
+    xTaskCreatePinnedToCore(acquisitionTask, "acquisition", 4096, nullptr, 1, nullptr, 0);
+}
+
+
+void loop()
+{
+    bridge.process();
+
+    if (bridge.isConnected() != connection_status) {
+        connection_status = !connection_status;
+        INFO_PRINTLN((connection_status) ? F("Connected !") : F("Not Connected !"));
+    }
+
+    static unsigned long lastStatsTick = 0;
+    if (millis() - lastStatsTick > 10000) {
+        printLatencyStats();
+        lastStatsTick = millis();
+    }
+}
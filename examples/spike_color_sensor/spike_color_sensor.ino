@@ -28,9 +28,9 @@
 #include "MyOwnBricks.h"
 #define DEBUG
 // Normalize values from sensor to 0...100 interval
-// See getPercentage() function notes
-#define LUX_TO_PERCENTAGE(val)                (getPercentage(val, <a_coef>, <b_coef>))
-#define REFLECTED_LIGHT_TO_PERCENTAGE(val)    (getPercentage(val, <a_coef>, <b_coef>))
+// See utilities/range_mapper.hpp notes
+#define LUX_TO_PERCENTAGE(val)                (MOB_RANGE_MAPPER(<a_coef>, <b_coef>)::map(val))
+#define REFLECTED_LIGHT_TO_PERCENTAGE(val)    (MOB_RANGE_MAPPER(<a_coef>, <b_coef>)::map(val))
 
 uint8_t       sensorColor;
 uint8_t       reflectedLight;
@@ -61,24 +61,6 @@ void LEDBrightnessesChanged(const uint8_t *LEDBrightnesses) {
 }
 
 
-/**
- * @brief Map lux/reflected light values to percentages
- *    Weights of the equation must be calculated empirically
- *    Map equation: y = ax + b
- *    System to solve:
- *      100% = MaxRawValue * a + b
- *      0% = MinRawValue * a + b
- */
-uint8_t getPercentage(const uint16_t rawValue, const float& a_coef, const float& b_coef) {
-    int8_t percent = static_cast<int8_t>(rawValue * a_coef + b_coef);
-    if (percent > 100)
-        return 100;
-    if (percent < 0)
-        return 0;
-    return static_cast<uint8_t>(percent);
-}
-
-
 void setup() {
     pinMode(LED_BUILTIN, OUTPUT);
 
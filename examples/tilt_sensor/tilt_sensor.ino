@@ -15,13 +15,43 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
-#include <TiltSensor.h>
+/*
+ *   Sensor   Pro Micro
+ *   SCL      SCL pin 3
+ *   SDA      SDA pin 2
+ *   VCC      VCC
+ *   GND      GND
+ *
+ *   MPU6050 (GY-521 board) or any MPU6050-class accelerometer;
+ *   see Accelerometer in utilities/tilt_estimator.hpp for other chips.
+ */
+#include "MyOwnBricks.h"
 
-int8_t sensorX;
-int8_t sensorY;
-bool   connection_status;
+// Sample rate of the accelerometer (Hz)
+#define IMU_SAMPLE_RATE    500
 
-TiltSensor myOwnTilt(& sensorX, & sensorY);
+int8_t  sensorX;
+int8_t  sensorY;
+uint8_t sensorDirection;
+int8_t  sensorCalibration[3];
+bool    connection_status;
+
+TiltSensor    myOwnTilt(& sensorX, & sensorY);
+MPU6050Accel  imu;
+// Low-pass filter of the gravity vector; strength 4: ~32ms at 500Hz
+TiltEstimator tilt(4);
+// Direction: entered above 20°, left below 10°
+TiltDirection direction(20, 10);
+// Impacts above 0.5g (±2g full scale), baseline of 32ms, rebounds ignored during 100ms
+ImpactDetector<16> impacts(8192, 50);
+
+
+/**
+ * @brief Callback for the raw samples of the accelerometer
+ */
+void onAccelSample(const AccelSample& sample) {
+    impacts.update(sample);
+}
 
 
 void setup() {
@@ -35,18 +65,32 @@ void setup() {
     // Init roll & pitch values if not made via the constructor
     //myOwnTilt.setSensorTiltX(&sensorX);
     //myOwnTilt.setSensorTiltY(&sensorY);
+    myOwnTilt.setSensorDirection(&sensorDirection);
+    myOwnTilt.setSensorCrashCount(impacts.getCounts());
+    myOwnTilt.setSensorCalibration(sensorCalibration);
+    tilt.setSampleCallback(&onAccelSample);
+    sensorDirection   = TILT_DIRECTION_NEUTRAL;
     connection_status = false;
+
+    // The samples are read through the FIFO of the chip (see AsyncI2C.h)
+    I2CEngine.begin();
+    imu.begin(IMU_SAMPLE_RATE);
 }
 
 
 void loop() {
-    // Get data from orientation sensor
-    int arbitraryValue = 512;
-
-    sensorX = map(arbitraryValue, 0, 1023, -45, 45);
-    sensorY = map(arbitraryValue, 0, 1023, -45, 45);
+    // Get data from orientation sensor; never blocks
+    I2CEngine.poll();
+    imu.poll();
+    if (tilt.poll(imu)) {
+        // Roll & pitch clamped to -45..45 degrees
+        sensorX         = tilt.getRoll();
+        sensorY         = tilt.getPitch();
+        sensorDirection = direction.update(sensorX, sensorY);
+        tilt.getCalibration(sensorCalibration);
+    }
 
-    myOwnTilt.Process();
+    myOwnTilt.process();
 
     if (myOwnTilt.isConnected()) {
         // Already connected ?
@@ -0,0 +1,334 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host benchmark of the color classifiers of color_detection_methods.hpp
+ *      on TCS34725 captures.
+ *
+ *    Captures are the "Spreadsheet debugging" lines printed by the examples
+ *    when DEBUG or INFO is enabled, followed by a ground truth column:
+ *
+ *      lux;maxlux;r;g;b;c;label
+ *      lux;maxlux;r;g;b;c;integration_time;label
+ *
+ *    The integration time (ms) of the auto-ranging examples is ignored.
+ *    The label is a color name (RED, BLUE, NONE, etc.) or its numeric code.
+ *    Other lines (logs) are ignored.
+ *    Like in the examples, readings outside [40; maxlux] lux are not classified
+ *    and count as COLOR_NONE ("discarded").
+ *
+ *    For each metric (BASIC_RGB, MANHATTAN, CANBERRA) the report gives the
+ *    confusion matrix, accuracy, COLOR_NONE rate, time per classification
+ *    and the number of channel distances computed per call.
+ *
+ *    Build & usage:
+ *      make color_benchmark
+ *      ./extras/benchmarks/color_benchmark capture1.csv [capture2.csv ...]
+ */
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ColorDistanceSensor.h"
+
+// Each metric is compiled in its own namespace, as in the sketches:
+// these copies are the timed ones
+namespace basic_rgb {
+#define BASIC_RGB
+#include "utilities/color_detection_methods.hpp"
+#undef BASIC_RGB
+}
+
+namespace manhattan {
+#define MANHATTAN
+#include "utilities/color_detection_methods.hpp"
+#undef MANHATTAN
+}
+
+namespace canberra {
+#define CANBERRA
+#include "utilities/color_detection_methods.hpp"
+#undef CANBERRA
+}
+
+// Same metrics with the cost counters, only used for the accuracy pass;
+// the counters would inflate the timings
+#undef COLOR_STATS_CHANNEL
+#define COLOR_DETECTION_STATS
+
+namespace manhattan_counted {
+#define MANHATTAN
+#include "utilities/color_detection_methods.hpp"
+#undef MANHATTAN
+}
+
+namespace canberra_counted {
+#define CANBERRA
+#include "utilities/color_detection_methods.hpp"
+#undef CANBERRA
+}
+
+#undef COLOR_DETECTION_STATS
+
+
+/**
+ * @brief Labels of the colors; index = color code. NONE (0xFF) is the last one.
+ */
+static const char *COLOR_NAMES[] = {
+    "BLACK", "PINK", "PURPLE", "BLUE", "LIGHTBLUE", "CYAN",
+    "GREEN", "YELLOW", "ORANGE", "RED", "WHITE", "NONE"
+};
+static const uint8_t COLORS_NB = sizeof(COLOR_NAMES) / sizeof(COLOR_NAMES[0]);
+
+/**
+ * @brief Row index of a color code in the confusion matrix.
+ */
+static uint8_t colorIndex(uint8_t color) {
+    return (color == COLOR_NONE || color >= COLORS_NB - 1) ? COLORS_NB - 1 : color;
+}
+
+/**
+ * @brief One reading of a capture.
+ */
+struct Reading {
+    float    lux;
+    uint16_t maxlux;
+    uint16_t red, green, blue, clear;
+    uint8_t  label;
+};
+
+/**
+ * @brief Cost counters of a classifier; copy of its ColorDetectionStats.
+ */
+struct BenchStats {
+    uint32_t calls;
+    uint32_t channels;
+    uint32_t fullEvaluations;
+    uint16_t worstChannels;
+};
+
+typedef uint8_t (*DetectFunction)(const uint16_t&, const uint16_t&, const uint16_t&);
+
+/**
+ * @brief A metric: timed function, same function with counters & its stats.
+ */
+struct Classifier {
+    const char     *name;
+    DetectFunction detect;
+    DetectFunction detectCounted;
+    BenchStats (*takeStats)(); // Get and reset the counters
+};
+
+// Counters are specific to each namespace
+#define TAKE_STATS(ns)                                                         \
+    static BenchStats ns ## _stats() {                                         \
+        BenchStats stats = {                                                   \
+            ns::colorDetectionStats.calls, ns::colorDetectionStats.channels,   \
+            ns::colorDetectionStats.fullEvaluations,                           \
+            ns::colorDetectionStats.worstChannels                              \
+        };                                                                     \
+        ns::colorDetectionStats = ns::ColorDetectionStats();                   \
+        return stats;                                                          \
+    }
+TAKE_STATS(manhattan_counted)
+TAKE_STATS(canberra_counted)
+
+// BASIC_RGB has no counter
+static BenchStats basic_rgb_stats() {
+    return BenchStats();
+}
+
+
+/**
+ * @brief Parse a label: color name or numeric code.
+ * @return false if the label is unknown.
+ */
+static bool parseLabel(const std::string& text, uint8_t& label) {
+    for (uint8_t i = 0; i < COLORS_NB; i++) {
+        if (text == COLOR_NAMES[i]) {
+            label = (i == COLORS_NB - 1) ? COLOR_NONE : i;
+            return true;
+        }
+    }
+    char *end;
+    long  value = strtol(text.c_str(), &end, 0);
+    if (end == text.c_str() || *end != '\0')
+        return false;
+    label = _(uint8_t)(value);
+    return true;
+}
+
+
+/**
+ * @brief Load readings from a capture; malformed lines are skipped.
+ */
+static size_t loadCapture(const char *path, std::vector<Reading>& readings) {
+    std::ifstream file(path);
+    std::string   line;
+    size_t        loaded = 0;
+
+    while (std::getline(file, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        std::vector<std::string> fields;
+        std::stringstream        stream(line);
+        std::string              field;
+        while (std::getline(stream, field, ';'))
+            fields.push_back(field);
+        if (fields.size() != 7 && fields.size() != 8)
+            continue;
+
+        Reading reading;
+        char   *end;
+        reading.lux = strtof(fields[0].c_str(), &end);
+        if (end == fields[0].c_str())
+            continue;
+        reading.maxlux = _(uint16_t)(atoi(fields[1].c_str()));
+        reading.red    = _(uint16_t)(atoi(fields[2].c_str()));
+        reading.green  = _(uint16_t)(atoi(fields[3].c_str()));
+        reading.blue   = _(uint16_t)(atoi(fields[4].c_str()));
+        reading.clear  = _(uint16_t)(atoi(fields[5].c_str()));
+        if (!parseLabel(fields.back(), reading.label))
+            continue;
+
+        readings.push_back(reading);
+        loaded++;
+    }
+    return loaded;
+}
+
+
+/**
+ * @brief Same validity check as in the examples before any classification.
+ */
+static bool isUsable(const Reading& reading) {
+    long lux = lround(reading.lux);
+    return (lux >= 40) && (lux <= reading.maxlux);
+}
+
+
+static void runClassifier(const Classifier& classifier, const std::vector<Reading>& readings) {
+    unsigned long confusion[COLORS_NB][COLORS_NB] = {};
+    unsigned long correct   = 0;
+    unsigned long none      = 0;
+    unsigned long discarded = 0;
+    std::vector<const Reading*> usable;
+
+    // Accuracy pass
+    classifier.takeStats();
+    for (size_t i = 0; i < readings.size(); i++) {
+        const Reading& reading = readings[i];
+        uint8_t        found   = COLOR_NONE;
+        if (isUsable(reading)) {
+            found = classifier.detectCounted(reading.red, reading.green, reading.blue);
+            usable.push_back(&reading);
+        } else {
+            discarded++;
+        }
+        confusion[colorIndex(reading.label)][colorIndex(found)]++;
+        if (colorIndex(found) == colorIndex(reading.label))
+            correct++;
+        if (found == COLOR_NONE)
+            none++;
+    }
+    const BenchStats stats = classifier.takeStats();
+
+    // Timing pass: repeat the usable readings during at least 200ms
+    double        elapsedNs = 0;
+    unsigned long calls     = 0;
+    volatile uint8_t sink   = 0;
+    while (!usable.empty() && elapsedNs < 2e8) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < usable.size(); i++)
+            sink = sink + classifier.detect(usable[i]->red, usable[i]->green, usable[i]->blue);
+        auto stop = std::chrono::steady_clock::now();
+        elapsedNs += std::chrono::duration<double, std::nano>(stop - start).count();
+        calls     += usable.size();
+    }
+
+    printf("== %s ==\n", classifier.name);
+    printf("Readings: %zu, accuracy: %.2f%%, COLOR_NONE rate: %.2f%% (discarded: %lu)\n",
+           readings.size(), 100.0 * correct / readings.size(),
+           100.0 * none / readings.size(), discarded);
+    if (calls)
+        printf("Time per classification: %.1f ns\n", elapsedNs / calls);
+    if (stats.calls)
+        printf("Channel distances per call: avg %.2f, worst %u; full evaluations per call: %.2f\n",
+               _(double)(stats.channels) / stats.calls, stats.worstChannels,
+               _(double)(stats.fullEvaluations) / stats.calls);
+
+    // Confusion matrix: rows = truth, columns = prediction; empty rows/columns are hidden
+    bool usedRows[COLORS_NB]    = {};
+    bool usedColumns[COLORS_NB] = {};
+    for (uint8_t i = 0; i < COLORS_NB; i++) {
+        for (uint8_t j = 0; j < COLORS_NB; j++) {
+            if (confusion[i][j]) {
+                usedRows[i]    = true;
+                usedColumns[j] = true;
+            }
+        }
+    }
+    printf("%-10s", "truth\\pred");
+    for (uint8_t j = 0; j < COLORS_NB; j++) {
+        if (usedColumns[j])
+            printf("%10s", COLOR_NAMES[j]);
+    }
+    printf("\n");
+    for (uint8_t i = 0; i < COLORS_NB; i++) {
+        if (!usedRows[i])
+            continue;
+        printf("%-10s", COLOR_NAMES[i]);
+        for (uint8_t j = 0; j < COLORS_NB; j++) {
+            if (usedColumns[j])
+                printf("%10lu", confusion[i][j]);
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s capture.csv [capture.csv ...]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Reading> readings;
+    for (int i = 1; i < argc; i++) {
+        size_t loaded = loadCapture(argv[i], readings);
+        printf("%s: %zu readings\n", argv[i], loaded);
+    }
+    if (readings.empty()) {
+        fprintf(stderr, "No labelled reading found\n");
+        return 1;
+    }
+    printf("\n");
+
+    const Classifier classifiers[] = {
+        { "BASIC_RGB", basic_rgb::detectColor, basic_rgb::detectColor,         basic_rgb_stats         },
+        { "MANHATTAN", manhattan::detectColor, manhattan_counted::detectColor, manhattan_counted_stats },
+        { "CANBERRA",  canberra::detectColor,  canberra_counted::detectColor,  canberra_counted_stats  },
+    };
+    for (size_t i = 0; i < sizeof(classifiers) / sizeof(classifiers[0]); i++)
+        runClassifier(classifiers[i], readings);
+    return 0;
+}
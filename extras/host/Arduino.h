@@ -0,0 +1,65 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Minimal replacement of the Arduino core for host (Linux) builds.
+ *      Only what is needed to compile the library headers with the host
+ *      tools and benchmarks of the extras folder.
+ */
+#ifndef MOB_HOST_ARDUINO_H
+#define MOB_HOST_ARDUINO_H
+
+// Host build: enables the host backends of the library (UartEventSerial, etc.)
+#define MOB_HOST
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define HEX       16
+#define DEC       10
+#define F(str)    (str)
+#define PROGMEM
+
+#define LOW       0
+#define HIGH      1
+#define INPUT     0
+#define OUTPUT    1
+
+// Time functions; implemented by the host program
+// (or by the simulation, see simulation.h)
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+// Pins & serial port; implemented by the simulation
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+#include "HostSerial.h"
+extern HostSerial Serial;
+
+// Arduino's abs() is a macro; the std one is enough for host builds
+using std::abs;
+
+#endif // MOB_HOST_ARDUINO_H
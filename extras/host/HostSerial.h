@@ -0,0 +1,85 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_HOST_SERIAL_H
+#define MOB_HOST_SERIAL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+
+/**
+ * @brief Serial port of host builds (Serial, i.e. SerialTTL); implemented by
+ *      the simulation (see simulation.h).
+ *
+ *    Same API as the subset of HardwareSerial used by the library.
+ *    The time is the one of the simulation: readBytes() waits for the
+ *    missing bytes by advancing the clock, flush() waits for the end of the
+ *    transmission at the current baudrate (10 bits per byte).
+ *    The other side (a model of the hub) injects bytes with injectRx() and
+ *    takes the transmitted ones with takeTx().
+ *
+ * @param m_rx Bytes received, not read yet.
+ * @param m_tx Bytes transmitted, not taken by the other side yet.
+ * @param m_baud Current baudrate; 0: port closed (bytes are lost).
+ * @param m_timeout Timeout of readBytes() in ms (default: 1000, like Stream).
+ * @param m_txEnd End of the current transmission (µs).
+ */
+class HostSerial {
+
+public:
+    HostSerial();
+
+    void begin(unsigned long baud);
+    void end();
+    int available();
+    int read();
+    size_t readBytes(uint8_t *buffer, size_t length);
+    size_t readBytes(char *buffer, size_t length) {
+        return readBytes(reinterpret_cast<uint8_t *>(buffer), length);
+    }
+    size_t write(uint8_t byte) {
+        return write(&byte, 1);
+    }
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *buffer, size_t size) {
+        return write(reinterpret_cast<const uint8_t *>(buffer), size);
+    }
+    void flush();
+    void setTimeout(unsigned long timeout) {
+        m_timeout = timeout;
+    }
+
+    // Other side of the line
+    void reset();
+    void injectRx(const uint8_t *buffer, size_t size);
+    std::vector<uint8_t> takeTx();
+    unsigned long getBaud() {
+        return m_baud;
+    }
+
+private:
+    std::deque<uint8_t>  m_rx;
+    std::vector<uint8_t> m_tx;
+    unsigned long        m_baud;
+    unsigned long        m_timeout;
+    unsigned long        m_txEnd;
+};
+
+#endif // MOB_HOST_SERIAL_H
@@ -0,0 +1,206 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "simulation.h"
+
+Simulation Sim;
+HostSerial Serial;
+
+
+Simulation::Simulation() {
+    reset();
+}
+
+
+/**
+ * @brief Restart the clock at 0, without tick callback; the pins are LOW
+ *      and the serial port is closed.
+ */
+void Simulation::reset() {
+    m_now  = 0;
+    m_tick = nullptr;
+    memset(m_pins, LOW, sizeof(m_pins));
+    Serial.reset();
+}
+
+
+/**
+ * @brief Advance the clock by steps of MOB_SIM_STEP_US; the tick callback
+ *      is called after each step.
+ * @param duration Time to elapse (µs).
+ */
+void Simulation::advance(unsigned long duration) {
+    const unsigned long end = m_now + duration;
+    while (m_now < end) {
+        const unsigned long step = end - m_now;
+        m_now += (step < MOB_SIM_STEP_US) ? step : MOB_SIM_STEP_US;
+        if (m_tick)
+            m_tick();
+    }
+}
+
+
+/**
+ * @brief Drive a pin from the other side (the RX line of the library, etc.).
+ */
+void Simulation::setPin(uint8_t pin, uint8_t level) {
+    if (pin < MOB_SIM_PINS)
+        m_pins[pin] = level;
+}
+
+
+/**
+ * @brief Get the level of a pin (written by digitalWrite() or setPin()).
+ */
+uint8_t Simulation::getPin(uint8_t pin) {
+    return (pin < MOB_SIM_PINS) ? m_pins[pin] : LOW;
+}
+
+
+// Arduino core functions used by the library
+
+unsigned long millis() {
+    return Sim.now() / 1000;
+}
+
+unsigned long micros() {
+    return Sim.now();
+}
+
+void delay(unsigned long ms) {
+    Sim.advance(ms * 1000);
+}
+
+void yield() {
+    Sim.advance(MOB_SIM_STEP_US);
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    Sim.setPin(pin, value);
+}
+
+int digitalRead(uint8_t pin) {
+    return Sim.getPin(pin);
+}
+
+
+// Serial port
+
+HostSerial::HostSerial() :
+    m_baud(0),
+    m_timeout(1000),
+    m_txEnd(0)
+{}
+
+
+void HostSerial::begin(unsigned long baud) {
+    m_baud = baud;
+}
+
+
+void HostSerial::end() {
+    m_baud = 0;
+    m_rx.clear();
+}
+
+
+int HostSerial::available() {
+    return static_cast<int>(m_rx.size());
+}
+
+
+int HostSerial::read() {
+    if (m_rx.empty())
+        return -1;
+    const uint8_t byte = m_rx.front();
+    m_rx.pop_front();
+    return byte;
+}
+
+
+/**
+ * @brief Read the given number of bytes; the clock advances until they
+ *      are received or until the timeout.
+ */
+size_t HostSerial::readBytes(uint8_t *buffer, size_t length) {
+    const unsigned long start = millis();
+    while (m_rx.size() < length && millis() - start < m_timeout)
+        Sim.advance(MOB_SIM_STEP_US);
+
+    size_t count = 0;
+    for (; count < length && !m_rx.empty(); count++) {
+        buffer[count] = m_rx.front();
+        m_rx.pop_front();
+    }
+    return count;
+}
+
+
+/**
+ * @brief Transmit bytes; they are available immediately for the other side,
+ *      the transmission time is waited by flush().
+ */
+size_t HostSerial::write(const uint8_t *buffer, size_t size) {
+    if (!m_baud)
+        return 0;
+    m_tx.insert(m_tx.end(), buffer, buffer + size);
+
+    const unsigned long start = (m_txEnd > Sim.now()) ? m_txEnd : Sim.now();
+    m_txEnd = start + static_cast<unsigned long>(size * 10 * 1000000ULL / m_baud);
+    return size;
+}
+
+
+/**
+ * @brief Wait for the end of the transmission.
+ */
+void HostSerial::flush() {
+    if (m_txEnd > Sim.now())
+        Sim.advance(m_txEnd - Sim.now());
+}
+
+
+/**
+ * @brief Emulate the reception of bytes; lost if the port is closed.
+ */
+void HostSerial::injectRx(const uint8_t *buffer, size_t size) {
+    if (m_baud)
+        m_rx.insert(m_rx.end(), buffer, buffer + size);
+}
+
+
+/**
+ * @brief Close the port and drop the bytes of both directions; used by
+ *      Simulation::reset().
+ */
+void HostSerial::reset() {
+    end();
+    m_tx.clear();
+    m_txEnd = 0;
+}
+
+
+/**
+ * @brief Get and clear the bytes transmitted.
+ */
+std::vector<uint8_t> HostSerial::takeTx() {
+    std::vector<uint8_t> tx;
+    tx.swap(m_tx);
+    return tx;
+}
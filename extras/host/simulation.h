@@ -0,0 +1,75 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_HOST_SIMULATION_H
+#define MOB_HOST_SIMULATION_H
+
+#include "Arduino.h"
+
+// Resolution of the simulated clock (µs): the tick callback is called after
+// each step; yield() advances the clock by 1 step
+#ifndef MOB_SIM_STEP_US
+#define MOB_SIM_STEP_US    100
+#endif
+#define MOB_SIM_PINS       64
+
+
+/**
+ * @brief Deterministic simulation of the time, the pins & the serial port
+ *      of a microcontroller, for the host tests of the library (MOB_HOST).
+ *
+ *    Link simulation.cpp instead of defining millis(), micros(), delay()...
+ *    in the test program. There is no thread and no wall time: the clock
+ *    only advances when the library waits (delay(), yield() in the busy loops
+ *    of the handshake, readBytes() without enough data, flush()) or when the
+ *    test calls advance(). Seconds of protocol run in a few microseconds and
+ *    the results are reproducible.
+ *
+ *    After each step of MOB_SIM_STEP_US, the tick callback is called: it is
+ *    the model of the other side (the hub), which takes the bytes sent by the
+ *    library (Serial.takeTx()), injects its own (Serial.injectRx()) and
+ *    drives the pins (setPin()). It must not call the library.
+ *
+ * @param m_now Time since the start of the simulation (µs).
+ * @param m_tick Tick callback; nullptr: none.
+ * @param m_pins Levels of the pins (driven by the library or by setPin()).
+ */
+class Simulation {
+
+public:
+    Simulation();
+
+    void reset();
+    void advance(unsigned long duration);
+    unsigned long now() {
+        return m_now;
+    }
+    void setTickCallback(void (*tick)()) {
+        m_tick = tick;
+    }
+    void setPin(uint8_t pin, uint8_t level);
+    uint8_t getPin(uint8_t pin);
+
+private:
+    unsigned long m_now;
+    void          (*m_tick)();
+    uint8_t       m_pins[MOB_SIM_PINS];
+};
+
+extern Simulation Sim;
+
+#endif // MOB_HOST_SIMULATION_H
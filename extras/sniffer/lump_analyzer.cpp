@@ -0,0 +1,452 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "lump_analyzer.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+/**
+ * @brief Size of a message (header and checksum included).
+ * @return 0 if the header has an invalid size (64 or 128 bytes).
+ */
+uint8_t LumpFrameParser::messageSize(uint8_t header) {
+    if ((header & LUMP_MSG_TYPE_MASK) == LUMP_MSG_TYPE_SYS)
+        return 1;
+    if ((header & LUMP_MSG_SIZE_MASK) > LUMP_MSG_SIZE_32)
+        return 0;
+    uint8_t size = LUMP_MSG_SIZE(header) + 2;
+    if ((header & LUMP_MSG_TYPE_MASK) == LUMP_MSG_TYPE_INFO)
+        size++;
+    return size;
+}
+
+
+LumpFrameParser::LumpFrameParser() :
+    m_handler(nullptr),
+    m_context(nullptr) {
+    reset();
+}
+
+
+void LumpFrameParser::setHandler(FrameHandler handler, void *context) {
+    m_handler = handler;
+    m_context = context;
+}
+
+
+void LumpFrameParser::reset() {
+    bytes          = 0;
+    frames         = 0;
+    checksumErrors = 0;
+    m_length       = 0;
+    m_expected     = 0;
+}
+
+
+void LumpFrameParser::feed(const uint8_t *data, size_t length, uint64_t timestamp) {
+    bytes += length;
+    for (size_t i = 0; i < length; i++)
+        push(data[i], timestamp);
+}
+
+
+void LumpFrameParser::push(uint8_t byte, uint64_t timestamp) {
+    if (m_length == 0) {
+        // New header
+        m_expected = messageSize(byte);
+        if (m_expected == 0) {
+            checksumErrors++;
+            return;
+        }
+        if (m_expected == 1) {
+            if (byte != LUMP_SYS_SYNC && byte != LUMP_SYS_NACK && byte != LUMP_SYS_ACK)
+                return;
+            m_frame.bytes[0]  = byte;
+            m_frame.size      = 1;
+            m_frame.timestamp = timestamp;
+            frames++;
+            if (m_handler)
+                m_handler(m_frame, m_context);
+            return;
+        }
+    }
+    m_frame.bytes[m_length++] = byte;
+    if (m_length < m_expected)
+        return;
+
+    uint8_t checksum = 0xFF;
+    for (uint8_t i = 0; i < m_length - 1; i++)
+        checksum ^= m_frame.bytes[i];
+
+    if (checksum != m_frame.bytes[m_length - 1]) {
+        // Lost byte or noise: resynchronize on the byte following the header
+        checksumErrors++;
+        uint8_t pending[LUMP_MAX_MSG_SIZE];
+        uint8_t count = m_length - 1;
+        memcpy(pending, m_frame.bytes + 1, count);
+        m_length = 0;
+        for (uint8_t i = 0; i < count; i++)
+            push(pending[i], timestamp);
+        return;
+    }
+    m_frame.size      = m_length;
+    m_frame.timestamp = timestamp;
+    m_length          = 0;
+    frames++;
+    if (m_handler)
+        m_handler(m_frame, m_context);
+}
+
+
+LatencyStats::LatencyStats() :
+    m_count(0),
+    m_sum(0),
+    m_max(0)
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+
+/**
+ * @brief Bucket of a value: 1 bucket per value below 2^LATENCY_SUB_BITS,
+ *      then 2^(LATENCY_SUB_BITS - 1) buckets per power of 2.
+ */
+uint16_t LatencyStats::bucketIndex(uint32_t value) {
+    if (value < (1U << LATENCY_SUB_BITS))
+        return static_cast<uint16_t>(value);
+    uint8_t msb   = static_cast<uint8_t>(31 - __builtin_clz(value));
+    uint8_t shift = msb - (LATENCY_SUB_BITS - 1);
+    return static_cast<uint16_t>((1 << LATENCY_SUB_BITS) +
+                                 (msb - LATENCY_SUB_BITS) * (1 << (LATENCY_SUB_BITS - 1)) +
+                                 (value >> shift) - (1 << (LATENCY_SUB_BITS - 1)));
+}
+
+
+/**
+ * @brief Highest value recorded in the given bucket.
+ */
+uint32_t LatencyStats::bucketHighest(uint16_t index) {
+    if (index < (1 << LATENCY_SUB_BITS))
+        return index;
+    uint16_t offset = index - (1 << LATENCY_SUB_BITS);
+    uint8_t  shift  = static_cast<uint8_t>(offset / (1 << (LATENCY_SUB_BITS - 1)) + 1);
+    uint32_t sub    = offset % (1 << (LATENCY_SUB_BITS - 1)) + (1 << (LATENCY_SUB_BITS - 1));
+    return (sub << shift) + ((1U << shift) - 1);
+}
+
+
+void LatencyStats::add(uint32_t value) {
+    m_buckets[bucketIndex(value)]++;
+    m_count++;
+    m_sum += value;
+    if (value > m_max)
+        m_max = value;
+}
+
+
+/**
+ * @brief Percentile of the samples (nearest rank); the highest value of its
+ *      bucket, so a latency is never underestimated.
+ */
+uint32_t LatencyStats::percentile(uint8_t percent) const {
+    if (!m_count)
+        return 0;
+    size_t rank = (m_count * percent + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+    size_t seen = 0;
+    for (uint16_t index = 0; index < LATENCY_BUCKETS; index++) {
+        seen += m_buckets[index];
+        if (seen >= rank)
+            return std::min(bucketHighest(index), m_max);
+    }
+    return m_max;
+}
+
+
+double LatencyStats::mean() const {
+    return m_count ? static_cast<double>(m_sum) / m_count : 0;
+}
+
+
+void LatencyStats::print(FILE *out, const char *name) const {
+    fprintf(out, "%-12s n=%-7zu mean=%8.3f p50=%8.3f p90=%8.3f p99=%8.3f max=%8.3f (ms)\n",
+            name, count(), mean() / 1000, percentile(50) / 1000.0, percentile(90) / 1000.0,
+            percentile(99) / 1000.0, max() / 1000.0);
+}
+
+
+LumpAnalyzer::LumpAnalyzer() {
+    memset(&m_device, 0, sizeof(m_device));
+    m_device.typeId = -1;
+    m_device.speed  = LUMP_INIT_BAUDRATE;
+    memset(m_requestTime, 0xFF, sizeof(m_requestTime));
+    m_extMode[0]        = m_extMode[1] = 0;
+    m_extModePending[0] = m_extModePending[1] = false;
+    m_selectedMode      = 0;
+    m_lastNack          = LUMP_NO_TIME;
+    m_lastDeviceFrame   = 0;
+    m_firstTimestamp    = LUMP_NO_TIME;
+    m_lastTimestamp     = 0;
+    m_deviceAck         = false;
+    m_connected         = false;
+    m_disconnections    = 0;
+    m_extModePairs      = 0;
+    m_writes            = 0;
+    m_statusTime        = LUMP_NO_TIME;
+    m_statusBytes[0]    = m_statusBytes[1] = 0;
+    m_parsers[LUMP_FROM_DEVICE].setHandler(onDeviceFrame, this);
+    m_parsers[LUMP_FROM_HUB].setHandler(onHubFrame, this);
+}
+
+
+/**
+ * @brief Decode bytes received in one direction.
+ * @param timestamp Reception time (µs); must not go backwards.
+ */
+void LumpAnalyzer::feed(LumpDirection direction, const uint8_t *data, size_t length, uint64_t timestamp) {
+    if (length == 0)
+        return;
+    poll(timestamp);
+    if (m_firstTimestamp == LUMP_NO_TIME)
+        m_firstTimestamp = timestamp;
+    m_lastTimestamp = timestamp;
+    m_parsers[direction].feed(data, length, timestamp);
+}
+
+
+/**
+ * @brief Detect the disconnection of the device (silence longer than
+ *      LUMP_DISCONNECTION_DELAY); call it regularly when no byte is received.
+ */
+void LumpAnalyzer::poll(uint64_t now) {
+    if (m_connected && now - m_lastDeviceFrame > LUMP_DISCONNECTION_DELAY)
+        disconnect();
+}
+
+
+void LumpAnalyzer::disconnect() {
+    m_connected = false;
+    m_deviceAck = false;
+    m_disconnections++;
+    m_extMode[0] = m_extMode[1] = 0;
+    memset(m_requestTime, 0xFF, sizeof(m_requestTime));
+    m_lastNack = LUMP_NO_TIME;
+}
+
+
+void LumpAnalyzer::onDeviceFrame(const LumpFrame& frame, void *context) {
+    static_cast<LumpAnalyzer *>(context)->deviceFrame(frame);
+}
+
+
+void LumpAnalyzer::onHubFrame(const LumpFrame& frame, void *context) {
+    static_cast<LumpAnalyzer *>(context)->hubFrame(frame);
+}
+
+
+void LumpAnalyzer::deviceFrame(const LumpFrame& frame) {
+    m_lastDeviceFrame = frame.timestamp;
+    switch (frame.type()) {
+        case LUMP_MSG_TYPE_SYS:
+            if (frame.header() == LUMP_SYS_SYNC) {
+                // New init sequence: the device was reset
+                if (m_connected)
+                    disconnect();
+            } else if (frame.header() == LUMP_SYS_ACK) {
+                m_deviceAck = true;
+            }
+            break;
+        case LUMP_MSG_TYPE_CMD:
+        case LUMP_MSG_TYPE_INFO:
+            deviceInfo(frame);
+            break;
+        case LUMP_MSG_TYPE_DATA: {
+            uint8_t mode = frame.cmd() + m_extMode[LUMP_FROM_DEVICE];
+            if (m_extModePending[LUMP_FROM_DEVICE]) {
+                m_extModePairs++;
+                m_extModePending[LUMP_FROM_DEVICE] = false;
+            }
+            m_selectedMode = mode;
+            if (m_requestTime[mode] != LUMP_NO_TIME) {
+                m_latencies[mode].add(static_cast<uint32_t>(frame.timestamp - m_requestTime[mode]));
+                m_requestTime[mode] = LUMP_NO_TIME;
+            }
+            break;
+        }
+    }
+}
+
+
+/**
+ * @brief Init sequence & EXT_MODE messages of the device.
+ */
+void LumpAnalyzer::deviceInfo(const LumpFrame& frame) {
+    const uint8_t *payload = frame.payload();
+    uint8_t        mode    = frame.cmd();
+
+    if (frame.type() == LUMP_MSG_TYPE_CMD) {
+        switch (mode) {
+            case LUMP_CMD_TYPE:
+                m_device.typeId = payload[0];
+                break;
+            case LUMP_CMD_MODES:
+                m_device.modes = payload[0] + 1;
+                m_device.views = payload[1] + 1;
+                // Powered Up devices: modes2 & views2 (up to 16 modes)
+                if (frame.size == 6 && payload[2]) {
+                    m_device.modes = payload[2] + 1;
+                    m_device.views = payload[3] + 1;
+                }
+                break;
+            case LUMP_CMD_SPEED:
+                m_device.speed = payload[0] | (payload[1] << 8) |
+                                 (static_cast<uint32_t>(payload[2]) << 16) | (static_cast<uint32_t>(payload[3]) << 24);
+                break;
+            case LUMP_CMD_VERSION:
+                m_device.fwVersionKnown = true;
+                memcpy(&m_device.fwVersion, payload, 4);
+                memcpy(&m_device.hwVersion, payload + 4, 4);
+                break;
+            case LUMP_CMD_EXT_MODE:
+                m_extMode[LUMP_FROM_DEVICE]        = payload[0] & LUMP_EXT_MODE_8;
+                m_extModePending[LUMP_FROM_DEVICE] = true;
+                break;
+        }
+        return;
+    }
+
+    // LUMP_MSG_TYPE_INFO
+    uint8_t infoType = payload[0];
+    if (infoType & LUMP_INFO_MODE_PLUS_8)
+        mode += 8;
+    infoType &= ~LUMP_INFO_MODE_PLUS_8;
+    if (infoType == LUMP_INFO_NAME) {
+        // Name: up to 11 chars (newer devices: 5 chars, null, then flags)
+        size_t length = std::min<size_t>(frame.size - 3, LUMP_MODE_NAME_SIZE - 1);
+        memcpy(m_device.names[mode], payload + 1, length);
+        m_device.names[mode][length] = '\0';
+    } else if (infoType == LUMP_INFO_FORMAT) {
+        memcpy(m_device.formats[mode], payload + 1, 4);
+        m_device.formatKnown[mode] = true;
+    }
+}
+
+
+void LumpAnalyzer::hubFrame(const LumpFrame& frame) {
+    switch (frame.type()) {
+        case LUMP_MSG_TYPE_SYS:
+            if (frame.header() == LUMP_SYS_ACK && m_deviceAck) {
+                // End of the handshake: switch to the speed of the device
+                m_connected       = true;
+                m_lastDeviceFrame = frame.timestamp;
+            } else if (frame.header() == LUMP_SYS_NACK) {
+                if (m_lastNack != LUMP_NO_TIME)
+                    m_nackIntervals.add(static_cast<uint32_t>(frame.timestamp - m_lastNack));
+                m_lastNack = frame.timestamp;
+                // The device answers with the data of its current mode
+                if (m_requestTime[m_selectedMode] == LUMP_NO_TIME)
+                    m_requestTime[m_selectedMode] = frame.timestamp;
+            }
+            break;
+        case LUMP_MSG_TYPE_CMD:
+            if (frame.cmd() == LUMP_CMD_SELECT) {
+                m_selectedMode = frame.payload()[0] & 0x0F;
+                m_requestTime[m_selectedMode] = frame.timestamp;
+            } else if (frame.cmd() == LUMP_CMD_EXT_MODE) {
+                m_extMode[LUMP_FROM_HUB]        = frame.payload()[0] & LUMP_EXT_MODE_8;
+                m_extModePending[LUMP_FROM_HUB] = true;
+            }
+            break;
+        case LUMP_MSG_TYPE_DATA:
+            // Write query (mode + EXT_MODE of the hub)
+            if (m_extModePending[LUMP_FROM_HUB]) {
+                m_extModePairs++;
+                m_extModePending[LUMP_FROM_HUB] = false;
+            }
+            m_writes++;
+            break;
+    }
+}
+
+
+/**
+ * @brief One line of live statistics; rates since the previous call.
+ */
+void LumpAnalyzer::printStatus(FILE *out, uint64_t now) {
+    double elapsed = (m_statusTime != LUMP_NO_TIME && now > m_statusTime) ? (now - m_statusTime) / 1e6 : 0;
+    uint64_t deviceBytes = m_parsers[LUMP_FROM_DEVICE].bytes;
+    uint64_t hubBytes    = m_parsers[LUMP_FROM_HUB].bytes;
+
+    fprintf(out, "%s hub: %7.0f B/s device: %7.0f B/s | NACK: %7.3f ms (n=%zu) | errors: %u/%u | modes:",
+            m_connected ? "[connected]" : "[init]     ",
+            elapsed ? (hubBytes - m_statusBytes[LUMP_FROM_HUB]) / elapsed : 0,
+            elapsed ? (deviceBytes - m_statusBytes[LUMP_FROM_DEVICE]) / elapsed : 0,
+            m_nackIntervals.mean() / 1000, m_nackIntervals.count(),
+            m_parsers[LUMP_FROM_HUB].checksumErrors, m_parsers[LUMP_FROM_DEVICE].checksumErrors);
+    for (uint8_t mode = 0; mode < LUMP_MAX_MODES; mode++) {
+        if (m_latencies[mode].count())
+            fprintf(out, " %u:%.2fms", mode, m_latencies[mode].percentile(50) / 1000.0);
+    }
+    fprintf(out, "\n");
+
+    m_statusTime                     = now;
+    m_statusBytes[LUMP_FROM_HUB]     = hubBytes;
+    m_statusBytes[LUMP_FROM_DEVICE]  = deviceBytes;
+}
+
+
+/**
+ * @brief Device info and statistics of the whole session.
+ */
+void LumpAnalyzer::printReport(FILE *out) const {
+    static const char *dataTypes[] = { "int8", "int16", "int32", "float" };
+    double duration = (m_firstTimestamp != LUMP_NO_TIME) ? (m_lastTimestamp - m_firstTimestamp) / 1e6 : 0;
+
+    fprintf(out, "Device: type 0x%02X, %u modes, %u views, %u bauds\n",
+            static_cast<unsigned>(m_device.typeId & 0xFF), m_device.modes, m_device.views, static_cast<unsigned>(m_device.speed));
+    if (m_device.fwVersionKnown)
+        fprintf(out, "Versions: fw 0x%08X, hw 0x%08X\n", m_device.fwVersion, m_device.hwVersion);
+    for (uint8_t mode = 0; mode < LUMP_MAX_MODES; mode++) {
+        if (!m_device.formatKnown[mode] && !m_device.names[mode][0])
+            continue;
+        const uint8_t *format = m_device.formats[mode];
+        fprintf(out, "  mode %2u %-11s %u x %s\n", mode, m_device.names[mode], format[0],
+                (format[1] < 4) ? dataTypes[format[1]] : "?");
+    }
+
+    fprintf(out, "Duration: %.3f s, disconnections: %u\n", duration, m_disconnections);
+    const char *names[] = { "device", "hub" };
+    for (uint8_t direction = 0; direction < 2; direction++) {
+        const LumpFrameParser& parser = m_parsers[direction];
+        fprintf(out, "%-6s: %llu bytes (%.0f B/s), %u messages, %u checksum errors\n",
+                names[direction], static_cast<unsigned long long>(parser.bytes),
+                duration ? parser.bytes / duration : 0, parser.frames, parser.checksumErrors);
+    }
+    fprintf(out, "EXT_MODE pairs: %u, write queries: %u\n", m_extModePairs, m_writes);
+
+    m_nackIntervals.print(out, "NACK period");
+    for (uint8_t mode = 0; mode < LUMP_MAX_MODES; mode++) {
+        if (!m_latencies[mode].count())
+            continue;
+        char name[16];
+        snprintf(name, sizeof(name), "mode %u", mode);
+        m_latencies[mode].print(out, name);
+    }
+}
@@ -0,0 +1,225 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LUMP_ANALYZER_H
+#define LUMP_ANALYZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "lego_uart.h"
+
+#define LUMP_MAX_MODES          16
+#define LUMP_MODE_NAME_SIZE     12      // 11 chars + null
+#define LUMP_INIT_BAUDRATE      2400
+// Silence of the device before the connection is considered lost (µs)
+#define LUMP_DISCONNECTION_DELAY    500000
+#define LUMP_NO_TIME                UINT64_MAX
+// Histogram of the latencies: values below 2^LATENCY_SUB_BITS µs are exact,
+// the others are rounded to 1/2^(LATENCY_SUB_BITS - 1) of their power of 2
+#define LATENCY_SUB_BITS    7
+#define LATENCY_BUCKETS     ((1 << LATENCY_SUB_BITS) + (32 - LATENCY_SUB_BITS) * (1 << (LATENCY_SUB_BITS - 1)))
+
+
+/**
+ * @brief Direction of the traffic; same values as the captures of the
+ *      Python tooling (see my_own_bricks/capture.py).
+ */
+enum LumpDirection {
+    LUMP_FROM_DEVICE = 0,
+    LUMP_FROM_HUB    = 1,
+};
+
+
+/**
+ * @brief Complete message (header, payload, checksum).
+ * @param timestamp Reception time of the last byte (µs).
+ */
+struct LumpFrame {
+    uint8_t  bytes[LUMP_MAX_MSG_SIZE];
+    uint8_t  size;
+    uint64_t timestamp;
+
+    uint8_t header() const { return bytes[0]; }
+    uint8_t type() const { return bytes[0] & LUMP_MSG_TYPE_MASK; }
+    uint8_t cmd() const { return bytes[0] & LUMP_MSG_CMD_MASK; }
+    const uint8_t *payload() const { return bytes + 1; }
+};
+
+
+/**
+ * @brief Split the bytes of one direction into messages.
+ *
+ *    The size of a message is given by its header. Messages with a bad
+ *    checksum (or an invalid size) are counted and dropped; the parser
+ *    then resynchronizes on the byte following their header.
+ *    Unknown SYS bytes are skipped.
+ *
+ * @param m_buffer Bytes of the current message.
+ * @param m_length Number of bytes in m_buffer.
+ * @param m_expected Size of the current message.
+ */
+class LumpFrameParser {
+
+public:
+    typedef void (*FrameHandler)(const LumpFrame& frame, void *context);
+
+    LumpFrameParser();
+    void setHandler(FrameHandler handler, void *context);
+    void feed(const uint8_t *data, size_t length, uint64_t timestamp);
+    void reset();
+    static uint8_t messageSize(uint8_t header);
+
+    uint64_t bytes;
+    uint32_t frames;
+    uint32_t checksumErrors;
+
+private:
+    void push(uint8_t byte, uint64_t timestamp);
+
+    FrameHandler m_handler;
+    void        *m_context;
+    LumpFrame    m_frame;
+    uint8_t      m_length;
+    uint8_t      m_expected;
+};
+
+
+/**
+ * @brief Distribution of durations (µs) in a log-linear histogram of fixed
+ *      size: recording is O(1), percentiles walk the buckets (< 1% error).
+ *      Count, mean & max are exact.
+ */
+class LatencyStats {
+
+public:
+    LatencyStats();
+    void add(uint32_t value);
+    size_t count() const { return m_count; }
+    uint32_t percentile(uint8_t percent) const;
+    uint32_t max() const { return m_max; }
+    double mean() const;
+    void print(FILE *out, const char *name) const;
+
+private:
+    static uint16_t bucketIndex(uint32_t value);
+    static uint32_t bucketHighest(uint16_t index);
+
+    uint32_t m_buckets[LATENCY_BUCKETS];
+    size_t   m_count;
+    uint64_t m_sum;
+    uint32_t m_max;
+};
+
+
+/**
+ * @brief What the device announced during its init sequence.
+ * @param formats Data sets, data type (lump_data_type_t), figures, decimals.
+ */
+struct LumpDeviceInfo {
+    int16_t  typeId;
+    uint8_t  modes;
+    uint8_t  views;
+    uint32_t speed;
+    bool     fwVersionKnown;
+    uint32_t fwVersion;
+    uint32_t hwVersion;
+    char     names[LUMP_MAX_MODES][LUMP_MODE_NAME_SIZE];
+    bool     formatKnown[LUMP_MAX_MODES];
+    uint8_t  formats[LUMP_MAX_MODES][4];
+};
+
+
+/**
+ * @brief Decode the traffic between a hub and a device, and compute
+ *      statistics on it.
+ *
+ *    Both directions are given with their reception time; the bytes of
+ *    each direction are split by a LumpFrameParser. Decoded:
+ *      - init sequence of the device (type, modes, speed, versions, names
+ *        and formats of the modes), ACK of the device, then ACK of the hub:
+ *        the line is then at the announced speed (see lineSpeed());
+ *      - EXT_MODE + DATA pairs of both directions (modes 8 to 15);
+ *      - NACKs and mode selections of the hub.
+ *
+ *    Statistics:
+ *      - interval between the NACKs of the hub;
+ *      - latency of each mode: time between a request of the hub (NACK
+ *        while the mode is selected, or selection of the mode) and the
+ *        first DATA message of this mode sent by the device;
+ *      - bytes, messages, checksum errors per direction; disconnections.
+ *
+ * @param m_parsers Parser of each direction (index: LumpDirection).
+ * @param m_extMode Current EXT_MODE of each direction.
+ * @param m_selectedMode Mode of the last DATA message or selection.
+ * @param m_requestTime Time of the pending request of each mode.
+ * @param m_lastNack, m_lastDeviceFrame Time of the last NACK / message
+ *      of the device.
+ *      Times are in µs, LUMP_NO_TIME if unknown.
+ */
+class LumpAnalyzer {
+
+public:
+    LumpAnalyzer();
+    void feed(LumpDirection direction, const uint8_t *data, size_t length, uint64_t timestamp);
+    void poll(uint64_t now);
+
+    const LumpDeviceInfo& device() const { return m_device; }
+    const LatencyStats& nackIntervals() const { return m_nackIntervals; }
+    const LatencyStats& latencies(uint8_t mode) const { return m_latencies[mode & 0x0F]; }
+    const LumpFrameParser& parser(LumpDirection direction) const { return m_parsers[direction]; }
+    uint32_t lineSpeed() const { return m_connected ? m_device.speed : LUMP_INIT_BAUDRATE; }
+    bool isConnected() const { return m_connected; }
+    uint32_t getDisconnections() const { return m_disconnections; }
+    uint32_t getExtModePairs() const { return m_extModePairs; }
+    uint32_t getWrites() const { return m_writes; }
+
+    void printStatus(FILE *out, uint64_t now);
+    void printReport(FILE *out) const;
+
+private:
+    static void onDeviceFrame(const LumpFrame& frame, void *context);
+    static void onHubFrame(const LumpFrame& frame, void *context);
+    void deviceFrame(const LumpFrame& frame);
+    void hubFrame(const LumpFrame& frame);
+    void deviceInfo(const LumpFrame& frame);
+    void disconnect();
+
+    LumpFrameParser m_parsers[2];
+    LumpDeviceInfo  m_device;
+    LatencyStats    m_nackIntervals;
+    LatencyStats    m_latencies[LUMP_MAX_MODES];
+    uint8_t         m_extMode[2];
+    bool            m_extModePending[2];
+    uint8_t         m_selectedMode;
+    uint64_t        m_requestTime[LUMP_MAX_MODES];
+    uint64_t        m_lastNack;
+    uint64_t        m_lastDeviceFrame;
+    uint64_t        m_firstTimestamp;
+    uint64_t        m_lastTimestamp;
+    bool            m_deviceAck;
+    bool            m_connected;
+    uint32_t        m_disconnections;
+    uint32_t        m_extModePairs;
+    uint32_t        m_writes;
+    // Live status: counters at the previous call
+    uint64_t        m_statusTime;
+    uint64_t        m_statusBytes[2];
+};
+
+#endif
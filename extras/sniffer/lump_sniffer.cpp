@@ -0,0 +1,337 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Real-time sniffer of the LEGO UART protocol (Linux).
+ *
+ *    Two serial taps listen to the lines of a hub and a device: the RX of
+ *    the first one is wired to the TX of the hub, the RX of the second one
+ *    to the TX of the device (common ground). The taps follow the baudrate
+ *    of the line: 2400 bauds during the init sequence, then the speed
+ *    announced by the device, back to 2400 bauds on disconnection.
+ *
+ *    Messages are decoded and the statistics printed every second
+ *    (see LumpAnalyzer); the report of the session is printed on Ctrl+C.
+ *    The traffic can be recorded in a capture of the Python tooling
+ *    (see my_own_bricks/capture.py), and captures can be replayed into
+ *    the analyzer without hardware.
+ *
+ *    Build & usage:
+ *      make lump_sniffer
+ *      ./extras/sniffer/lump_sniffer /dev/ttyUSB0 /dev/ttyUSB1 [-w session.mobcap]
+ *      ./extras/sniffer/lump_sniffer -r session.mobcap
+ */
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "lump_analyzer.h"
+
+#define STATUS_PERIOD       1000000 // µs
+#define POLL_TIMEOUT        50      // ms
+#define CAPTURE_INDEX_STEP  256     // Same as my_own_bricks/capture.py
+
+static volatile sig_atomic_t stopRequested = 0;
+
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+
+static uint64_t monotonicMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+
+/**
+ * @brief Capture file of the Python tooling (little endian):
+ *      header: "MOBCAP", version 1, reserved byte;
+ *      records: direction (1 byte), timestamp (µs, 8 bytes),
+ *      baudrate (4 bytes), length (2 bytes), raw bytes.
+ *    The sidecar index (.idx) has 1 entry every CAPTURE_INDEX_STEP records:
+ *      header: "MOBIDX", version 1, reserved byte, step (4 bytes);
+ *      entries: record number, timestamp, offset (8 bytes each).
+ */
+class CaptureWriter {
+
+public:
+    CaptureWriter() : m_file(nullptr), m_index(nullptr), m_count(0) {}
+    ~CaptureWriter() { close(); }
+
+    bool open(const char *path) {
+        std::string indexPath = std::string(path) + ".idx";
+        m_file  = fopen(path, "wb");
+        m_index = fopen(indexPath.c_str(), "wb");
+        if (!m_file || !m_index)
+            return false;
+        uint8_t header[8] = { 'M', 'O', 'B', 'C', 'A', 'P', 1, 0 };
+        uint8_t indexHeader[12] = { 'M', 'O', 'B', 'I', 'D', 'X', 1, 0 };
+        uint32_t step = CAPTURE_INDEX_STEP;
+        memcpy(indexHeader + 8, &step, 4);
+        fwrite(header, 1, sizeof(header), m_file);
+        fwrite(indexHeader, 1, sizeof(indexHeader), m_index);
+        return true;
+    }
+
+    void write(uint8_t direction, uint64_t timestamp, uint32_t baudrate,
+               const uint8_t *data, uint16_t length) {
+        if (!m_file)
+            return;
+        if (m_count % CAPTURE_INDEX_STEP == 0) {
+            uint64_t entry[3] = { m_count, timestamp, static_cast<uint64_t>(ftell(m_file)) };
+            fwrite(entry, 1, sizeof(entry), m_index);
+        }
+        uint8_t header[15];
+        header[0] = direction;
+        memcpy(header + 1, &timestamp, 8);
+        memcpy(header + 9, &baudrate, 4);
+        memcpy(header + 13, &length, 2);
+        fwrite(header, 1, sizeof(header), m_file);
+        fwrite(data, 1, length, m_file);
+        m_count++;
+    }
+
+    void close() {
+        if (m_file)
+            fclose(m_file);
+        if (m_index)
+            fclose(m_index);
+        m_file = m_index = nullptr;
+    }
+
+private:
+    FILE    *m_file;
+    FILE    *m_index;
+    uint64_t m_count;
+};
+
+
+/**
+ * @brief Feed the analyzer with the records of a capture (recorded timestamps).
+ * @return false if the file can't be read.
+ */
+static bool replayCapture(const char *path, LumpAnalyzer& analyzer) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    uint8_t header[8];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, "MOBCAP", 6) != 0 || header[6] != 1) {
+        fprintf(stderr, "%s: not a capture\n", path);
+        fclose(file);
+        return false;
+    }
+
+    uint8_t  record[15];
+    static uint8_t data[65535];
+    uint64_t timestamp = 0;
+    while (fread(record, 1, sizeof(record), file) == sizeof(record)) {
+        uint16_t length;
+        memcpy(&timestamp, record + 1, 8);
+        memcpy(&length, record + 13, 2);
+        if (fread(data, 1, length, file) != length)
+            break; // Truncated capture
+        analyzer.feed(record[0] ? LUMP_FROM_HUB : LUMP_FROM_DEVICE, data, length, timestamp);
+    }
+    analyzer.poll(timestamp);
+    fclose(file);
+    return true;
+}
+
+
+static speed_t termiosSpeed(uint32_t baudrate) {
+    switch (baudrate) {
+        case 2400: return B2400;
+        case 9600: return B9600;
+        case 57600: return B57600;
+        case 230400: return B230400;
+        default: return B115200;
+    }
+}
+
+
+static bool setSpeed(int fd, uint32_t baudrate) {
+    struct termios attributes;
+    if (tcgetattr(fd, &attributes) < 0)
+        return false;
+    cfsetispeed(&attributes, termiosSpeed(baudrate));
+    cfsetospeed(&attributes, termiosSpeed(baudrate));
+    return tcsetattr(fd, TCSANOW, &attributes) == 0;
+}
+
+
+/**
+ * @brief Open a tap in raw, non-blocking mode at 2400 bauds.
+ * @return File descriptor or -1.
+ */
+static int openTap(const char *path) {
+    int fd = open(path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct termios attributes;
+    if (tcgetattr(fd, &attributes) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&attributes);
+    attributes.c_cflag |= CLOCAL | CREAD;
+    attributes.c_cc[VMIN]  = 0;
+    attributes.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &attributes);
+    setSpeed(fd, LUMP_INIT_BAUDRATE);
+
+    // Accurate timestamps: bytes are given as soon as received
+    // (USB adapters: no latency timer); not supported by all drivers
+    struct serial_struct serial;
+    if (ioctl(fd, TIOCGSERIAL, &serial) == 0) {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(fd, TIOCSSERIAL, &serial);
+    }
+    tcflush(fd, TCIFLUSH);
+    return fd;
+}
+
+
+static int sniff(const char *hubTap, const char *deviceTap, CaptureWriter& capture,
+                 LumpAnalyzer& analyzer) {
+    int fds[2];
+    fds[LUMP_FROM_DEVICE] = openTap(deviceTap);
+    fds[LUMP_FROM_HUB]    = openTap(hubTap);
+    if (fds[0] < 0 || fds[1] < 0)
+        return EXIT_FAILURE;
+
+    struct pollfd pollFds[2];
+    for (uint8_t i = 0; i < 2; i++) {
+        pollFds[i].fd     = fds[i];
+        pollFds[i].events = POLLIN;
+    }
+
+    uint32_t speed      = LUMP_INIT_BAUDRATE;
+    uint64_t start      = monotonicMicros();
+    uint64_t nextStatus = start + STATUS_PERIOD;
+    uint8_t  buffer[4096];
+    while (!stopRequested) {
+        int ret = poll(pollFds, 2, POLL_TIMEOUT);
+        if (ret < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        uint64_t now = monotonicMicros() - start;
+        // Hub first: a request and its response read at once keep their order
+        for (int8_t i = LUMP_FROM_HUB; ret > 0 && i >= LUMP_FROM_DEVICE; i--) {
+            if (!(pollFds[i].revents & POLLIN))
+                continue;
+            ssize_t length = read(fds[i], buffer, sizeof(buffer));
+            if (length <= 0)
+                continue;
+            LumpDirection direction = static_cast<LumpDirection>(i);
+            capture.write(direction, now, speed, buffer, static_cast<uint16_t>(length));
+            analyzer.feed(direction, buffer, length, now);
+        }
+        analyzer.poll(now);
+
+        // Follow the line: handshake done or disconnection
+        if (analyzer.lineSpeed() != speed) {
+            speed = analyzer.lineSpeed();
+            setSpeed(fds[0], speed);
+            setSpeed(fds[1], speed);
+        }
+        if (now + start >= nextStatus) {
+            analyzer.printStatus(stdout, now);
+            fflush(stdout);
+            nextStatus += STATUS_PERIOD;
+        }
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return EXIT_SUCCESS;
+}
+
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage:\n"
+            "  %s HUB_TAP DEVICE_TAP [-w CAPTURE]   sniff the lines (Ctrl+C to stop)\n"
+            "  %s -r CAPTURE                        replay a capture\n",
+            name, name);
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *replayPath = nullptr;
+    const char *writePath  = nullptr;
+    const char *taps[2]    = { nullptr, nullptr };
+    uint8_t     tapCount   = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+            writePath = argv[++i];
+        } else if (argv[i][0] != '-' && tapCount < 2) {
+            taps[tapCount++] = argv[i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    LumpAnalyzer analyzer;
+    if (replayPath) {
+        if (!replayCapture(replayPath, analyzer))
+            return EXIT_FAILURE;
+        analyzer.printReport(stdout);
+        return EXIT_SUCCESS;
+    }
+    if (tapCount != 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    CaptureWriter capture;
+    if (writePath && !capture.open(writePath)) {
+        perror(writePath);
+        return EXIT_FAILURE;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    int ret = sniff(taps[0], taps[1], capture, analyzer);
+    capture.close();
+    printf("\n");
+    analyzer.printReport(stdout);
+    return ret;
+}
@@ -0,0 +1,343 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of the TWI state machine of AsyncI2C.
+ *
+ *    Built with -D__AVR__ against the fake registers of extras/tests/fake_avr:
+ *    the commands written in TWCR are executed by a model of the bus with
+ *    2 slaves (8 & 16 bits registers) at each call of hardwareStep(), like
+ *    a hardware running concurrently to loop().
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <cstdio>
+#include <vector>
+
+#include <avr/interrupt.h>
+#include <util/twi.h>
+
+#include "check.h"
+#include "AsyncI2C.h"
+
+// Virtual clock
+static unsigned long now = 0;
+unsigned long millis() { return now; }
+unsigned long micros() { return now * 1000; }
+void delay(unsigned long ms) { now += ms; }
+
+
+/**
+ * @brief Slave on the bus: register pointer set by the first written bytes,
+ *      auto-incremented on each data byte.
+ */
+struct FakeSlave {
+    uint8_t  address;
+    bool     reg16;
+    uint8_t  regs[0x200];
+    uint16_t pointer;
+};
+
+static FakeSlave slaves[2];
+static FakeSlave *selected;
+static bool      stuck;        // Hardware never signals the events
+static int       command = -1; // Command written in TWCR, not executed yet
+static uint8_t   regBytes;     // Register address bytes received
+static std::vector<uint8_t> starts; // Addresses of the transactions (START only)
+
+enum BusState { BUS_IDLE, BUS_START, BUS_TRANSMIT, BUS_RECEIVE };
+static BusState busState = BUS_IDLE;
+
+FakeRegister     TWCR = { 0, nullptr };
+FakeRegister     TWDR = { 0, nullptr };
+volatile uint8_t TWSR;
+volatile uint8_t TWBR;
+volatile uint8_t SREG;
+
+
+/**
+ * @brief Writing 1 to TWINT clears the flag and starts the command.
+ */
+static void onTWCRWrite(uint8_t value) {
+    command    = (value & _BV(TWINT)) ? value : -1;
+    TWCR.value = value & ~_BV(TWINT);
+}
+
+
+/**
+ * @brief Execute the pending command; TWINT is set again when it is done.
+ */
+static void hardwareStep() {
+    if (command < 0 || stuck)
+        return;
+    uint8_t value = _(uint8_t)(command);
+    command    = -1;
+    TWCR.value = value;
+
+    if (value & _BV(TWSTO)) {
+        busState   = BUS_IDLE;
+        TWCR.value = value & ~(_BV(TWSTO) | _BV(TWINT));
+        TWSR       = TW_NO_INFO;
+        return;
+    }
+    if (value & _BV(TWSTA)) {
+        TWSR     = (busState == BUS_IDLE) ? TW_START : TW_REP_START;
+        busState = BUS_START;
+        return;
+    }
+
+    switch (busState) {
+        case BUS_START: {
+            uint8_t address = TWDR >> 1;
+            bool    read    = TWDR & TW_READ;
+            selected = nullptr;
+            for (FakeSlave& slave : slaves) {
+                if (slave.address == address)
+                    selected = &slave;
+            }
+            if (!read)
+                starts.push_back(address);
+            if (!selected) {
+                TWSR = (read) ? TW_MR_SLA_NACK : TW_MT_SLA_NACK;
+            } else if (read) {
+                busState = BUS_RECEIVE;
+                TWSR     = TW_MR_SLA_ACK;
+            } else {
+                busState = BUS_TRANSMIT;
+                regBytes = 0;
+                TWSR     = TW_MT_SLA_ACK;
+            }
+            break;
+        }
+        case BUS_TRANSMIT:
+            if (regBytes < ((selected->reg16) ? 2 : 1)) {
+                selected->pointer = _(uint16_t)((regBytes) ? (selected->pointer << 8) | TWDR : TWDR);
+                regBytes++;
+            } else {
+                selected->regs[selected->pointer++ & 0x1FF] = TWDR;
+            }
+            TWSR = TW_MT_DATA_ACK;
+            break;
+        case BUS_RECEIVE:
+            TWDR.value = selected->regs[selected->pointer++ & 0x1FF];
+            TWSR       = (value & _BV(TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+            break;
+        default:
+            TWSR = 0x00; // Bus error
+            break;
+    }
+}
+
+
+static void resetBus() {
+    for (FakeSlave& slave : slaves) {
+        memset(slave.regs, 0, sizeof(slave.regs));
+        slave.pointer = 0;
+    }
+    slaves[0].address = 0x29;
+    slaves[0].reg16   = false;
+    slaves[1].address = 0x39;
+    slaves[1].reg16   = true;
+    stuck             = false;
+    command           = -1;
+    busState          = BUS_IDLE;
+    starts.clear();
+}
+
+
+static void pollUntilIdle(AsyncI2C& engine) {
+    for (int i = 0; i < 1000 && !engine.isIdle(); i++) {
+        engine.poll();
+        hardwareStep();
+    }
+}
+
+
+static uint8_t completions;
+static void onCompletion(I2CTransaction& transaction) {
+    (void)transaction;
+    completions++;
+}
+
+
+/**
+ * @brief Burst read, register write with a 16 bits address, empty write.
+ */
+static void testTransfers() {
+    resetBus();
+    AsyncI2C  engine;
+    I2CDevice rgbChip(0x29);
+    I2CDevice distChip(0x39, true);
+    engine.begin();
+    engine.attach(rgbChip);
+    engine.attach(distChip);
+    CHECK(TWBR == 12); // 400kHz at 16MHz
+
+    for (uint8_t i = 0; i < 8; i++)
+        slaves[0].regs[0x14 + i] = _(uint8_t)(0xA0 + i);
+    slaves[1].regs[0x62] = 42;
+
+    uint8_t        rgbc[8] = { 0 };
+    uint8_t        range   = 0;
+    uint8_t        clearValue = 0x07;
+    I2CTransaction rgbcRead, rangeRead, interruptClear, specialFunction;
+    rgbcRead.setRead(0x14, rgbc, 8);
+    rgbcRead.callback = onCompletion;
+    rangeRead.setRead(0x0062, &range, 1);
+    rangeRead.callback = onCompletion;
+    interruptClear.setWrite(0x0015, &clearValue, 1);
+    specialFunction.setWrite(0x66, nullptr, 0);
+
+    completions = 0;
+    CHECK(engine.submit(rgbChip, rgbcRead));
+    CHECK(!engine.submit(rgbChip, rgbcRead)); // Already pending
+    CHECK(engine.submit(distChip, rangeRead));
+    CHECK(engine.submit(distChip, interruptClear));
+    CHECK(engine.submit(rgbChip, specialFunction));
+    CHECK(!engine.isIdle());
+    pollUntilIdle(engine);
+
+    CHECK(engine.isIdle());
+    CHECK(completions == 2);
+    CHECK(rgbcRead.status == I2CTransaction::I2C_DONE);
+    CHECK(rangeRead.status == I2CTransaction::I2C_DONE);
+    CHECK(interruptClear.status == I2CTransaction::I2C_DONE);
+    CHECK(specialFunction.status == I2CTransaction::I2C_DONE);
+    for (uint8_t i = 0; i < 8; i++)
+        CHECK(rgbc[i] == 0xA0 + i);
+    CHECK(range == 42);
+    CHECK(slaves[1].regs[0x15] == 0x07);
+    CHECK(slaves[0].pointer == 0x66);
+    CHECK(busState == BUS_IDLE);
+}
+
+
+/**
+ * @brief The devices are served alternately, whatever the submission order.
+ */
+static void testInterleaving() {
+    resetBus();
+    AsyncI2C  engine;
+    I2CDevice rgbChip(0x29);
+    I2CDevice distChip(0x39, true);
+    engine.begin();
+    engine.attach(rgbChip);
+    engine.attach(distChip);
+
+    uint8_t        buffers[6][2];
+    I2CTransaction transactions[6];
+    // 3 transactions queued on the first chip before the other ones
+    for (uint8_t i = 0; i < 6; i++) {
+        transactions[i].setRead(i, buffers[i], 2);
+        engine.submit((i < 3) ? rgbChip : distChip, transactions[i]);
+    }
+    pollUntilIdle(engine);
+
+    for (I2CTransaction& transaction : transactions)
+        CHECK(transaction.status == I2CTransaction::I2C_DONE);
+    CHECK(starts.size() == 6);
+    for (size_t i = 1; i < starts.size(); i++)
+        CHECK(starts[i] != starts[i - 1]);
+}
+
+
+/**
+ * @brief Slow loop: each event waits longer than the timeout to be handled,
+ *      the multi-byte read still completes since it keeps progressing.
+ */
+static void testSlowLoop() {
+    resetBus();
+    AsyncI2C  engine;
+    I2CDevice rgbChip(0x29);
+    engine.begin();
+    engine.attach(rgbChip);
+
+    for (uint8_t i = 0; i < 8; i++)
+        slaves[0].regs[0x14 + i] = _(uint8_t)(0x30 + i);
+
+    uint8_t        rgbc[8] = { 0 };
+    I2CTransaction rgbcRead;
+    rgbcRead.setRead(0x14, rgbc, 8);
+    engine.submit(rgbChip, rgbcRead);
+    for (int i = 0; i < 1000 && !engine.isIdle(); i++) {
+        engine.poll();
+        hardwareStep();
+        delay(2 * ASYNC_I2C_TIMEOUT);
+    }
+
+    CHECK(rgbcRead.status == I2CTransaction::I2C_DONE);
+    for (uint8_t i = 0; i < 8; i++)
+        CHECK(rgbc[i] == 0x30 + i);
+    CHECK(busState == BUS_IDLE);
+}
+
+
+/**
+ * @brief Missing device & stuck bus: the transactions fail, the engine recovers.
+ */
+static void testErrors() {
+    resetBus();
+    AsyncI2C  engine;
+    I2CDevice ghost(0x50);
+    I2CDevice rgbChip(0x29);
+    engine.begin();
+    engine.attach(ghost);
+    engine.attach(rgbChip);
+
+    uint8_t        data;
+    I2CTransaction ghostRead;
+    ghostRead.setRead(0x00, &data, 1);
+    ghostRead.callback = onCompletion;
+    completions        = 0;
+    engine.submit(ghost, ghostRead);
+    pollUntilIdle(engine);
+    CHECK(ghostRead.status == I2CTransaction::I2C_ERROR);
+    CHECK(completions == 1);
+
+    // The hardware doesn't respond anymore: timeout
+    stuck = true;
+    I2CTransaction rgbRead;
+    rgbRead.setRead(0x14, &data, 1);
+    engine.submit(rgbChip, rgbRead);
+    engine.poll();
+    hardwareStep();
+    engine.poll();
+    CHECK(rgbRead.isPending());
+    delay(ASYNC_I2C_TIMEOUT + 1);
+    engine.poll();
+    CHECK(rgbRead.status == I2CTransaction::I2C_ERROR);
+    CHECK(engine.isIdle());
+
+    // Back to normal; the STOP condition of the reset is sent first
+    stuck                = false;
+    slaves[0].regs[0x14] = 0x55;
+    engine.submit(rgbChip, rgbRead);
+    pollUntilIdle(engine);
+    CHECK(rgbRead.status == I2CTransaction::I2C_DONE);
+    CHECK(data == 0x55);
+}
+
+
+int main() {
+    TWCR.onWrite = onTWCRWrite;
+
+    testTransfers();
+    testInterleaving();
+    testSlowLoop();
+    testErrors();
+
+    return checkReport();
+}
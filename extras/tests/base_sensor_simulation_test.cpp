@@ -0,0 +1,335 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Simulation of the timings of BaseSensor (handshake, ACK timeout,
+ *      disconnection) against a model of the hub.
+ *
+ *    The time, the RX pin & the serial port are simulated (extras/host/
+ *    simulation.h): thousands of random connect / ACK timeout / NACK gap
+ *    scenarios run in a few seconds, with reproducible results (fixed seed,
+ *    checked by running them twice).
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "check.h"
+#include "simulation.h"
+#include "ColorDistanceSensor.h"
+
+#define RX_PIN            0
+#define SCENARIOS         1000
+// Duration of an iteration of the loop of the sketch while connected (µs)
+#define LOOP_DURATION     MOB_SIM_STEP_US
+
+
+/**
+ * @brief Behaviour of the hub during a scenario (times in µs).
+ *
+ * @param plugAt Time when the device is plugged (RX line idle HIGH).
+ * @param ignoredInits Number of init sequences not acknowledged
+ *      (the device retries after 2s).
+ * @param nackPeriod Period of the NACKs once connected.
+ * @param gapAt, gapLength Pause of the NACKs (hub busy); the device must
+ *      disconnect if the pause exceeds 200ms.
+ * @param end End of the scenario.
+ */
+struct Scenario {
+    unsigned long plugAt;
+    uint8_t       ignoredInits;
+    unsigned long nackPeriod;
+    unsigned long gapAt;
+    unsigned long gapLength;
+    unsigned long end;
+};
+
+/**
+ * @brief Observations of a scenario.
+ */
+struct Result {
+    unsigned      initSequences;
+    unsigned      connections;
+    unsigned      disconnections;
+    unsigned      nacks;
+    unsigned      responses;
+    unsigned      checksumErrors;
+    unsigned long firstConnection;   // Time of the 1st connection (µs)
+    unsigned long disconnectDelay;   // Last NACK to the disconnection (µs)
+    unsigned long maxSilence;        // Longest time without NACK while connected (µs)
+
+    bool operator==(const Result& other) const {
+        return memcmp(this, &other, sizeof(Result)) == 0;
+    }
+};
+
+
+/**
+ * @brief Model of the hub: listens to the init sequence at 2400 bauds, ACKs it,
+ *      then sends NACKs at 115200 bauds and checks the responses.
+ */
+struct HubModel {
+    const Scenario *scenario;
+    Result          result;
+    bool            connected;
+    unsigned long   lastNack;
+    unsigned        ignored;
+    std::vector<uint8_t> pending;   // Bytes of an incomplete message
+
+    void reset(const Scenario& sc) {
+        scenario  = &sc;
+        result    = Result();
+        connected = false;
+        lastNack  = 0;
+        ignored   = 0;
+        pending.clear();
+    }
+
+    /**
+     * @brief Size of a LUMP message from its header.
+     */
+    static size_t messageSize(uint8_t header) {
+        if ((header & 0xC0) == 0x00)
+            return 1; // SYS
+        const size_t size = (1 << ((header >> 3) & 0x7)) + 2;
+        return ((header & 0xC0) == 0x80) ? size + 1 : size; // INFO: + info type
+    }
+
+    void parse(const std::vector<uint8_t>& bytes) {
+        pending.insert(pending.end(), bytes.begin(), bytes.end());
+        size_t pos = 0;
+        while (pos < pending.size()) {
+            const uint8_t header = pending[pos];
+            const size_t  size   = messageSize(header);
+            if (pending.size() - pos < size)
+                break;
+            if (size > 1) {
+                uint8_t checksum = 0xFF;
+                for (size_t i = 0; i < size - 1; i++)
+                    checksum ^= pending[pos + i];
+                if (checksum != pending[pos + size - 1])
+                    result.checksumErrors++;
+            }
+            handleMessage(header);
+            pos += size;
+        }
+        pending.erase(pending.begin(), pending.begin() + pos);
+    }
+
+    void handleMessage(uint8_t header) {
+        const unsigned long now = Sim.now();
+        if (!connected) {
+            if (header == 0x40) {
+                result.initSequences++;
+            } else if (header == 0x04) {
+                // End of the init sequence
+                if (ignored < scenario->ignoredInits) {
+                    ignored++;
+                    return;
+                }
+                const uint8_t ack = 0x04;
+                Serial.injectRx(&ack, 1);
+                connected = true;
+                lastNack  = now;
+            }
+            return;
+        }
+        if ((header & 0xC0) == 0xC0)
+            result.responses++;
+    }
+
+    void tick() {
+        const unsigned long now = Sim.now();
+        Sim.setPin(RX_PIN, (now >= scenario->plugAt) ? HIGH : LOW);
+
+        const unsigned long baud = Serial.getBaud();
+        if (connected && !baud) {
+            // The device closed the port to restart its handshake
+            connected = false;
+            pending.clear();
+        }
+        std::vector<uint8_t> tx = Serial.takeTx();
+        if (!tx.empty())
+            parse(tx);
+        if (connected && now - lastNack > result.maxSilence)
+            result.maxSilence = now - lastNack;
+
+        const bool paused = now >= scenario->gapAt && now < scenario->gapAt + scenario->gapLength;
+        if (connected && !paused && baud == 115200 && now - lastNack >= scenario->nackPeriod) {
+            const uint8_t nack = 0x02;
+            Serial.injectRx(&nack, 1);
+            result.nacks++;
+            lastNack = now;
+        }
+    }
+};
+
+static HubModel hub;
+// Total simulated time (µs)
+static unsigned long long simulatedTime = 0;
+
+static void hubTick() {
+    hub.tick();
+}
+
+
+/**
+ * @brief Run a scenario: the loop of a sketch calling process().
+ */
+static Result run(const Scenario& scenario) {
+    ColorDistanceSensor sensor;
+    uint8_t             distance = 5;
+    sensor.setSensorDistance(&distance);
+
+    Sim.reset();
+    hub.reset(scenario);
+    Sim.setTickCallback(hubTick);
+
+    bool connected = false;
+    while (Sim.now() < scenario.end) {
+        sensor.process();
+        if (sensor.isConnected() != connected) {
+            connected = !connected;
+            if (connected) {
+                if (!hub.result.connections)
+                    hub.result.firstConnection = Sim.now();
+                hub.result.connections++;
+            } else {
+                hub.result.disconnections++;
+                hub.result.disconnectDelay = Sim.now() - hub.lastNack;
+            }
+        }
+        if (connected)
+            Sim.advance(LOOP_DURATION);
+    }
+    Sim.setTickCallback(nullptr);
+    simulatedTime += Sim.now();
+    return hub.result;
+}
+
+
+/**
+ * @brief Nominal handshake, then stable connection: every NACK is answered.
+ */
+static void testHandshake() {
+    Scenario scenario = { 50000, 0, 100000, ~0UL, 0, 8000000 };
+    Result   result   = run(scenario);
+
+    CHECK(result.initSequences == 1);
+    CHECK(result.connections == 1);
+    CHECK(result.disconnections == 0);
+    CHECK(result.checksumErrors == 0);
+    // Line idle (100ms) + TX pulses (200ms) + init sequence at 2400 bauds (~3s)
+    CHECK(result.firstConnection > scenario.plugAt + 3000000);
+    CHECK(result.firstConnection < scenario.plugAt + 4000000);
+    CHECK(result.nacks > 20);
+    // Mode 8 after each NACK: EXT_MODE + DATA (the last NACK may be pending)
+    CHECK(result.responses >= result.nacks - 1 && result.responses <= result.nacks);
+}
+
+
+/**
+ * @brief Init sequences not acknowledged: retry after the 2s timeout.
+ */
+static void testAckTimeout() {
+    Scenario scenario = { 0, 2, 100000, ~0UL, 0, 20000000 };
+    Result   result   = run(scenario);
+
+    CHECK(result.initSequences == 3);
+    CHECK(result.connections == 1);
+    // 2 failed attempts: init sequence + 2s without ACK
+    CHECK(result.firstConnection > 3 * 3000000 + 2 * 2000000);
+}
+
+
+/**
+ * @brief NACKs paused more than 200ms: disconnection right after the
+ *      deadline, then new handshake.
+ */
+static void testDisconnection() {
+    Scenario scenario = { 0, 0, 100000, 5000000, 500000, 12000000 };
+    Result   result   = run(scenario);
+
+    CHECK(result.disconnections == 1);
+    CHECK(result.connections == 2);
+    CHECK(result.initSequences == 2);
+    CHECK(result.disconnectDelay > 200000 && result.disconnectDelay <= 202000);
+    CHECK(result.maxSilence > 200000);
+}
+
+
+/**
+ * @brief Random scenarios; checks the invariants of the timings.
+ * @return Results of all the scenarios.
+ */
+static std::vector<Result> runRandomScenarios(unsigned seed) {
+    std::mt19937        random(seed);
+    std::vector<Result> results;
+
+    for (unsigned i = 0; i < SCENARIOS; i++) {
+        Scenario scenario;
+        scenario.plugAt       = random() % 500000;
+        scenario.ignoredInits = random() % 2;
+        scenario.nackPeriod   = 20000 + random() % 170000;
+        // Once connected (init sequence ignored: ~9s)
+        scenario.gapAt        = 10000000 + random() % 1000000;
+        scenario.gapLength    = random() % 400000;
+        // Time to reconnect
+        scenario.end          = scenario.gapAt + scenario.gapLength + 4000000;
+
+        const Result result = run(scenario);
+        results.push_back(result);
+
+        CHECK(result.checksumErrors == 0);
+        CHECK(result.initSequences == scenario.ignoredInits + result.connections);
+        CHECK(result.firstConnection > scenario.plugAt + 3000000);
+        CHECK(result.firstConnection < scenario.gapAt);
+        CHECK(result.responses >= result.nacks - 1 - result.disconnections);
+
+        // Disconnected iff the hub was silent for more than 200ms (+ the
+        // resolution of millis() & of the loop)
+        if (result.maxSilence < 200000)
+            CHECK(result.disconnections == 0);
+        if (result.maxSilence > 202000)
+            CHECK(result.disconnections == 1);
+        if (result.disconnections)
+            CHECK(result.disconnectDelay > 200000 && result.disconnectDelay <= 202000);
+        // Reconnected after a disconnection
+        CHECK(result.connections == result.disconnections + 1);
+    }
+    return results;
+}
+
+
+int main() {
+    testHandshake();
+    testAckTimeout();
+    testDisconnection();
+
+    simulatedTime    = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<Result> results = runRandomScenarios(42);
+    const double elapsed   = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double simulated = simulatedTime / 1e6;
+    // Deterministic
+    CHECK(runRandomScenarios(42) == results);
+    printf("%d scenarios: %.0fs simulated in %.2fs (x%.0f)\n", SCENARIOS, simulated, elapsed, simulated / elapsed);
+
+    return checkReport();
+}
@@ -0,0 +1,51 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Checks shared by the host tests of extras/tests.
+ *    A failed CHECK() is reported and counted without stopping the test;
+ *    main() returns checkReport() as exit status.
+ */
+#ifndef MOB_TESTS_CHECK_H
+#define MOB_TESTS_CHECK_H
+
+#include <cstdio>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                             \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                         \
+        }                                                                       \
+    } while (0)
+
+
+/**
+ * @brief Print the result of the checks.
+ * @return Exit status of the test program: non-zero if a check failed.
+ */
+static inline int checkReport() {
+    if (failures)
+        fprintf(stderr, "%d failure(s)\n", failures);
+    else
+        printf("All tests passed\n");
+    return failures != 0;
+}
+
+#endif
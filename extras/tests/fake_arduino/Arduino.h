@@ -0,0 +1,104 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Declarations of the Arduino core of the Pro Micro (ATmega32U4) for
+ *      the syntax builds of the examples (see tests/test_host_programs.py).
+ *      Nothing is implemented: the examples are only compiled, not linked.
+ */
+#ifndef MOB_FAKE_ARDUINO_H
+#define MOB_FAKE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <avr/interrupt.h>
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define HEX             16
+#define DEC             10
+#define F(str)          (str)
+#define PROGMEM
+
+#define LOW             0
+#define HIGH            1
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define FALLING         2
+
+#define LED_BUILTIN        17
+#define LED_BUILTIN_RX     17
+#define LED_BUILTIN_TX     30
+#define digitalPinToInterrupt(p)    ((p) == 7 ? 4 : -1)
+
+#define min(a, b)                 ((a) < (b) ? (a) : (b))
+#define max(a, b)                 ((a) > (b) ? (a) : (b))
+#define constrain(x, low, high)   ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+// Pin change & external interrupts
+#define PB4      4
+#define PCIF0    0
+#define INTF6    6
+extern volatile uint8_t PCICR;
+extern volatile uint8_t PCMSK0;
+extern volatile uint8_t PCIFR;
+extern volatile uint8_t EIFR;
+extern volatile uint8_t PINB;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*callback)(), int mode);
+
+class Stream {
+public:
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    int peek();
+    void flush();
+    size_t write(uint8_t byte);
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t availableForWrite();
+    template <typename T> size_t print(const T& value, int base = DEC);
+    template <typename T> size_t println(const T& value, int base = DEC);
+    size_t println();
+};
+
+class HardwareSerial : public Stream {
+public:
+    operator bool();
+};
+
+class Serial_ : public Stream {
+public:
+    operator bool();
+};
+
+extern Serial_        Serial;  // USB CDC
+extern HardwareSerial Serial1; // UART
+
+#endif // MOB_FAKE_ARDUINO_H
@@ -0,0 +1,64 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Declarations of the VL6180X library (https://github.com/pololu/vl6180x-arduino)
+ *      for the syntax builds of the examples.
+ */
+#ifndef MOB_FAKE_VL6180X_H
+#define MOB_FAKE_VL6180X_H
+
+#include "Arduino.h"
+
+#define VL6180X_ERROR_NONE    0
+
+class VL6180X {
+public:
+    enum regAddr {
+        SYSTEM__MODE_GPIO1                 = 0x011,
+        SYSTEM__INTERRUPT_CONFIG_GPIO      = 0x014,
+        SYSTEM__INTERRUPT_CLEAR            = 0x015,
+        SYSTEM__FRESH_OUT_OF_RESET         = 0x016,
+        SYSRANGE__START                    = 0x018,
+        SYSRANGE__INTERMEASUREMENT_PERIOD  = 0x01B,
+        SYSALS__START                      = 0x038,
+        SYSALS__INTERMEASUREMENT_PERIOD    = 0x03E,
+        SYSALS__INTEGRATION_PERIOD         = 0x040,
+        RESULT__RANGE_STATUS               = 0x04D,
+        RESULT__ALS_STATUS                 = 0x04E,
+        RESULT__INTERRUPT_STATUS_GPIO      = 0x04F,
+        RESULT__ALS_VAL                    = 0x050,
+        RESULT__RANGE_VAL                  = 0x062,
+    };
+
+    uint8_t last_status;
+
+    void setAddress(uint8_t new_addr);
+    void init();
+    void configureDefault();
+    void writeReg(uint16_t reg, uint8_t value);
+    void writeReg16Bit(uint16_t reg, uint16_t value);
+    uint8_t readReg(uint16_t reg);
+    void setScaling(uint8_t new_scaling);
+    uint8_t getScaling();
+    void startRangeContinuous(uint16_t period = 100);
+    void startInterleavedContinuous(uint16_t period = 500);
+    void stopContinuous();
+    void setTimeout(uint16_t timeout);
+};
+
+#endif // MOB_FAKE_VL6180X_H
@@ -0,0 +1,50 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Declarations of the TCS34725 library (https://github.com/ysard/TCS34725)
+ *      for the syntax builds of the examples.
+ */
+#ifndef MOB_FAKE_TCS34725_H
+#define MOB_FAKE_TCS34725_H
+
+#include "Arduino.h"
+
+#define TCS34725_ATIME        0x01
+#define TCS34725_PERS         0x0C
+#define TCS34725_PERS_NONE    0x00
+#define TCS34725_CONTROL      0x0F
+
+class Adafruit_TCS34725 {
+public:
+    void enable();
+    void disable();
+    void write8(uint8_t reg, uint32_t value);
+    void setInterrupt(bool flag);
+};
+
+class TCS34725 {
+public:
+    bool begin();
+    bool getData();
+
+    float    lux;
+    uint16_t maxlux;
+    Adafruit_TCS34725 tcs;
+};
+
+#endif // MOB_FAKE_TCS34725_H
@@ -0,0 +1,99 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Fake AVR registers for host tests of the TWI & Timer1 code.
+ *      TWCR and TWDR are objects: their writes are forwarded to a model
+ *      of the bus implemented by the test program.
+ *      ISR(vector) defines a plain function the test can call.
+ */
+#ifndef MOB_FAKE_AVR_INTERRUPT_H
+#define MOB_FAKE_AVR_INTERRUPT_H
+
+#include <cstdint>
+
+#define F_CPU    16000000UL
+#define _BV(bit)    (1 << (bit))
+
+// TWCR bits
+#define TWINT    7
+#define TWEA     6
+#define TWSTA    5
+#define TWSTO    4
+#define TWWC     3
+#define TWEN     2
+#define TWIE     0
+
+// Timer1 bits
+#define COM1A1   7
+#define COM1A0   6
+#define WGM11    1
+#define WGM10    0
+#define WGM13    4
+#define WGM12    3
+#define CS12     2
+#define CS11     1
+#define CS10     0
+#define OCIE1A   1
+#define TOIE1    0
+#define OCF1A    1
+#define TOV1     0
+
+// Port B bits
+#define PB1      1
+#define PB5      5
+
+#define ISR(vector)    extern "C" void vector(void)
+
+/**
+ * @brief Register whose writes are handled by a callback.
+ */
+struct FakeRegister {
+    uint8_t value;
+    void (*onWrite)(uint8_t value);
+
+    operator uint8_t() const {
+        return value;
+    }
+    FakeRegister& operator=(uint8_t newValue) {
+        value = newValue;
+        if (onWrite)
+            onWrite(newValue);
+        return *this;
+    }
+};
+
+extern FakeRegister     TWCR;
+extern FakeRegister     TWDR;
+extern volatile uint8_t TWSR;
+extern volatile uint8_t TWBR;
+extern volatile uint8_t SREG;
+
+extern volatile uint8_t  TCCR1A;
+extern volatile uint8_t  TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t ICR1;
+extern volatile uint8_t  TIMSK1;
+extern volatile uint8_t  TIFR1;
+extern volatile uint8_t  DDRB;
+extern volatile uint8_t  PORTB;
+
+inline void cli() {}
+inline void sei() {}
+
+#endif // MOB_FAKE_AVR_INTERRUPT_H
@@ -0,0 +1,43 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Status codes of the TWI unit (subset of avr-libc's util/twi.h).
+ */
+#ifndef MOB_FAKE_UTIL_TWI_H
+#define MOB_FAKE_UTIL_TWI_H
+
+#define TW_STATUS_MASK     0xF8
+#define TW_STATUS          (TWSR & TW_STATUS_MASK)
+
+#define TW_START           0x08
+#define TW_REP_START       0x10
+#define TW_MT_SLA_ACK      0x18
+#define TW_MT_SLA_NACK     0x20
+#define TW_MT_DATA_ACK     0x28
+#define TW_MT_DATA_NACK    0x30
+#define TW_MT_ARB_LOST     0x38
+#define TW_MR_SLA_ACK      0x40
+#define TW_MR_SLA_NACK     0x48
+#define TW_MR_DATA_ACK     0x50
+#define TW_MR_DATA_NACK    0x58
+#define TW_NO_INFO         0xF8
+
+#define TW_READ            1
+#define TW_WRITE           0
+
+#endif // MOB_FAKE_UTIL_TWI_H
@@ -0,0 +1,208 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of the streaming filters: median outlier rejection,
+ *      convergence & rounding of the average, hysteresis switches, chains.
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "check.h"
+#include "Arduino.h"
+#include "utilities/filters.hpp"
+
+// Color codes (see ColorDistanceSensor.h)
+enum : uint8_t { BLUE = 3, GREEN = 6, YELLOW = 7, RED = 9, NONE = 0xFF };
+
+
+/**
+ * @brief Steps taken by an average to go from `from` to exactly `to`;
+ *      0 if the target is not reached after `maxSteps`.
+ */
+static unsigned stepsToTarget(uint8_t strength, uint16_t from, uint16_t to, unsigned maxSteps) {
+    ExponentialAverage<uint16_t> average(strength);
+    average.update(from);
+    for (unsigned step = 1; step <= maxSteps; step++) {
+        if (average.update(to) == to)
+            return step;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Lower median of the window, warm-up and outliers; same output as
+ *      a sort of the N last samples on a random stream.
+ */
+static void testMovingMedian() {
+    MovingMedian<uint16_t, 5> median;
+    CHECK(median.value() == 0);
+    // Warm-up: median of the samples received so far (lower one if even)
+    CHECK(median.update(30) == 30);
+    CHECK(median.update(10) == 10);
+    CHECK(median.update(20) == 20);
+    CHECK(median.update(40) == 20);
+    CHECK(median.update(50) == 30);
+
+    // Spikes shorter than half the window are removed
+    median.reset();
+    for (uint8_t i = 0; i < 5; i++)
+        median.update(100);
+    CHECK(median.update(5000) == 100);
+    CHECK(median.update(0) == 100);
+    for (uint8_t i = 0; i < 3; i++)
+        CHECK(median.update(100) == 100);
+    CHECK(median.update(5000) == 100);
+    CHECK(median.update(5000) == 100);
+    // A lasting change passes: 3 samples out of 5
+    median.reset();
+    for (uint8_t i = 0; i < 5; i++)
+        median.update(100);
+    CHECK(median.update(400) == 100);
+    CHECK(median.update(400) == 100);
+    CHECK(median.update(400) == 400);
+
+    // Reference: sort of the window (duplicates included)
+    MovingMedian<uint16_t, 7> tracked;
+    std::vector<uint16_t>     samples;
+    srand(42);
+    for (unsigned i = 0; i < 2000; i++) {
+        uint16_t sample = _(uint16_t)(rand() % 16);
+        samples.push_back(sample);
+        size_t first = (samples.size() > 7) ? samples.size() - 7 : 0;
+        std::vector<uint16_t> window(samples.begin() + first, samples.end());
+        std::sort(window.begin(), window.end());
+        CHECK(tracked.update(sample) == window[(window.size() - 1) / 2]);
+    }
+}
+
+
+/**
+ * @brief Exact convergence in both directions at each strength, no loss
+ *      of small variations, time constant & runtime strength changes.
+ */
+static void testExponentialAverage() {
+    for (uint8_t strength = 0; strength <= 8; strength++) {
+        const unsigned maxSteps = (16U << strength) + 256;
+        const unsigned rising   = stepsToTarget(strength, 0, 1000, maxSteps);
+        CHECK(rising > 0);
+        CHECK(stepsToTarget(strength, 1000, 0, maxSteps) > 0);
+        // Fractional bits: +1 is not lost by the integer division
+        CHECK(stepsToTarget(strength, 1000, 1001, maxSteps) > 0);
+        CHECK(stepsToTarget(strength, 1001, 1000, maxSteps) > 0);
+        if (strength == 0)
+            CHECK(rising == 1);
+
+        // 1st step: 1/2^strength of the way, rounded down
+        ExponentialAverage<uint16_t> average(strength);
+        CHECK(average.update(0) == 0);
+        CHECK(average.update(1000) == (1000 >> strength));
+        // Time constant ~2^strength samples (63% of the step)
+        average.reset();
+        average.update(0);
+        unsigned steps = 0;
+        while (average.update(1000) < 632)
+            steps++;
+        steps++;
+        if (strength)
+            CHECK(steps >= (1U << (strength - 1)) && steps <= (2U << strength));
+    }
+
+    // The first sample primes the average
+    ExponentialAverage<uint16_t> average(3);
+    CHECK(average.update(700) == 700);
+    // The value is kept when the strength changes; strength is limited to 8
+    average.setStrength(5);
+    CHECK(average.value() == 700);
+    average.setStrength(20);
+    CHECK(average.value() == 700);
+    CHECK(average.update(700 + 256) == 701);
+    average.reset();
+    CHECK(average.update(42) == 42);
+}
+
+
+/**
+ * @brief Number of published switches on a flickering stream.
+ */
+static void testColorHysteresis() {
+    const uint8_t stream[] = {
+        RED, RED, RED,                      // Switch 1 (NONE -> RED)
+        BLUE, RED, BLUE, RED, BLUE, RED,    // Flicker: ignored
+        BLUE, BLUE, RED,                    // Interrupted: ignored
+        BLUE, BLUE, BLUE,                   // Switch 2
+        GREEN, GREEN, YELLOW, GREEN,        // Candidate replaced: ignored
+        GREEN, GREEN,                       // Switch 3 (3 GREEN in a row)
+        NONE, GREEN, NONE, NONE, NONE,      // Switch 4
+    };
+    ColorHysteresis<uint8_t> hysteresis(NONE);
+    uint8_t  published = hysteresis.value();
+    unsigned switches  = 0;
+    unsigned raw       = 0;
+    for (size_t i = 0; i < sizeof(stream); i++) {
+        uint8_t value = hysteresis.update(stream[i]);
+        if (value != published)
+            switches++;
+        if (i && stream[i] != stream[i - 1])
+            raw++;
+        published = value;
+    }
+    CHECK(switches == 4);
+    CHECK(raw > 3 * switches);
+    CHECK(hysteresis.value() == NONE);
+
+    // Threshold 1: every change is published
+    hysteresis.setThreshold(1);
+    CHECK(hysteresis.update(RED) == RED);
+    CHECK(hysteresis.update(BLUE) == BLUE);
+    CHECK(hysteresis.update(BLUE) == BLUE);
+}
+
+
+/**
+ * @brief The median removes the spikes before the average; nested chains.
+ */
+static void testFilterChain() {
+    FilterChain<MovingMedian<uint16_t, 3>, ExponentialAverage<uint16_t> > chain;
+    const uint16_t stream[] = { 100, 100, 5000, 100, 100, 0, 100 };
+    for (uint16_t sample : stream)
+        CHECK(chain.update(sample) == 100);
+
+    // Median of medians, average disabled
+    FilterChain<FilterChain<MovingMedian<uint16_t, 3>, MovingMedian<uint16_t, 3> >,
+                ExponentialAverage<uint16_t> > nested;
+    nested.second.setStrength(0);
+    CHECK(nested.update(_(uint16_t)(10)) == 10);
+    CHECK(nested.update(_(uint16_t)(50)) == 10);
+    CHECK(nested.update(_(uint16_t)(50)) == 10);
+    CHECK(nested.update(_(uint16_t)(50)) == 50);
+    CHECK(nested.first.first.value() == 50);
+}
+
+
+int main() {
+    testMovingMedian();
+    testExponentialAverage();
+    testColorHysteresis();
+    testFilterChain();
+
+    return checkReport();
+}
@@ -0,0 +1,228 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of the LEGO UART analyzer of the sniffer
+ *      (see extras/sniffer): message splitting, init sequence, EXT_MODE
+ *      pairs, latencies & NACK statistics.
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "lump_analyzer.h"
+
+
+/**
+ * @brief Message with its checksum.
+ */
+static std::vector<uint8_t> message(std::vector<uint8_t> bytes) {
+    uint8_t checksum = 0xFF;
+    for (uint8_t byte : bytes)
+        checksum ^= byte;
+    bytes.push_back(checksum);
+    return bytes;
+}
+
+
+static void feed(LumpAnalyzer& analyzer, LumpDirection direction,
+                 const std::vector<uint8_t>& bytes, uint64_t timestamp) {
+    analyzer.feed(direction, bytes.data(), bytes.size(), timestamp);
+}
+
+
+/**
+ * @brief The percentiles of the histogram are rounded up, by less than 1/64.
+ */
+static bool roundedUp(uint32_t value, uint32_t expected) {
+    return value >= expected && value - expected <= expected / 64;
+}
+
+
+static std::vector<LumpFrame> frames;
+
+static void collect(const LumpFrame& frame, void *) {
+    frames.push_back(frame);
+}
+
+
+/**
+ * @brief Messages split between reads, unknown SYS bytes, resynchronization.
+ */
+static void testParser() {
+    LumpFrameParser parser;
+    parser.setHandler(collect, nullptr);
+
+    std::vector<uint8_t> stream = message({ 0xD0, 1, 2, 3, 4 });
+    stream.push_back(0x02);
+    stream.push_back(0x2A); // Noise
+    std::vector<uint8_t> info = message({ 0x90, 0x80, 1, 0, 3, 0 });
+    stream.insert(stream.end(), info.begin(), info.end());
+    for (uint8_t byte : stream)
+        parser.feed(&byte, 1, 10);
+
+    CHECK(frames.size() == 3);
+    CHECK(frames[0].size == 6 && frames[0].payload()[3] == 4);
+    CHECK(frames[1].size == 1 && frames[1].header() == LUMP_SYS_NACK);
+    CHECK(frames[2].size == 7 && frames[2].timestamp == 10);
+    CHECK(parser.checksumErrors == 0);
+    CHECK(parser.bytes == stream.size());
+
+    // Corrupted payload: dropped, the next message is found
+    frames.clear();
+    std::vector<uint8_t> corrupted = message({ 0xC1, 0x2A });
+    corrupted[1] ^= 0x01;
+    std::vector<uint8_t> valid = message({ 0xC3, 0x09 });
+    corrupted.insert(corrupted.end(), valid.begin(), valid.end());
+    parser.feed(corrupted.data(), corrupted.size(), 20);
+    CHECK(parser.checksumErrors == 1);
+    CHECK(frames.size() == 1 && frames[0].header() == 0xC3);
+
+    // Invalid size (64 bytes)
+    uint8_t invalid = 0xF0;
+    parser.feed(&invalid, 1, 30);
+    CHECK(parser.checksumErrors == 2);
+}
+
+
+/**
+ * @brief Init sequence, handshake, then disconnection.
+ */
+static void testHandshake() {
+    LumpAnalyzer analyzer;
+    uint64_t     t = 1000;
+
+    feed(analyzer, LUMP_FROM_DEVICE, { 0x00 }, t);
+    feed(analyzer, LUMP_FROM_DEVICE, message({ 0x40, 0x22 }), t += 10000);
+    feed(analyzer, LUMP_FROM_DEVICE, message({ 0x51, 0x07, 0x07, 0x0A, 0x07 }), t += 10000);
+    feed(analyzer, LUMP_FROM_DEVICE, message({ 0x52, 0x00, 0xC2, 0x01, 0x00 }), t += 10000);
+    feed(analyzer, LUMP_FROM_DEVICE, message({ 0x98, 0x20, 'S', 'P', 'E', 'C', ' ', '1', 0, 0 }), t += 10000);
+    feed(analyzer, LUMP_FROM_DEVICE, message({ 0x90, 0xA0, 0x04, 0x00, 0x03, 0x00 }), t += 10000);
+    feed(analyzer, LUMP_FROM_DEVICE, { 0x04 }, t += 10000);
+    CHECK(!analyzer.isConnected());
+    CHECK(analyzer.lineSpeed() == 2400);
+
+    feed(analyzer, LUMP_FROM_HUB, { 0x04 }, t += 10000);
+    CHECK(analyzer.isConnected());
+    CHECK(analyzer.lineSpeed() == 115200);
+
+    const LumpDeviceInfo& device = analyzer.device();
+    CHECK(device.typeId == 0x22);
+    CHECK(device.modes == 11 && device.views == 8);
+    CHECK(device.formatKnown[8] && device.formats[8][0] == 4);
+    CHECK(std::string(device.names[8]) == "SPEC 1");
+
+    // Silence of the device
+    analyzer.poll(t + LUMP_DISCONNECTION_DELAY / 2);
+    CHECK(analyzer.isConnected());
+    analyzer.poll(t + LUMP_DISCONNECTION_DELAY + 1);
+    CHECK(!analyzer.isConnected());
+    CHECK(analyzer.getDisconnections() == 1);
+    CHECK(analyzer.lineSpeed() == 2400);
+}
+
+
+/**
+ * @brief NACK period, latencies of the modes, EXT_MODE pairs & writes.
+ */
+static void testStatistics() {
+    LumpAnalyzer analyzer;
+    uint64_t     t = 0;
+
+    for (uint8_t i = 0; i < 100; i++) {
+        // NACK every 100ms (+- 1ms), answered after i * 10µs
+        uint64_t nack = t + ((i & 1) ? 1000 : 0);
+        feed(analyzer, LUMP_FROM_HUB, { 0x02 }, nack);
+        feed(analyzer, LUMP_FROM_DEVICE, message({ 0xC1, i }), nack + 1000 + i * 10);
+        t += 100000;
+    }
+    CHECK(analyzer.nackIntervals().count() == 99);
+    CHECK(analyzer.nackIntervals().max() == 101000);
+    CHECK(roundedUp(analyzer.nackIntervals().percentile(50), 99000) ||
+          roundedUp(analyzer.nackIntervals().percentile(50), 101000));
+
+    // The 1st NACK requests the unknown mode 0
+    const LatencyStats& mode1 = analyzer.latencies(1);
+    CHECK(mode1.count() == 99);
+    CHECK(roundedUp(mode1.percentile(50), 1500));
+    CHECK(roundedUp(mode1.percentile(90), 1900));
+    CHECK(mode1.percentile(99) == 1990); // Bounded by the max
+    CHECK(mode1.max() == 1990);
+
+    // Selection of mode 9 (EXT_MODE 8 + mode 1), answered with an EXT_MODE pair
+    feed(analyzer, LUMP_FROM_HUB, message({ 0x43, 0x09 }), t);
+    feed(analyzer, LUMP_FROM_DEVICE, message({ 0x46, 0x08 }), t + 400);
+    feed(analyzer, LUMP_FROM_DEVICE, message({ 0xD1, 0x01, 0x00, 0x02, 0x00 }), t + 500);
+    CHECK(analyzer.latencies(9).count() == 1);
+    CHECK(analyzer.latencies(9).max() == 500);
+    CHECK(analyzer.latencies(1).count() == 99);
+    // The NACKs request the data of the selected mode
+    feed(analyzer, LUMP_FROM_HUB, { 0x02 }, t + 100000);
+    feed(analyzer, LUMP_FROM_DEVICE, message({ 0xD1, 0x01, 0x00, 0x02, 0x00 }), t + 100700);
+    CHECK(analyzer.latencies(9).count() == 2);
+
+    // Write query of the hub: EXT_MODE + DATA
+    feed(analyzer, LUMP_FROM_HUB, message({ 0x46, 0x00 }), t + 150000);
+    feed(analyzer, LUMP_FROM_HUB, message({ 0xC5, 0x03 }), t + 150000);
+    CHECK(analyzer.getWrites() == 1);
+    CHECK(analyzer.getExtModePairs() == 2);
+
+    CHECK(analyzer.parser(LUMP_FROM_HUB).checksumErrors == 0);
+    CHECK(analyzer.parser(LUMP_FROM_DEVICE).checksumErrors == 0);
+    CHECK(analyzer.parser(LUMP_FROM_DEVICE).frames == 103);
+}
+
+
+/**
+ * @brief Histogram: exact small values, bounded error, no growth with the samples.
+ */
+static void testHistogram() {
+    const uint32_t values[] = { 0, 1, 127, 128, 129, 255, 256, 1000, 65535, 65536,
+                                99999, 1U << 31, UINT32_MAX - 1 };
+    for (uint32_t value : values) {
+        LatencyStats stats;
+        stats.add(value);
+        stats.add(UINT32_MAX);
+        // Rank 1: the bucket of the value
+        CHECK(roundedUp(stats.percentile(50), value));
+        if (value < 128)
+            CHECK(stats.percentile(50) == value);
+        CHECK(stats.percentile(100) == UINT32_MAX);
+    }
+
+    LatencyStats stats;
+    for (uint32_t i = 0; i < 1000000; i++)
+        stats.add(1000 + i % 1000);
+    CHECK(stats.count() == 1000000);
+    CHECK(stats.max() == 1999);
+    CHECK(stats.mean() == 1499.5);
+    CHECK(roundedUp(stats.percentile(50), 1499));
+    CHECK(sizeof(LatencyStats) < 8192);
+}
+
+
+int main() {
+    testParser();
+    testHandshake();
+    testStatistics();
+    testHistogram();
+
+    return checkReport();
+}
@@ -0,0 +1,353 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of LumpBridge between an emulated device and hub.
+ *
+ *    Both UARTs are UartEventSerial host backends; the time is simulated
+ *    (process() is called every 50µs of simulated time).
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <cstdio>
+#include <vector>
+
+#include "check.h"
+#include "LumpBridge.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+static unsigned long now_us = 0;
+
+unsigned long millis() {
+    return now_us / 1000;
+}
+
+unsigned long micros() {
+    return now_us;
+}
+
+void delay(unsigned long ms) {
+    now_us += ms * 1000;
+}
+
+
+static Bytes frame(std::initializer_list<uint8_t> bytes) {
+    Bytes   ret(bytes);
+    uint8_t checksum = 0xFF;
+    for (uint8_t byte : ret)
+        checksum ^= byte;
+    ret.push_back(checksum);
+    return ret;
+}
+
+static void append(Bytes& out, const Bytes& bytes) {
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+static void inject(UartEventSerial& serial, const Bytes& bytes) {
+    serial.injectRx(bytes.data(), bytes.size());
+}
+
+
+/**
+ * @brief Init sequence of a device with the given number of modes:
+ *      type 0x25, 115200 bauds, NAME & FORMAT of each mode, then ACK.
+ */
+static Bytes deviceInit(uint8_t modes) {
+    Bytes init;
+    append(init, frame({ 0x40, 0x25 }));
+    if (modes > 8)
+        append(init, frame({ 0x51, 0x07, 0x07, _(uint8_t)(modes - 1), _(uint8_t)(modes - 1) }));
+    else
+        append(init, frame({ 0x49, _(uint8_t)(modes - 1), _(uint8_t)(modes - 1) }));
+    append(init, frame({ 0x52, 0x00, 0xC2, 0x01, 0x00 }));
+    append(init, frame({ 0x5F, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x10 }));
+    for (int mode = modes - 1; mode >= 0; mode--) {
+        const uint8_t plus8 = (mode >= 8) ? 0x20 : 0;
+        const uint8_t header = 0x80 | (mode & 0x07);
+        append(init, frame({ _(uint8_t)(header | 0x10), plus8, 'M', 'O', 'D', 'E' }));
+        append(init, frame({ _(uint8_t)(header | 0x10), _(uint8_t)(0x80 | plus8), 0x01, 0x00, 0x03, 0x00 }));
+    }
+    init.push_back(0x04);
+    return init;
+}
+
+
+/**
+ * @brief Split a stream into frames; checksums are checked.
+ */
+static std::vector<Bytes> splitFrames(const Bytes& stream) {
+    std::vector<Bytes> frames;
+    size_t             pos = 0;
+    while (pos < stream.size()) {
+        const uint8_t header = stream[pos];
+        size_t        size   = 1;
+        if ((header & 0xC0) != 0) {
+            size = (1 << ((header >> 3) & 0x07)) + 2 + (((header & 0xC0) == 0x80) ? 1 : 0);
+        }
+        if (pos + size > stream.size())
+            break;
+        Bytes current(stream.begin() + pos, stream.begin() + pos + size);
+        if (size > 1) {
+            uint8_t checksum = 0xFF;
+            for (size_t i = 0; i < size - 1; i++)
+                checksum ^= current[i];
+            CHECK(checksum == current.back());
+        }
+        frames.push_back(current);
+        pos += size;
+    }
+    CHECK(pos == stream.size());
+    return frames;
+}
+
+
+// Added mode: 2 int16 values; the hub writes 1 int16
+static const LumpModeInfo distanceMode = {
+    "DIST MM", { 0, 2000 }, { 0, 100 }, { 0, 2000 }, "MM",
+    0x10, 0x10, 2, LUMP_DATA_TYPE_DATA16, 4, 0
+};
+static uint16_t distance = 0x1234;
+static Bytes    written;
+
+static uint8_t readDistance(uint8_t *payload) {
+    payload[0] = distance & 0xFF;
+    payload[1] = distance >> 8;
+    payload[2] = 0x56;
+    payload[3] = 0x78;
+    return 4;
+}
+
+static void writeDistance(const uint8_t *payload, uint8_t size) {
+    written.assign(payload, payload + size);
+}
+
+
+struct Session {
+    UartEventSerial device;
+    UartEventSerial hub;
+    LumpBridge      bridge;
+
+    Session() : bridge(device, hub) {
+        bridge.addMode(&distanceMode, readDistance, writeDistance);
+    }
+
+    void run(unsigned long duration_us) {
+        for (unsigned long end = now_us + duration_us; now_us < end; now_us += 50)
+            bridge.process();
+    }
+
+    /**
+     * @brief Handshakes with both sides.
+     * @return Init sequence received by the hub.
+     */
+    Bytes connect(uint8_t modes) {
+        run(1000);
+        CHECK(bridge.getState() == LumpBridge::BRIDGE_DEVICE_SYNC);
+        // Noise & an incomplete sequence: the device repeats its sequence
+        // until it is acknowledged
+        inject(device, { 0x00, 0x12, 0x40, 0x25 });
+        inject(device, deviceInit(modes));
+        inject(device, deviceInit(modes));
+        run(1000);
+        CHECK(bridge.getState() == LumpBridge::BRIDGE_HUB_SYNC);
+        CHECK(bridge.getDeviceType() == 0x25);
+        CHECK(bridge.getDeviceModes() == modes);
+        CHECK(device.takeTx() == Bytes({ 0x04 }));
+
+        // ~4ms per byte at 2400 bauds; the device is kept alive meanwhile
+        Bytes  sequence;
+        size_t nacks = 0;
+        for (int i = 0; i < 50; i++) {
+            run(100000);
+            Bytes received = hub.takeTx();
+            nacks += device.takeTx().size();
+            inject(device, frame({ 0xC0, 0x00 }));
+            if (received.empty() && !sequence.empty())
+                // Waiting for the ACK of the hub
+                break;
+            append(sequence, received);
+        }
+        CHECK(nacks >= 5);
+        CHECK(!sequence.empty() && sequence.back() == 0x04);
+        CHECK(bridge.getState() == LumpBridge::BRIDGE_HUB_SYNC);
+
+        const Bytes ack = { 0x04 };
+        inject(hub, ack);
+        run(1000);
+        CHECK(bridge.isConnected());
+        device.takeTx();
+        hub.takeTx();
+        sequence.pop_back();
+        return sequence;
+    }
+
+    /**
+     * @brief NACK of the hub & response of the device.
+     * @return Bytes received by the hub.
+     */
+    Bytes nack(const Bytes& response) {
+        inject(hub, { 0x02 });
+        run(100);
+        CHECK(device.takeTx() == Bytes({ 0x02 }));
+        inject(device, response);
+        run(100);
+        return hub.takeTx();
+    }
+};
+
+
+/**
+ * @brief The hub receives the sequence of the device with the added mode.
+ */
+static void testInitSequence() {
+    now_us = 0;
+    Session session;
+    Bytes   sequence = session.connect(2);
+
+    std::vector<Bytes> frames = splitFrames(sequence);
+    Bytes expected = deviceInit(2);
+    expected.pop_back();
+    std::vector<Bytes> deviceFrames = splitFrames(expected);
+
+    // TYPE, MODES (3 modes), SPEED, VERSION, INFO of the mode 2, INFO of the device
+    CHECK(frames.size() == deviceFrames.size() + 7);
+    CHECK(frames[0] == deviceFrames[0]);
+    CHECK(frames[1] == frame({ 0x49, 0x02, 0x01 }));
+    CHECK(frames[2] == deviceFrames[2]);
+    CHECK(frames[3] == deviceFrames[3]);
+    // Name padded to 8 bytes
+    CHECK(frames[4] == frame({ 0x9A, 0x00, 'D', 'I', 'S', 'T', ' ', 'M', 'M', 0x00 }));
+    CHECK(frames[5][0] == 0x9A && frames[5][1] == LUMP_INFO_RAW);
+    CHECK(frames[8] == frame({ 0x92, 0x04, 'M', 'M', 0x00, 0x00 }));
+    CHECK(frames[9] == frame({ 0x8A, 0x05, 0x10, 0x10 }));
+    CHECK(frames[10] == frame({ 0x92, 0x80, 0x02, 0x01, 0x04, 0x00 }));
+    for (size_t i = 4; i < deviceFrames.size(); i++)
+        CHECK(frames[i + 7] == deviceFrames[i]);
+}
+
+
+/**
+ * @brief Frames forwarded in both directions; added mode selected,
+ *      read & written; EXT_MODE inserted for the hub.
+ */
+static void testForwarding() {
+    now_us = 0;
+    Session session;
+    // 8 modes: the added mode is mode 8 (extended)
+    Bytes sequence = session.connect(8);
+    std::vector<Bytes> frames = splitFrames(sequence);
+    CHECK(frames[1] == frame({ 0x51, 0x07, 0x07, 0x08, 0x07 }));
+    CHECK(frames[4][0] == 0x98 && frames[4][1] == (LUMP_INFO_NAME | LUMP_INFO_MODE_PLUS_8));
+
+    // Data of the device
+    Bytes data = frame({ 0xC0, 0x05 });
+    CHECK(session.nack(data) == data);
+
+    // Select of a mode of the device
+    Bytes select = frame({ 0x43, 0x01 });
+    inject(session.hub, select);
+    session.run(100);
+    CHECK(session.device.takeTx() == select);
+    CHECK(session.bridge.getSelectedMode() == 1);
+
+    // Cut-through: bytes are forwarded as they are received
+    Bytes rgb = frame({ 0xD1, 0x01, 0x02, 0x03, 0x04 });
+    for (size_t i = 0; i < rgb.size(); i++) {
+        inject(session.device, Bytes(1, rgb[i]));
+        session.run(50);
+        CHECK(session.hub.takeTx() == Bytes(1, rgb[i]));
+    }
+
+    // Added mode: answered by the bridge, device data dropped
+    inject(session.hub, frame({ 0x43, 0x08 }));
+    session.run(100);
+    CHECK(session.device.takeTx().empty());
+    Bytes expected = frame({ 0x46, 0x08 });
+    append(expected, frame({ 0xD0, 0x34, 0x12, 0x56, 0x78 }));
+    CHECK(session.hub.takeTx() == expected);
+    CHECK(session.nack(frame({ 0xC1, 0x09 })) == expected);
+
+    // Write to the added mode: nothing for the device
+    Bytes write = frame({ 0x46, 0x08 });
+    append(write, frame({ 0xC8, 0x2A, 0x00 }));
+    inject(session.hub, write);
+    session.run(100);
+    CHECK(written == Bytes({ 0x2A, 0x00 }));
+    CHECK(session.device.takeTx().empty());
+
+    // Write to a mode of the device: forwarded
+    write = frame({ 0x46, 0x00 });
+    append(write, frame({ 0xC5, 0x03 }));
+    inject(session.hub, write);
+    session.run(100);
+    CHECK(session.device.takeTx() == write);
+
+    // Back to a mode of the device: the hub is told its EXT_MODE is 0 again
+    inject(session.hub, frame({ 0x43, 0x01 }));
+    session.run(100);
+    session.device.takeTx();
+    expected = frame({ 0x46, 0x00 });
+    append(expected, frame({ 0xC1, 0x07 }));
+    CHECK(session.nack(frame({ 0xC1, 0x07 })) == expected);
+
+    // The EXT_MODE messages of the device are forwarded
+    data = frame({ 0x46, 0x08 });
+    append(data, frame({ 0xD0, 0x01, 0x02, 0x03, 0x04 }));
+    CHECK(session.nack(data) == data);
+
+    // Latencies: 1 or 2 calls of process() (50µs each)
+    BridgeLatencyStats toHub    = session.bridge.getLatencyStats(LumpBridge::BRIDGE_TO_HUB);
+    BridgeLatencyStats toDevice = session.bridge.getLatencyStats(LumpBridge::BRIDGE_TO_DEVICE);
+    CHECK(toHub.count >= 5);
+    CHECK(toDevice.count >= 7);
+    CHECK(toHub.maxUs <= 100);
+    CHECK(toDevice.maxUs <= 100);
+    CHECK(toHub.buckets[0] + toHub.buckets[1] + toHub.buckets[2] == toHub.count);
+}
+
+
+/**
+ * @brief Timeouts: the hub is reconnected, then the device.
+ */
+static void testDisconnections() {
+    now_us = 0;
+    Session session;
+    session.connect(2);
+
+    // No NACK from the hub: new init sequence for the hub
+    for (int i = 0; i < 4; i++) {
+        session.run(100000);
+        inject(session.device, frame({ 0xC0, 0x00 }));
+    }
+    CHECK(session.bridge.getState() == LumpBridge::BRIDGE_HUB_SYNC);
+    // The device is kept alive
+    CHECK(!session.device.takeTx().empty());
+
+    // Silent device: back to its init sequence
+    session.run(600000);
+    CHECK(session.bridge.getState() == LumpBridge::BRIDGE_DEVICE_SYNC);
+}
+
+
+int main() {
+    testInitSequence();
+    testForwarding();
+    testDisconnections();
+
+    return checkReport();
+}
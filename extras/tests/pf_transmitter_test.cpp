@@ -0,0 +1,375 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of PFTransmitter: waveform, repeat schedule & queue.
+ *
+ *    Built with -D__AVR__ against the fake registers of extras/tests/fake_avr;
+ *    the test plays the role of Timer1 by calling the interrupt handlers:
+ *    the overflow handler once per carrier period while it is enabled, the
+ *    compare handler at the end of the gaps. The state of the carrier
+ *    (COM1A1) is sampled at each period, then decoded.
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <cstdio>
+#include <vector>
+
+#include <avr/interrupt.h>
+
+#include "check.h"
+#include "PFTransmitter.h"
+
+FakeRegister     TWCR = { 0, nullptr };
+FakeRegister     TWDR = { 0, nullptr };
+volatile uint8_t TWSR, TWBR, SREG;
+volatile uint8_t  TCCR1A, TCCR1B, TIMSK1, TIFR1, DDRB, PORTB;
+volatile uint16_t TCNT1, OCR1A, ICR1;
+
+// Virtual clock (µs), advanced by run()
+static double now = 0;
+unsigned long millis() { return _(unsigned long)(now / 1000); }
+unsigned long micros() { return _(unsigned long)(now); }
+void delay(unsigned long ms) { now += ms * 1000.0; }
+
+extern "C" void TIMER1_OVF_vect(void);
+extern "C" void TIMER1_COMPA_vect(void);
+
+/**
+ * @brief Decoded frame: bits & start time (µs since the call of send()).
+ */
+struct Frame {
+    double   start;
+    uint16_t bits;
+    bool     valid;
+};
+
+static const double PERIOD_US = 1e6 / PF_CARRIER_FREQUENCY;
+static const double TICK_US   = 1024 * 1e6 / F_CPU;
+
+
+/**
+ * @brief Decode the samples of a frame (1 per carrier period).
+ */
+static Frame decode(const std::vector<bool>& samples) {
+    Frame  frame = { 0, 0, false };
+    // Lengths of the runs: mark, space, mark, space...
+    std::vector<int> runs;
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (i == 0 || samples[i] != samples[i - 1])
+            runs.push_back(0);
+        runs.back()++;
+    }
+    if (runs.size() != 36)
+        return frame;
+    for (size_t i = 0; i < runs.size(); i += 2) {
+        if (runs[i] != PF_MARK_PERIODS)
+            return frame;
+    }
+    if (runs[1] != PF_START_STOP_PERIODS || runs[35] != PF_START_STOP_PERIODS)
+        return frame;
+    for (int bit = 0; bit < 16; bit++) {
+        int space = runs[3 + 2 * bit];
+        if (space != PF_LOW_PERIODS && space != PF_HIGH_PERIODS)
+            return frame;
+        frame.bits = _(uint16_t)((frame.bits << 1) | (space == PF_HIGH_PERIODS));
+    }
+    frame.valid = true;
+    return frame;
+}
+
+
+/**
+ * @brief Run the timer until the transmitter is idle.
+ * @param sendAt Optional: send this message at the given frame index,
+ *      in the middle of the frame.
+ */
+static std::vector<Frame> run(int sendAt = -1, uint16_t message = 0) {
+    std::vector<Frame> frames;
+    now = 0;
+
+    for (int guard = 0; PFIRTransmitter.isBusy() && guard < 200; guard++) {
+        if (TIMSK1 & _BV(OCIE1A)) {
+            // Gap: prescaler 1024, 1 interrupt
+            CHECK(TCCR1B == (_BV(WGM12) | _BV(CS12) | _BV(CS10)));
+            now += OCR1A * TICK_US;
+            TIMER1_COMPA_vect();
+            continue;
+        }
+        CHECK(TIMSK1 == _BV(TOIE1));
+        CHECK(ICR1 == F_CPU / PF_CARRIER_FREQUENCY - 1);
+        std::vector<bool> samples;
+        double            start = now;
+        while (TIMSK1 == _BV(TOIE1)) {
+            samples.push_back(TCCR1A & _BV(COM1A1));
+            now += PERIOD_US;
+            TIMER1_OVF_vect();
+            if (_(int)(frames.size()) == sendAt && samples.size() == 100)
+                PFIRTransmitter.send(message);
+        }
+        // Trailing space of the stop bit is the last run
+        Frame frame = decode(samples);
+        frame.start = start;
+        frames.push_back(frame);
+    }
+    CHECK(!PFIRTransmitter.isBusy());
+    CHECK(TIMSK1 == 0);
+    return frames;
+}
+
+
+/**
+ * @brief LRC of known messages (PF RC protocol v1.20).
+ */
+static void testEncode() {
+    // Combo PWM, channel 1: red float, blue float: 0x4 0x0 0x0 LRC 0xB
+    CHECK(PFTransmitter::encode(0x4000) == 0x400B);
+    // Single output, channel 2, output A forward step 1: 0x1 0x4 0x1 LRC 0xB
+    CHECK(PFTransmitter::encode(0x1410) == 0x141B);
+    // A wrong LRC given by the hub is replaced
+    CHECK(PFTransmitter::encode(0x1415) == 0x141B);
+    CHECK(PFTransmitter::getChannel(0x0000) == 1);
+    CHECK(PFTransmitter::getChannel(0x3000) == 4);
+}
+
+
+/**
+ * @brief 5 frames with the channel dependent schedule.
+ */
+static void testSchedule() {
+    for (uint8_t channel = 0; channel < 4; channel++) {
+        const uint16_t message = _(uint16_t)(0x0420 | (channel << 12));
+        const uint16_t frame   = PFTransmitter::encode(message);
+
+        PFIRTransmitter.begin();
+        PFIRTransmitter.send(message);
+        CHECK(PFIRTransmitter.isBusy());
+        std::vector<Frame> frames = run();
+
+        CHECK(frames.size() == PF_REPEATS);
+        double previous = 0;
+        for (size_t i = 0; i < frames.size(); i++) {
+            CHECK(frames[i].valid);
+            CHECK(frames[i].bits == frame);
+            // Start to start delays, within 1%
+            double expected = PFTransmitter::getRepeatDelay(frame, _(uint8_t)(i)) * 1000.0;
+            double delay    = frames[i].start - previous;
+            if (delay < expected * 0.99 - 30 || delay > expected * 1.01 + 30) {
+                fprintf(stderr, "channel %u, frame %u: %.0fus instead of %.0fus\n",
+                        channel + 1, _(unsigned)(i), delay, expected);
+                CHECK(false);
+            }
+            previous = frames[i].start;
+        }
+    }
+}
+
+
+/**
+ * @brief Send messages at t = 0 (the clock is reset by run()).
+ */
+static void sendAll(const uint16_t *messages, size_t count) {
+    now = 0;
+    PFIRTransmitter.begin();
+    PFIRTransmitter.resetStats();
+    for (size_t i = 0; i < count; i++)
+        PFIRTransmitter.send(messages[i]);
+}
+
+
+static size_t countFrames(const std::vector<Frame>& frames, uint16_t message) {
+    size_t count = 0;
+    for (const Frame& frame : frames)
+        count += (frame.valid && frame.bits == PFTransmitter::encode(message));
+    return count;
+}
+
+
+/**
+ * @brief Outputs driven by the modes of the protocol.
+ */
+static void testTargets() {
+    // Single output PWM (mode 1MO): A, B
+    CHECK(PFCommandQueue::getTarget(0x0420) == PFCommandQueue::PF_OUTPUT_A);
+    CHECK(PFCommandQueue::getTarget(0x0530) == PFCommandQueue::PF_OUTPUT_B);
+    // Single output clear/set/toggle (mode 11O)
+    CHECK(PFCommandQueue::getTarget(0x0710) == PFCommandQueue::PF_OUTPUT_B);
+    // Combo direct (mode 001) & combo PWM (escape)
+    CHECK(PFCommandQueue::getTarget(0x0150) == PFCommandQueue::PF_BOTH_OUTPUTS);
+    CHECK(PFCommandQueue::getTarget(0x4770) == PFCommandQueue::PF_BOTH_OUTPUTS);
+    // Extended mode: increment A, toggle B, toggle address bit
+    CHECK(PFCommandQueue::getTarget(0x0010) == PFCommandQueue::PF_OUTPUT_A);
+    CHECK(PFCommandQueue::getTarget(0x0040) == PFCommandQueue::PF_OUTPUT_B);
+    CHECK(PFCommandQueue::getTarget(0x0060) == PFCommandQueue::PF_BOTH_OUTPUTS);
+}
+
+
+/**
+ * @brief A new message replaces the repeats of the current one.
+ */
+static void testLatestWins() {
+    PFIRTransmitter.begin();
+    PFIRTransmitter.resetStats();
+    PFIRTransmitter.send(0x0420);
+    std::vector<Frame> frames = run(1, 0x0450);
+
+    // 2 frames of the 1st message (the 2nd one is completed), then 5 of the new one
+    CHECK(frames.size() == 2 + PF_REPEATS);
+    for (size_t i = 0; i < frames.size(); i++) {
+        CHECK(frames[i].valid);
+        CHECK(frames[i].bits == PFTransmitter::encode((i < 2) ? 0x0420 : 0x0450));
+    }
+    PFQueueStats stats = PFIRTransmitter.getStats();
+    CHECK(stats.received == 2);
+    CHECK(stats.coalesced == 0);
+    CHECK(stats.dropped == 1);
+}
+
+
+/**
+ * @brief A burst of commands for the same output is reduced to the last one.
+ */
+static void testCoalescing() {
+    uint16_t messages[10];
+    for (uint8_t i = 0; i < 10; i++)
+        messages[i] = _(uint16_t)(0x0400 | ((i % 7) << 4)); // Speed ramp, output A
+    sendAll(messages, 10);
+    std::vector<Frame> frames = run();
+
+    CHECK(frames.size() == PF_REPEATS);
+    CHECK(countFrames(frames, messages[9]) == PF_REPEATS);
+    PFQueueStats stats = PFIRTransmitter.getStats();
+    CHECK(stats.received == 10);
+    CHECK(stats.coalesced == 9);
+    CHECK(stats.dropped == 0);
+}
+
+
+/**
+ * @brief Relative commands are steps: none of them is coalesced.
+ */
+static void testRelative() {
+    CHECK(PFCommandQueue::isRelative(0x0010));  // Extended: increment A
+    CHECK(PFCommandQueue::isRelative(0x0740));  // Single output B: increment PWM
+    CHECK(!PFCommandQueue::isRelative(0x0760)); // Single output B: full forward
+    CHECK(!PFCommandQueue::isRelative(0x0420)); // Single output PWM
+    CHECK(!PFCommandQueue::isRelative(0x4010)); // Combo PWM
+
+    // 3 increments of output A (new commands: the toggle bit alternates)
+    const uint16_t increments[] = { 0x0010, 0x8010, 0x0010 };
+    sendAll(increments, 3);
+    std::vector<Frame> frames = run();
+
+    CHECK(frames.size() == 3 * PF_REPEATS);
+    for (size_t i = 0; i < frames.size(); i++) {
+        CHECK(frames[i].valid);
+        CHECK(frames[i].bits == PFTransmitter::encode(increments[i / PF_REPEATS]));
+    }
+    PFQueueStats stats = PFIRTransmitter.getStats();
+    CHECK(stats.received == 3);
+    CHECK(stats.coalesced == 0 && stats.dropped == 0 && stats.overflowed == 0);
+
+    // Absolute command, increment of the new speed, then a new absolute
+    // command: replaces both
+    const uint16_t messages[] = { 0x0420, 0x0640, 0x0450 };
+    sendAll(messages, 2);
+    frames = run();
+    CHECK(frames.size() == 2 * PF_REPEATS);
+    CHECK(frames[0].bits == PFTransmitter::encode(messages[0]));
+    CHECK(frames[PF_REPEATS].bits == PFTransmitter::encode(messages[1]));
+    sendAll(messages, 3);
+    frames = run();
+    CHECK(frames.size() == PF_REPEATS);
+    CHECK(countFrames(frames, messages[2]) == PF_REPEATS);
+    CHECK(PFIRTransmitter.getStats().coalesced == 2);
+}
+
+
+/**
+ * @brief Commands of different channels & outputs are all transmitted,
+ *      interleaved, with a bounded latency.
+ */
+static void testInterleaving() {
+    // Channel 1 output A & B, channel 3 output A
+    const uint16_t messages[] = { 0x0420, 0x0530, 0x2470 };
+    sendAll(messages, 3);
+    std::vector<Frame> frames = run();
+
+    CHECK(frames.size() == 3 * PF_REPEATS);
+    for (const uint16_t message : messages)
+        CHECK(countFrames(frames, message) == PF_REPEATS);
+    // Round-robin between the channels: never the same channel twice in a row
+    // while both are pending, then outputs A & B alternately on channel 1
+    for (size_t i = 1; i < 6; i++)
+        CHECK(PFTransmitter::getChannel(frames[i].bits) != PFTransmitter::getChannel(frames[i - 1].bits));
+    // At least 1 message time between the frames
+    for (size_t i = 1; i < frames.size(); i++)
+        CHECK(frames[i].start - frames[i - 1].start >= PF_MESSAGE_TIME * 1000 - 30);
+
+    // Latency: each command is transmitted among the first 4 frames
+    double latency = 0;
+    for (const uint16_t message : messages) {
+        size_t first = 0;
+        while (first < frames.size() && frames[first].bits != PFTransmitter::encode(message))
+            first++;
+        CHECK(first < 4);
+        if (first < frames.size() && frames[first].start > latency)
+            latency = frames[first].start;
+    }
+    PFQueueStats stats = PFIRTransmitter.getStats();
+    CHECK(stats.received == 3);
+    CHECK(stats.coalesced == 0 && stats.dropped == 0);
+    CHECK(stats.maxLatency == _(uint16_t)(latency / 1000));
+}
+
+
+/**
+ * @brief A command for both outputs replaces the pending commands of A & B.
+ */
+static void testBothOutputs() {
+    // Channel 2: output A, output B, then combo direct (A forward, B backward)
+    const uint16_t messages[] = { 0x1420, 0x1530, 0x1190 };
+    sendAll(messages, 3);
+    std::vector<Frame> frames = run();
+
+    CHECK(frames.size() == PF_REPEATS);
+    CHECK(countFrames(frames, messages[2]) == PF_REPEATS);
+    PFQueueStats stats = PFIRTransmitter.getStats();
+    CHECK(stats.received == 3);
+    CHECK(stats.coalesced == 2);
+
+    // A single output command received during the repeats waits for them
+    PFIRTransmitter.begin();
+    PFIRTransmitter.send(messages[2]);
+    frames = run(1, 0x1420);
+    CHECK(frames.size() == 2 * PF_REPEATS);
+    for (size_t i = 0; i < frames.size(); i++)
+        CHECK(frames[i].bits == PFTransmitter::encode((i < PF_REPEATS) ? messages[2] : 0x1420));
+}
+
+
+int main() {
+    testEncode();
+    testSchedule();
+    testTargets();
+    testLatestWins();
+    testCoalescing();
+    testRelative();
+    testInterleaving();
+    testBothOutputs();
+
+    return checkReport();
+}
@@ -0,0 +1,122 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of the section profiler: scopes, stats, histogram & dump.
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <cstdio>
+#include <string>
+
+#include "check.h"
+#include "Arduino.h"
+#include "utilities/profiler.hpp"
+
+// Virtual clock (µs)
+static unsigned long now = 0;
+unsigned long millis() { return now / 1000; }
+unsigned long micros() { return now; }
+void delay(unsigned long ms) { now += ms * 1000; }
+
+/**
+ * @brief Stream keeping the printed text.
+ */
+struct FakeSerial {
+    std::string text;
+
+    void print(const char *str) { text += str; }
+    void print(unsigned long value) { text += std::to_string(value); }
+    void println() { text += "\n"; }
+    void println(unsigned long value) { text += std::to_string(value) + "\n"; }
+};
+
+// Sections with static storage, as in a sketch
+ProfileSection sensorsProfile("sensors");
+ProfileSection processProfile("process");
+
+
+/**
+ * @brief Time a section lasting the given duration.
+ */
+static void runSection(ProfileSection& section, unsigned long duration) {
+    MOB_PROFILE(section);
+    now += duration;
+}
+
+
+/**
+ * @brief Durations recorded by the scopes, min/max & buckets.
+ */
+static void testStats() {
+    runSection(sensorsProfile, 3);
+    runSection(sensorsProfile, 100);
+    runSection(sensorsProfile, 120);
+    runSection(sensorsProfile, 0);
+
+    const ProfileStats& stats = sensorsProfile.getStats();
+    CHECK(stats.count == 4);
+    CHECK(stats.min == 0);
+    CHECK(stats.max == 120);
+    // [0; 2[, [2; 4[, [64; 128[
+    CHECK(stats.buckets[0] == 1);
+    CHECK(stats.buckets[1] == 1);
+    CHECK(stats.buckets[6] == 2);
+
+    // Durations beyond the last bucket are kept in it
+    runSection(processProfile, 1UL << 20);
+    CHECK(processProfile.getStats().buckets[MOB_PROFILER_BUCKETS - 1] == 1);
+    CHECK(processProfile.getStats().max == 1UL << 20);
+
+    // 2 scopes in the same block
+    {
+        MOB_PROFILE(sensorsProfile);
+        MOB_PROFILE(processProfile);
+        now += 10;
+    }
+    CHECK(sensorsProfile.getStats().count == 5);
+    CHECK(processProfile.getStats().count == 2);
+}
+
+
+/**
+ * @brief Sections are chained in their declaration order; dump & reset.
+ */
+static void testDump() {
+    CHECK(ProfileSection::first() == &sensorsProfile);
+    CHECK(sensorsProfile.getNext() == &processProfile);
+    CHECK(processProfile.getNext() == nullptr);
+
+    FakeSerial serial;
+    ProfileSection::dumpAll(serial);
+    CHECK(serial.text.find("sensors: count 5, min (us) 0, max (us) 120\n") == 0);
+    CHECK(serial.text.find("  < 128 us: 2\n") != std::string::npos);
+    CHECK(serial.text.find("  < inf us: 1\n") != std::string::npos);
+
+    ProfileSection::resetAll();
+    serial.text.clear();
+    ProfileSection::dumpAll(serial);
+    CHECK(serial.text == "sensors: count 0\nprocess: count 0\n");
+    CHECK(sensorsProfile.getStats().min == 0xFFFFFFFF);
+}
+
+
+int main() {
+    testStats();
+    testDump();
+
+    return checkReport();
+}
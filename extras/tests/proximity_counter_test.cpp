@@ -0,0 +1,208 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of the detection counter of the Color & Distance sensor:
+ *      hysteresis of ProximityCounter & mode 2 frame sent to the hub.
+ *    Built with COLOR_DISTANCE_COUNTER against the simulation (see
+ *    extras/host/simulation.h).
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "simulation.h"
+#include "ColorDistanceSensor.h"
+
+#define RX_PIN    0
+
+
+/**
+ * @brief One detection per object, whatever the jitter around the thresholds.
+ */
+static void testHysteresis() {
+    ProximityCounter counter(50, 60);
+    CHECK(counter.count() == 0);
+
+    // Object approaching with jitter around the near threshold
+    const uint16_t approach[] = { 200, 120, 70, 52, 49, 51, 48, 50, 55, 40 };
+    uint8_t detections = 0;
+    for (uint16_t distance : approach)
+        detections += counter.update(distance);
+    CHECK(detections == 1);
+    CHECK(counter.isNear());
+    CHECK(counter.count() == 1);
+
+    // Leaves slowly: still near until the far threshold is exceeded
+    CHECK(!counter.update(59));
+    CHECK(!counter.update(60));
+    CHECK(counter.isNear());
+    CHECK(!counter.update(61));
+    CHECK(!counter.isNear());
+    CHECK(!counter.update(55)); // Between the thresholds: not a detection
+
+    // Lost target then a new object
+    CHECK(!counter.update(PROXIMITY_COUNTER_FAR));
+    CHECK(counter.update(30));
+    CHECK(counter.count() == 2);
+
+    counter.reset();
+    CHECK(counter.count() == 0);
+    CHECK(!counter.isNear());
+}
+
+
+/**
+ * @brief The count read concurrently is never torn: a producer thread counts
+ *      while the consumer checks that the values only increase.
+ */
+static void testConcurrentReads() {
+    ProximityCounter counter(50, 60);
+    const uint32_t   objects = 200000;
+
+    std::thread producer([&counter, objects]() {
+        for (uint32_t i = 0; i < objects; i++) {
+            counter.update(10);
+            counter.update(PROXIMITY_COUNTER_FAR);
+        }
+    });
+    uint32_t previous  = 0;
+    bool     monotonic = true;
+    while (previous < objects) {
+        const uint32_t count = counter.count();
+        if (count < previous || count > objects)
+            monotonic = false;
+        previous = count;
+        if (!monotonic)
+            break;
+    }
+    producer.join();
+    CHECK(monotonic);
+    CHECK(counter.count() == objects);
+}
+
+
+// Model of the hub: ACK of the init sequence, then the bytes received
+static bool                 hubConnected;
+static std::vector<uint8_t> hubRx;
+
+static void hubTick() {
+    Sim.setPin(RX_PIN, HIGH);
+    const std::vector<uint8_t> tx = Serial.takeTx();
+    if (hubConnected) {
+        hubRx.insert(hubRx.end(), tx.begin(), tx.end());
+        return;
+    }
+    // End of the init sequence (last byte at 2400 bauds)
+    if (!tx.empty() && tx.back() == 0x04 && Serial.getBaud() == 2400) {
+        const uint8_t ack = 0x04;
+        Serial.injectRx(&ack, 1);
+        hubConnected = true;
+    }
+}
+
+
+/**
+ * @brief Query of mode 2 by a connected hub.
+ * @return Count sent by the sensor (below 256); -1 if the frame is wrong.
+ */
+static int queryCount(ColorDistanceSensor& sensor) {
+    const uint8_t query[] = { 0x43, 0x02, 0xFF ^ 0x43 ^ 0x02 };
+    hubRx.clear();
+    Serial.injectRx(query, sizeof(query));
+    sensor.process();
+    Sim.advance(MOB_SIM_STEP_US);
+
+    // Last frame: header, count (Little-Endian), checksum
+    if (hubRx.size() < 6)
+        return -1;
+    const uint8_t *frame = &hubRx[hubRx.size() - 6];
+    const uint8_t  expected[] = { 0xD2, frame[1], 0x00, 0x00, 0x00, _(uint8_t)(0xFF ^ 0xD2 ^ frame[1]) };
+    return std::equal(expected, expected + sizeof(expected), frame) ? frame[1] : -1;
+}
+
+
+/**
+ * @brief Query of mode 2 by the hub: 1 int32 in a DATA message of size 4
+ *      (header 0xD2), read from the bound counter, the bound value or
+ *      the owned value.
+ */
+static void testModeFrame() {
+    ColorDistanceSensor sensor;
+    ProximityCounter    counter(50, 60);
+
+    Sim.reset();
+    Sim.setTickCallback(hubTick);
+    hubConnected = false;
+    while (!sensor.isConnected() && Sim.now() < 10000000)
+        sensor.process();
+    CHECK(sensor.isConnected());
+
+    // Count above 16 bits
+    for (uint32_t i = 0; i < 70000; i++) {
+        counter.update(10);
+        counter.update(100);
+    }
+    sensor.setDetectionCounter(&counter);
+
+    // Get value of mode 2: header, mode, checksum
+    const uint8_t query[] = { 0x43, 0x02, 0xFF ^ 0x43 ^ 0x02 };
+    hubRx.clear();
+    Serial.injectRx(query, sizeof(query));
+    sensor.process();
+    Sim.advance(MOB_SIM_STEP_US);
+
+    // Frame after the EXT_MODE message
+    const uint8_t expected[] = {
+        0xD2, 0x70, 0x11, 0x01, 0x00, // 70000, Little-Endian
+        0xFF ^ 0xD2 ^ 0x70 ^ 0x11 ^ 0x01,
+    };
+    CHECK(hubRx.size() >= sizeof(expected));
+    if (hubRx.size() >= sizeof(expected))
+        CHECK(std::equal(expected, expected + sizeof(expected), hubRx.end() - sizeof(expected)));
+
+    // Without counter: the owned value
+    sensor.setDetectionCounter(nullptr);
+    sensor.setDetectionCount(3);
+    CHECK(queryCount(sensor) == 3);
+
+    // Bound value: sent instead of the owned one
+    uint32_t external = 5;
+    sensor.setSensorDetectionCount(&external);
+    CHECK(queryCount(sensor) == 5);
+    sensor.setSensorDetectionCount(nullptr);
+    CHECK(queryCount(sensor) == 3);
+
+    // A copy sends its own values
+    ColorDistanceSensor copy(sensor);
+    sensor.setDetectionCount(4);
+    CHECK(queryCount(copy) == 3);
+    CHECK(queryCount(sensor) == 4);
+    Sim.setTickCallback(nullptr);
+}
+
+
+int main() {
+    testHysteresis();
+    testConcurrentReads();
+    testModeFrame();
+
+    return checkReport();
+}
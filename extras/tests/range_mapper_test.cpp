@@ -0,0 +1,88 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of RangeMapper against the float equation it replaces,
+ *      with the coefficients of the examples.
+ *
+ *    The coefficients are also rounded to 32 bits floats before their
+ *    conversion, like the literals on AVR where double is a float.
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <cmath>
+#include <cstdio>
+
+#include "check.h"
+#include "Arduino.h"
+#include "utilities/range_mapper.hpp"
+
+
+/**
+ * @brief Compare the mapper with the equation y = ax + b, truncated and
+ *      clamped to 0-100 (former float implementation of the examples).
+ *
+ *    Identical results for 8 bits raw values; for 16 bits raw values, the
+ *    results can only differ by 1 where ax + b is an integer, within the
+ *    rounding of the fixed-point coefficients (1/2 LSB each, i.e.
+ *    (raw + 1) / 2^(shift + 1)) and of the float coefficients on AVR.
+ */
+template <typename Mapper>
+static void checkMapper(const char *name, double a_coef, double b_coef) {
+    const double lsb        = 1.0 / (1L << mobFixedShift(a_coef, b_coef));
+    unsigned     mismatches = 0;
+
+    for (uint32_t raw = 0; raw <= 65535; raw++) {
+        const double value    = a_coef * raw + b_coef;
+        const long   expected = (value > 100) ? 100 : (value < 0) ? 0 : _(long)(value);
+        const long   mapped   = Mapper::map(_(uint16_t)(raw));
+        if (mapped == expected)
+            continue;
+
+        mismatches++;
+        const double rounding   = (raw + 1) * lsb / 2 + 1e-5;
+        const bool   atBoundary = fabs(value - lround(value)) <= rounding && labs(mapped - expected) == 1;
+        if (raw <= 255 || !atBoundary) {
+            fprintf(stderr, "%s: raw %u, mapped %ld, expected %ld (%f)\n",
+                    name, _(unsigned)(raw), mapped, expected, value);
+            CHECK(false);
+        }
+    }
+    printf("%s: %u boundary mismatches\n", name, mismatches);
+}
+
+// Host (double) and AVR (float) conversions of the coefficients
+#define CHECK_COEFFICIENTS(a_coef, b_coef)                                      \
+    checkMapper<MOB_RANGE_MAPPER(a_coef, b_coef)>(#a_coef ", " #b_coef,         \
+                                                  a_coef, b_coef);               \
+    checkMapper<MOB_RANGE_MAPPER(_(float)(a_coef), _(float)(b_coef))>(          \
+        "float " #a_coef ", " #b_coef, a_coef, b_coef)
+
+
+int main() {
+    // LUX_TO_PERCENTAGE
+    CHECK_COEFFICIENTS(0.0105, -0.0843);
+    // REFLECTED_LIGHT_TO_PERCENTAGE
+    CHECK_COEFFICIENTS(0.0017, -8);
+    // DISTANCE_TO_PERCENTAGE
+    CHECK_COEFFICIENTS(0.543, -8.152);
+    // ALS_TO_PERCENTAGE (DIST_ALS_INTEGRATION_TIME: 50ms)
+    CHECK_COEFFICIENTS(0.0105 * 0.32 * 100 / 50, -0.0843);
+    // Scaling 2 of the VL6180X (see initDistSensor())
+    CHECK_COEFFICIENTS(0.3401, -5.4422);
+
+    return checkReport();
+}
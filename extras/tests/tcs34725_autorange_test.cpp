@@ -0,0 +1,199 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of TCS34725AutoRange against a model of the sensor.
+ *
+ *    The model returns the clear count of a scene of a given brightness
+ *    (counts at the reference settings: gain 4x, 154ms) with the settings
+ *    of the integration, saturated to the full scale.
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <cstdio>
+
+#include "check.h"
+#include "Arduino.h"
+#include "utilities/tcs34725_autorange.hpp"
+
+
+/**
+ * @brief Raw count of a channel for a scene and a setting.
+ * @param reference Count with the reference settings (can exceed 16 bits).
+ */
+static uint16_t sensorCount(uint32_t reference, uint8_t level) {
+    uint32_t count = reference * TCS34725AutoRange::getSensitivity(level) / TCS_AUTORANGE_REF_SENSITIVITY;
+    uint16_t fullScale = TCS34725AutoRange::getFullScale(level);
+    return (count > fullScale) ? fullScale : _(uint16_t)(count);
+}
+
+
+/**
+ * @brief Feed readings until the settings are stable.
+ * @return Number of readings before the first valid one with stable settings.
+ */
+static int converge(TCS34725AutoRange& autorange, uint32_t reference) {
+    // Settings written after a reading are applied during the next integration
+    for (int i = 0; i < 20; i++) {
+        if (!autorange.update(sensorCount(reference, autorange.getLevel())) && autorange.isValid())
+            return i;
+    }
+    return -1;
+}
+
+
+/**
+ * @brief A scene is measured with the same scaled value whatever the
+ *      starting setting; bright scenes use short integration times.
+ */
+static void testConvergence() {
+    const uint32_t scenes[] = { 30, 300, 3000, 20000, 60000, 65000 };
+
+    for (uint32_t reference : scenes) {
+        for (uint8_t start = 0; start < TCS_AUTORANGE_LEVELS; start++) {
+            TCS34725AutoRange autorange(start);
+            int readings = converge(autorange, reference);
+            CHECK(readings >= 0);
+            CHECK(readings <= 2 * TCS_AUTORANGE_LEVELS);
+
+            uint16_t raw      = sensorCount(reference, autorange.getLevel());
+            uint32_t expected = reference;
+            uint16_t scaled   = autorange.scale(raw);
+            CHECK(autorange.isValid());
+            // Quantization of the least sensitive settings
+            uint32_t error = (scaled > expected) ? scaled - expected : expected - scaled;
+            if (error > expected / 50 + 26) {
+                fprintf(stderr, "scene %u, start %u: scaled %u\n",
+                        _(unsigned)(reference), start, scaled);
+                CHECK(false);
+            }
+            // The 10 bits values sent to the hub don't depend on the setting
+            CHECK((scaled >> 6) <= 1023);
+        }
+    }
+
+    // Usual indoor scene (reference clear count ~3000): 24ms integration
+    TCS34725AutoRange autorange;
+    converge(autorange, 3000);
+    CHECK(autorange.getIntegrationTime() == 24);
+    // Darkness: longest integration time
+    converge(autorange, 30);
+    CHECK(autorange.getIntegrationTime() == 614);
+    CHECK(autorange.getATime() == 0x00);
+    CHECK(autorange.getControl() == 0x03);
+    // Beyond the range of the least sensitive setting: no valid reading
+    CHECK(converge(autorange, 1000000) < 0);
+    CHECK(autorange.getLevel() == 0);
+}
+
+
+/**
+ * @brief Readings of the least sensitive setting that exceed 16 bits once
+ *      scaled to the reference settings are invalid.
+ */
+static void testOutOfScale() {
+    // Not saturated at 1x, 24ms (full scale 10240) but scaled above 65535
+    TCS34725AutoRange autorange;
+    CHECK(converge(autorange, 150000) < 0);
+    CHECK(autorange.getLevel() == 0);
+    CHECK(sensorCount(150000, 0) < TCS34725AutoRange::getFullScale(0) * 3 / 4);
+    CHECK(!autorange.isValid());
+    CHECK(autorange.scale(sensorCount(150000, 0)) == 65535);
+
+    // Clear channel in range, but not another channel
+    TCS34725AutoRange bright(0);
+    CHECK(!bright.update(sensorCount(50000, 0)));
+    CHECK(bright.isValid());
+    CHECK(bright.scale(sensorCount(50000, 0)) < 65535);
+    CHECK(bright.isValid());
+    CHECK(bright.scale(sensorCount(70000, 0)) == 65535);
+    CHECK(!bright.isValid());
+    // The next reading is valid again
+    CHECK(!bright.update(sensorCount(50000, 0)));
+    CHECK(bright.isValid());
+}
+
+
+/**
+ * @brief The reading following a change is discarded;
+ *      a stable scene doesn't change the settings.
+ */
+static void testStability() {
+    TCS34725AutoRange autorange(0);
+    // Too dark for 1x: change to 4x
+    CHECK(autorange.update(50));
+    CHECK(!autorange.isValid());
+    CHECK(autorange.getLevel() == 1);
+    // Mixed integration
+    CHECK(!autorange.update(sensorCount(20000, 1)));
+    CHECK(!autorange.isValid());
+    CHECK(autorange.getLevel() == 1);
+
+    // Scenes around the thresholds of each setting
+    for (uint32_t reference = 20; reference < 400000; reference += reference / 8) {
+        TCS34725AutoRange stable;
+        converge(stable, reference);
+        uint8_t level = stable.getLevel();
+        for (int i = 0; i < 10; i++) {
+            CHECK(!stable.update(sensorCount(reference, stable.getLevel())));
+        }
+        CHECK(stable.getLevel() == level);
+    }
+}
+
+
+/**
+ * @brief A capped integration time keeps the sample rate in the dark;
+ *      the readings at the most sensitive allowed setting stay valid.
+ */
+static void testMaxIntegrationTime() {
+    TCS34725AutoRange autorange;
+    converge(autorange, 30);
+    CHECK(autorange.getIntegrationTime() == 614);
+
+    // Lowered cap: the next reading changes the settings
+    autorange.setMaxIntegrationTime(120);
+    CHECK(autorange.update(sensorCount(30, autorange.getLevel())));
+    CHECK(autorange.getIntegrationTime() == 101);
+    CHECK(converge(autorange, 30) >= 0);
+    CHECK(autorange.getIntegrationTime() == 101);
+    CHECK(autorange.isValid());
+
+    // Shorter than any setting: the 24ms settings are still allowed
+    autorange.setMaxIntegrationTime(10);
+    CHECK(converge(autorange, 30) >= 0);
+    CHECK(autorange.getLevel() == 3);
+    CHECK(autorange.getIntegrationTime() == 24);
+
+    // Bright scenes are not affected
+    converge(autorange, 20000);
+    CHECK(autorange.getIntegrationTime() == 24);
+
+    // Cap removed
+    autorange.setMaxIntegrationTime(0);
+    converge(autorange, 30);
+    CHECK(autorange.getIntegrationTime() == 614);
+}
+
+
+int main() {
+    testConvergence();
+    testOutOfScale();
+    testStability();
+    testMaxIntegrationTime();
+
+    return checkReport();
+}
@@ -0,0 +1,167 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of the tilt pipeline: integer atan2 & square root,
+ *      TiltEstimator fed by a model of accelerometer.
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "check.h"
+#include "Arduino.h"
+#include "utilities/tilt_estimator.hpp"
+
+// 1g at ±2g full scale (MPU6050)
+#define ONE_G    16384
+
+
+/**
+ * @brief Accelerometer at rest with a given orientation, with some noise;
+ *      the samples are delivered by bursts like a FIFO.
+ */
+class FakeAccelerometer : public Accelerometer {
+public:
+    FakeAccelerometer() : roll(0), pitch(0), noise(0), pending(0) {}
+
+    virtual uint8_t readSamples(AccelSample *samples, uint8_t maxSamples) {
+        uint8_t count = 0;
+        for (; count < maxSamples && pending; count++, pending--) {
+            // Gravity in the frame of the sensor
+            samples[count].x = noisy(-ONE_G * sin(pitch));
+            samples[count].y = noisy(ONE_G * cos(pitch) * sin(roll));
+            samples[count].z = noisy(ONE_G * cos(pitch) * cos(roll));
+        }
+        return count;
+    }
+
+    double   roll, pitch; // Radians
+    int      noise;       // Max amplitude
+    unsigned pending;     // Samples in the FIFO
+
+private:
+    int16_t noisy(double value) {
+        if (noise)
+            value += (rand() % (2 * noise + 1)) - noise;
+        return _(int16_t)(lround(value));
+    }
+};
+
+
+static double radians(double degrees) {
+    return degrees * M_PI / 180;
+}
+
+
+/**
+ * @brief Max error of the approximation over all the octants & magnitudes.
+ */
+static void testAtan2() {
+    double maxError = 0;
+    for (int32_t magnitude = 1; magnitude <= 1000000; magnitude *= 10) {
+        for (int degrees = -180; degrees <= 180; degrees++) {
+            const int32_t y     = _(int32_t)(lround(magnitude * 100 * sin(radians(degrees + 0.37))));
+            const int32_t x     = _(int32_t)(lround(magnitude * 100 * cos(radians(degrees + 0.37))));
+            const double  error = fabs(mobAtan2(y, x) / 100.0 - atan2(y, x) * 180 / M_PI);
+            if (error > maxError && error < 359)
+                maxError = error;
+        }
+    }
+    CHECK(maxError < 0.15);
+    CHECK(mobAtan2(0, 0) == 0);
+    CHECK(mobAtan2(0, 1) == 0);
+    CHECK(mobAtan2(1, 0) == 9000);
+    CHECK(mobAtan2(-1, 0) == -9000);
+    CHECK(mobAtan2(0, -1) == 18000);
+    CHECK(mobAtan2(5, 5) == 4500);
+    CHECK(mobAtan2(-32768, -32768) == -13500);
+}
+
+
+static void testSqrt() {
+    const uint32_t values[] = { 0, 1, 2, 3, 4, 15, 16, 17, 65535, 65536, 1000000, 2147483648UL, 4294967295UL };
+    for (const uint32_t value : values) {
+        const uint32_t root = mobSqrt(value);
+        CHECK(root * root <= value);
+        CHECK((root + 1) * (root + 1) > value || root == 65535);
+    }
+}
+
+
+/**
+ * @brief The angles converge on the orientation, within 1°; clamped to ±45°.
+ */
+static void testEstimator() {
+    FakeAccelerometer imu;
+    TiltEstimator     tilt;
+    CHECK(!tilt.isValid());
+
+    const int angles[][2] = { { 0, 0 }, { 10, -20 }, { -30, 5 }, { 44, -44 }, { 60, 0 }, { 0, -80 } };
+    for (const auto& angle : angles) {
+        imu.roll    = radians(angle[0]);
+        imu.pitch   = radians(angle[1]);
+        imu.pending = 200; // 0.4s at 500Hz
+        CHECK(tilt.poll(imu) == 200);
+        CHECK(tilt.isValid());
+
+        const int roll  = (angle[0] > MOB_TILT_MAX_ANGLE) ? MOB_TILT_MAX_ANGLE : angle[0];
+        const int pitch = (angle[1] < -MOB_TILT_MAX_ANGLE) ? -MOB_TILT_MAX_ANGLE : angle[1];
+        CHECK(abs(tilt.getRoll() - roll) <= 1);
+        CHECK(abs(tilt.getPitch() - pitch) <= 1);
+        if (abs(angle[0]) <= MOB_TILT_MAX_ANGLE)
+            CHECK(abs(tilt.getRollCenti() - angle[0] * 100) <= 20);
+    }
+}
+
+
+/**
+ * @brief With noisy samples (~±0.1g), the published angles are steady.
+ */
+static void testNoise() {
+    FakeAccelerometer imu;
+    TiltEstimator     tilt(5);
+    imu.roll  = radians(20);
+    imu.pitch = radians(-10);
+    imu.noise = 1600;
+    srand(1);
+
+    imu.pending = 500;
+    tilt.poll(imu);
+    int minRoll = 127, maxRoll = -128;
+    for (int i = 0; i < 500; i++) {
+        imu.pending = 1;
+        tilt.poll(imu);
+        if (tilt.getRoll() < minRoll)
+            minRoll = tilt.getRoll();
+        if (tilt.getRoll() > maxRoll)
+            maxRoll = tilt.getRoll();
+    }
+    CHECK(minRoll >= 18 && maxRoll <= 22);
+    CHECK(abs(tilt.getPitch() + 10) <= 2);
+}
+
+
+int main() {
+    testAtan2();
+    testSqrt();
+    testEstimator();
+    testNoise();
+
+    return checkReport();
+}
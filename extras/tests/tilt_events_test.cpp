@@ -0,0 +1,158 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of the events of the Tilt sensor: direction with
+ *      hysteresis & streaming impact detector.
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <cstdio>
+#include <cstdlib>
+
+#include "check.h"
+#include "Arduino.h"
+#include "utilities/tilt_events.hpp"
+
+// 1g at ±2g full scale (MPU6050)
+#define ONE_G    16384
+
+
+/**
+ * @brief Lookup of the directions & hysteresis on the thresholds.
+ */
+static void testDirection() {
+    TiltDirection direction(20, 10);
+
+    CHECK(direction.update(0, 0) == TILT_DIRECTION_NEUTRAL);
+    CHECK(direction.update(19, 0) == TILT_DIRECTION_NEUTRAL);
+    CHECK(direction.update(20, 0) == TILT_DIRECTION_RIGHT);
+    // Kept down to the exit threshold
+    CHECK(direction.update(11, 0) == TILT_DIRECTION_RIGHT);
+    CHECK(direction.update(10, 3) == TILT_DIRECTION_RIGHT);
+    CHECK(direction.update(9, 3) == TILT_DIRECTION_NEUTRAL);
+    CHECK(direction.update(-25, 0) == TILT_DIRECTION_LEFT);
+    CHECK(direction.update(0, 30) == TILT_DIRECTION_FORWARD);
+    CHECK(direction.update(0, -45) == TILT_DIRECTION_BACKWARD);
+    CHECK(direction.value() == TILT_DIRECTION_BACKWARD);
+
+    // Diagonal: the other axis must be larger by 10°
+    direction.reset();
+    CHECK(direction.update(25, 20) == TILT_DIRECTION_RIGHT);
+    CHECK(direction.update(25, 30) == TILT_DIRECTION_RIGHT);
+    CHECK(direction.update(25, 34) == TILT_DIRECTION_RIGHT);
+    CHECK(direction.update(25, 35) == TILT_DIRECTION_FORWARD);
+    CHECK(direction.update(30, 35) == TILT_DIRECTION_FORWARD);
+
+    // Noise around the enter threshold doesn't make it flicker
+    direction.reset();
+    int changes = 0;
+    uint8_t previous = direction.value();
+    for (int i = 0; i < 100; i++) {
+        const uint8_t value = direction.update(_(int8_t)(20 + (i % 5) - 2), 0);
+        changes  += (value != previous);
+        previous  = value;
+    }
+    CHECK(changes == 1);
+}
+
+
+/**
+ * @brief Impacts are counted once on their axis; the tilt is not an impact.
+ */
+static void testImpacts() {
+    ImpactDetector<16> impacts(ONE_G / 2, 20);
+    AccelSample        rest = { 0, 0, ONE_G };
+    srand(1);
+
+    // Noisy rest, then a slow tilt of the sensor
+    for (int i = 0; i < 200; i++) {
+        AccelSample sample = rest;
+        sample.x = _(int16_t)(rand() % 801 - 400);
+        CHECK(!impacts.update(sample));
+    }
+    for (int i = 0; i <= 100; i++) {
+        AccelSample sample = { 0, _(int16_t)(ONE_G * i / 200), _(int16_t)(ONE_G - ONE_G * i / 400) };
+        CHECK(!impacts.update(sample));
+    }
+    rest = { 0, ONE_G / 2, 3 * ONE_G / 4 };
+    for (int i = 0; i < 50; i++)
+        impacts.update(rest);
+
+    // Impact on X with rebounds: 1 count
+    const int16_t shock[] = { ONE_G, -ONE_G / 2, ONE_G / 2, -ONE_G / 4, ONE_G };
+    for (const int16_t value : shock) {
+        AccelSample sample = rest;
+        sample.x = value;
+        impacts.update(sample);
+    }
+    for (int i = 0; i < 50; i++)
+        impacts.update(rest);
+    CHECK(impacts.getCounts()[0] == 1);
+    CHECK(impacts.getCounts()[1] == 0);
+    CHECK(impacts.getCounts()[2] == 0);
+
+    // 2 separate impacts on Z (drop)
+    for (int n = 0; n < 2; n++) {
+        AccelSample sample = rest;
+        sample.z = -ONE_G;
+        CHECK(impacts.update(sample));
+        for (int i = 0; i < 30; i++)
+            impacts.update(rest);
+    }
+    CHECK(impacts.getCounts()[2] == 2);
+
+    // Saturation
+    for (int n = 0; n < 150; n++) {
+        AccelSample sample = rest;
+        sample.y = -ONE_G;
+        impacts.update(sample);
+        for (int i = 0; i < 30; i++)
+            impacts.update(rest);
+    }
+    CHECK(impacts.getCounts()[1] == TILT_MAX_CRASH_COUNT);
+    impacts.resetCounts();
+    CHECK(impacts.getCounts()[0] == 0 && impacts.getCounts()[1] == 0);
+}
+
+
+/**
+ * @brief Gravity on the axes for the calibration mode.
+ */
+static void testCalibration() {
+    TiltEstimator tilt;
+    AccelSample   sample = { 0, 0, ONE_G };
+    int8_t        values[3];
+
+    tilt.update(sample);
+    tilt.getCalibration(values);
+    CHECK(values[0] == 0 && values[1] == 0 && values[2] == MOB_TILT_MAX_ANGLE);
+
+    tilt.reset();
+    sample = { -ONE_G, 0, 0 };
+    tilt.update(sample);
+    tilt.getCalibration(values);
+    CHECK(values[0] == -MOB_TILT_MAX_ANGLE && values[2] == 0);
+}
+
+
+int main() {
+    testDirection();
+    testImpacts();
+    testCalibration();
+
+    return checkReport();
+}
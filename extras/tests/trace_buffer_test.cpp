@@ -0,0 +1,135 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of TraceBuffer: frames, non-blocking drain & overflow.
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <cstdio>
+#include <vector>
+
+#include "check.h"
+#include "Arduino.h"
+#include "TraceBuffer.h"
+
+// Virtual clock (µs)
+static unsigned long now = 0;
+unsigned long millis() { return now / 1000; }
+unsigned long micros() { return now; }
+void delay(unsigned long ms) { now += ms * 1000; }
+
+/**
+ * @brief Serial port with a TX buffer of limited size.
+ */
+struct FakeSerial {
+    std::vector<uint8_t> sent;
+    size_t               room;
+
+    int availableForWrite() { return _(int)(room); }
+    size_t write(const uint8_t *buffer, size_t size) {
+        sent.insert(sent.end(), buffer, buffer + size);
+        room -= size;
+        return size;
+    }
+};
+
+
+/**
+ * @brief Layout & checksum of a frame.
+ */
+static void testEncode() {
+    TraceEvent event = { 0x12345678, TRACE_IR_DATA_SET, 0x01, 0x4142 };
+    uint8_t    frame[TRACE_FRAME_SIZE];
+    uint8_t    expected[] = { 0xA5, 7, 0x01, 0x42, 0x41, 0x78, 0x56, 0x34, 0x12, 0 };
+
+    uint8_t checksum = 0xFF;
+    for (uint8_t i = 0; i < TRACE_FRAME_SIZE - 1; i++)
+        checksum ^= expected[i];
+    expected[TRACE_FRAME_SIZE - 1] = checksum;
+
+    CHECK(TraceBuffer::encode(event, frame) == TRACE_FRAME_SIZE);
+    CHECK(memcmp(frame, expected, TRACE_FRAME_SIZE) == 0);
+}
+
+
+/**
+ * @brief Only the frames that fit in the TX buffer are sent; the others
+ *      are kept for the next drain.
+ */
+static void testDrain() {
+    TraceBuffer trace;
+    FakeSerial  serial;
+
+    now = 100;
+    trace.record(TRACE_HEADER, 0x43);
+    now = 200;
+    trace.record(TRACE_ASKED_MODE, 8);
+    trace.record(TRACE_DEFAULT_COMBOS);
+    CHECK(trace.pending() == 3);
+
+    // Room for 2 frames and a half
+    serial.room = 2 * TRACE_FRAME_SIZE + 5;
+    CHECK(trace.drain(serial) == 2);
+    CHECK(serial.sent.size() == 2 * TRACE_FRAME_SIZE);
+    CHECK(serial.sent[1] == TRACE_HEADER && serial.sent[2] == 0x43 && serial.sent[5] == 100);
+    CHECK(serial.sent[11] == TRACE_ASKED_MODE && serial.sent[15] == 200);
+    CHECK(trace.pending() == 1);
+
+    serial.room = 0;
+    CHECK(trace.drain(serial) == 0);
+    serial.room = 100;
+    CHECK(trace.drain(serial) == 1);
+    CHECK(serial.sent[21] == TRACE_DEFAULT_COMBOS);
+    CHECK(trace.pending() == 0);
+}
+
+
+/**
+ * @brief Events recorded in a full buffer are counted, then reported by
+ *      a TRACE_OVERFLOW event before the kept ones; the indexes wrap.
+ */
+static void testOverflow() {
+    TraceBuffer trace;
+    FakeSerial  serial;
+
+    for (uint16_t i = 0; i < TRACE_BUFFER_SIZE + 4; i++)
+        trace.record(TRACE_ASKED_MODE, _(uint8_t)(i));
+    // 1 slot is always free
+    CHECK(trace.pending() == TRACE_BUFFER_SIZE - 1);
+
+    serial.room = 1000;
+    CHECK(trace.drain(serial) == TRACE_BUFFER_SIZE);
+    CHECK(serial.sent[1] == TRACE_OVERFLOW && serial.sent[3] == 5 && serial.sent[4] == 0);
+    // Oldest events kept
+    CHECK(serial.sent[TRACE_FRAME_SIZE + 2] == 0);
+    CHECK(serial.sent[(TRACE_BUFFER_SIZE - 1) * TRACE_FRAME_SIZE + 2] == TRACE_BUFFER_SIZE - 2);
+
+    // Reported once
+    serial.sent.clear();
+    trace.record(TRACE_MODE_SENT, 6);
+    CHECK(trace.drain(serial) == 1);
+    CHECK(serial.sent[1] == TRACE_MODE_SENT);
+}
+
+
+int main() {
+    testEncode();
+    testDrain();
+    testOverflow();
+
+    return checkReport();
+}
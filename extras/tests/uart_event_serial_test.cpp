@@ -0,0 +1,168 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @brief Host test of UartEventSerial with its queue based backend.
+ *
+ *    A "hub" thread injects bytes while the "protocol" thread sleeps in
+ *    waitForData(), like the protocol task on ESP32.
+ *    Run by tests/test_host_programs.py; returns non-zero on failure.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "UartEventSerial.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static long elapsedMs(Clock::time_point start) {
+    return _(long)(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count());
+}
+
+
+/**
+ * @brief No data: waitForData() sleeps until its timeout.
+ */
+static void testTimeout() {
+    UartEventSerial serial;
+    serial.begin(115200);
+
+    Clock::time_point start = Clock::now();
+    CHECK(!serial.waitForData(30));
+    CHECK(elapsedMs(start) >= 29);
+    CHECK(serial.available() == 0);
+    CHECK(serial.read() == -1);
+}
+
+
+/**
+ * @brief A NACK wakes up the waiting thread before the timeout.
+ */
+static void testWakeUpOnNack() {
+    UartEventSerial serial;
+    const uint8_t   nack = 0x02;
+
+    std::thread hub([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        serial.injectRx(&nack, 1);
+    });
+    Clock::time_point start = Clock::now();
+    CHECK(serial.waitForData(1000));
+    CHECK(elapsedMs(start) < 500);
+    CHECK(serial.read() == 0x02);
+    hub.join();
+}
+
+
+/**
+ * @brief readBytes() waits for a message received in several parts,
+ *      and returns what was received on timeout.
+ */
+static void testReadBytes() {
+    UartEventSerial serial;
+    const uint8_t   query[] = { 0x43, 0x00, 0xBC };
+    uint8_t         buffer[4];
+
+    serial.setTimeout(200);
+    std::thread hub([&]() {
+        serial.injectRx(query, 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        serial.injectRx(query + 1, 2);
+    });
+    CHECK(serial.readBytes(buffer, 3) == 3);
+    CHECK(std::equal(query, query + 3, buffer));
+    hub.join();
+
+    // Incomplete message
+    serial.setTimeout(20);
+    serial.injectRx(query, 2);
+    CHECK(serial.readBytes(buffer, 3) == 2);
+}
+
+
+/**
+ * @brief Bytes written are available to the hub, in order.
+ */
+static void testWrite() {
+    UartEventSerial serial;
+    serial.write("\x40\x25\x9A", 3);
+    serial.write(0x04);
+    serial.flush();
+
+    std::vector<uint8_t> tx = serial.takeTx();
+    const uint8_t expected[] = { 0x40, 0x25, 0x9A, 0x04 };
+    CHECK(tx.size() == 4);
+    CHECK(std::equal(expected, expected + 4, tx.begin()));
+    CHECK(serial.takeTx().empty());
+}
+
+
+/**
+ * @brief Protocol-like loop: answer each NACK of the hub with a data frame,
+ *      and measure the response latencies.
+ */
+static void testNackResponses() {
+    const int       NACKS = 50;
+    UartEventSerial serial;
+    std::atomic<bool> stop(false);
+
+    std::thread protocol([&]() {
+        while (!stop) {
+            if (!serial.waitForData(20))
+                continue;
+            if (serial.read() == 0x02)
+                serial.write("\xC0\x00\x3F", 3);
+        }
+    });
+
+    std::vector<long> latencies;
+    const uint8_t     nack = 0x02;
+    for (int i = 0; i < NACKS; i++) {
+        Clock::time_point start = Clock::now();
+        serial.injectRx(&nack, 1);
+        // Poll for the response
+        std::vector<uint8_t> tx;
+        while ((tx = serial.takeTx()).empty() && elapsedMs(start) < 1000)
+            std::this_thread::yield();
+        CHECK(tx.size() == 3);
+        latencies.push_back(_(long)(std::chrono::duration_cast<std::chrono::microseconds>(
+                                        Clock::now() - start).count()));
+    }
+    stop = true;
+    protocol.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("NACK response latency (us): median %ld, max %ld\n",
+           latencies[latencies.size() / 2], latencies.back());
+    CHECK(latencies.back() < 1000000);
+}
+
+
+int main() {
+    testTimeout();
+    testWakeUpOnNack();
+    testReadBytes();
+    testWrite();
+    testNackResponses();
+
+    return checkReport();
+}
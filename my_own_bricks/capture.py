@@ -0,0 +1,432 @@
+# MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+# Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Binary captures of the hub <-> device traffic, and their replay
+
+Capture file (.mobcap):
+
+    - header: magic "MOBCAP", version (1 byte), 1 reserved byte;
+    - records: direction (1 byte), timestamp (µs, 8 bytes), baudrate (4 bytes),
+      length (2 bytes), then the raw bytes (little endian values).
+
+Sidecar index (.mobcap.idx), written with the capture:
+
+    - header: magic "MOBIDX", version (1 byte), 1 reserved byte,
+      step (4 bytes);
+    - 1 entry every `step` records: record number, timestamp (µs),
+      offset of the record in the capture (8 bytes each).
+
+The captures are memory-mapped on read; the index allows to seek a record
+by its number or its timestamp without reading the whole capture.
+
+:Example: Record a session, then replay the hub queries 2x faster to a device:
+
+    >>> with CaptureWriter("session.mobcap") as capture:
+    >>>     messages = get_device_messages(capture=capture)
+    >>>     ...
+    >>>
+    >>> with CaptureReader("session.mobcap") as capture:
+    >>>     replay(capture, serial.Serial("/dev/ttyUSB0"), speed=2)
+
+Command line:
+
+    $ python -m my_own_bricks.capture info session.mobcap
+    $ python -m my_own_bricks.capture dump session.mobcap --start 10.5
+    $ python -m my_own_bricks.capture replay session.mobcap /dev/pts/3 --speed 2
+"""
+# Standard imports
+import argparse
+import mmap
+import time
+from bisect import bisect_right
+from collections import namedtuple
+from struct import Struct, error as StructError
+
+# Custom imports
+from my_own_bricks.messages import get_hex_msg
+
+DEVICE_TO_HUB = 0
+HUB_TO_DEVICE = 1
+INDEX_STEP = 256  # Records between 2 entries of the index
+
+_CAPTURE_HEADER = Struct("<6sBx")
+_CAPTURE_MAGIC = b"MOBCAP"
+_INDEX_HEADER = Struct("<6sBxI")
+_INDEX_MAGIC = b"MOBIDX"
+_VERSION = 1
+_RECORD_HEADER = Struct("<BQIH")
+_INDEX_ENTRY = Struct("<QQQ")
+
+Record = namedtuple("Record", ["number", "direction", "timestamp", "baudrate", "data"])
+Record.__doc__ = """Bytes sent in one direction
+
+:param number: Position of the record in the capture.
+:param direction: DEVICE_TO_HUB or HUB_TO_DEVICE.
+:param timestamp: Time since the start of the capture (µs).
+:param baudrate: Speed of the line.
+:param data: Raw bytes.
+"""
+
+
+def index_path(path):
+    """Get the path of the sidecar index of a capture"""
+    return path + ".idx"
+
+
+class CaptureWriter:
+    """Write a capture and its index
+
+    :param path: Path of the capture; an existing file is overwritten.
+    :key step: Number of records between 2 entries of the index.
+    :key clock: Function returning the current time (s); the timestamps
+        are relative to the creation of the writer.
+    :key count: Number of written records.
+    """
+
+    def __init__(self, path, step=INDEX_STEP, clock=time.monotonic):
+        """Constructor"""
+        self.path = path
+        self.step = step
+        self.clock = clock
+        self.count = 0
+        self._start = clock()
+        self._last_timestamp = 0
+        self._file = open(path, "wb")
+        self._index = open(index_path(path), "wb")
+        self._file.write(_CAPTURE_HEADER.pack(_CAPTURE_MAGIC, _VERSION))
+        self._index.write(_INDEX_HEADER.pack(_INDEX_MAGIC, _VERSION, step))
+
+    def write(self, direction, data, baudrate, timestamp=None):
+        """Append the bytes sent in one direction
+
+        :param direction: DEVICE_TO_HUB or HUB_TO_DEVICE.
+        :param data: Raw bytes (max 65535).
+        :param baudrate: Speed of the line.
+        :key timestamp: Time since the start of the capture (µs);
+            default: now. Timestamps can't go backwards.
+        :type direction: <int>
+        :type data: <bytes>
+        :type baudrate: <int>
+        :type timestamp: <int>
+        """
+        if timestamp is None:
+            timestamp = int((self.clock() - self._start) * 1e6)
+        # Keep the timestamps sorted for the binary search in the index
+        timestamp = max(timestamp, self._last_timestamp)
+        self._last_timestamp = timestamp
+
+        if self.count % self.step == 0:
+            self._index.write(_INDEX_ENTRY.pack(self.count, timestamp, self._file.tell()))
+        self._file.write(_RECORD_HEADER.pack(direction, timestamp, baudrate, len(data)))
+        self._file.write(data)
+        self.count += 1
+
+    def close(self):
+        """Flush and close the capture and its index"""
+        self._file.close()
+        self._index.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+class CaptureReader:
+    """Read a capture (memory-mapped) with its index
+
+    The index is rebuilt in memory if it is missing or unusable; otherwise
+    only the records after its last entry are scanned to count the records
+    (Ex: capture interrupted before its closing).
+
+    :param path: Path of the capture.
+    :raise: <ValueError> if the file is not a capture.
+    """
+
+    def __init__(self, path):
+        """Constructor"""
+        self.path = path
+        self._file = open(path, "rb")
+        self._map = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version = _CAPTURE_HEADER.unpack_from(self._map)
+        if magic != _CAPTURE_MAGIC or version != _VERSION:
+            self.close()
+            raise ValueError("Not a capture: %s" % path)
+        self._load_index()
+        self._count = None
+
+    def _load_index(self):
+        """Load the entries of the sidecar index, or rebuild them"""
+        self._index_numbers = []
+        self._index_timestamps = []
+        self._index_offsets = []
+        try:
+            with open(index_path(self.path), "rb") as file:
+                content = file.read()
+            magic, version, step = _INDEX_HEADER.unpack_from(content)
+            if magic != _INDEX_MAGIC or version != _VERSION:
+                raise ValueError
+        except (OSError, ValueError, StructError):
+            # No usable index: rebuild it (the whole capture is read)
+            for number, offset in enumerate(self._offsets(_CAPTURE_HEADER.size)):
+                if number % INDEX_STEP == 0:
+                    self._add_entry(number, offset)
+            return
+        end = len(content) - (len(content) - _INDEX_HEADER.size) % _INDEX_ENTRY.size
+        for number, timestamp, offset in _INDEX_ENTRY.iter_unpack(content[_INDEX_HEADER.size:end]):
+            if offset + _RECORD_HEADER.size > len(self._map):
+                # Entry of a record not flushed in the capture
+                break
+            self._index_numbers.append(number)
+            self._index_timestamps.append(timestamp)
+            self._index_offsets.append(offset)
+
+    def _add_entry(self, number, offset):
+        """Append an entry to the index in memory"""
+        self._index_numbers.append(number)
+        self._index_timestamps.append(_RECORD_HEADER.unpack_from(self._map, offset)[1])
+        self._index_offsets.append(offset)
+
+    def _offsets(self, offset):
+        """Generator of the offsets of the complete records from the given one"""
+        size = len(self._map)
+        while offset + _RECORD_HEADER.size <= size:
+            length = _RECORD_HEADER.unpack_from(self._map, offset)[3]
+            if offset + _RECORD_HEADER.size + length > size:
+                # Truncated capture
+                return
+            yield offset
+            offset += _RECORD_HEADER.size + length
+
+    def _read(self, number, offset):
+        """Get the record at the given offset"""
+        direction, timestamp, baudrate, length = _RECORD_HEADER.unpack_from(self._map, offset)
+        start = offset + _RECORD_HEADER.size
+        # Copy of the bytes: no reference to the map is kept after its closing
+        return Record(number, direction, timestamp, baudrate, self._map[start:start + length])
+
+    def __len__(self):
+        """Number of records (records after the last entry of the index are counted)"""
+        if self._count is None:
+            if not self._index_numbers:
+                self._count = 0
+            else:
+                count = sum(1 for _ in self._offsets(self._index_offsets[-1]))
+                self._count = self._index_numbers[-1] + count
+        return self._count
+
+    def records(self, start=0, stop=None):
+        """Iterate over the records
+
+        :key start: Number of the first record.
+        :key stop: Number of the record after the last one (default: end).
+        :return: Generator of records.
+        :rtype: <generator <Record>>
+        """
+        if stop is not None and stop <= start:
+            return
+        position = bisect_right(self._index_numbers, start) - 1
+        if position < 0:
+            return
+        number = self._index_numbers[position]
+        for offset in self._offsets(self._index_offsets[position]):
+            if stop is not None and number >= stop:
+                return
+            if number >= start:
+                yield self._read(number, offset)
+            number += 1
+
+    def __iter__(self):
+        return self.records()
+
+    def __getitem__(self, number):
+        """Get a record by its number (negative numbers are supported)
+
+        :raise: <IndexError> if the record doesn't exist.
+        """
+        if number < 0:
+            number += len(self)
+        for record in self.records(number, number + 1):
+            return record
+        raise IndexError("Record %d not found" % number)
+
+    def find_time(self, timestamp):
+        """Get the number of the first record sent at or after the given time
+
+        :param timestamp: Time since the start of the capture (µs).
+        :return: Number of the record; len(self) if the capture ends before.
+        :rtype: <int>
+        """
+        if not self._index_numbers:
+            return 0
+        # Last entry before the timestamp: the record is after it
+        position = max(0, bisect_right(self._index_timestamps, timestamp - 1) - 1)
+        number = self._index_numbers[position]
+        for offset in self._offsets(self._index_offsets[position]):
+            if _RECORD_HEADER.unpack_from(self._map, offset)[1] >= timestamp:
+                return number
+            number += 1
+        return number
+
+    def close(self):
+        """Release the capture"""
+        self._map.close()
+        self._file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+class RecordingSerial:
+    """Serial handler (pyserial) that records the exchanged bytes
+
+    Received bytes are recorded as DEVICE_TO_HUB, sent bytes as HUB_TO_DEVICE.
+    The other attributes are those of the wrapped handler.
+
+    :param serial_handler: Opened serial port.
+    :param capture: Capture in which the bytes are recorded.
+    :type serial_handler: <serial.Serial>
+    :type capture: <CaptureWriter>
+    """
+
+    def __init__(self, serial_handler, capture):
+        """Constructor"""
+        # Bypass __setattr__: these attributes belong to the wrapper
+        self.__dict__["serial_handler"] = serial_handler
+        self.__dict__["capture"] = capture
+
+    def read(self, size=1):
+        """Read bytes from the device (see serial.Serial.read)"""
+        data = self.serial_handler.read(size)
+        if data:
+            self.capture.write(DEVICE_TO_HUB, data, self.serial_handler.baudrate)
+        return data
+
+    def readline(self, *args, **kwargs):
+        """Read a line from the device (see serial.Serial.readline)"""
+        data = self.serial_handler.readline(*args, **kwargs)
+        if data:
+            self.capture.write(DEVICE_TO_HUB, data, self.serial_handler.baudrate)
+        return data
+
+    def write(self, data):
+        """Send bytes to the device (see serial.Serial.write)"""
+        self.capture.write(HUB_TO_DEVICE, bytes(data), self.serial_handler.baudrate)
+        return self.serial_handler.write(data)
+
+    def __getattr__(self, name):
+        return getattr(self.serial_handler, name)
+
+    def __setattr__(self, name, value):
+        # Ex: baudrate & timeout are settings of the wrapped handler
+        setattr(self.serial_handler, name, value)
+
+
+def replay(capture, serial_handler, speed=1.0, direction=HUB_TO_DEVICE,
+           start=0, stop=None, clock=time.monotonic, sleep=time.sleep):
+    """Send the recorded bytes of one direction with their original timing
+
+    The send times are absolute deadlines from the first record: the delays
+    of the loop don't accumulate. The baudrate of the endpoint follows the
+    baudrate of the records (if the endpoint has a `baudrate` attribute).
+
+    :param capture: Capture to replay.
+    :param serial_handler: Endpoint with a `write()` method (Ex: serial.Serial
+        opened on a serial port or the slave side of a pseudo-terminal).
+    :key speed: Speed factor (2: 2x faster).
+    :key direction: Direction of the replayed records.
+    :key start: Number of the first record.
+    :key stop: Number of the record after the last one.
+    :key clock: Function returning the current time (s).
+    :key sleep: Function waiting the given time (s).
+    :type capture: <CaptureReader>
+    :type speed: <float>
+    :return: Number of sent records and max lateness of the records (s).
+    :rtype: <tuple <int>, <float>>
+    """
+    count = 0
+    max_lateness = 0
+    origin = None
+    for record in capture.records(start, stop):
+        if record.direction != direction:
+            continue
+        if origin is None:
+            origin = (clock(), record.timestamp)
+        deadline = origin[0] + (record.timestamp - origin[1]) / 1e6 / speed
+        delay = deadline - clock()
+        if delay > 0:
+            sleep(delay)
+        else:
+            max_lateness = max(max_lateness, -delay)
+
+        if getattr(serial_handler, "baudrate", record.baudrate) != record.baudrate:
+            serial_handler.baudrate = record.baudrate
+        serial_handler.write(record.data)
+        count += 1
+    return count, max_lateness
+
+
+def main():
+    """Inspect or replay a capture"""
+    parser = argparse.ArgumentParser(description=main.__doc__)
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    subparser = subparsers.add_parser("info", help="Summary of the capture")
+    subparser.add_argument("capture")
+    subparser = subparsers.add_parser("dump", help="Print the records")
+    subparser.add_argument("capture")
+    subparser.add_argument("--start", type=float, default=0, help="Start time (s)")
+    subparser.add_argument("--count", type=int, default=None, help="Number of records")
+    subparser = subparsers.add_parser("replay", help="Send the hub queries to an endpoint")
+    subparser.add_argument("capture")
+    subparser.add_argument("port", help="Serial port or slave side of a pty")
+    subparser.add_argument("--speed", type=float, default=1.0, help="Speed factor")
+    subparser.add_argument("--start", type=float, default=0, help="Start time (s)")
+    subparser.add_argument("--device", action="store_true",
+                           help="Replay the device traffic instead of the hub traffic")
+    args = parser.parse_args()
+
+    with CaptureReader(args.capture) as capture:
+        if args.command == "info":
+            count = len(capture)
+            duration = capture[-1].timestamp / 1e6 if count else 0
+            print(f"{count} records, {duration:.3f}s, {len(capture._index_numbers)} index entries")
+            return
+
+        start = capture.find_time(int(args.start * 1e6))
+        if args.command == "dump":
+            stop = None if args.count is None else start + args.count
+            for record in capture.records(start, stop):
+                print(f"{record.timestamp / 1e6:.6f}",
+                      ">" if record.direction == HUB_TO_DEVICE else "<",
+                      record.baudrate, get_hex_msg(record.data))
+            return
+
+        # Replay
+        import serial
+        serial_handler = serial.Serial(args.port, capture[start].baudrate)
+        count, lateness = replay(
+            capture, serial_handler, args.speed,
+            DEVICE_TO_HUB if args.device else HUB_TO_DEVICE, start
+        )
+        serial_handler.close()
+        print(f"{count} records sent, max lateness: {lateness * 1000:.3f}ms")
+
+
+if __name__ == "__main__":
+    main()
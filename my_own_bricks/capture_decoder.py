@@ -0,0 +1,317 @@
+# MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+# Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Streaming decoder of the messages sent by a device (captures)
+
+Unlike `device_messages_parser.parse_messages()`, the decoder:
+
+    - is fed with chunks of any size (bytes, bytearray or memoryview);
+      a message split between 2 chunks is completed by the next one;
+    - never rescans the input: only the bytes of an incomplete message
+      are kept between 2 chunks;
+    - decodes the DATA messages with the formats (INFO_FORMAT) learned
+      from the init sequence;
+    - doesn't print anything: records are yielded.
+
+:Example:
+
+    >>> decoder = CaptureDecoder()
+    >>> with open("capture.bin", "rb") as file:
+    >>>     for chunk in iter(lambda: file.read(1 << 16), b""):
+    >>>         for record in decoder.feed(chunk):
+    >>>             if record.msg_type == "LUMP_MSG_TYPE_DATA":
+    >>>                 print(record.mode, record.values)
+
+Benchmark (synthetic capture, size in MB):
+
+    $ python -m my_own_bricks.capture_decoder 100
+"""
+# Standard imports
+import argparse
+import time
+from collections import namedtuple
+from struct import Struct
+
+# Custom imports
+from my_own_bricks.header_checksum import get_size, get_cheksum, \
+    LUMP_MSG_TYPE_MASK, LUMP_MSG_CMD_MASK, lump_msg_type_t, lump_cmd_t
+
+Record = namedtuple("Record", ["offset", "msg_type", "mode", "info_type", "payload", "values"])
+Record.__doc__ = """Message decoded from a capture
+
+:param offset: Position of the header in the whole stream.
+:param msg_type: Type of message (key of lump_msg_type_t).
+:param mode: DATA: mode (EXT_MODE included: 0-15);
+    INFO: mode (INFO_MODE_PLUS_8 included); CMD: command (key of lump_cmd_t);
+    SYS: header byte.
+:param info_type: INFO: type of info (INFO_MODE_PLUS_8 removed); None otherwise.
+:param payload: Bytes between the header (info type for INFO messages)
+    and the checksum.
+:param values: DATA: tuple of values if the format of the mode is known;
+    INFO_FORMAT: (data_sets, data_format, figures, decimals);
+    CMD_TYPE, CMD_SPEED, CMD_EXT_MODE: integer; None otherwise.
+    The other payloads can be processed by the parse_* functions of
+    `device_messages_parser`.
+"""
+
+INFO_MODE_PLUS_8 = 0x20
+INFO_FORMAT = 0x80
+
+_MSG_TYPE_INFO = lump_msg_type_t["LUMP_MSG_TYPE_INFO"]
+_MSG_TYPE_DATA = lump_msg_type_t["LUMP_MSG_TYPE_DATA"]
+_CMD_TYPE = lump_cmd_t["LUMP_CMD_TYPE"]
+_CMD_SPEED = lump_cmd_t["LUMP_CMD_SPEED"]
+_CMD_EXT_MODE = lump_cmd_t["LUMP_CMD_EXT_MODE"]
+# SYS messages sent by a device: SYNC, NACK, ACK
+_SYS_MESSAGES = (0x00, 0x02, 0x04)
+
+_rev_lump_cmd_t = {v: k for k, v in lump_cmd_t.items()}
+# Lookup tables indexed by the header byte
+_SIZES = [get_size(header) for header in range(256)]
+_MAX_SIZE = max(_SIZES)
+# Struct codes of the INFO_FORMAT data formats (DATA8, DATA16, DATA32, DATAF)
+_DATA_FORMATS = "bhif"
+_SPEED_STRUCT = Struct("<l")
+
+
+class CaptureDecoder:
+    """Incremental decoder of a stream of messages sent by a device
+
+    The formats of the modes are learned from the INFO_FORMAT messages;
+    they are kept when the device reconnects (see `reset()` to forget them).
+    Messages with a bad checksum are counted and dropped; the stream is then
+    resynchronized on the next byte. Unknown SYS bytes are skipped.
+
+    :key offset: Number of bytes received (position in the whole stream).
+    :key checksum_errors: Number of dropped messages.
+    :key formats: Struct of the DATA messages of each known mode.
+    :key type_id: Type of the device (CMD_TYPE).
+    :key speed: Baudrate announced by the device (CMD_SPEED).
+    """
+
+    def __init__(self):
+        """Constructor"""
+        self.reset()
+
+    def reset(self):
+        """Forget the stream and the learned formats"""
+        self.offset = 0
+        self.checksum_errors = 0
+        self.formats = {}
+        self.type_id = None
+        self.speed = None
+        self._ext_mode = 0
+        self._tail = b""
+
+    def feed(self, chunk):
+        """Decode the messages completed by the given chunk
+
+        :param chunk: Bytes following the previous chunk.
+        :type chunk: <bytes> or <bytearray> or <memoryview>
+        :return: Generator of records in their arrival order.
+        :rtype: <generator <Record>>
+        """
+        if not isinstance(chunk, bytes):
+            # Indexing & slicing are faster on bytes (1 copy of each chunk)
+            chunk = bytes(chunk)
+        tail = self._tail
+        if tail:
+            # Complete the pending message with the head of the chunk only;
+            # the remaining bytes are decoded in place
+            data = tail + chunk[:_MAX_SIZE]
+            base = self.offset - len(tail)
+            pos = yield from self._decode(data, base, 0)
+            if pos < len(tail):
+                # Not enough bytes yet: the chunk is too small
+                self._tail = data[pos:]
+                self.offset += len(chunk)
+                return
+            start = pos - len(tail)
+        else:
+            start = 0
+
+        base = self.offset
+        self.offset += len(chunk)
+        pos = yield from self._decode(chunk, base, start)
+        self._tail = chunk[pos:]
+
+    def _decode(self, data, base, pos):
+        """Decode the complete messages of data from the given position
+
+        :param data: Buffer.
+        :param base: Offset of the buffer in the whole stream.
+        :param pos: Position of the first message in the buffer.
+        :return: Position of the first byte not decoded.
+        :rtype: <int>
+        """
+        # Hot loop: everything is local, records are built without the
+        # keyword wrapper of the namedtuple
+        sizes = _SIZES
+        formats = self.formats
+        new_record = tuple.__new__
+        end = len(data)
+        while pos < end:
+            header = data[pos]
+            size = sizes[header]
+            if size == 1:
+                if header in _SYS_MESSAGES:
+                    yield new_record(
+                        Record, (base + pos, "LUMP_MSG_TYPE_SYS", header, None, b"", None)
+                    )
+                pos += 1
+                continue
+            next_pos = pos + size
+            if next_pos > end:
+                break
+            if size == 3:
+                # Most frequent: 1 byte of payload
+                checksum = header ^ data[pos + 1] ^ data[pos + 2] ^ 0xFF
+            else:
+                checksum = 0xFF
+                for byte in data[pos:next_pos]:
+                    checksum ^= byte
+            if checksum:
+                # Lost byte or noise: resynchronize on the next byte
+                self.checksum_errors += 1
+                pos += 1
+                continue
+
+            if header >= _MSG_TYPE_DATA:
+                mode = (header & LUMP_MSG_CMD_MASK) + self._ext_mode
+                payload = data[pos + 1:next_pos - 1]
+                struct = formats.get(mode)
+                values = None
+                if struct is not None and struct.size <= size - 2:
+                    values = struct.unpack_from(payload)
+                yield new_record(
+                    Record, (base + pos, "LUMP_MSG_TYPE_DATA", mode, None, payload, values)
+                )
+            else:
+                yield self._decode_message(
+                    base + pos, header, header & LUMP_MSG_TYPE_MASK,
+                    data[pos + 1:next_pos - 1]
+                )
+            pos = next_pos
+        return pos
+
+    def _decode_message(self, offset, header, msg_type, payload):
+        """Decode INFO & CMD messages; learn the formats of the modes
+
+        :return: Record of the message.
+        :rtype: <Record>
+        """
+        mode = header & LUMP_MSG_CMD_MASK
+        values = None
+        if msg_type == _MSG_TYPE_INFO:
+            raw_info_type = payload[0]
+            if raw_info_type & INFO_MODE_PLUS_8:
+                mode += 8
+            info_type = raw_info_type & ~INFO_MODE_PLUS_8
+            payload = payload[1:]
+            if info_type == INFO_FORMAT:
+                data_sets, data_format, figures, decimals = payload[:4]
+                values = (data_sets, data_format, figures, decimals)
+                if data_format < len(_DATA_FORMATS):
+                    self.formats[mode] = Struct("<%d%s" % (data_sets, _DATA_FORMATS[data_format]))
+            return Record(offset, "LUMP_MSG_TYPE_INFO", mode, info_type, payload, values)
+
+        # LUMP_MSG_TYPE_CMD
+        if mode == _CMD_TYPE:
+            values = self.type_id = payload[0]
+        elif mode == _CMD_SPEED:
+            values = self.speed = _SPEED_STRUCT.unpack_from(payload)[0]
+        elif mode == _CMD_EXT_MODE:
+            values = self._ext_mode = payload[0]
+        return Record(offset, "LUMP_MSG_TYPE_CMD", _rev_lump_cmd_t[mode], None, payload, values)
+
+
+def forge_message(header, payload=b""):
+    """Build a message sent by a device (checksum appended)
+
+    :param header: Header byte.
+    :param payload: Bytes after the header (info type included).
+    :type header: <int>
+    :type payload: <bytes>
+    :rtype: <bytes>
+    """
+    message = bytes([header]) + payload
+    return message + bytes([get_cheksum(message)])
+
+
+def synthetic_capture(size):
+    """Build a capture of a Color & Distance sensor streaming its modes
+
+    Init sequence (formats of the modes 0, 2, 6 and 8), then a pattern of
+    DATA messages repeated up to the given size (the last pattern is complete).
+
+    :param size: Minimal size in bytes.
+    :type size: <int>
+    :rtype: <bytes>
+    """
+    init = b"".join([
+        forge_message(0x40, b"\x25"),  # CMD_TYPE
+        forge_message(0x52, (115200).to_bytes(4, "little")),  # CMD_SPEED
+        forge_message(0x90, b"\x80\x01\x00\x03\x00"),  # mode 0: 1 int8
+        forge_message(0x92, b"\x80\x01\x02\x06\x00"),  # mode 2: 1 int32
+        forge_message(0x96, b"\x80\x03\x01\x05\x00"),  # mode 6: 3 int16
+        forge_message(0x90, b"\xa0\x04\x00\x03\x00"),  # mode 8: 4 int8
+        b"\x04",
+    ])
+    pattern = b"".join([
+        forge_message(0xC0, b"\x09"),
+        forge_message(0xD2, (1234).to_bytes(4, "little")),
+        forge_message(0xDE, b"\x10\x01\x20\x02\x30\x03\x00\x00"),
+        forge_message(0x46, b"\x08"),
+        forge_message(0xD0, b"\x09\x19\x3a\x00"),
+        forge_message(0x46, b"\x00"),
+        b"\x02",
+    ])
+    return init + pattern * max(1, -(-(size - len(init)) // len(pattern)))
+
+
+def benchmark(size, chunk_size=1 << 16):
+    """Decode a synthetic capture of the given size
+
+    :param size: Size of the capture in bytes.
+    :param chunk_size: Size of the chunks given to the decoder.
+    :return: Number of records, throughput (MB/s).
+    :rtype: <tuple <int>, <float>>
+    """
+    capture = memoryview(synthetic_capture(size))
+    decoder = CaptureDecoder()
+    count = 0
+    start = time.perf_counter()
+    for pos in range(0, len(capture), chunk_size):
+        for _ in decoder.feed(capture[pos:pos + chunk_size]):
+            count += 1
+    duration = time.perf_counter() - start
+    return count, len(capture) / duration / 1e6
+
+
+def main():
+    """Entry point of the benchmark"""
+    parser = argparse.ArgumentParser(description=main.__doc__)
+    parser.add_argument("size", type=int, nargs="?", default=100,
+                        help="Size of the synthetic capture (MB)")
+    parser.add_argument("--chunk", type=int, default=1 << 16,
+                        help="Size of the chunks (bytes)")
+    args = parser.parse_args()
+
+    count, throughput = benchmark(args.size * 1000000, args.chunk)
+    print(f"{count} records, {throughput:.2f} MB/s")
+
+
+if __name__ == "__main__":
+    main()
@@ -25,7 +25,7 @@ from my_own_bricks.messages import get_hex_msg, forge_mode_msg, \
 from my_own_bricks.commons import LOOP_TIMEOUT
 
 
-def get_device_messages():
+def get_device_messages(capture=None):
     """Coroutine for device responses
 
     It's a wrapper that fully encapsulates the LEGO UART protocol. The user the
@@ -52,12 +52,15 @@ def get_device_messages():
     >>>     # messages.send((5, 0))
     >>>     msg = messages.send(6)
 
+    :key capture: Optional capture in which the exchanged bytes are recorded
+        (init sequence included).
+    :type capture: <my_own_bricks.capture.CaptureWriter>
     :return: Coroutine that yields a tuple with (header, response) and accepts
         values: `mode` and `payload` for write queries.
         `mode` is the mode selected on the device to read/write the data.
         `mode` can be set alone if the query is read-only.
     """
-    serial_handler = autoconnect()
+    serial_handler = autoconnect(capture=capture)
     serial_handler.timeout = LOOP_TIMEOUT
 
     # Keep-alive packet: Send NACK to force the device response
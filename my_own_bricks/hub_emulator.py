@@ -0,0 +1,428 @@
+# MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+# Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Asyncio hub emulator: drive several LEGO UART devices at once
+
+Each device is connected to a serial endpoint (real port or pseudo-terminal).
+All endpoints are served concurrently by the same event loop:
+
+    - handshake: the init sequence is read at 2400 bauds until the ACK
+      of the device; the hub answers with an ACK and switches to the speed
+      announced by the device (CMD_SPEED);
+    - keep-alive: a NACK is sent every 100ms; the deadlines are absolute,
+      so the cadence doesn't drift with the load of the loop;
+    - queries: read (select mode) and write queries are queued and sent
+      between the NACKs, with a minimal spacing;
+    - latencies: time between a NACK (or a query) and the first data
+      frame (of the queried mode) received after it.
+
+The frames sent by each device are decoded by a `CaptureDecoder` and exposed
+as an async iterator.
+
+:Example: Soak test of 2 devices:
+
+    >>> async def soak():
+    >>>     async with HubEmulator(["/dev/ttyUSB0", "/dev/ttyACM0"]) as hub:
+    >>>         hub.devices[0].query(1)
+    >>>         async for frame in hub.devices[0].frames():
+    >>>             print(frame.mode, frame.payload)
+    >>>
+    >>> asyncio.run(soak())
+
+.. note:: Linux/POSIX only (termios, non-blocking file descriptors).
+"""
+# Standard imports
+import asyncio
+import os
+import statistics
+import termios
+import tty
+from collections import namedtuple, defaultdict
+
+# Custom imports
+from my_own_bricks.capture_decoder import CaptureDecoder
+from my_own_bricks.messages import forge_mode_msg, forge_write_mode_msg
+
+NACK_PERIOD = 0.1  # Keep-alive period (s)
+QUERY_SPACING = 0.01  # Min time between 2 queries (s)
+HANDSHAKE_TIMEOUT = 5  # Max duration of the init sequence (s)
+DISCONNECTION_DELAY = 0.25  # Silence of a connected device before disconnection (s)
+BAUDRATE_INIT = 2400
+BAUDRATE = 115200
+
+_SYS_NACK = 0x02
+_SYS_ACK = 0x04
+
+_TERMIOS_SPEEDS = {
+    2400: termios.B2400,
+    9600: termios.B9600,
+    57600: termios.B57600,
+    115200: termios.B115200,
+    230400: termios.B230400,
+}
+
+Frame = namedtuple("Frame", ["timestamp", "msg_type", "mode", "info_type", "payload", "values"])
+Frame.__doc__ = """Frame sent by a device
+
+:param timestamp: Reception time (loop time, s).
+:param msg_type: Type of message (LUMP_MSG_TYPE_* key of lump_msg_type_t).
+:param mode: Mode of DATA frames (EXT_MODE included: 0-15); mode of INFO
+    frames; command of CMD frames (key of lump_cmd_t); header of SYS frames.
+:param info_type, payload, values: See `capture_decoder.Record`.
+"""
+
+
+class DeviceEndpoint:
+    """A device connected to the hub emulator through a serial endpoint
+
+    :param path: Path of the serial port or pty; Optional if `fd` is given.
+    :param fd: Already opened file descriptor (Ex: master side of a pty);
+        it is not closed by the endpoint.
+    :param name: Name used in the reports (default: path or fd).
+    :param nack_period: Keep-alive period (s).
+    :param query_spacing: Min time between 2 queries (s).
+    :key type_id: Type of the device (from its init sequence).
+    :key speed: Baudrate announced by the device.
+    :key info_frames: Frames of the init sequence.
+    :key nack_times: Send times of the NACKs (loop time, s).
+    :key latencies: Latencies (s); key "nack" for the data received after
+        the NACKs, mode numbers for the queries.
+    :key disconnections: Number of silences longer than DISCONNECTION_DELAY
+        or closings of the other side.
+    :key closed: The other side of the endpoint is closed (EOF or EIO);
+        the keep-alive is stopped and the frames iterator ended.
+    """
+
+    def __init__(self, path=None, fd=None, name=None, nack_period=NACK_PERIOD,
+                 query_spacing=QUERY_SPACING):
+        """Constructor"""
+        if path is None and fd is None:
+            raise ValueError("A path or a file descriptor is expected")
+        self.path = path
+        self.fd = fd
+        self.name = name or path or "fd%d" % fd
+        self.nack_period = nack_period
+        self.query_spacing = query_spacing
+
+        self.type_id = None
+        self.speed = BAUDRATE
+        self.info_frames = []
+        self.nack_times = []
+        self.latencies = defaultdict(list)
+        self.disconnections = 0
+        self.frames_count = 0
+        self.closed = False
+
+        self._owned_fd = fd is None
+        self._decoder = CaptureDecoder()
+        self._incoming = None
+        self._frames = None
+        self._queries = None
+        self._tasks = []
+        self._pending_nack = None
+        self._pending_queries = {}
+        self._last_frame_time = None
+        self._connected = False
+
+    @property
+    def checksum_errors(self):
+        """Number of frames dropped because of a bad checksum"""
+        return self._decoder.checksum_errors
+
+    @property
+    def connected(self):
+        """The device answered during the last DISCONNECTION_DELAY"""
+        return self._connected
+
+    # Serial endpoint #########################################################
+
+    def _open(self):
+        """Open the endpoint in raw, non-blocking mode"""
+        if self._owned_fd:
+            self.fd = os.open(self.path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        else:
+            os.set_blocking(self.fd, False)
+        tty.setraw(self.fd)
+        self.set_baudrate(BAUDRATE_INIT)
+
+    def set_baudrate(self, baudrate):
+        """Set the speed of the endpoint (no effect on a pty)
+
+        :type baudrate: <int>
+        """
+        attributes = termios.tcgetattr(self.fd)
+        speed = _TERMIOS_SPEEDS[baudrate]
+        attributes[4] = attributes[5] = speed
+        termios.tcsetattr(self.fd, termios.TCSADRAIN, attributes)
+
+    def _write(self, data):
+        """Send bytes to the device; 1 message never exceeds the kernel buffer"""
+        if self.closed:
+            return
+        try:
+            os.write(self.fd, data)
+        except OSError:
+            self._on_closed()
+
+    def _on_readable(self):
+        """Reader callback of the loop: decode the received bytes into frames"""
+        try:
+            data = os.read(self.fd, 4096)
+        except (BlockingIOError, InterruptedError):
+            return
+        except OSError:
+            # EIO: other side of the pty closed
+            data = b""
+        if not data:
+            self._on_closed()
+            return
+        timestamp = asyncio.get_running_loop().time()
+        for record in self._decoder.feed(data):
+            self._incoming.put_nowait(Frame(timestamp, *record[1:]))
+
+    def _on_closed(self):
+        """Other side closed: stop polling the endpoint (the fd would stay
+        readable forever) and wake the consumers of the incoming frames
+        """
+        if self.closed:
+            return
+        self.closed = True
+        asyncio.get_running_loop().remove_reader(self.fd)
+        if self._connected:
+            self.disconnections += 1
+        self._connected = False
+        self._incoming.put_nowait(None)
+
+    # Protocol ################################################################
+
+    async def _handshake(self, timeout):
+        """Read the init sequence until the ACK of the device, then answer
+
+        :raise: <asyncio.TimeoutError> if no ACK is received in time.
+        :raise: <ConnectionError> if the other side is closed.
+        """
+        async def wait_ack():
+            while True:
+                frame = await self._incoming.get()
+                if frame is None:
+                    raise ConnectionError("%s closed during the handshake" % self.name)
+                if frame.msg_type == "LUMP_MSG_TYPE_SYS":
+                    if frame.mode == _SYS_ACK:
+                        return
+                    continue
+                self.info_frames.append(frame)
+                if frame.mode == "LUMP_CMD_TYPE":
+                    self.type_id = frame.values
+                elif frame.mode == "LUMP_CMD_SPEED":
+                    self.speed = frame.values
+
+        await asyncio.wait_for(wait_ack(), timeout)
+        self._write(bytes([_SYS_ACK]))
+        # Let the ACK leave at the init speed before switching
+        await asyncio.get_running_loop().run_in_executor(None, termios.tcdrain, self.fd)
+        self.set_baudrate(self.speed if self.speed in _TERMIOS_SPEEDS else BAUDRATE)
+
+    async def _nack_loop(self):
+        """Send a NACK every nack_period, on absolute deadlines"""
+        loop = asyncio.get_running_loop()
+        deadline = loop.time()
+        while not self.closed:
+            now = loop.time()
+            self._write(bytes([_SYS_NACK]))
+            self.nack_times.append(now)
+            if self._pending_nack is None:
+                self._pending_nack = now
+
+            if self._last_frame_time is not None and now - self._last_frame_time > DISCONNECTION_DELAY:
+                if self._connected:
+                    self.disconnections += 1
+                self._connected = False
+
+            deadline += self.nack_period
+            if deadline < now:
+                # The loop was blocked: skip the missed slots
+                deadline = now + self.nack_period
+            await asyncio.sleep(deadline - loop.time())
+
+    async def _query_loop(self):
+        """Send the queued queries, spaced by query_spacing"""
+        loop = asyncio.get_running_loop()
+        last_time = None
+        while True:
+            mode, message = await self._queries.get()
+            if last_time is not None:
+                delay = last_time + self.query_spacing - loop.time()
+                if delay > 0:
+                    await asyncio.sleep(delay)
+            self._write(message)
+            last_time = loop.time()
+            self._pending_queries.setdefault(mode, last_time)
+
+    async def _dispatch_loop(self):
+        """Decode the frames, measure the latencies and publish the frames"""
+        while True:
+            frame = await self._incoming.get()
+            if frame is None:
+                # Endpoint closed: end the frames iterator
+                self._frames.put_nowait(None)
+                return
+            timestamp = frame.timestamp
+            self._last_frame_time = timestamp
+            self._connected = True
+            self.frames_count += 1
+
+            if frame.mode == "LUMP_CMD_EXT_MODE":
+                # 1st part of the data of a mode >= 8 (applied by the decoder)
+                continue
+            if frame.msg_type == "LUMP_MSG_TYPE_DATA":
+                if self._pending_nack is not None:
+                    self.latencies["nack"].append(timestamp - self._pending_nack)
+                    self._pending_nack = None
+                query_time = self._pending_queries.pop(frame.mode, None)
+                if query_time is not None:
+                    self.latencies[frame.mode].append(timestamp - query_time)
+            self._frames.put_nowait(frame)
+
+    async def start(self, timeout=HANDSHAKE_TIMEOUT):
+        """Open the endpoint, make the handshake and start the keep-alive"""
+        self._incoming = asyncio.Queue()
+        self._frames = asyncio.Queue()
+        self._queries = asyncio.Queue()
+        self._open()
+        loop = asyncio.get_running_loop()
+        loop.add_reader(self.fd, self._on_readable)
+        try:
+            await self._handshake(timeout)
+        except BaseException:
+            await self.stop()
+            raise
+        self._connected = True
+        self._tasks = [
+            asyncio.ensure_future(self._nack_loop()),
+            asyncio.ensure_future(self._query_loop()),
+            asyncio.ensure_future(self._dispatch_loop()),
+        ]
+
+    async def stop(self):
+        """Stop the keep-alive, end the frames iterator and close the endpoint"""
+        for task in self._tasks:
+            task.cancel()
+        await asyncio.gather(*self._tasks, return_exceptions=True)
+        self._tasks = []
+        if self.fd is not None:
+            asyncio.get_running_loop().remove_reader(self.fd)
+            if self._owned_fd:
+                os.close(self.fd)
+                self.fd = None
+        if self._frames is not None:
+            self._frames.put_nowait(None)
+
+    def query(self, mode, payload=None):
+        """Queue a query
+
+        :param mode: Mode to select (read query) or to write.
+        :param payload: Value to write (see `forge_write_mode_msg`);
+            None for a read query.
+        :type mode: <int>
+        :type payload: <int>
+        """
+        if payload is None:
+            message = forge_mode_msg(mode)
+        else:
+            message = forge_write_mode_msg(mode, data=payload)
+        self._queries.put_nowait((mode, bytes(message)))
+
+    async def frames(self):
+        """Async iterator of the frames sent by the device after the handshake
+
+        Ends when the endpoint is stopped or closed by the other side.
+
+        :rtype: <async iterator <Frame>>
+        """
+        while True:
+            frame = await self._frames.get()
+            if frame is None:
+                return
+            yield frame
+
+    def get_stats(self):
+        """Summary of the timings of the session
+
+        :return: NACK intervals (mean, max deviation from the period) and
+            latencies (count, median, max) in ms.
+        :rtype: <dict>
+        """
+        intervals = [b - a for a, b in zip(self.nack_times, self.nack_times[1:])]
+        stats = {
+            "name": self.name,
+            "frames": self.frames_count,
+            "checksum_errors": self.checksum_errors,
+            "disconnections": self.disconnections,
+            "nack_mean_ms": statistics.mean(intervals) * 1000 if intervals else None,
+            "nack_jitter_ms": max(abs(i - self.nack_period) for i in intervals) * 1000 if intervals else None,
+        }
+        for key, values in self.latencies.items():
+            stats["latency_%s_ms" % key] = (
+                len(values),
+                statistics.median(values) * 1000,
+                max(values) * 1000,
+            )
+        return stats
+
+
+class HubEmulator:
+    """Hub driving several devices concurrently
+
+    :param endpoints: Paths of serial ports/ptys or DeviceEndpoint objects.
+    :param timeout: Max duration of the handshakes (s).
+    """
+
+    def __init__(self, endpoints, timeout=HANDSHAKE_TIMEOUT):
+        """Constructor"""
+        self.devices = [
+            endpoint if isinstance(endpoint, DeviceEndpoint) else DeviceEndpoint(endpoint)
+            for endpoint in endpoints
+        ]
+        self.timeout = timeout
+
+    async def start(self):
+        """Connect all the devices concurrently
+
+        :raise: <asyncio.TimeoutError> if a device doesn't complete its handshake;
+            the other devices are stopped.
+        """
+        results = await asyncio.gather(
+            *(device.start(self.timeout) for device in self.devices),
+            return_exceptions=True
+        )
+        errors = [result for result in results if isinstance(result, BaseException)]
+        if errors:
+            await self.stop()
+            raise errors[0]
+
+    async def stop(self):
+        """Disconnect all the devices"""
+        await asyncio.gather(*(device.stop() for device in self.devices))
+
+    async def __aenter__(self):
+        await self.start()
+        return self
+
+    async def __aexit__(self, *args):
+        await self.stop()
+
+    def get_stats(self):
+        """Timings of all the devices; see `DeviceEndpoint.get_stats`"""
+        return [device.get_stats() for device in self.devices]
@@ -0,0 +1,181 @@
+# MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+# Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Decoder of the binary trace events sent by the library (TRACE in global.h)
+
+The events are recorded by the microcontroller in a ring buffer instead of
+printing messages in the hot paths of the protocol (see src/TraceBuffer.h),
+then sent to the debug serial port as frames of 10 bytes:
+
+    sync (0xA5), id, arg0, arg1 (2 bytes LE), timestamp in µs (4 bytes LE),
+    checksum (0xFF XOR the previous bytes).
+
+The ids are mapped back to the messages formerly printed by DEBUG/INFO.
+
+:Example:
+
+    >>> decoder = TraceDecoder()
+    >>> for event in decoder.feed(serial_handler.read(serial_handler.in_waiting)):
+    >>>     print(event.tick, event.message)
+
+Command line:
+
+    $ python -m my_own_bricks.trace_decoder /dev/ttyACM0
+"""
+# Standard imports
+import argparse
+from collections import namedtuple
+from struct import Struct
+
+TRACE_SYNC = 0xA5
+TRACE_FRAME_SIZE = 10
+
+# Messages of the ids of trace_event_t (src/TraceBuffer.h); MUST be kept in sync.
+# Fields: arg0, arg1, arg1_msb, arg1_lsb.
+TRACE_MESSAGES = {
+    0: "Trace overflow; events lost: {arg1}",
+    1: "<\tHeader {arg0:X}",
+    2: "incomplete message: {arg0:X}",
+    3: "<\tAsked mode {arg0}",
+    4: "unknown R mode: {arg0:X}",
+    5: "unknown W mode: {arg0:X}",
+    6: "LEDcolor set: {arg0:X}",
+    7: "IR data set: {arg1:X}",
+    8: "Config set: {arg1}",
+    9: "Mode {arg0}",
+    10: "LEDBrightnesses set (Left,Bottom,Right): {arg0:X}, {arg1_msb:X}, {arg1_lsb:X}",
+    11: "Default combos mode",
+    12: "Disconnect; Too much time since last NACK - {arg1}",
+}
+
+TraceEvent = namedtuple("TraceEvent", ["tick", "id", "arg0", "arg1", "message"])
+TraceEvent.__doc__ = """Event decoded from the trace
+
+:param tick: Time of the event on the microcontroller (µs, wraps every ~71 min).
+:param id: Id of the event (trace_event_t).
+:param arg0: 8 bits value.
+:param arg1: 16 bits value.
+:param message: Formatted message; "unknown event <id>" for an unknown id.
+"""
+
+_FRAME_STRUCT = Struct("<BBBHIB")
+
+
+def format_message(event_id, arg0, arg1):
+    """Get the message of an event with its values
+
+    :rtype: <str>
+    """
+    message = TRACE_MESSAGES.get(event_id)
+    if message is None:
+        return f"unknown event {event_id}: {arg0}, {arg1}"
+    return message.format(arg0=arg0, arg1=arg1, arg1_msb=arg1 >> 8, arg1_lsb=arg1 & 0xFF)
+
+
+def forge_frame(event_id, arg0=0, arg1=0, tick=0):
+    """Build the frame of an event, as sent by TraceBuffer::drain()
+
+    :rtype: <bytes>
+    """
+    frame = bytearray(_FRAME_STRUCT.pack(TRACE_SYNC, event_id, arg0, arg1, tick, 0))
+    checksum = 0xFF
+    for byte in frame[:-1]:
+        checksum ^= byte
+    frame[-1] = checksum
+    return bytes(frame)
+
+
+class TraceDecoder:
+    """Incremental decoder of a stream of trace frames
+
+    Frames with a bad checksum are counted and dropped; the stream is then
+    resynchronized on the next sync byte (other prints of the sketch on the
+    same port are skipped the same way).
+
+    :key checksum_errors: Number of dropped frames.
+    :key skipped: Number of bytes skipped while searching a sync byte.
+    """
+
+    def __init__(self):
+        """Constructor"""
+        self.checksum_errors = 0
+        self.skipped = 0
+        self._tail = b""
+
+    def feed(self, chunk):
+        """Decode the frames completed by the given chunk
+
+        :param chunk: Bytes following the previous chunk.
+        :type chunk: <bytes> or <bytearray> or <memoryview>
+        :return: Generator of events in their arrival order.
+        :rtype: <generator <TraceEvent>>
+        """
+        data = self._tail + bytes(chunk)
+        pos = 0
+        end = len(data)
+        while True:
+            sync = data.find(TRACE_SYNC, pos)
+            if sync == -1:
+                self.skipped += end - pos
+                pos = end
+                break
+            self.skipped += sync - pos
+            pos = sync
+            if end - pos < TRACE_FRAME_SIZE:
+                break
+
+            checksum = 0xFF
+            for byte in data[pos:pos + TRACE_FRAME_SIZE]:
+                checksum ^= byte
+            if checksum:
+                # Not a frame or corrupted one: search the next sync byte
+                self.checksum_errors += 1
+                self.skipped += 1
+                pos += 1
+                continue
+
+            _, event_id, arg0, arg1, tick, _ = _FRAME_STRUCT.unpack_from(data, pos)
+            pos += TRACE_FRAME_SIZE
+            yield TraceEvent(tick, event_id, arg0, arg1, format_message(event_id, arg0, arg1))
+        self._tail = data[pos:]
+
+
+def main():
+    """Print the trace events received on a serial port (or from a file)"""
+    parser = argparse.ArgumentParser(description=main.__doc__)
+    parser.add_argument("port", help="Serial port (/dev/ttyACM0) or file of raw frames")
+    parser.add_argument("--baudrate", type=int, default=115200)
+    args = parser.parse_args()
+
+    decoder = TraceDecoder()
+    if args.port.startswith("/dev/"):
+        import serial
+        serial_handler = serial.Serial(args.port, args.baudrate)
+        read = lambda: serial_handler.read(max(1, serial_handler.in_waiting))
+    else:
+        file = open(args.port, "rb")
+        read = lambda: file.read(1 << 16)
+
+    try:
+        for chunk in iter(read, b""):
+            for event in decoder.feed(chunk):
+                print(f"{event.tick / 1e6:.6f}", event.message)
+    except KeyboardInterrupt:
+        pass
+    print(f"checksum errors: {decoder.checksum_errors}, skipped bytes: {decoder.skipped}")
+
+
+if __name__ == "__main__":
+    main()
@@ -32,6 +32,9 @@ import os
 import time
 import serial
 
+# Custom imports
+from my_own_bricks.capture import RecordingSerial
+
 SERIAL_PORT = "/dev/ttyUSB0"
 BAUDRATE_INIT = 2400
 BAUDRATE = 115200
@@ -104,16 +107,21 @@ def get_serial_handler(serial_path, baudrate):
     raise IOError("Serial port <%s> not available!" % serial_path)
 
 
-def connect_to_hub():
+def connect_to_hub(capture=None):
     """Connect to hub, send and receive queries
 
     .. note:: The maximum time interval allowed is ~200ms between 2 NACKS,
         or between the connection and the first NACK sent to the device.
 
+    :key capture: Optional capture in which the exchanged bytes are recorded,
+        from the init sequence.
+    :type capture: <my_own_bricks.capture.CaptureWriter>
     :return: Serial handler
-    :rtype: serial.Serial
+    :rtype: serial.Serial or RecordingSerial
     """
     serial_handler = get_serial_handler(SERIAL_PORT, BAUDRATE_INIT)
+    if capture is not None:
+        serial_handler = RecordingSerial(serial_handler, capture)
 
     # Wait configuration data until ACK
     ack_exchanged = False
@@ -143,20 +151,23 @@ def connect_to_hub():
     return serial_handler
 
 
-def autoconnect():
+def autoconnect(capture=None):
     """Automatic connection via 3 attempts to find device on serial line
     Sometimes init sequence can be missed, this function accept 5 fails.
 
     .. seealso:: `connect_to_hub`
 
+    :key capture: Optional capture in which the exchanged bytes are recorded
+        (failed attempts included).
+    :type capture: <my_own_bricks.capture.CaptureWriter>
     :return: Serial handler
-    :rtype: serial.Serial
+    :rtype: serial.Serial or RecordingSerial
     """
     i = 0
     serial_handler = None
     while i < 3:
         try:
-            serial_handler = connect_to_hub()
+            serial_handler = connect_to_hub(capture)
         except AssertionError as e:
             if "retry" in e.__str__():
                 i += 1
@@ -0,0 +1,319 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "AsyncI2C.h"
+
+#if defined(__AVR__) || defined(ARDUINO)
+
+#if defined(__AVR__)
+#include <avr/interrupt.h>
+#include <util/twi.h>
+#else
+#include <Wire.h>
+#endif
+
+#if defined(__AVR__) && defined(ASYNC_I2C_ISR)
+// Queues are shared with the TWI interrupt
+#define I2C_LOCK()      uint8_t sreg = SREG; cli()
+#define I2C_UNLOCK()    SREG = sreg
+// Let the hardware raise the TWI interrupt
+#define TWI_IE          _BV(TWIE)
+#else
+#define I2C_LOCK()      void()
+#define I2C_UNLOCK()    void()
+#define TWI_IE          0
+#endif
+
+AsyncI2C I2CEngine;
+
+
+AsyncI2C::AsyncI2C() :
+    m_devices(nullptr),
+    m_current(nullptr),
+    m_active(nullptr),
+    m_regIndex(0),
+    m_dataIndex(0),
+    m_receiving(false),
+    m_progressTick(0)
+{}
+
+
+/**
+ * @brief Configure the bus.
+ * @param frequency SCL frequency (default: 400kHz, supported by TCS34725 & VL6180X).
+ */
+void AsyncI2C::begin(uint32_t frequency){
+#if defined(__AVR__)
+    // Prescaler 1; SCL = F_CPU / (16 + 2 * TWBR)
+    TWSR = 0;
+    TWBR = _(uint8_t)(((F_CPU / frequency) - 16) / 2);
+    TWCR = _BV(TWEN);
+#else
+    Wire.begin();
+    Wire.setClock(frequency);
+#endif
+}
+
+
+/**
+ * @brief Register a device; the device must stay alive.
+ */
+void AsyncI2C::attach(I2CDevice& device){
+    I2C_LOCK();
+    device.next = m_devices;
+    m_devices   = &device;
+    I2C_UNLOCK();
+}
+
+
+/**
+ * @brief Queue a transaction at the end of the queue of the given device.
+ * @return false if the transaction is already pending.
+ */
+bool AsyncI2C::submit(I2CDevice& device, I2CTransaction& transaction){
+    if (transaction.isPending())
+        return false;
+
+    transaction.device = &device;
+    transaction.next   = nullptr;
+    transaction.status = I2CTransaction::I2C_PENDING;
+
+    I2C_LOCK();
+    if (device.tail)
+        device.tail->next = &transaction;
+    else
+        device.head = &transaction;
+    device.tail = &transaction;
+    I2C_UNLOCK();
+
+#if defined(__AVR__)
+    poll();
+#endif
+    return true;
+}
+
+
+/**
+ * @brief Bus is free and no transaction is queued.
+ *      Wire can be used safely if true.
+ */
+bool AsyncI2C::isIdle(){
+    if (m_active)
+        return false;
+    for (I2CDevice *device = m_devices; device; device = device->next) {
+        if (device->head)
+            return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Take the next transaction (round-robin between devices) and start it.
+ *      The bus must be free.
+ */
+void AsyncI2C::startNext(){
+    if (!m_devices)
+        return;
+
+    I2C_LOCK();
+    // Start from the device after the last one served
+    I2CDevice *start  = (m_current && m_current->next) ? m_current->next : m_devices;
+    I2CDevice *device = start;
+    do {
+        if (device->head) {
+            m_active     = device->head;
+            device->head = m_active->next;
+            if (!device->head)
+                device->tail = nullptr;
+            m_current = device;
+            break;
+        }
+        device = (device->next) ? device->next : m_devices;
+    } while (device != start);
+    I2C_UNLOCK();
+
+    if (!m_active)
+        return;
+
+    m_regIndex  = 0;
+    m_dataIndex = 0;
+    m_receiving = false;
+    m_progressTick = millis();
+
+#if defined(__AVR__)
+    TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | TWI_IE;
+#else
+    // Blocking fallback with Wire
+    I2CTransaction *transaction = m_active;
+    uint8_t         status      = I2CTransaction::I2C_ERROR;
+
+    Wire.beginTransmission(transaction->device->address);
+    if (transaction->device->reg16)
+        Wire.write(_(uint8_t)(transaction->reg >> 8));
+    Wire.write(_(uint8_t)(transaction->reg));
+    if (transaction->read) {
+        if (Wire.endTransmission(false) == 0 &&
+            Wire.requestFrom(transaction->device->address, transaction->length) == transaction->length) {
+            for (uint8_t i = 0; i < transaction->length; i++)
+                transaction->buffer[i] = Wire.read();
+            status = I2CTransaction::I2C_DONE;
+        }
+    } else {
+        Wire.write(transaction->buffer, transaction->length);
+        if (Wire.endTransmission() == 0)
+            status = I2CTransaction::I2C_DONE;
+    }
+    finish(status);
+#endif
+}
+
+
+/**
+ * @brief End the active transaction and call its callback.
+ * @param status I2C_DONE or I2C_ERROR.
+ */
+void AsyncI2C::finish(uint8_t status){
+    I2CTransaction *transaction = m_active;
+
+#if defined(__AVR__)
+    // Release the bus
+    TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+#endif
+    m_active = nullptr;
+
+    transaction->status = status;
+    if (transaction->callback)
+        transaction->callback(*transaction);
+}
+
+
+/**
+ * @brief Advance the engine: handle the pending events of the bus and
+ *      start the next transaction if the bus is free.
+ *      Must be called frequently from loop(); never blocks on AVR.
+ */
+void AsyncI2C::poll(){
+#if defined(__AVR__)
+    if (m_active) {
+#ifndef ASYNC_I2C_ISR
+        // Handle all the events already signaled by the hardware
+        while (m_active && (TWCR & _BV(TWINT)))
+            handleEvent();
+#endif
+        // The timeout runs since the last handled event, not since the start:
+        // a multi-byte transaction may span several slow iterations of loop()
+        I2C_LOCK();
+        if (m_active && millis() - m_progressTick > ASYNC_I2C_TIMEOUT) {
+            // Bus stuck: reset the TWI unit
+            TWCR = 0;
+            finish(I2CTransaction::I2C_ERROR);
+        }
+        I2C_UNLOCK();
+    }
+    // Wait for the end of the previous STOP condition
+    if (!m_active && !(TWCR & _BV(TWSTO)))
+        startNext();
+#else
+    if (!m_active)
+        startNext();
+#endif
+}
+
+
+#if defined(__AVR__)
+/**
+ * @brief Handle 1 step of the TWI state machine (TWINT is set).
+ *      Called from poll() or from the TWI interrupt.
+ */
+void AsyncI2C::handleEvent(){
+    I2CTransaction *transaction = m_active;
+    if (!transaction) {
+        // Spurious event
+        TWCR = _BV(TWINT) | _BV(TWEN);
+        return;
+    }
+    const uint8_t regSize = (transaction->device->reg16) ? 2 : 1;
+    m_progressTick = millis();
+
+    switch (TW_STATUS) {
+        case TW_START:
+        case TW_REP_START:
+            TWDR = _(uint8_t)((transaction->device->address << 1) | ((m_receiving) ? TW_READ : TW_WRITE));
+            TWCR = _BV(TWINT) | _BV(TWEN) | TWI_IE;
+            break;
+
+        case TW_MT_SLA_ACK:
+        case TW_MT_DATA_ACK:
+            if (m_regIndex < regSize) {
+                // Register address, MSB first
+                m_regIndex++;
+                TWDR = _(uint8_t)(transaction->reg >> (8 * (regSize - m_regIndex)));
+                TWCR = _BV(TWINT) | _BV(TWEN) | TWI_IE;
+            } else if (transaction->read && transaction->length) {
+                // Repeated start for the read phase
+                m_receiving = true;
+                TWCR        = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | TWI_IE;
+            } else if (m_dataIndex < transaction->length) {
+                TWDR = transaction->buffer[m_dataIndex++];
+                TWCR = _BV(TWINT) | _BV(TWEN) | TWI_IE;
+            } else {
+                finish(I2CTransaction::I2C_DONE);
+            }
+            break;
+
+        case TW_MR_DATA_ACK:
+            transaction->buffer[m_dataIndex++] = TWDR;
+            // fall through
+        case TW_MR_SLA_ACK:
+            // ACK all bytes but the last one
+            if (m_dataIndex + 1 < transaction->length)
+                TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | TWI_IE;
+            else
+                TWCR = _BV(TWINT) | _BV(TWEN) | TWI_IE;
+            break;
+
+        case TW_MR_DATA_NACK:
+            // Last byte
+            transaction->buffer[m_dataIndex++] = TWDR;
+            finish(I2CTransaction::I2C_DONE);
+            break;
+
+        default:
+            // NACK of address/data, arbitration lost, bus error
+            finish(I2CTransaction::I2C_ERROR);
+            break;
+    }
+
+#ifdef ASYNC_I2C_ISR
+    if (!m_active) {
+        // Chain the next transaction as soon as the STOP condition is sent
+        while (TWCR & _BV(TWSTO)) {}
+        startNext();
+    }
+#endif
+}
+
+
+#ifdef ASYNC_I2C_ISR
+ISR(TWI_vect) {
+    I2CEngine.handleEvent();
+}
+#endif
+#endif // __AVR__
+
+#endif // __AVR__ || ARDUINO
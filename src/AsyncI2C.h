@@ -0,0 +1,188 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ASYNCI2C_H
+#define ASYNCI2C_H
+
+#include "global.h"
+#include "Arduino.h"
+
+#if defined(__AVR__) || defined(ARDUINO)
+
+// Max time without any bus event in the active transaction before the bus is reset (ms)
+#define ASYNC_I2C_TIMEOUT    10
+
+struct I2CTransaction;
+typedef void (*I2CCallback)(I2CTransaction& transaction);
+
+
+/**
+ * @brief Register read/write queued on an I2CDevice.
+ *
+ *    The transaction and its buffer are owned by the caller and must stay
+ *    alive until its completion (status != I2C_PENDING); A transaction can't
+ *    be submitted again while it is pending.
+ *
+ * @param reg Register address (8 or 16 bits; see I2CDevice). For 8 bits
+ *      devices, the command bits must be included (Ex: 0x80 for TCS34725).
+ * @param buffer Data to write, or received data.
+ * @param length Number of bytes to read/write. A write of 0 bytes only
+ *      sends the register address (Ex: special functions of TCS34725).
+ * @param read Read transaction if true.
+ * @param status I2C_PENDING, I2C_DONE or I2C_ERROR (NACK, bus error, timeout).
+ * @param callback Function called on completion; Optional.
+ *      It is called from AsyncI2C::poll() or from the TWI interrupt
+ *      if ASYNC_I2C_ISR is defined; keep it short.
+ * @param context Free pointer for the callback.
+ */
+struct I2CTransaction {
+    enum Status : uint8_t {
+        I2C_IDLE,
+        I2C_PENDING,
+        I2C_DONE,
+        I2C_ERROR
+    };
+
+    I2CTransaction() :
+        reg(0), buffer(nullptr), length(0), read(false), status(I2C_IDLE),
+        callback(nullptr), context(nullptr), device(nullptr), next(nullptr)
+    {}
+
+    void setRead(uint16_t regAddress, uint8_t *data, uint8_t size) {
+        reg    = regAddress;
+        buffer = data;
+        length = size;
+        read   = true;
+    }
+
+    void setWrite(uint16_t regAddress, uint8_t *data, uint8_t size) {
+        reg    = regAddress;
+        buffer = data;
+        length = size;
+        read   = false;
+    }
+
+    bool isPending() const {
+        return status == I2C_PENDING;
+    }
+
+    uint16_t         reg;
+    uint8_t          *buffer;
+    uint8_t          length;
+    bool             read;
+    volatile uint8_t status;
+    I2CCallback      callback;
+    void             *context;
+
+    // Internal: queue of the device
+    struct I2CDevice      *device;
+    struct I2CTransaction *next;
+};
+
+
+/**
+ * @brief Chip on the bus with its own queue of transactions.
+ *
+ * @param address 7 bits address.
+ * @param reg16 Registers addresses on 16 bits (MSB first; Ex: VL6180X).
+ */
+struct I2CDevice {
+    explicit I2CDevice(uint8_t deviceAddress, bool reg16bits = false) :
+        address(deviceAddress), reg16(reg16bits), head(nullptr), tail(nullptr), next(nullptr)
+    {}
+
+    uint8_t address;
+    bool    reg16;
+
+    // Internal
+    I2CTransaction *head;
+    I2CTransaction *tail;
+    I2CDevice      *next;
+};
+
+
+/**
+ * @brief Asynchronous I2C engine: queued register transactions,
+ *      interleaved between devices.
+ *
+ *    Each device has its own FIFO of transactions; the engine serves the
+ *    devices in round-robin: one transaction of a device, then one of
+ *    the next device with pending work, etc. A burst read of a chip can't
+ *    starve the other one, and both can be read during the same period.
+ *
+ *    AVR: The TWI state machine is advanced byte by byte without ever
+ *    waiting for the bus:
+ *      - By default, from poll() which must be called from loop() (a call
+ *        only handles the events already signaled by the hardware).
+ *        This mode coexists with Wire: Wire calls (sensors libraries,
+ *        configuration) are allowed when isIdle() is true.
+ *      - With ASYNC_I2C_ISR (global.h), from the TWI interrupt. Wire MUST NOT
+ *        be linked in this mode: it also defines the TWI interrupt vector.
+ *    Other boards: transactions are made with Wire (blocking), one per call
+ *    of poll(), with the same queuing and interleaving.
+ *
+ *    Example:
+ *      I2CDevice      rgbChip(0x29);
+ *      I2CTransaction rgbcRead;
+ *      uint8_t        rgbc[8];
+ *
+ *      I2CEngine.begin();
+ *      I2CEngine.attach(rgbChip);
+ *      rgbcRead.setRead(0x80 | 0x20 | 0x14, rgbc, 8);
+ *      I2CEngine.submit(rgbChip, rgbcRead);
+ *      // In loop()
+ *      I2CEngine.poll();
+ *
+ * @param m_devices Linked list of attached devices.
+ * @param m_current Device served last (round-robin).
+ * @param m_active Transaction in progress; nullptr if the bus is free.
+ * @param m_regIndex, m_dataIndex Progress of the active transaction.
+ * @param m_receiving Active transaction is in its read phase (after the repeated start).
+ * @param m_progressTick Time of the last progress of the active transaction (ms);
+ *      see ASYNC_I2C_TIMEOUT.
+ */
+class AsyncI2C {
+
+public:
+    AsyncI2C();
+    void begin(uint32_t frequency = 400000);
+    void attach(I2CDevice& device);
+    bool submit(I2CDevice& device, I2CTransaction& transaction);
+    void poll();
+    bool isIdle();
+
+#if defined(__AVR__)
+    void handleEvent();
+#endif
+
+private:
+    void startNext();
+    void finish(uint8_t status);
+
+    I2CDevice      *m_devices;
+    I2CDevice      *m_current;
+    I2CTransaction *volatile m_active;
+    uint8_t        m_regIndex;
+    uint8_t        m_dataIndex;
+    bool           m_receiving;
+    volatile unsigned long m_progressTick;
+};
+
+extern AsyncI2C I2CEngine;
+
+#endif // __AVR__ || ARDUINO
+#endif // ASYNCI2C_H
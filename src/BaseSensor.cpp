@@ -19,11 +19,42 @@
  */
 #include "BaseSensor.h"
 
+#if defined(ESP32) && defined(NACK_LATENCY_STATS)
+// Stats are written by the protocol task and read from the other core
+static portMUX_TYPE nackStatsMux = portMUX_INITIALIZER_UNLOCKED;
+#define NACK_STATS_LOCK()      taskENTER_CRITICAL(&nackStatsMux)
+#define NACK_STATS_UNLOCK()    taskEXIT_CRITICAL(&nackStatsMux)
+#else
+#define NACK_STATS_LOCK()      void()
+#define NACK_STATS_UNLOCK()    void()
+#endif
+
 BaseSensor::BaseSensor() :
+#if defined(ESP32) && (defined(ESP32_SERIAL2) || defined(UART_EVENT_SERIAL))
+    // UART2 default pins
+    m_connSerialRX_pin(16),
+    m_connSerialTX_pin(17),
+#elif defined(ESP32)
+    // UART0 (Serial) pins
+    m_connSerialRX_pin(3),
+    m_connSerialTX_pin(1),
+#else
     m_connSerialRX_pin(0),
     m_connSerialTX_pin(1),
+#endif
     m_lastAckTick(0),
-    m_connected(false)
+    m_connected(false),
+    m_idleCallback(nullptr),
+    m_firstDataTick(0)
+#if defined(ESP32)
+    , m_syncCallback(nullptr)
+#endif
+#ifdef NACK_LATENCY_STATS
+    , m_previousPollTick(0)
+    , m_lastPollTick(0)
+    , m_nackTick(0)
+    , m_nackStats()
+#endif
 {}
 
 /**
@@ -35,6 +66,31 @@ bool BaseSensor::isConnected(){
 }
 
 
+/**
+ * @brief Set a function called repeatedly while the sensor waits for the hub
+ *      during the handshake (line idle, init sequence at 2400 bauds, ACK).
+ *
+ *    The connection takes more than 1s; the sketch can bring up its chips
+ *    meanwhile instead of before the first call of process(), with a
+ *    StartupSequencer (utilities/startup_sequencer.hpp) for example.
+ *    The callback must return quickly (a few ms): the timings of the
+ *    handshake are checked between 2 calls.
+ * @param idleCallback Function without argument; nullptr to disable.
+ */
+void BaseSensor::setIdleCallback(void (*idleCallback)()){
+    m_idleCallback = idleCallback;
+}
+
+
+/**
+ * @brief Get the time from power-on to the first data message sent to the hub.
+ * @return Time in ms (value of millis()); 0 if no data was sent yet.
+ */
+unsigned long BaseSensor::getFirstDataTime(){
+    return m_firstDataTick;
+}
+
+
 /**
  * @brief Get checksum for the given message
  * @param pData Message array: Header + Payload
@@ -74,12 +130,30 @@ void BaseSensor::commWaitForHubIdle(){
         if (millis() - idletick > 100) {
             break;
         }
+        if (m_idleCallback)
+            m_idleCallback();
+        MOB_YIELD();
     }
 
     digitalWrite(m_connSerialTX_pin, HIGH);
-    delay(100);
+    commWait(100);
     digitalWrite(m_connSerialTX_pin, LOW);
-    delay(100);
+    commWait(100);
+}
+
+
+/**
+ * @brief Wait during the handshake; the idle callback is called meanwhile.
+ *      Replaces delay() in the connection process.
+ * @param duration Time to wait in ms.
+ */
+void BaseSensor::commWait(unsigned long duration){
+    unsigned long starttime = millis();
+    do {
+        if (m_idleCallback)
+            m_idleCallback();
+        MOB_YIELD();
+    } while (millis() - starttime < duration);
 }
 
 
@@ -117,11 +191,16 @@ void BaseSensor::connectToHub() {
                 SerialTTL.begin(115200);
                 m_connected   = true;
                 m_lastAckTick = millis();
+#ifdef NACK_LATENCY_STATS
+                m_lastPollTick = micros();
+#endif
                 break;
             }
         }
+        if (m_idleCallback)
+            m_idleCallback();
+        MOB_YIELD();
         currenttime = millis();
-        delay(10);
     }
 }
 
@@ -156,19 +235,32 @@ void BaseSensor::handleModes(){}
  */
 void BaseSensor::process(){
     if(!m_connected){
+        TRACE_DRAIN();
         this->connectToHub();
         return;
     }
 
     // Connection established
+#ifdef NACK_LATENCY_STATS
+    m_previousPollTick = m_lastPollTick;
+    m_lastPollTick     = micros();
+#endif
+#if defined(ESP32)
+    // Let the sketch update the data of the sensor from the protocol task
+    if (m_syncCallback)
+        m_syncCallback();
+#endif
     handleModes();
 
     // Check disconnection from the Hub and go in reset/init mode if needed
     if (millis() - m_lastAckTick > 200) {
         INFO_PRINT(F("Disconnect; Too much time since last NACK - "));
         INFO_PRINTLN(millis() - m_lastAckTick);
+        TRACE_EVENT(TRACE_DISCONNECT, 0, _(uint16_t)(millis() - m_lastAckTick));
         m_connected = false;
     }
+    // Send the trace events once the queries are handled
+    TRACE_DRAIN();
 }
 
 
@@ -237,4 +329,104 @@ void BaseSensor::sendUARTBuffer(uint8_t msg_size){
     // Send data (size = payload + header + checksum = payload + 2)
     SerialTTL.write((char *)this->m_txBuf, msg_size + 2);
     SerialTTL.flush();
+    if (!m_firstDataTick)
+        m_firstDataTick = millis();
+#ifdef NACK_LATENCY_STATS
+    if (m_nackTick)
+        recordNackLatency();
+#endif
+}
+
+
+#if defined(ESP32)
+/**
+ * @brief Run the protocol (process()) in a dedicated FreeRTOS task pinned on
+ *      the MOB_PROTOCOL_CORE core (0 by default) with a high priority
+ *      (MOB_PROTOCOL_PRIORITY).
+ *
+ *    The Arduino loop on the other core is then free to do the acquisitions
+ *    and computations without delaying the responses to the hub.
+ *    With UART_EVENT_SERIAL (global.h), the task sleeps on the UART events
+ *    instead of polling the port every tick.
+ *    process() MUST NOT be called from the loop anymore.
+ *
+ *    The data of the sensor (variables given to the setters) should only be
+ *    modified from the protocol task, i.e. in syncCallback. The loop can
+ *    publish its samples in a Snapshot (utilities/snapshot.hpp) that
+ *    syncCallback reads without blocking.
+ *
+ * @param syncCallback Function called by the protocol task before each
+ *      processing of the queries of the hub; Optional.
+ * @return false if the task can't be created.
+ */
+bool BaseSensor::startProtocolTask(void (*syncCallback)()) {
+    m_syncCallback = syncCallback;
+    return xTaskCreatePinnedToCore(
+        BaseSensor::protocolTask, "LUMP protocol", MOB_PROTOCOL_STACK_SIZE,
+        this, MOB_PROTOCOL_PRIORITY, nullptr, MOB_PROTOCOL_CORE) == pdPASS;
+}
+
+
+/**
+ * @brief Body of the protocol task; see startProtocolTask().
+ * @param sensor Pointer to the BaseSensor object.
+ */
+void BaseSensor::protocolTask(void *sensor) {
+    BaseSensor *self = _(BaseSensor *)(sensor);
+    for (;;) {
+        self->process();
+#ifdef UART_EVENT_SERIAL
+        if (self->m_connected) {
+            // Sleep until the hub sends something; the timeout lets process()
+            // detect a disconnection
+            SerialTTL.waitForData(20);
+            continue;
+        }
+#endif
+        // Hand over to the lower priority tasks of the core during 1 tick (1ms)
+        vTaskDelay(1);
+    }
+}
+#endif
+
+
+#ifdef NACK_LATENCY_STATS
+/**
+ * @brief Add the latency of the NACK being answered to the distribution.
+ *      Called after the first response frame is sent.
+ */
+void BaseSensor::recordNackLatency(){
+    const unsigned long latency = micros() - m_nackTick;
+    m_nackTick = 0;
+
+    uint8_t bucket = 0;
+    for (unsigned long bound = latency >> 6; bound && bucket < NACK_LATENCY_BUCKETS - 1; bound >>= 1)
+        bucket++;
+
+    NACK_STATS_LOCK();
+    m_nackStats.count++;
+    m_nackStats.buckets[bucket]++;
+    if (latency > m_nackStats.maxUs)
+        m_nackStats.maxUs = latency;
+    NACK_STATS_UNLOCK();
+}
+
+
+/**
+ * @brief Get a copy of the distribution of the NACK response latencies.
+ * @see NackLatencyStats
+ */
+NackLatencyStats BaseSensor::getNackLatencyStats(){
+    NACK_STATS_LOCK();
+    const NackLatencyStats stats = m_nackStats;
+    NACK_STATS_UNLOCK();
+    return stats;
+}
+
+
+void BaseSensor::resetNackLatencyStats(){
+    NACK_STATS_LOCK();
+    m_nackStats = NackLatencyStats();
+    NACK_STATS_UNLOCK();
 }
+#endif
@@ -23,18 +23,80 @@
 #include "global.h"
 #include "lego_uart.h"
 #include "Arduino.h"
+#include "TraceBuffer.h"
+
+#if defined(ESP32)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#ifdef UART_EVENT_SERIAL
+#include "UartEventSerial.h"
+#endif
+
+// Settings of the protocol task; see BaseSensor::startProtocolTask()
+#ifndef MOB_PROTOCOL_CORE
+// The Arduino loop runs on core 1 (ARDUINO_RUNNING_CORE)
+#define MOB_PROTOCOL_CORE          0
+#endif
+#ifndef MOB_PROTOCOL_PRIORITY
+#define MOB_PROTOCOL_PRIORITY      (configMAX_PRIORITIES - 1)
+#endif
+#ifndef MOB_PROTOCOL_STACK_SIZE
+#define MOB_PROTOCOL_STACK_SIZE    4096
+#endif
+#endif
+
+#ifdef NACK_LATENCY_STATS
+// Bucket i counts the latencies in [2^(i+5); 2^(i+6)[ µs; 1st and last buckets are open
+#define NACK_LATENCY_BUCKETS    14
+
+/**
+ * @brief Distribution of the NACK response latencies.
+ *
+ *    The latency of a response is measured from the previous call of
+ *    process() (the NACK was not read then, so it arrived later: this is
+ *    an upper bound of the time spent in the RX buffer) to the end of the
+ *    transmission of the first response frame.
+ *
+ * @param count Number of NACKs answered.
+ * @param maxUs Worst latency in µs.
+ * @param buckets Histogram of latencies with power of 2 bounds (see NACK_LATENCY_BUCKETS).
+ */
+struct NackLatencyStats {
+    uint32_t count;
+    uint32_t maxUs;
+    uint32_t buckets[NACK_LATENCY_BUCKETS];
+};
+
+// To be used by derived classes when a NACK is received
+#define NACK_LATENCY_START()    (m_nackTick = m_previousPollTick)
+#else
+#define NACK_LATENCY_START()    void()
+#endif
 
 
 /**
  * @brief Handle basic functions for LegoUART protocol.
  *      Designed to be inherited in specific classes of sensors.
  *
- * @param m_connSerialRX_pin Serial RX pin of the board. (default: 0).
- * @param m_connSerialTX_pin Serial TX pin of the board. (default: 1).
+ * @param m_connSerialRX_pin Serial RX pin of the board connected to the hub.
+ *      (default: 0; ESP32: 3, or 16 with ESP32_SERIAL2 or UART_EVENT_SERIAL).
+ * @param m_connSerialTX_pin Serial TX pin of the board connected to the hub.
+ *      (default: 1; ESP32: 1, or 17 with ESP32_SERIAL2 or UART_EVENT_SERIAL).
  * @param m_rxBuf Buffer used to store bytes emitted by the hub.
  * @param m_txBug Buffer used to store bytes before being sent to the hub.
  * @param m_lastAckTick Time flag used to detect disconnection from the hub.
  * @param m_connected Connection flag.
+ * @param m_idleCallback Function called during the waits of the handshake
+ *      with the hub; see setIdleCallback().
+ * @param m_firstDataTick Time (ms since power-on) of the first data message
+ *      sent to the hub, 0 before; see getFirstDataTime().
+ * @param m_syncCallback (ESP32 only) Function called by the protocol task
+ *      before handling the queries of the hub; see startProtocolTask().
+ * @param m_previousPollTick, m_lastPollTick (NACK_LATENCY_STATS only)
+ *      Times in µs of the 2 last calls of process().
+ * @param m_nackTick (NACK_LATENCY_STATS only) Start time of the NACK being
+ *      answered, 0 otherwise.
+ * @param m_nackStats (NACK_LATENCY_STATS only) Distribution of latencies.
  */
 class BaseSensor {
 
@@ -43,6 +105,15 @@ public:
     // virtual ~BasicSensor(){}
     void process();
     bool isConnected();
+    void setIdleCallback(void (*idleCallback)());
+    unsigned long getFirstDataTime();
+#if defined(ESP32)
+    bool startProtocolTask(void (*syncCallback)() = nullptr);
+#endif
+#ifdef NACK_LATENCY_STATS
+    NackLatencyStats getNackLatencyStats();
+    void resetNackLatencyStats();
+#endif
 
 protected:
     // Protocol handy functions
@@ -52,6 +123,7 @@ protected:
     uint8_t getMsgSize(const uint8_t& header);
     void sendUARTBuffer(uint8_t msg_size);
     void commWaitForHubIdle();
+    void commWait(unsigned long duration);
     void connectToHub();
     // Could/should use virtual pure (..() = 0) but it uses 14bytes for nothing
     virtual void commSendInitSequence();
@@ -65,6 +137,23 @@ protected:
     unsigned long m_lastAckTick;
 
     bool m_connected;
+
+    void (*m_idleCallback)();
+    unsigned long m_firstDataTick;
+
+#if defined(ESP32)
+    static void protocolTask(void *sensor);
+
+    void (*m_syncCallback)();
+#endif
+#ifdef NACK_LATENCY_STATS
+    void recordNackLatency();
+
+    unsigned long    m_previousPollTick;
+    unsigned long    m_lastPollTick;
+    unsigned long    m_nackTick;
+    NackLatencyStats m_nackStats;
+#endif
 };
 
 #endif // BASESENSOR_H
@@ -19,26 +19,50 @@
  */
 #include "ColorDistanceSensor.h"
 
+// Owned values: 5 bytes, 4 words (+1 long with COLOR_DISTANCE_COUNTER), padding included
+static_assert(sizeof(ColorDistanceState) <= 5 + 4 * sizeof(uint16_t) + 1
+#ifdef COLOR_DISTANCE_COUNTER
+              + sizeof(uint32_t) + 2
+#endif
+              , "ColorDistanceState is not compact");
+// RAM footprint: BaseSensor + owned values + 6 bindings + 2 callbacks + ExtMode
+// (+ 1 binding & 1 counter with COLOR_DISTANCE_COUNTER)
+// (+ settings & 1 callback with COLOR_DISTANCE_CONFIG) + trailing padding
+static_assert(sizeof(ColorDistanceSensor) <= sizeof(BaseSensor) + sizeof(ColorDistanceState)
+              + 6 * sizeof(void *) + 2 * sizeof(void (*)()) + 1 + (sizeof(void *) - 1)
+#ifdef COLOR_DISTANCE_COUNTER
+              + 2 * sizeof(void *)
+#endif
+#ifdef COLOR_DISTANCE_CONFIG
+              + sizeof(AcquisitionConfig) + sizeof(void (*)())
+#endif
+              , "Unexpected RAM footprint of ColorDistanceSensor");
+
+
 /**
- * @brief Default constructor
+ * @brief Default constructor; all values are owned by the sensor (no heap
+ *      allocation) and initialized to 0.
  */
 ColorDistanceSensor::ColorDistanceSensor(){
-    m_defaultIntVal  = new uint8_t(0);
-    uint16_t defaultRGB[3] = {0, 0, 0};
+    m_state          = ColorDistanceState();
 
-    // Sensor default values
-    m_sensorColor    = m_defaultIntVal;
-    m_sensorDistance = m_defaultIntVal;
-    m_LEDColor       = new uint8_t(0);
+    // No binding: the owned values are sent
+    m_sensorColor    = nullptr;
+    m_sensorDistance = nullptr;
+    m_LEDColor       = nullptr;
 #ifdef COLOR_DISTANCE_COUNTER
-    m_detectionCount = new uint32_t(0);
+    m_detectionCount   = nullptr;
+    m_detectionCounter = nullptr;
 #endif
-    m_reflectedLight = m_defaultIntVal;
-    m_ambientLight   = m_defaultIntVal;
-    m_sensorRGB      = defaultRGB;
-    m_IR_code        = 0;
+    m_reflectedLight = nullptr;
+    m_ambientLight   = nullptr;
+    m_sensorRGB      = nullptr;
     m_pIRfunc        = nullptr;
     m_pLEDColorfunc  = nullptr;
+#ifdef COLOR_DISTANCE_CONFIG
+    m_config         = { 100, 2, 0, 3 };
+    m_pConfigfunc    = nullptr;
+#endif
 }
 
 
@@ -49,32 +73,70 @@ ColorDistanceSensor::ColorDistanceSensor(){
  * @param pSensorDistance Pointer to a discreztized distance measured to the
  *      the nearest object. Continuous values 0...10.
  */
-ColorDistanceSensor::ColorDistanceSensor(uint8_t *pSensorColor, uint8_t *pSensorDistance){
-    m_defaultIntVal  = new uint8_t(0);
-    uint16_t defaultRGB[3] = {0, 0, 0};
-
+ColorDistanceSensor::ColorDistanceSensor(uint8_t *pSensorColor, uint8_t *pSensorDistance) :
+    ColorDistanceSensor() {
     // Set given values
-    m_sensorColor    = pSensorColor;
-    m_sensorDistance = pSensorDistance;
-    // Sensor default values
-    m_LEDColor       = new uint8_t(0);
+    this->setSensorColor(pSensorColor);
+    this->setSensorDistance(pSensorDistance);
+}
+
+
+/**
+ * @brief Set the detected color; see setSensorColor().
+ */
+void ColorDistanceSensor::setColor(uint8_t color){
+    this->m_state.color = color;
+}
+
+
+/**
+ * @brief Set the distance measured to the nearest object; see setSensorDistance().
+ */
+void ColorDistanceSensor::setDistance(uint8_t distance){
+    this->m_state.distance = distance;
+}
+
 #ifdef COLOR_DISTANCE_COUNTER
-    m_detectionCount = new uint32_t(0);
+/**
+ * @brief Set the counter of detections; see setSensorDetectionCount().
+ */
+void ColorDistanceSensor::setDetectionCount(uint32_t count){
+    this->m_state.detectionCount = count;
+}
 #endif
-    m_reflectedLight = m_defaultIntVal;
-    m_ambientLight   = m_defaultIntVal;
-    m_sensorRGB      = defaultRGB;
-    m_IR_code        = 0;
-    m_pIRfunc        = nullptr;
-    m_pLEDColorfunc  = nullptr;
+
+/**
+ * @brief Set the raw values of Red Green Blue channels; see setSensorRGB().
+ */
+void ColorDistanceSensor::setRGB(uint16_t red, uint16_t green, uint16_t blue){
+    this->m_state.RGB[0] = red;
+    this->m_state.RGB[1] = green;
+    this->m_state.RGB[2] = blue;
+}
+
+
+/**
+ * @brief Set the reflected light; see setSensorReflectedLight().
+ */
+void ColorDistanceSensor::setReflectedLight(uint8_t reflectedLight){
+    this->m_state.reflectedLight = reflectedLight;
 }
 
 
 /**
- * @brief Destructor
+ * @brief Set the ambient light; see setSensorAmbientLight().
  */
-ColorDistanceSensor::~ColorDistanceSensor() {
-    delete m_defaultIntVal;
+void ColorDistanceSensor::setAmbientLight(uint8_t ambientLight){
+    this->m_state.ambientLight = ambientLight;
+}
+
+
+/**
+ * @brief Getter for m_LEDColor
+ * @return Current LED color set by the hub.
+ */
+uint8_t ColorDistanceSensor::getLEDColor(){
+    return (this->m_LEDColor) ? *this->m_LEDColor : this->m_state.LEDColor;
 }
 
 
@@ -104,10 +166,18 @@ void ColorDistanceSensor::setSensorDistance(uint8_t *pData){
  */
 #ifdef COLOR_DISTANCE_COUNTER
 void ColorDistanceSensor::setSensorDetectionCount(uint32_t *pData){
-    // Free constructor's value
-    delete this->m_detectionCount;
     this->m_detectionCount = pData;
 }
+
+
+/**
+ * @brief Bind a counter of detections updated with each sample of the
+ *      distance sensor; the count is read without tearing when the hub
+ *      queries mode 2. nullptr: back to m_detectionCount.
+ */
+void ColorDistanceSensor::setDetectionCounter(ProximityCounter *counter){
+    this->m_detectionCounter = counter;
+}
 #endif
 
 /**
@@ -122,16 +192,16 @@ void ColorDistanceSensor::setSensorRGB(uint16_t *pData){
 
 
 /**
- * @brief Getter for m_IR_code
+ * @brief Getter for m_state.IRCode
  * @return IR code
  */
 uint16_t ColorDistanceSensor::getSensorIRCode(){
-    return this->m_IR_code;
+    return this->m_state.IRCode;
 }
 
 
 /**
- * @brief Set callback receiving m_IR_code when modified by the hub.
+ * @brief Set callback receiving m_state.IRCode when modified by the hub.
  */
 void ColorDistanceSensor::setIRCallback(void(pfunc)(const uint16_t)){
     this->m_pIRfunc = pfunc;
@@ -145,8 +215,6 @@ void ColorDistanceSensor::setIRCallback(void(pfunc)(const uint16_t)){
  *      COLOR_BLACK, COLOR_BLUE, COLOR_GREEN, COLOR_YELLOW, COLOR_RED, COLOR_WHITE.
  */
 void ColorDistanceSensor::setSensorLEDColor(uint8_t *pData){
-    // Free constructor's value
-    delete this->m_LEDColor;
     this->m_LEDColor = pData;
 }
 
@@ -178,6 +246,37 @@ void ColorDistanceSensor::setSensorAmbientLight(uint8_t *pData){
     this->m_ambientLight = pData;
 }
 
+#ifdef COLOR_DISTANCE_CONFIG
+/**
+ * @brief Setter for m_config; settings sent to the hub in mode 11 until
+ *      it writes new ones. See AcquisitionConfig.
+ *      Default: 100ms, strength 2, no integration time limit, 3 detections.
+ */
+void ColorDistanceSensor::setAcquisitionConfig(const AcquisitionConfig& config){
+    this->m_config = config;
+}
+
+
+/**
+ * @brief Getter for m_config
+ * @return Current acquisition settings.
+ */
+const AcquisitionConfig& ColorDistanceSensor::getAcquisitionConfig(){
+    return this->m_config;
+}
+
+
+/**
+ * @brief Set callback receiving m_config when modified by the hub.
+ *      The callback should reconfigure the acquisition pipeline; like the
+ *      other callbacks, it must return quickly (see handleModes()).
+ */
+void ColorDistanceSensor::setConfigCallback(void(pfunc)(const AcquisitionConfig&)){
+    this->m_pConfigfunc = pfunc;
+}
+#endif
+
+
 /**
  * @brief Send initialization sequences for the current sensor.
  * @see https://github.com/pybricks/pybricks-micropython/lib/pbio/test/src/uartdev.c
@@ -188,11 +287,27 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.begin(2400);
 
     SerialTTL.write("\x40\x25\x9A", 3);                              // Type ID: 0x25
+#ifdef COLOR_DISTANCE_CONFIG
+    SerialTTL.write("\x51\x07\x07\x0B\x07\xA2", 6);                  // CMD_MODES: 8 modes, 8 views, Ext. Modes: modes: 12, views: 8
+#else
     SerialTTL.write("\x51\x07\x07\x0A\x07\xA3", 6);                  // CMD_MODES: 8 modes, 8 views, Ext. Modes: modes: 11, views: 8
+#endif
     SerialTTL.write("\x52\x00\xC2\x01\x00\x6E", 6);                  // CMD_SPEED: 115200
     SerialTTL.write("\x5F\x00\x00\x00\x10\x00\x00\x00\x10\xA0", 10); // CMD_VERSION: fw-version: 1.0.0.0, hw-version: 1.0.0.0
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
+#ifdef COLOR_DISTANCE_CONFIG
+    // Mode 11
+    SerialTTL.write("\x9B\x20\x43\x4F\x4E\x46\x49\x47\x00\x00\x4E", 11); // Name: "CONFIG"
+    SerialTTL.write("\x9B\x21\x00\x00\x00\x00\x00\xFE\xFF\x46\x02", 11); // Range: 0 to 32767
+    SerialTTL.write("\x9B\x22\x00\x00\x00\x00\x00\x00\xC8\x42\xCC", 11); // PCT Range: 0.0% to 100.0%
+    SerialTTL.write("\x9B\x23\x00\x00\x00\x00\x00\xFE\xFF\x46\x00", 11); // Si Range: 0 to 32767
+    SerialTTL.write("\x93\x24\x4E\x2F\x41\x00\x68", 7);                  // Si Symbol: 'N/A'
+    SerialTTL.write("\x8B\x25\x10\x10\x51", 5);                          // input_flags: Absolute, output_flags: Absolute
+    SerialTTL.write("\x93\xA0\x04\x01\x05\x00\xCC", 7);                  // Format: 4 int16, each 5 chars, 0 decimals
+    SerialTTL.flush();
+    commWait(10);
+#endif
     // Mode 10
     SerialTTL.write("\x9A\x20\x43\x41\x4C\x49\x42\x00\x00\x00\x00", 11); // Name: "CALIB"
     SerialTTL.write("\x9A\x21\x00\x00\x00\x00\x00\xFF\x7F\x47\x83", 11); // Range: 0 to 65535
@@ -202,7 +317,7 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x8A\x25\x10\x00\x40", 5);                          // input_flags: Absolute, output_flags: None
     SerialTTL.write("\x92\xA0\x08\x01\x05\x00\xC1", 7);                  // Format: 8 int16, each 5 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 9
     SerialTTL.write("\x99\x20\x44\x45\x42\x55\x47\x00\x00\x00\x17", 11); // Name: "DEBUG"
     SerialTTL.write("\x99\x21\x00\x00\x00\x00\x00\xC0\x7F\x44\xBC", 11); // Range: 0.0 to 1023.0
@@ -212,7 +327,7 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x89\x25\x10\x00\x43", 5);                          // input_flags: Absolute, output_flags: None
     SerialTTL.write("\x91\xA0\x02\x01\x05\x00\xC8", 7);                  // Format: 2 int16, each 5 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 8
     SerialTTL.write("\x98\x20\x53\x50\x45\x43\x20\x31\x00\x00\x53", 11); // Name: "SPEC 1"
     SerialTTL.write("\x98\x21\x00\x00\x00\x00\x00\x00\x7F\x43\x7A", 11); // Range: 0.0 to 255.0
@@ -222,7 +337,7 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x88\x25\x00\x00\x52", 5);                          // No additional info mapping flag
     SerialTTL.write("\x90\xA0\x04\x00\x03\x00\xC8", 7);                  // Format: 4 int8, each 3 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 7
     SerialTTL.write("\x9F\x00\x49\x52\x20\x54\x78\x00\x00\x00\x77", 11); // Name: "IR Tx"
     SerialTTL.write("\x9F\x01\x00\x00\x00\x00\x00\xFF\x7F\x47\xA6", 11); // Range: 0 to 65535
@@ -232,7 +347,7 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x8F\x05\x00\x04\x71", 5);                          // input_flags: None, output_flags: Discrete
     SerialTTL.write("\x97\x80\x01\x01\x05\x00\xED", 7);                  // Format: 1 int16, each 5 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 6
     SerialTTL.write("\x9E\x00\x52\x47\x42\x20\x49\x00\x00\x00\x5F", 11); // Name: "RGB I"
     SerialTTL.write("\x9E\x01\x00\x00\x00\x00\x00\xC0\x7F\x44\x9B", 11); // Range: 0.0 to 1023.0
@@ -242,7 +357,7 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x8E\x05\x10\x00\x64", 5);                          // input_flags: Absolute, output_flags: None
     SerialTTL.write("\x96\x80\x03\x01\x05\x00\xEE", 7);                  // Format: 3 int16, each 5 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 5
     SerialTTL.write("\x9D\x00\x43\x4F\x4C\x20\x4F\x00\x00\x00\x4D", 11); // Name: "COL O"
     SerialTTL.write("\x9D\x01\x00\x00\x00\x00\x00\x00\x20\x41\x02", 11); // Range: 0.0 to 10.0
@@ -252,7 +367,7 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x8D\x05\x00\x04\x73", 5);                          // input_flags: None, output_flags: Discrete
     SerialTTL.write("\x95\x80\x01\x00\x03\x00\xE8", 7);                  // Format: 1 int8, each 3 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 4
     SerialTTL.write("\x94\x00\x41\x4D\x42\x49\x6C", 7);                  // Name: "AMBI"
     SerialTTL.write("\x9C\x01\x00\x00\x00\x00\x00\x00\xC8\x42\xE8", 11); // Range: 0.0 to 100.0
@@ -262,7 +377,7 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x8C\x05\x10\x00\x66", 5);                          // input_flags: Absolute, output_flags: None
     SerialTTL.write("\x94\x80\x01\x00\x03\x00\xE9", 7);                  // Format: 1 int8, each 3 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 3
     SerialTTL.write("\x9B\x00\x52\x45\x46\x4C\x54\x00\x00\x00\x2D", 11); // Name: "REFLT"
     SerialTTL.write("\x9B\x01\x00\x00\x00\x00\x00\x00\xC8\x42\xEF", 11); // Range: 0.0 to 100.0
@@ -272,7 +387,7 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x8B\x05\x10\x00\x61", 5);                          // input_flags: Absolute, output_flags: None
     SerialTTL.write("\x93\x80\x01\x00\x03\x00\xEE", 7);                  // Format: 1 int8, each 3 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 2
     SerialTTL.write("\x9A\x00\x43\x4F\x55\x4E\x54\x00\x00\x00\x26", 11); // Name: "COUNT"
     SerialTTL.write("\x9A\x01\x00\x00\x00\x00\x00\x00\xC8\x42\xEE", 11); // Range: 0.0 to 100.0
@@ -282,7 +397,7 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x8A\x05\x08\x00\x78", 5);                          // input_flags: Relative, output_flags: None
     SerialTTL.write("\x92\x80\x01\x02\x04\x00\xEA", 7);                  // Format: 1 int32, each 4 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 1
     SerialTTL.write("\x91\x00\x50\x52\x4F\x58\x7B", 7);                  // Name: "PROX"
     SerialTTL.write("\x99\x01\x00\x00\x00\x00\x00\x00\x20\x41\x06", 11); // Range: 0.0 to 10.0
@@ -292,7 +407,7 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x89\x05\x50\x00\x23", 5);                          // input_flags: Absolute,Func mapping 2.0+, output_flags: None
     SerialTTL.write("\x91\x80\x01\x00\x03\x00\xEC", 7);                  // Format: 1 int8, each 3 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 0
     SerialTTL.write("\x98\x00\x43\x4F\x4C\x4F\x52\x00\x00\x00\x3A", 11); // Name: "COLOR"
     SerialTTL.write("\x98\x01\x00\x00\x00\x00\x00\x00\x20\x41\x07", 11); // Range: 0.0 to 10.0
@@ -303,10 +418,10 @@ void ColorDistanceSensor::commSendInitSequence(){
     SerialTTL.write("\x90\x80\x01\x00\x03\x00\xED", 7);                  // Format: 1 int8, each 3 chars, 0 decimals
     SerialTTL.write("\x88\x06\x4F\x00\x3E", 5);                          // Combinable modes: 0:Color, 1:Proximity, 2:Count, 3:Reflectance, 6:RGB I
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     SerialTTL.write("\x04", 1);
     SerialTTL.flush();
-    delay(5);
+    commWait(5);
 }
 
 
@@ -325,11 +440,11 @@ void ColorDistanceSensor::handleModes(){
     unsigned char mode;
     header = SerialTTL.read();
 
-    DEBUG_PRINT(F("<\tHeader "));
-    DEBUG_PRINTLN(header, HEX);
+    TRACE_EVENT(TRACE_HEADER, header);
 
     if (header == 0x02) { // NACK
         m_lastAckTick = millis();
+        NACK_LATENCY_START();
         // Here we can send mode 0 or mode 8 according to the value of ExtMode
         // And send extendedModeInfoResponse before any data response.
         // Usually we go into mode 8, which automatically sends extendedModeInfoResponse
@@ -341,12 +456,11 @@ void ColorDistanceSensor::handleModes(){
         size_t ret = SerialTTL.readBytes(m_rxBuf, 2);
         if (ret < 2) {
             // check if all expected bytes are received without timeout
-            DEBUG_PRINT(F("incomplete 0x43 message"));
+            TRACE_EVENT(TRACE_INCOMPLETE_MESSAGE, 0x43);
             return;
         }
         mode = m_rxBuf[0];
-        DEBUG_PRINT(F("<\tAsked mode "));
-        DEBUG_PRINTLN(mode);
+        TRACE_EVENT(TRACE_ASKED_MODE, mode);
 
         this->m_currentExtMode = (mode < 8) ? EXT_MODE_0 : EXT_MODE_8;
 
@@ -380,9 +494,13 @@ void ColorDistanceSensor::handleModes(){
                 this->sensorDebugMode();
                 break;
             #endif
+            #ifdef COLOR_DISTANCE_CONFIG
+            case ColorDistanceSensor::PBIO_IODEV_MODE_PUP_COLOR_DISTANCE_SENSOR__CONFIG:
+                this->configMode();
+                break;
+            #endif
             default:
-                INFO_PRINT(F("unknown R mode: "));
-                INFO_PRINTLN(mode, HEX);
+                TRACE_EVENT(TRACE_UNKNOWN_R_MODE, mode);
                 break;
         }
     } else if (header == 0x46) {
@@ -402,7 +520,11 @@ void ColorDistanceSensor::handleModes(){
         // Get mode and size of the message from the header
         uint8_t msg_size;
         parseHeader(m_rxBuf[2], mode, msg_size);
-        // TODO: avoid buffer overflow: check msg size <= size rx buffer
+        if (msg_size - 1 > _(int)(sizeof(m_rxBuf)))
+            return;
+        // The header only holds the 3 lower bits of the mode
+        if (this->m_currentExtMode == EXT_MODE_8)
+            mode += 8;
 
         // Read the remaining bytes after the header (cheksum included)
         // Data will be in the indexes [0;msg_size-2]
@@ -417,9 +539,13 @@ void ColorDistanceSensor::handleModes(){
             case ColorDistanceSensor::PBIO_IODEV_MODE_PUP_COLOR_DISTANCE_SENSOR__IR_TX:
                 this->setIRTXMode();
                 break;
+            #ifdef COLOR_DISTANCE_CONFIG
+            case ColorDistanceSensor::PBIO_IODEV_MODE_PUP_COLOR_DISTANCE_SENSOR__CONFIG:
+                this->setConfigMode();
+                break;
+            #endif
             default:
-                INFO_PRINT(F("unknown W mode: "));
-                INFO_PRINTLN(mode, HEX);
+                TRACE_EVENT(TRACE_UNKNOWN_W_MODE, mode);
                 break;
         }
     }
@@ -451,32 +577,29 @@ void ColorDistanceSensor::extendedModeInfoResponse(){
 void ColorDistanceSensor::setLEDColorMode(){
     // Mode 5 (write mode)
     // Expect LED color index (1 int8_t)
-    *this->m_LEDColor = m_rxBuf[0];
+    if (this->m_LEDColor)
+        *this->m_LEDColor = m_rxBuf[0];
+    else
+        this->m_state.LEDColor = m_rxBuf[0];
 
-    DEBUG_PRINT(F("LEDcolor set: "));
-    DEBUG_PRINTLN(*this->m_LEDColor, HEX);
+    TRACE_EVENT(TRACE_LED_COLOR_SET, m_rxBuf[0]);
 
     if (this->m_pLEDColorfunc != nullptr)
-        this->m_pLEDColorfunc(*this->m_LEDColor);
+        this->m_pLEDColorfunc(m_rxBuf[0]);
 }
 
 
 /**
  * @brief Mode 7 response (write)
- *      Set m_IR_code attribute with the given code.
+ *      Set m_state.IRCode attribute with the given code.
  *      Also call IR callback if defined. See m_pIRfunc.
- * @todo
- *      Repeated pulses: count 5 IR codes in x loops: multi callback call
- *      Because we maybe can't block the loop for 5 consecutive transmissions
- *      (a loop can't take more than 200ms).
- *      LEGO protocol needs 5 repetitions, the delay between 2 repetitions is
- *      channel dependent, the length of a message is 16ms (doc), ~11ms in IRremote.
- *      channel delays: 1: 110ms, 2: 148ms, 3: 189ms, 4: 230ms (100 to 200ms in IRremote)
- *
- *      For the repetitions purpose, the getter getSensorIRCode() should be used.
+ * @note LEGO protocol needs 5 repetitions, the delay between 2 repetitions is
+ *      channel dependent; this can't be done in the callback without blocking
+ *      the loop (a loop can't take more than 200ms). Use PFTransmitter::send()
+ *      (PF_TRANSMITTER in global.h) in the callback: the repetitions are
+ *      made in the background.
  *
  *      See:
- *      https://github.com/Arduino-IRremote/Arduino-IRremote/blob/e06b594fbefac384d7e1c12aa3e014fca9ee0e6b/src/ir_Lego.hpp#L123
  *      https://web.archive.org/web/20190711083546/http://www.hackvandedam.nl/blog/?page_id=559
  */
 void ColorDistanceSensor::setIRTXMode(){
@@ -484,15 +607,66 @@ void ColorDistanceSensor::setIRTXMode(){
     // Expect IR code on (1 int16_t)
     // From Little-Endian (LSB first in the array, then the MSB)
     // Don't do this: prefer explicit endianness handling
-    //this->m_IR_code = *((uint16_t *) &m_rxBuf[0]);
-    this->m_IR_code = (_(uint16_t) (m_rxBuf[1] << 8)) | m_rxBuf[0];
+    //this->m_state.IRCode = *((uint16_t *) &m_rxBuf[0]);
+    this->m_state.IRCode = (_(uint16_t) (m_rxBuf[1] << 8)) | m_rxBuf[0];
 
-    DEBUG_PRINT(F("IR data set: "));
-    DEBUG_PRINTLN(this->m_IR_code, HEX);
+    TRACE_EVENT(TRACE_IR_DATA_SET, 0, this->m_state.IRCode);
 
     if (this->m_pIRfunc != nullptr)
-        this->m_pIRfunc(this->m_IR_code);
+        this->m_pIRfunc(this->m_state.IRCode);
+}
+
+
+#ifdef COLOR_DISTANCE_CONFIG
+/**
+ * @brief Mode 11 response (write)
+ *      Update m_config with the given settings (4 int16, Little-Endian);
+ *      negative values leave the corresponding setting unchanged.
+ *      Also call config callback if defined. See m_pConfigfunc.
+ * @note This mode doesn't exist on the LEGO sensor.
+ */
+void ColorDistanceSensor::setConfigMode(){
+    // Mode 11 (write mode)
+    int16_t *settings[4] = {
+        &this->m_config.samplePeriod,
+        &this->m_config.filterStrength,
+        &this->m_config.integrationTime,
+        &this->m_config.colorHysteresis,
+    };
+    for (uint8_t i = 0; i < 4; i++) {
+        int16_t value = _(int16_t)((m_rxBuf[i * 2 + 1] << 8) | m_rxBuf[i * 2]);
+        if (value >= 0)
+            *settings[i] = value;
+    }
+
+    TRACE_EVENT(TRACE_CONFIG_SET, 0, _(uint16_t)(this->m_config.samplePeriod));
+
+    if (this->m_pConfigfunc != nullptr)
+        this->m_pConfigfunc(this->m_config);
+}
+
+
+/**
+ * @brief Mode 11 response (read): Send the current acquisition settings.
+ */
+void ColorDistanceSensor::configMode(){
+    // Mode 11
+    this->extendedModeInfoResponse();
+
+    const int16_t settings[4] = {
+        this->m_config.samplePeriod,
+        this->m_config.filterStrength,
+        this->m_config.integrationTime,
+        this->m_config.colorHysteresis,
+    };
+    m_txBuf[0] = getHeader(lump_msg_type_t::LUMP_MSG_TYPE_DATA, 11, 10); // 0xDB
+    for (uint8_t i = 0; i < 4; i++) {
+        m_txBuf[i * 2 + 1] = settings[i] & 0xFF;        // LSB
+        m_txBuf[i * 2 + 2] = (settings[i] >> 8) & 0xFF; // MSB
+    }
+    sendUARTBuffer(8);
 }
+#endif
 
 
 /**
@@ -501,7 +675,7 @@ void ColorDistanceSensor::setIRTXMode(){
 void ColorDistanceSensor::LEDColorMode(){
     // Mode 0
     m_txBuf[0] = 0xC0;                      // header
-    m_txBuf[1] = *m_LEDColor;               // LED current color [0, 3, 5, 9, 0x0A]
+    m_txBuf[1] = (m_LEDColor) ? *m_LEDColor : m_state.LEDColor; // LED current color [0, 3, 5, 9, 0x0A]
     sendUARTBuffer(1);
 }
 
@@ -512,24 +686,25 @@ void ColorDistanceSensor::LEDColorMode(){
 void ColorDistanceSensor::sensorDistanceMode(){
     // Mode 1
     m_txBuf[0] = 0xC1;                      // header
-    m_txBuf[1] = *m_sensorDistance;         // distance [0..10]
+    m_txBuf[1] = (m_sensorDistance) ? *m_sensorDistance : m_state.distance; // distance [0..10]
     sendUARTBuffer(1);
 }
 
 /**
  * @brief Mode 2 response (read): Send detection count below 5cm
  *      (2inches in useless non metric system).
- * @note Packet size: 10 (not a power of 2 size... to be tested).
  */
 #ifdef COLOR_DISTANCE_COUNTER
 void ColorDistanceSensor::sensorDetectionCount(){
     // Mode 2
-    m_txBuf[0] = 0xda;                      // header
+    const uint32_t count = (m_detectionCounter) ? m_detectionCounter->count() :
+                           (m_detectionCount) ? *m_detectionCount : m_state.detectionCount;
+    m_txBuf[0] = 0xD2;                      // header: 1 int32 (size 4)
     // Decompose 32 bits value into bytes from LSB to MSB (Little-Endian)
-    for (uint8_t i = 0; i < 8; i++) {
-        m_txBuf[i + 1] = (*m_detectionCount >> (i * 8)) & 0xFF;
+    for (uint8_t i = 0; i < 4; i++) {
+        m_txBuf[i + 1] = (count >> (i * 8)) & 0xFF;
     }
-    sendUARTBuffer(8);
+    sendUARTBuffer(4);
 }
 #endif
 
@@ -539,7 +714,7 @@ void ColorDistanceSensor::sensorDetectionCount(){
 void ColorDistanceSensor::sensorReflectedLightMode(){
     // Mode 3
     m_txBuf[0] = 0xC3;                      // header
-    m_txBuf[1] = *this->m_reflectedLight;   // 0..100
+    m_txBuf[1] = (m_reflectedLight) ? *m_reflectedLight : m_state.reflectedLight; // 0..100
     sendUARTBuffer(1);
 }
 
@@ -550,7 +725,7 @@ void ColorDistanceSensor::sensorReflectedLightMode(){
 void ColorDistanceSensor::sensorAmbientLight(){
     // Mode 4
     m_txBuf[0] = 0xC4;                      // header
-    m_txBuf[1] = *this->m_ambientLight;
+    m_txBuf[1] = (m_ambientLight) ? *m_ambientLight : m_state.ambientLight;
     sendUARTBuffer(1);
 }
 
@@ -566,13 +741,14 @@ void ColorDistanceSensor::sensorRGBIMode() {
     // Send data; payload size = 6, but total msg_size = 10
     // TODO: we send: device header: 0xde => type LUMP_MSG_TYPE_DATA mode 6 tot size 10
     // size = 10 !! 8 bytes useful / 10
+    const uint16_t *RGB = (m_sensorRGB) ? m_sensorRGB : m_state.RGB;
     m_txBuf[0] = getHeader(lump_msg_type_t::LUMP_MSG_TYPE_DATA, 6, 10); // 0xde
-    m_txBuf[1] = this->m_sensorRGB[0] & 0xFF;           // Send LSB of red value
-    m_txBuf[2] = (this->m_sensorRGB[0] >> 8) & 0xFF;    // Send MSB
-    m_txBuf[3] = this->m_sensorRGB[1] & 0xFF;           // Send LSB of green value
-    m_txBuf[4] = (this->m_sensorRGB[1] >> 8) & 0xFF;
-    m_txBuf[5] = this->m_sensorRGB[2] & 0xFF;           // Send LSB of blue value
-    m_txBuf[6] = (this->m_sensorRGB[2] >> 8) & 0xFF;
+    m_txBuf[1] = RGB[0] & 0xFF;                         // Send LSB of red value
+    m_txBuf[2] = (RGB[0] >> 8) & 0xFF;                  // Send MSB
+    m_txBuf[3] = RGB[1] & 0xFF;                         // Send LSB of green value
+    m_txBuf[4] = (RGB[1] >> 8) & 0xFF;
+    m_txBuf[5] = RGB[2] & 0xFF;                         // Send LSB of blue value
+    m_txBuf[6] = (RGB[2] >> 8) & 0xFF;
     m_txBuf[7] = 0;                                     // Padding
     m_txBuf[8] = 0;                                     // Padding
     sendUARTBuffer(8);
@@ -585,17 +761,17 @@ void ColorDistanceSensor::sensorRGBIMode() {
  */
 void ColorDistanceSensor::sensorSpec1Mode(){
     // Mode 8
-    DEBUG_PRINTLN(F("Mode 8"));
+    TRACE_EVENT(TRACE_MODE_SENT, 8);
 
     // extended mode info
     this->extendedModeInfoResponse();
 
     // Send data
     m_txBuf[0] = 0xD0;               // header
-    m_txBuf[1] = *m_sensorColor;     // color    [0, 3, 5, 9, 0x0A, 0xFF]
-    m_txBuf[2] = *m_sensorDistance;  // distance [0..10]
-    m_txBuf[3] = *m_LEDColor;        // LED current color [0, 3, 5, 9, 0x0A]
-    m_txBuf[4] = *m_reflectedLight;  // reflected light [0..100]
+    m_txBuf[1] = (m_sensorColor) ? *m_sensorColor : m_state.color;          // color    [0, 3, 5, 9, 0x0A, 0xFF]
+    m_txBuf[2] = (m_sensorDistance) ? *m_sensorDistance : m_state.distance; // distance [0..10]
+    m_txBuf[3] = (m_LEDColor) ? *m_LEDColor : m_state.LEDColor;             // LED current color [0, 3, 5, 9, 0x0A]
+    m_txBuf[4] = (m_reflectedLight) ? *m_reflectedLight : m_state.reflectedLight; // reflected light [0..100]
     sendUARTBuffer(4);
 }
 
@@ -21,6 +21,9 @@
 #define COLOR_DISTANCESENSOR_H
 
 #include "BaseSensor.h"
+#ifdef COLOR_DISTANCE_COUNTER
+#include "utilities/proximity_counter.hpp"
+#endif
 
 
 // Colors (detected & LED (except NONE for this last one)) expected values
@@ -41,6 +44,51 @@
 #define EXT_MODE_0      0x00  // for mode numbers < 8
 #define EXT_MODE_8      0x08  // for mode numbers >= 8
 
+/**
+ * @brief Values owned by ColorDistanceSensor; sent to the hub unless a
+ *      pointer to an external value is bound with the setSensor...() setters.
+ *      Fields are ordered by size to avoid padding.
+ *
+ * @param detectionCount See ColorDistanceSensor::m_detectionCount.
+ * @param RGB See ColorDistanceSensor::m_sensorRGB.
+ * @param IRCode Last IR code written by the hub.
+ * @param color, distance, LEDColor, reflectedLight, ambientLight
+ *      See the attributes of ColorDistanceSensor with the same names.
+ */
+struct ColorDistanceState {
+#ifdef COLOR_DISTANCE_COUNTER
+    uint32_t detectionCount;
+#endif
+    uint16_t RGB[3];
+    uint16_t IRCode;
+    uint8_t  color;
+    uint8_t  distance;
+    uint8_t  LEDColor;
+    uint8_t  reflectedLight;
+    uint8_t  ambientLight;
+};
+
+#ifdef COLOR_DISTANCE_CONFIG
+/**
+ * @brief Acquisition settings of mode 11 "CONFIG" (4x int16 on the wire).
+ *      Negative values written by the hub leave the setting unchanged.
+ *
+ * @param samplePeriod Period of the measurements (ms).
+ * @param filterStrength Strength of the streaming filters
+ *      (see ExponentialAverage in utilities/filters.hpp).
+ * @param integrationTime Max integration time of the color sensor (ms);
+ *      0: no limit (see TCS34725AutoRange::setMaxIntegrationTime()).
+ * @param colorHysteresis Number of identical detections before a new color
+ *      is sent (see ColorHysteresis in utilities/filters.hpp).
+ */
+struct AcquisitionConfig {
+    int16_t samplePeriod;
+    int16_t filterStrength;
+    int16_t integrationTime;
+    int16_t colorHysteresis;
+};
+#endif
+
 /**
  * @brief Handle the LegoUART protocol and define modes of the
  * Color & Distance sensor.
@@ -51,6 +99,8 @@
  *      Continuous values 0...10.
  * @param m_detectionCount Detection count; should be incremented each time
  *      the sensor detects a distance < 5cm.
+ * @param m_detectionCounter Counter of detections updated at the rate of the
+ *      samples; replaces m_detectionCount if set (see setDetectionCounter()).
  * @param m_reflectedLight Reflected light (from clear channel value or
  *      calculations based on rgb channels).
  *      Continuous values 0...100.
@@ -61,10 +111,18 @@
  *      Continuous values 0..1023.
  * @param m_sensorColor Detected color; Available values:
  *      COLOR_NONE, COLOR_BLACK, COLOR_BLUE, COLOR_GREEN, COLOR_YELLOW, COLOR_RED, COLOR_WHITE.
- * @param m_IR_code IR code for Power Functions IR devices
+ * @param m_state Owned values, written by the by-value setters (setColor(),
+ *      etc.) and sent to the hub by default.
+ *      The previous attributes are nullptr unless a pointer to an external
+ *      value (zero-copy) is bound with the setSensor...(pointer) setters;
+ *      a bound value is sent instead of the owned one.
+ *      No attribute points into the object: copies are independent.
+ *      IRCode: IR code for Power Functions IR devices
  *      (supposed to be transmitted via the Power Functions RC Protocol).
- * @param m_pIRfunc Callback set by user receiving m_IR_code, when it's changed by the hub.
+ * @param m_pIRfunc Callback set by user receiving m_state.IRCode, when it's changed by the hub.
  * @param m_pLEDColorfunc Callback set by user receiving m_LEDColor, when it's changed by the hub.
+ * @param m_config Acquisition settings of mode 11 (COLOR_DISTANCE_CONFIG).
+ * @param m_pConfigfunc Callback set by user receiving m_config, when it's changed by the hub.
  *
  * @param m_currentExtMode Extended mode switch for modes >= 8. Available values:
  *      EXT_MODE_0, EXT_MODE_8.
@@ -84,18 +142,31 @@ class ColorDistanceSensor : public BaseSensor {
         PBIO_IODEV_MODE_PUP_COLOR_DISTANCE_SENSOR__SPEC1 = 8, // rrwr 4x int8_t
         PBIO_IODEV_MODE_PUP_COLOR_DISTANCE_SENSOR__DEBUG = 9, // ?? 2x int16_t
         //PBIO_IODEV_MODE_PUP_COLOR_DISTANCE_SENSOR__CALIB = 10, // ?? 8x int16_t
+        PBIO_IODEV_MODE_PUP_COLOR_DISTANCE_SENSOR__CONFIG = 11, // rrwr 4x int16_t (not in LEGO sensor)
     };
 
 public:
     ColorDistanceSensor();
     ColorDistanceSensor(uint8_t *pSensorColor, uint8_t *pSensorDistance);
-    virtual ~ColorDistanceSensor();
 
+    // By-value setters of the owned values
+    void setColor(uint8_t color);
+    void setDistance(uint8_t distance);
+#ifdef COLOR_DISTANCE_COUNTER
+    void setDetectionCount(uint32_t count);
+#endif
+    void setRGB(uint16_t red, uint16_t green, uint16_t blue);
+    void setReflectedLight(uint8_t reflectedLight);
+    void setAmbientLight(uint8_t ambientLight);
+    uint8_t getLEDColor();
     uint16_t getSensorIRCode();
+
+    // Pointer bindings (zero-copy); nullptr restores the owned value
     void setSensorColor(uint8_t *pData);
     void setSensorDistance(uint8_t *pData);
 #ifdef COLOR_DISTANCE_COUNTER
     void setSensorDetectionCount(uint32_t *pData);
+    void setDetectionCounter(ProximityCounter *counter);
 #endif
     void setSensorRGB(uint16_t *pData);
     void setIRCallback(void(pfunc)(const uint16_t));
@@ -103,6 +174,11 @@ public:
     void setLEDColorCallback(void(pfunc)(const uint8_t));
     void setSensorReflectedLight(uint8_t *pData);
     void setSensorAmbientLight(uint8_t *pData);
+#ifdef COLOR_DISTANCE_CONFIG
+    void setAcquisitionConfig(const AcquisitionConfig& config);
+    const AcquisitionConfig& getAcquisitionConfig();
+    void setConfigCallback(void(pfunc)(const AcquisitionConfig&));
+#endif
 
 private:
     // Process queries from/to hub
@@ -114,6 +190,10 @@ private:
     // Handle queries from the hub
     void setLEDColorMode();
     void setIRTXMode();
+#ifdef COLOR_DISTANCE_CONFIG
+    void setConfigMode();
+    void configMode();
+#endif
     void LEDColorMode();
     void sensorDistanceMode();
 #ifdef COLOR_DISTANCE_COUNTER
@@ -129,16 +209,20 @@ private:
     uint8_t  *m_sensorDistance;
 #ifdef COLOR_DISTANCE_COUNTER
     uint32_t *m_detectionCount;
+    ProximityCounter *m_detectionCounter;
 #endif
     uint8_t  *m_reflectedLight;
     uint8_t  *m_ambientLight;
     uint16_t *m_sensorRGB;
-    uint16_t m_IR_code;
     uint8_t  *m_sensorColor;
     void     (*m_pIRfunc)(const uint16_t); // Callback for IR change
     void     (*m_pLEDColorfunc)(const uint8_t);// Callback for Led color change
-
-    uint8_t *m_defaultIntVal;
+#ifdef COLOR_DISTANCE_CONFIG
+    AcquisitionConfig m_config;
+    void     (*m_pConfigfunc)(const AcquisitionConfig&); // Callback for config change
+#endif
+    // Last: the tail of the state is packed with the next byte
+    ColorDistanceState m_state;
 
     // UART protocol
     uint8_t m_currentExtMode = 0;
@@ -17,22 +17,28 @@
  */
 #include "ColorSensor.h"
 
+// Owned values: 6 bytes, 6 words, padding included
+static_assert(sizeof(ColorSensorState) <= 6 + 6 * sizeof(uint16_t), "ColorSensorState is not compact");
+// RAM footprint: BaseSensor + owned values + 5 bindings + 1 callback + 2 flags
+// + trailing padding
+static_assert(sizeof(ColorSensor) <= sizeof(BaseSensor) + sizeof(ColorSensorState)
+              + 5 * sizeof(void *) + sizeof(void (*)()) + 2 + (sizeof(void *) - 1),
+              "Unexpected RAM footprint of ColorSensor");
+
+
 /**
- * @brief Default constructor
+ * @brief Default constructor; all values are owned by the sensor (no heap
+ *      allocation) and initialized to 0.
  */
 ColorSensor::ColorSensor(){
-    m_defaultIntVal = new uint8_t(0);
-    uint16_t defaultRGB[3]      = { 0, 0, 0 };
-    uint16_t defaultHSV[3]      = { 0, 0, 0 };
-    uint8_t  LEDBrightnesses[3] = { 0, 0, 0 };
-
-    // Sensor default values
-    m_sensorColor              = m_defaultIntVal;
-    m_reflectedLight           = m_defaultIntVal;
-    m_ambientLight             = m_defaultIntVal;
-    m_sensorRGB_I              = defaultRGB;
-    m_sensorHSV                = defaultHSV;
-    m_LEDBrightnesses          = LEDBrightnesses;
+    m_state = ColorSensorState();
+
+    // No binding: the owned values are sent
+    m_sensorColor              = nullptr;
+    m_reflectedLight           = nullptr;
+    m_ambientLight             = nullptr;
+    m_sensorRGB_I              = nullptr;
+    m_sensorHSV                = nullptr;
     m_pLEDBrightnessesfunc     = nullptr;
     m_defaultComboModesEnabled = false;
 }
@@ -45,30 +51,65 @@ ColorSensor::ColorSensor(){
  * @param pRGB_I Pointer to Raw values of Red Green Blue channels. See m_sensorRGB_I.
  * @param pHSV Pointer to Raw values of Hue, Saturation, Value/Brightness channels. See m_sensorHSV.
  */
-ColorSensor::ColorSensor(uint8_t *pSensorColor, uint16_t *pRGB_I, uint16_t *pHSV){
-    m_defaultIntVal = new uint8_t(0);
-    uint8_t LEDBrightnesses[3] = { 0, 0, 0 };
-
+ColorSensor::ColorSensor(uint8_t *pSensorColor, uint16_t *pRGB_I, uint16_t *pHSV) :
+    ColorSensor() {
     // Set given values
-    m_sensorColor = pSensorColor;
-    m_sensorRGB_I = pRGB_I;
-    m_sensorHSV   = pHSV;
-
-    // Sensor default values
-    m_reflectedLight           = m_defaultIntVal;
-    m_ambientLight             = m_defaultIntVal;
-    m_LEDBrightnesses          = LEDBrightnesses;
-    m_pLEDBrightnessesfunc     = nullptr;
-    m_defaultComboModesEnabled = false;
+    this->setSensorColor(pSensorColor);
+    this->setSensorRGB_I(pRGB_I);
+    this->setSensorHSV(pHSV);
+}
+
+
+/**
+ * @brief Set the detected color; see setSensorColor().
+ */
+void ColorSensor::setColor(uint8_t color){
+    this->m_state.color = color;
+}
+
+
+/**
+ * @brief Set the raw values of Red Green Blue channels; see setSensorRGB_I().
+ */
+void ColorSensor::setRGB_I(uint16_t red, uint16_t green, uint16_t blue){
+    this->m_state.RGB_I[0] = red;
+    this->m_state.RGB_I[1] = green;
+    this->m_state.RGB_I[2] = blue;
+}
+
+
+/**
+ * @brief Set the raw values of Hue, Saturation, Value channels; see setSensorHSV().
+ */
+void ColorSensor::setHSV(uint16_t hue, uint16_t saturation, uint16_t value){
+    this->m_state.HSV[0] = hue;
+    this->m_state.HSV[1] = saturation;
+    this->m_state.HSV[2] = value;
+}
+
+
+/**
+ * @brief Set the reflected light; see setSensorReflectedLight().
+ */
+void ColorSensor::setReflectedLight(uint8_t reflectedLight){
+    this->m_state.reflectedLight = reflectedLight;
+}
+
+
+/**
+ * @brief Set the ambient light; see setSensorAmbientLight().
+ */
+void ColorSensor::setAmbientLight(uint8_t ambientLight){
+    this->m_state.ambientLight = ambientLight;
 }
 
 
 /**
- * @brief Destructor
+ * @brief Getter for m_state.LEDBrightnesses
+ * @return Array of the 3 brightnesses set by the hub (left, bottom, right).
  */
-ColorSensor::~ColorSensor(){
-    delete m_defaultIntVal;
-    // TODO: Should also implement copy constructor or copy assignment operator
+const uint8_t *ColorSensor::getLEDBrightnesses(){
+    return this->m_state.LEDBrightnesses;
 }
 
 
@@ -101,13 +142,12 @@ void ColorSensor::setSensorHSV(uint16_t *pData){
  *      COLOR_YELLOW, COLOR_RED, COLOR_PURPLE, COLOR_WHITE.
  */
 void ColorSensor::setSensorColor(uint8_t *pData){
-    // Free constructor's value
     this->m_sensorColor = pData;
 }
 
 
 /**
- * @brief Set callback receiving m_LEDBrightnesses when modified by the hub.
+ * @brief Set callback receiving m_state.LEDBrightnesses when modified by the hub.
  */
 void ColorSensor::setLEDBrightnessesCallback(void(pfunc)(const uint8_t*)){
     this->m_pLEDBrightnessesfunc = pfunc;
@@ -148,7 +188,7 @@ void ColorSensor::commSendInitSequence(){
     SerialTTL.write("\x52\x00\xC2\x01\x00\x6E", 6);                  // CMD_SPEED: 115200
     SerialTTL.write("\x5F\x00\x00\x00\x10\x00\x00\x00\x10\xA0", 10); // CMD_VERSION: fw-version: 1.0.0.0, hw-version: 1.0.0.0
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 9:
     SerialTTL.write("\xA1\x20\x43\x41\x4C\x49\x42\x00\x40\x40\x00\x00\x04\x84\x00\x00\x00\x00\xBB", 19); // Name: "CALIB"+ flags
     SerialTTL.write("\x99\x21\x00\x00\x00\x00\x00\xFF\x7F\x47\x80", 11);                                 // Range: 0 to 65535
@@ -158,7 +198,7 @@ void ColorSensor::commSendInitSequence(){
     SerialTTL.write("\x89\x25\x00\x00\x53", 5);                                                          // No additional info mapping flag
     SerialTTL.write("\x91\xA0\x07\x01\x05\x00\xCD", 7);                                                  // Format: 7 uint16, each 5 chars, 0 decimal
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 8:
     SerialTTL.write("\xA0\x20\x44\x45\x42\x55\x47\x00\x40\x00\x00\x00\x04\x84\x00\x00\x00\x00\xEE", 19); // Name: "DEBUG" + flags
     SerialTTL.write("\x98\x21\x00\x00\x00\x00\x00\xFF\x7F\x47\x81", 11);                                 // Range: 0 to 65535
@@ -168,7 +208,7 @@ void ColorSensor::commSendInitSequence(){
     SerialTTL.write("\x88\x25\x10\x00\x42", 5);                                                          // input_flags: Absolute, output_flags: None
     SerialTTL.write("\x90\xA0\x04\x01\x04\x00\xCE", 7);                                                  // Format: 4 uint16, each 4 chars, 0 decimal
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 7:
     SerialTTL.write("\xA7\x00\x53\x48\x53\x56\x00\x00\x40\x00\x00\x00\x04\x84\x00\x00\x00\x00\x86", 19); // Name: "SHSV" + flags
     SerialTTL.write("\x9F\x01\x00\x00\x00\x00\x00\x00\xB4\x43\x96", 11);                                 // Range: 0 to 360
@@ -178,7 +218,7 @@ void ColorSensor::commSendInitSequence(){
     SerialTTL.write("\x8F\x05\x10\x00\x65", 5);                                                          // input_flags: Absolute, output_flags: None
     SerialTTL.write("\x97\x80\x04\x01\x04\x00\xE9", 7);                                                  // Format: 4 uint16, each 4 chars, 0 decimal
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 6:
     SerialTTL.write("\xA6\x00\x48\x53\x56\x00\x00\x00\x40\x00\x00\x00\x04\x84\x00\x00\x00\x00\xD4", 19); // Name: "HSV" + flags
     SerialTTL.write("\x9E\x01\x00\x00\x00\x00\x00\x00\xB4\x43\x97", 11);                                 // Range: 0 to 360
@@ -188,7 +228,7 @@ void ColorSensor::commSendInitSequence(){
     SerialTTL.write("\x8E\x05\x10\x00\x64", 5);                                                          // input_flags: Absolute, output_flags: None
     SerialTTL.write("\x96\x80\x03\x01\x04\x00\xEF", 7);                                                  // Format: 3 uint16, each 4 chars, 0 decimal
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 5:
     SerialTTL.write("\xA5\x00\x52\x47\x42\x20\x49\x00\x40\x00\x00\x00\x04\x84\x00\x00\x00\x00\xA4", 19); // Name: "RGB I" + flags
     SerialTTL.write("\x9D\x01\x00\x00\x00\x00\x00\x00\x80\x44\xA7", 11);                                 // Range: 0 to 1024
@@ -198,7 +238,7 @@ void ColorSensor::commSendInitSequence(){
     SerialTTL.write("\x8D\x05\x10\x00\x67", 5);                                                          // input_flags: Absolute, output_flags: None
     SerialTTL.write("\x95\x80\x04\x01\x04\x00\xEB", 7);                                                  // Format: 4 uint16, each 4 chars, 0 decimal
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 4:
     SerialTTL.write("\xA4\x00\x52\x52\x45\x46\x4C\x00\x40\x00\x00\x00\x04\x84\x00\x00\x00\x00\xD4", 19); // Name: "RREFL" + flags
     SerialTTL.write("\x9C\x01\x00\x00\x00\x00\x00\x00\x80\x44\xA6", 11);                                 // (reflected light RAW)
@@ -208,7 +248,7 @@ void ColorSensor::commSendInitSequence(){
     SerialTTL.write("\x8C\x05\x10\x00\x66", 5);                                                          // input_flags: Absolute, output_flags: None
     SerialTTL.write("\x94\x80\x02\x01\x04\x00\xEC", 7);                                                  // Format: 2 uint16, each 4 chars, 0 decimal
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 3:
     SerialTTL.write("\xA3\x00\x4C\x49\x47\x48\x54\x00\x40\x00\x00\x00\x05\x04\x00\x00\x00\x00\x43", 19); // Name: "LIGHT" + flags
     SerialTTL.write("\x9B\x01\x00\x00\x00\x00\x00\x00\xC8\x42\xEF", 11);                                 // Range: 0 to 100
@@ -218,7 +258,7 @@ void ColorSensor::commSendInitSequence(){
     SerialTTL.write("\x8B\x05\x00\x10\x61", 5);                                                          // input_flags: None, output_flags: Absolute
     SerialTTL.write("\x93\x80\x03\x00\x03\x00\xEC", 7);                                                  // Format: 3 uint8, shows 3 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 2:
     SerialTTL.write("\xA2\x00\x41\x4D\x42\x49\x00\x00\x40\x00\x00\x00\x04\x84\x00\x00\x00\x00\x9A", 19); // Name: "AMBI" + flags
     SerialTTL.write("\x9A\x01\x00\x00\x00\x00\x00\x00\xC8\x42\xEE", 11);                                 // Range: 0 to 100
@@ -228,7 +268,7 @@ void ColorSensor::commSendInitSequence(){
     SerialTTL.write("\x8A\x05\x30\x00\x40", 5);                                                          // input_flags: Absolute,N/A, output_flags: None
     SerialTTL.write("\x92\x80\x01\x00\x03\x00\xEF", 7);                                                  // Format: 1 uint8, shows 3 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 1:
     SerialTTL.write("\xA1\x00\x52\x45\x46\x4C\x54\x00\x40\x00\x00\x00\x04\x84\x00\x00\x00\x00\xD7", 19); // Name: "REFLT" + flags
     SerialTTL.write("\x99\x01\x00\x00\x00\x00\x00\x00\xC8\x42\xED", 11);                                 // Range: 0 to 100
@@ -238,7 +278,7 @@ void ColorSensor::commSendInitSequence(){
     SerialTTL.write("\x89\x05\x30\x00\x43", 5);                                                          // input_flags: Absolute,N/A, output_flags: None
     SerialTTL.write("\x91\x80\x01\x00\x03\x00\xEC", 7);                                                  // Format: 1 uint8, shows 3 chars, 0 decimals
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     // Mode 0:
     SerialTTL.write("\xA0\x00\x43\x4F\x4C\x4F\x52\x00\x40\x00\x00\x00\x04\x84\x00\x00\x00\x00\xC2", 19); // Name: "COLOR" + flags
     SerialTTL.write("\x98\x01\x00\x00\x00\x00\x00\x00\x20\x41\x07", 11);                                 // Range: 0 to 10
@@ -251,10 +291,10 @@ void ColorSensor::commSendInitSequence(){
     // Unknown
     SerialTTL.write("\xA0\x08\x00\x3C\x00\x31\x0A\x47\x39\x32\x35\x33\x39\x39\x00\x00\x00\x00\x1A", 19);
     SerialTTL.flush();
-    delay(10);
+    commWait(10);
     SerialTTL.write("\x04", 1);
     SerialTTL.flush();
-    delay(5);
+    commWait(5);
 }
 
 
@@ -273,11 +313,11 @@ void ColorSensor::handleModes(){
     unsigned char mode;
     header = SerialTTL.read();
 
-    DEBUG_PRINT(F("<\tHeader "));
-    DEBUG_PRINTLN(header, HEX);
+    TRACE_EVENT(TRACE_HEADER, header);
 
     if (header == 0x02) { // NACK
         m_lastAckTick = millis();
+        NACK_LATENCY_START();
         // Note: In theory the default mode is always the lowest (0).
         // If combos mode is enabled, prefer to send this data
         if (m_defaultComboModesEnabled)
@@ -289,12 +329,11 @@ void ColorSensor::handleModes(){
         size_t ret = SerialTTL.readBytes(m_rxBuf, 2);
         if (ret < 2) {
             // check if all expected bytes are received without timeout
-            DEBUG_PRINT(F("incomplete 0x43 message"));
+            TRACE_EVENT(TRACE_INCOMPLETE_MESSAGE, 0x43);
             return;
         }
         mode = m_rxBuf[0];
-        DEBUG_PRINT(F("<\tAsked mode "));
-        DEBUG_PRINTLN(mode);
+        TRACE_EVENT(TRACE_ASKED_MODE, mode);
 
         this->m_currentExtMode = (mode < 8) ? EXT_MODE_0 : EXT_MODE_8;
 
@@ -327,8 +366,7 @@ void ColorSensor::handleModes(){
                 break;
             #endif
             default:
-                INFO_PRINT(F("unknown R mode: "));
-                INFO_PRINTLN(mode, HEX);
+                TRACE_EVENT(TRACE_UNKNOWN_R_MODE, mode);
                 break;
         }
     } else if (header == 0x46) {
@@ -361,8 +399,7 @@ void ColorSensor::handleModes(){
                 this->setLEDBrightnessesMode();
                 break;
             default:
-                INFO_PRINT(F("unknown W mode: "));
-                INFO_PRINTLN(mode, HEX);
+                TRACE_EVENT(TRACE_UNKNOWN_W_MODE, mode);
                 break;
         }
     } else if (header == 0x4C) {
@@ -398,7 +435,7 @@ void ColorSensor::handleModes(){
         size_t ret = SerialTTL.readBytes(m_rxBuf, 9);
         if (ret < 9) {
             // check if all expected bytes are received without timeout
-            DEBUG_PRINT(F("incomplete 0x5C message"));
+            TRACE_EVENT(TRACE_INCOMPLETE_MESSAGE, 0x5C);
             return;
         }
 
@@ -434,19 +471,15 @@ void ColorSensor::extendedModeInfoResponse(){
 void ColorSensor::setLEDBrightnessesMode(){
     // Mode 3 (write mode)
     // Expect brightness values (3 int8_t)
-    this->m_LEDBrightnesses[0] = m_rxBuf[0];
-    this->m_LEDBrightnesses[1] = m_rxBuf[1];
-    this->m_LEDBrightnesses[2] = m_rxBuf[2];
+    this->m_state.LEDBrightnesses[0] = m_rxBuf[0];
+    this->m_state.LEDBrightnesses[1] = m_rxBuf[1];
+    this->m_state.LEDBrightnesses[2] = m_rxBuf[2];
 
-    DEBUG_PRINT(F("LEDBrightnesses set (Left,Bottom,Right): "));
-    DEBUG_PRINT(this->m_LEDBrightnesses[0], HEX);
-    DEBUG_PRINT(F(", "));
-    DEBUG_PRINT(this->m_LEDBrightnesses[1], HEX);
-    DEBUG_PRINT(F(", "));
-    DEBUG_PRINTLN(this->m_LEDBrightnesses[2], HEX);
+    TRACE_EVENT(TRACE_LED_BRIGHTNESSES, this->m_state.LEDBrightnesses[0],
+                _(uint16_t)((this->m_state.LEDBrightnesses[1] << 8) | this->m_state.LEDBrightnesses[2]));
 
     if (this->m_pLEDBrightnessesfunc != nullptr)
-        this->m_pLEDBrightnessesfunc(this->m_LEDBrightnesses);
+        this->m_pLEDBrightnessesfunc(this->m_state.LEDBrightnesses);
 }
 
 
@@ -460,7 +493,7 @@ void ColorSensor::setLEDBrightnessesMode(){
 void ColorSensor::sensorColorMode(){
     // Mode 0
     m_txBuf[0] = 0xC0;                      // header
-    m_txBuf[1] = *m_sensorColor;            // current detected color
+    m_txBuf[1] = (m_sensorColor) ? *m_sensorColor : m_state.color; // current detected color
     sendUARTBuffer(1);
 }
 
@@ -472,7 +505,7 @@ void ColorSensor::sensorColorMode(){
 void ColorSensor::sensorReflectedLightMode(){
     // Mode 1
     m_txBuf[0] = 0xC1;                      // header
-    m_txBuf[1] = *this->m_reflectedLight;   // 0..100
+    m_txBuf[1] = (m_reflectedLight) ? *m_reflectedLight : m_state.reflectedLight; // 0..100
     sendUARTBuffer(1);
 }
 
@@ -484,7 +517,7 @@ void ColorSensor::sensorReflectedLightMode(){
 void ColorSensor::sensorAmbientLight(){
     // Mode 2
     m_txBuf[0] = 0xC2;                      // header
-    m_txBuf[1] = *this->m_ambientLight;
+    m_txBuf[1] = (m_ambientLight) ? *m_ambientLight : m_state.ambientLight;
     sendUARTBuffer(1);
 }
 
@@ -496,13 +529,14 @@ void ColorSensor::sensorAmbientLight(){
  */
 void ColorSensor::sensorRGB_IMode(){
     // Mode 5
+    const uint16_t *RGB_I = (m_sensorRGB_I) ? m_sensorRGB_I : m_state.RGB_I;
     m_txBuf[0] = getHeader(lump_msg_type_t::LUMP_MSG_TYPE_DATA, 5, 10); // 0xdd
-    m_txBuf[1] = this->m_sensorRGB_I[0] & 0xFF;                         // Send LSB of red value
-    m_txBuf[2] = (this->m_sensorRGB_I[0] >> 8) & 0xFF;                  // Send MSB
-    m_txBuf[3] = this->m_sensorRGB_I[1] & 0xFF;                         // Send LSB of green value
-    m_txBuf[4] = (this->m_sensorRGB_I[1] >> 8) & 0xFF;
-    m_txBuf[5] = this->m_sensorRGB_I[2] & 0xFF;                         // Send LSB of blue value
-    m_txBuf[6] = (this->m_sensorRGB_I[2] >> 8) & 0xFF;
+    m_txBuf[1] = RGB_I[0] & 0xFF;                                       // Send LSB of red value
+    m_txBuf[2] = (RGB_I[0] >> 8) & 0xFF;                                // Send MSB
+    m_txBuf[3] = RGB_I[1] & 0xFF;                                       // Send LSB of green value
+    m_txBuf[4] = (RGB_I[1] >> 8) & 0xFF;
+    m_txBuf[5] = RGB_I[2] & 0xFF;                                       // Send LSB of blue value
+    m_txBuf[6] = (RGB_I[2] >> 8) & 0xFF;
     m_txBuf[7] = 0;                                                     // Unknown channel
     m_txBuf[8] = 0;                                                     // Unknown channel
     sendUARTBuffer(8);
@@ -516,16 +550,17 @@ void ColorSensor::sensorRGB_IMode(){
 void ColorSensor::sensorHSVMode(){
     // Mode 6
     // Send data; payload size = 6, but total msg_size = 10
-    DEBUG_PRINTLN(F("Mode 6"));
+    TRACE_EVENT(TRACE_MODE_SENT, 6);
 
     // Send data
+    const uint16_t *HSV = (m_sensorHSV) ? m_sensorHSV : m_state.HSV;
     m_txBuf[0] = getHeader(lump_msg_type_t::LUMP_MSG_TYPE_DATA, 6, 10); // header: 0xde
-    m_txBuf[1] = this->m_sensorHSV[0] & 0xFF;                           // Send LSB of hue value
-    m_txBuf[2] = (this->m_sensorHSV[0] >> 8) & 0xFF;                    // Send MSB
-    m_txBuf[3] = this->m_sensorHSV[1] & 0xFF;                           // Send LSB of saturation value
-    m_txBuf[4] = (this->m_sensorHSV[1] >> 8) & 0xFF;
-    m_txBuf[5] = this->m_sensorHSV[2] & 0xFF;                           // Send LSB of value
-    m_txBuf[6] = (this->m_sensorHSV[2] >> 8) & 0xFF;
+    m_txBuf[1] = HSV[0] & 0xFF;                                         // Send LSB of hue value
+    m_txBuf[2] = (HSV[0] >> 8) & 0xFF;                                  // Send MSB
+    m_txBuf[3] = HSV[1] & 0xFF;                                         // Send LSB of saturation value
+    m_txBuf[4] = (HSV[1] >> 8) & 0xFF;
+    m_txBuf[5] = HSV[2] & 0xFF;                                         // Send LSB of value
+    m_txBuf[6] = (HSV[2] >> 8) & 0xFF;
     m_txBuf[7] = 0;                                                     // Padding
     m_txBuf[8] = 0;                                                     // Padding
     sendUARTBuffer(8);
@@ -584,19 +619,20 @@ void ColorSensor::sensorDebugMode(){
  */
 void ColorSensor::defaultCombosMode(){
     // Send data; payload size = 8, but total msg_size = 10
-    DEBUG_PRINTLN(F("Default combos mode"));
+    TRACE_EVENT(TRACE_DEFAULT_COMBOS);
 
     // Send data
+    const uint16_t *RGB_I = (m_sensorRGB_I) ? m_sensorRGB_I : m_state.RGB_I;
     m_txBuf[0] = getHeader(lump_msg_type_t::LUMP_MSG_TYPE_DATA, 0, 10); // header: 0xd8
-    m_txBuf[1] = *this->m_reflectedLight;                               // mode 1 value 0
-    m_txBuf[2] = *this->m_sensorColor;                                  // mode 0 value 0
+    m_txBuf[1] = (m_reflectedLight) ? *m_reflectedLight : m_state.reflectedLight; // mode 1 value 0
+    m_txBuf[2] = (m_sensorColor) ? *m_sensorColor : m_state.color;      // mode 0 value 0
                                                                         // mode 5: values 0, 1, 2
-    m_txBuf[3] = this->m_sensorRGB_I[0] & 0xFF;                         // Send LSB of red value
-    m_txBuf[4] = (this->m_sensorRGB_I[0] >> 8) & 0xFF;                  // Send MSB
-    m_txBuf[5] = this->m_sensorRGB_I[1] & 0xFF;                         // Send LSB of green value
-    m_txBuf[6] = (this->m_sensorRGB_I[1] >> 8) & 0xFF;
-    m_txBuf[7] = this->m_sensorRGB_I[2] & 0xFF;                         // Send LSB of blue value
-    m_txBuf[8] = (this->m_sensorRGB_I[2] >> 8) & 0xFF;
+    m_txBuf[3] = RGB_I[0] & 0xFF;                                       // Send LSB of red value
+    m_txBuf[4] = (RGB_I[0] >> 8) & 0xFF;                                // Send MSB
+    m_txBuf[5] = RGB_I[1] & 0xFF;                                       // Send LSB of green value
+    m_txBuf[6] = (RGB_I[1] >> 8) & 0xFF;
+    m_txBuf[7] = RGB_I[2] & 0xFF;                                       // Send LSB of blue value
+    m_txBuf[8] = (RGB_I[2] >> 8) & 0xFF;
     sendUARTBuffer(8);
 }
 
@@ -39,6 +39,23 @@
 #define EXT_MODE_0      0x00  // for mode numbers < 8
 #define EXT_MODE_8      0x08  // for mode numbers >= 8
 
+/**
+ * @brief Values owned by ColorSensor; sent to the hub unless a pointer to
+ *      an external value is bound with the setSensor...() setters.
+ *      Fields are ordered by size to avoid padding.
+ *
+ * @param RGB_I, HSV, color, reflectedLight, ambientLight, LEDBrightnesses
+ *      See the attributes of ColorSensor with the same names.
+ */
+struct ColorSensorState {
+    uint16_t RGB_I[3];
+    uint16_t HSV[3];
+    uint8_t  color;
+    uint8_t  reflectedLight;
+    uint8_t  ambientLight;
+    uint8_t  LEDBrightnesses[3];
+};
+
 /**
  * @brief Handle the LegoUART protocol and define modes of the
  *      Spike/Technic Color Sensor.
@@ -59,7 +76,13 @@
  * @param m_ambientLight Ambient light based on lux value.
  *      In theory, it's the value of Value in SHSV array.
  *      Continuous values 0...100.
- * @param m_LEDBrightnesses This sensor has 3 built-in lights:
+ * @param m_state Owned values, written by the by-value setters (setColor(),
+ *      etc.) and sent to the hub by default.
+ *      The other attributes are nullptr unless a pointer to an external
+ *      value (zero-copy) is bound with the setSensor...(pointer) setters;
+ *      a bound value is sent instead of the owned one.
+ *      No attribute points into the object: copies are independent.
+ *      LEDBrightnesses: This sensor has 3 built-in lights:
  *      0: left, 1: bottom, 2: right.
  *      Values in the array are the brightness of each light.
  *      (supposed to be transmitted via the Power Functions RC Protocol).
@@ -69,7 +92,7 @@
  *      Continuous values 0..1023.
  * @param m_sensorHSV Raw values of Hue, Saturation, Value/Brightness channels.
  *      Continuous values 0..1023.
- * @param m_pLEDBrightnessesfunc Callback set by user, receiving m_LEDBrightnesses
+ * @param m_pLEDBrightnessesfunc Callback set by user, receiving m_state.LEDBrightnesses
  *      when it's values are changed by the hub.
  * @param m_defaultComboModesEnabled Boolean set to true if the device receives
  *      a combo mode / multi-mode packet. This packet should overwrite the default
@@ -100,9 +123,16 @@ class ColorSensor : public BaseSensor {
 public:
     ColorSensor();
     ColorSensor(uint8_t *pSensorColor, uint16_t *pRGB_I, uint16_t *pHSV);
-    virtual ~ColorSensor();
 
-    uint16_t getSensorIRCode();
+    // By-value setters of the owned values
+    void setColor(uint8_t color);
+    void setRGB_I(uint16_t red, uint16_t green, uint16_t blue);
+    void setHSV(uint16_t hue, uint16_t saturation, uint16_t value);
+    void setReflectedLight(uint8_t reflectedLight);
+    void setAmbientLight(uint8_t ambientLight);
+    const uint8_t *getLEDBrightnesses();
+
+    // Pointer bindings (zero-copy); nullptr restores the owned value
     void setSensorRGB_I(uint16_t *pData);
     void setSensorHSV(uint16_t *pData);
     void setSensorColor(uint8_t *pData);
@@ -134,12 +164,12 @@ private:
     uint8_t  *m_sensorColor;
     uint8_t  *m_reflectedLight;
     uint8_t  *m_ambientLight;
-    uint8_t  *m_LEDBrightnesses;
     uint16_t *m_sensorRGB_I;
     uint16_t *m_sensorHSV;
     void     (*m_pLEDBrightnessesfunc)(const uint8_t*);
+    // Last: the tail of the state is packed with the next bytes
+    ColorSensorState m_state;
     bool     m_defaultComboModesEnabled;
-    uint8_t  *m_defaultIntVal;
 
     // UART protocol
     uint8_t m_currentExtMode = 0;
@@ -0,0 +1,726 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "LumpBridge.h"
+
+// Headers of the messages handled by the bridge
+#define BRIDGE_NACK        (LUMP_MSG_TYPE_SYS | LUMP_SYS_NACK)
+#define BRIDGE_ACK         (LUMP_MSG_TYPE_SYS | LUMP_SYS_ACK)
+#define BRIDGE_TYPE        (LUMP_MSG_TYPE_CMD | LUMP_MSG_SIZE_1 | LUMP_CMD_TYPE)
+#define BRIDGE_SELECT      (LUMP_MSG_TYPE_CMD | LUMP_MSG_SIZE_1 | LUMP_CMD_SELECT)
+#define BRIDGE_EXT_MODE    (LUMP_MSG_TYPE_CMD | LUMP_MSG_SIZE_1 | LUMP_CMD_EXT_MODE)
+
+/**
+ * @brief Constructor
+ * @param deviceSerial Serial port connected to the LEGO device.
+ * @param hubSerial Serial port connected to the hub.
+ *      Both ports are started by process().
+ */
+LumpBridge::LumpBridge(LumpBridgeSerial& deviceSerial, LumpBridgeSerial& hubSerial) :
+    m_device(deviceSerial),
+    m_hub(hubSerial),
+    m_state(BRIDGE_IDLE),
+    m_modeCount(0),
+    m_initLen(0),
+    m_infoStart(0),
+    m_modesOffset(0),
+    m_frameLen(0),
+    m_frameSize(0),
+    m_deviceType(0),
+    m_deviceModes(0),
+    m_deviceViews(0),
+    m_speed(2400),
+    m_deviceTick(0),
+    m_hubTick(0),
+    m_keepAliveTick(0),
+    m_hubPos(0),
+    m_selectedMode(0),
+    m_deviceExtMode(LUMP_EXT_MODE_0),
+    m_hubExtMode(LUMP_EXT_MODE_0),
+    m_writeExtMode(LUMP_EXT_MODE_0),
+    m_devHeader(0),
+    m_devRemaining(0),
+    m_devForward(false),
+    m_hubLen(0),
+    m_hubSize(0),
+    m_hubHold(false),
+    m_extPending(false),
+    m_previousPollTick(0),
+    m_lastPollTick(0),
+    m_stats()
+{}
+
+
+/**
+ * @brief Add a mode emulated by the microcontroller.
+ *      Must be called before the first call of process().
+ * @param info Description of the mode; must stay valid (static or global).
+ * @param readFunc Callback filling the DATA messages sent to the hub
+ *      when the mode is selected; nullptr for write only modes.
+ * @param writeFunc Callback receiving the values written by the hub;
+ *      nullptr for read only modes.
+ * @return Index of the added mode (its number for the hub is
+ *      getDeviceModes() + index); -1 if LUMP_BRIDGE_MAX_MODES is reached.
+ */
+int8_t LumpBridge::addMode(const LumpModeInfo *info, LumpModeReadFunc readFunc, LumpModeWriteFunc writeFunc){
+    if (m_modeCount >= LUMP_BRIDGE_MAX_MODES)
+        return -1;
+    m_modes[m_modeCount].info  = info;
+    m_modes[m_modeCount].read  = readFunc;
+    m_modes[m_modeCount].write = writeFunc;
+    return _(int8_t)(m_modeCount++);
+}
+
+
+/**
+ * @brief Get the step of the connection.
+ */
+LumpBridge::State LumpBridge::getState(){
+    return m_state;
+}
+
+
+/**
+ * @brief Get status of connection with the hub (and the device).
+ */
+bool LumpBridge::isConnected(){
+    return m_state == BRIDGE_CONNECTED;
+}
+
+
+/**
+ * @brief Get the type id of the device (0 before its init sequence).
+ */
+uint8_t LumpBridge::getDeviceType(){
+    return m_deviceType;
+}
+
+
+/**
+ * @brief Get the number of modes of the device; the added modes follow them.
+ */
+uint8_t LumpBridge::getDeviceModes(){
+    return m_deviceModes;
+}
+
+
+/**
+ * @brief Get the mode selected by the hub.
+ */
+uint8_t LumpBridge::getSelectedMode(){
+    return m_selectedMode;
+}
+
+
+/**
+ * @brief Get the distribution of the latencies added to the forwarded frames.
+ * @param direction BRIDGE_TO_HUB or BRIDGE_TO_DEVICE.
+ * @see BridgeLatencyStats
+ */
+BridgeLatencyStats LumpBridge::getLatencyStats(uint8_t direction){
+    return m_stats[direction & 0x01];
+}
+
+
+void LumpBridge::resetLatencyStats(){
+    m_stats[BRIDGE_TO_HUB]    = BridgeLatencyStats();
+    m_stats[BRIDGE_TO_DEVICE] = BridgeLatencyStats();
+}
+
+
+/**
+ * @brief Handle the connections & forward the frames; never blocks.
+ *      Must be called as often as possible: the latency added to the
+ *      frames depends on the time between 2 calls.
+ */
+void LumpBridge::process(){
+    m_previousPollTick = m_lastPollTick;
+    m_lastPollTick     = micros();
+
+    switch (m_state) {
+        case BRIDGE_IDLE:
+            startDeviceSync();
+            break;
+        case BRIDGE_DEVICE_SYNC:
+            readDeviceInit();
+            break;
+        case BRIDGE_HUB_SYNC:
+            // The data of the device is dropped, but its frames are followed
+            forwardDeviceToHub();
+            keepDeviceAlive();
+            sendHubInit();
+            break;
+        case BRIDGE_CONNECTED:
+            // Hub first: the NACKs are forwarded before the data of the device
+            forwardHubToDevice();
+            forwardDeviceToHub();
+            if (millis() - m_hubTick > 200) {
+                INFO_PRINTLN(F("Bridge: hub disconnected"));
+                startHubSync();
+            }
+            break;
+    }
+
+    if (m_state > BRIDGE_DEVICE_SYNC && millis() - m_deviceTick > LUMP_BRIDGE_DEVICE_TIMEOUT) {
+        INFO_PRINTLN(F("Bridge: device disconnected"));
+        startDeviceSync();
+    }
+}
+
+
+/**
+ * @brief Wait for the init sequence of the device at 2400 bauds.
+ *      The hub doesn't receive anything until the end of the sequence;
+ *      a connected hub detects the disconnection.
+ */
+void LumpBridge::startDeviceSync(){
+    m_device.begin(2400);
+    m_state        = BRIDGE_DEVICE_SYNC;
+    m_initLen      = 0;
+    m_frameLen     = 0;
+    m_devRemaining = 0;
+}
+
+
+/**
+ * @brief Capture the init sequence of the device until its ACK.
+ *      The frames are stored in m_init from CMD_TYPE; the capture restarts
+ *      on a new CMD_TYPE or a bad checksum (the device repeats its sequence
+ *      until it is acknowledged).
+ */
+void LumpBridge::readDeviceInit(){
+    while (m_device.available() > 0) {
+        const uint8_t byte = m_device.read();
+
+        if (m_frameLen == 0) {
+            // Header
+            if (byte == BRIDGE_ACK && m_initLen) {
+                // End of the sequence; room is needed for the added modes
+                if (m_deviceModes && m_infoStart &&
+                        m_deviceModes + m_modeCount <= 16 && rewriteInitSequence()) {
+                    m_device.write(BRIDGE_ACK);
+                    m_device.flush();
+                    m_device.begin(m_speed);
+                    m_deviceTick = millis();
+                    DEBUG_PRINT(F("Bridge: device type "));
+                    DEBUG_PRINTLN(m_deviceType, HEX);
+                    startHubSync();
+                    return;
+                }
+                m_initLen = 0;
+                continue;
+            }
+            if (byte == BRIDGE_TYPE) {
+                // Start of the sequence
+                m_initLen     = 0;
+                m_infoStart   = 0;
+                m_modesOffset = 0;
+                m_deviceModes = 0;
+                m_speed       = 2400;
+            } else if (m_initLen == 0) {
+                continue;
+            }
+            m_frameSize = frameSize(byte);
+            if (m_frameSize <= 1)
+                // SYS messages (SYNC) & invalid headers
+                continue;
+            if (m_initLen + m_frameSize > LUMP_BRIDGE_INIT_SIZE) {
+                INFO_PRINTLN(F("Bridge: init sequence too long"));
+                m_initLen = 0;
+                continue;
+            }
+        }
+
+        m_init[m_initLen + m_frameLen++] = byte;
+        if (m_frameLen < m_frameSize)
+            continue;
+
+        const uint8_t *frame = &m_init[m_initLen];
+        if (checksum(frame, m_frameSize - 1) == frame[m_frameSize - 1]) {
+            parseInitFrame(frame);
+            m_initLen += m_frameSize;
+        } else {
+            DEBUG_PRINTLN(F("Bridge: bad checksum in init sequence"));
+            m_initLen = 0;
+        }
+        m_frameLen = 0;
+    }
+}
+
+
+/**
+ * @brief Get the identity of the device from a frame of its init sequence.
+ *      The frame is at the offset m_initLen of m_init.
+ */
+void LumpBridge::parseInitFrame(const uint8_t *frame){
+    const uint8_t header = frame[0];
+
+    if ((header & LUMP_MSG_TYPE_MASK) == LUMP_MSG_TYPE_INFO) {
+        if (!m_infoStart)
+            m_infoStart = m_initLen;
+        return;
+    }
+    if ((header & LUMP_MSG_TYPE_MASK) != LUMP_MSG_TYPE_CMD)
+        return;
+
+    switch (header & LUMP_MSG_CMD_MASK) {
+        case LUMP_CMD_TYPE:
+            m_deviceType = frame[1];
+            break;
+        case LUMP_CMD_MODES:
+            m_modesOffset = m_initLen;
+            if (LUMP_MSG_SIZE(header) >= 4) {
+                // Modes & views of the PoweredUp devices (up to 16)
+                m_deviceModes = frame[3] + 1;
+                m_deviceViews = frame[4] + 1;
+            } else {
+                m_deviceModes = frame[1] + 1;
+                m_deviceViews = (LUMP_MSG_SIZE(header) >= 2) ? frame[2] + 1 : m_deviceModes;
+            }
+            break;
+        case LUMP_CMD_SPEED:
+            m_speed = _(uint32_t)(frame[1]) | (_(uint32_t)(frame[2]) << 8) |
+                      (_(uint32_t)(frame[3]) << 16) | (_(uint32_t)(frame[4]) << 24);
+            break;
+        default:
+            break;
+    }
+}
+
+
+/**
+ * @brief Turn the init sequence of the device into the one of the hub:
+ *      CMD_MODES counts the added modes, and their INFO messages are
+ *      inserted before the ones of the device (from the highest mode,
+ *      like the devices).
+ * @return false if the buffer is too small.
+ */
+bool LumpBridge::rewriteInitSequence(){
+    if (!m_modeCount)
+        return true;
+    if (!m_modesOffset || m_modesOffset > m_infoStart)
+        return false;
+
+    const uint8_t total = m_deviceModes + m_modeCount;
+    uint8_t       modes[4];
+    modes[0] = ((total < 8) ? total : 8) - 1;
+    modes[1] = ((m_deviceViews < 8) ? m_deviceViews : 8) - 1;
+    modes[2] = total - 1;
+    modes[3] = m_deviceViews - 1;
+    // The short form can't count more than 8 modes
+    const uint8_t modesSize = (total > 8 || LUMP_MSG_SIZE(m_init[m_modesOffset]) >= 4) ? 4 : 2;
+    const uint8_t oldLength = frameSize(m_init[m_modesOffset]);
+    const uint8_t newLength = writeFrame(nullptr, LUMP_MSG_TYPE_CMD | LUMP_CMD_MODES, modes, modesSize);
+
+    uint16_t infoLength = 0;
+    for (uint8_t i = 0; i < m_modeCount; i++)
+        infoLength += writeModeInfo(nullptr, m_deviceModes + i, m_modes[i].info);
+
+    const uint16_t growth = newLength - oldLength + infoLength;
+    if (m_initLen + growth > LUMP_BRIDGE_INIT_SIZE) {
+        INFO_PRINTLN(F("Bridge: no room for the added modes"));
+        return false;
+    }
+
+    // INFO messages of the device, then the frames between CMD_MODES & them
+    const uint16_t modesEnd = m_modesOffset + oldLength;
+    memmove(&m_init[m_infoStart + growth], &m_init[m_infoStart], m_initLen - m_infoStart);
+    memmove(&m_init[modesEnd + newLength - oldLength], &m_init[modesEnd], m_infoStart - modesEnd);
+    writeFrame(&m_init[m_modesOffset], LUMP_MSG_TYPE_CMD | LUMP_CMD_MODES, modes, modesSize);
+
+    m_infoStart += newLength - oldLength;
+    uint16_t pos = m_infoStart;
+    for (int8_t i = m_modeCount - 1; i >= 0; i--)
+        pos += writeModeInfo(&m_init[pos], m_deviceModes + i, m_modes[i].info);
+    m_initLen += growth;
+    return true;
+}
+
+
+/**
+ * @brief Write the INFO messages of a mode.
+ * @param buffer Output buffer; nullptr to get the size only.
+ * @param mode Number of the mode for the hub.
+ * @return Size of the messages.
+ */
+uint16_t LumpBridge::writeModeInfo(uint8_t *buffer, uint8_t mode, const LumpModeInfo *info){
+    const uint8_t header = LUMP_MSG_TYPE_INFO | (mode & LUMP_MSG_CMD_MASK);
+    const uint8_t plus8  = (mode >= 8) ? LUMP_INFO_MODE_PLUS_8 : 0;
+    const uint8_t mapping[2] = { info->inputFlags, info->outputFlags };
+    const uint8_t format[4]  = { info->count, info->type, info->figures, info->decimals };
+    const size_t  nameSize   = strlen(info->name);
+    const size_t  symbolSize = strlen(info->symbol);
+    uint16_t      length     = 0;
+    // Units on 4 bytes, like the devices
+    char symbol[4] = { 0, 0, 0, 0 };
+    memcpy(symbol, info->symbol, (symbolSize < 4) ? symbolSize : 4);
+
+#define BRIDGE_INFO(info_type, payload, size)                                                   \
+    length += writeFrame(buffer ? &buffer[length] : nullptr, header,                            \
+                         reinterpret_cast<const uint8_t *>(payload), _(uint8_t)(size), (info_type) | plus8)
+
+    // Floats are sent as is: little-endian like the supported platforms
+    BRIDGE_INFO(LUMP_INFO_NAME, info->name, (nameSize < 11) ? nameSize : 11);
+    BRIDGE_INFO(LUMP_INFO_RAW, info->raw, 8);
+    BRIDGE_INFO(LUMP_INFO_PCT, info->pct, 8);
+    BRIDGE_INFO(LUMP_INFO_SI, info->si, 8);
+    BRIDGE_INFO(LUMP_INFO_UNITS, symbol, 4);
+    BRIDGE_INFO(LUMP_INFO_MAPPING, mapping, 2);
+    BRIDGE_INFO(LUMP_INFO_FORMAT, format, 4);
+#undef BRIDGE_INFO
+    return length;
+}
+
+
+/**
+ * @brief Start the init sequence of the hub at 2400 bauds.
+ *      The device stays at its speed, kept alive by keepDeviceAlive().
+ */
+void LumpBridge::startHubSync(){
+    m_hub.begin(2400);
+    while (m_hub.available() > 0)
+        m_hub.read();
+
+    m_state         = BRIDGE_HUB_SYNC;
+    m_hubPos        = 0;
+    m_hubTick       = millis();
+    m_keepAliveTick = m_hubTick;
+    m_selectedMode  = 0;
+    m_hubExtMode    = LUMP_EXT_MODE_0;
+    m_writeExtMode  = LUMP_EXT_MODE_0;
+    m_hubLen        = 0;
+    m_extPending    = false;
+}
+
+
+/**
+ * @brief Send the init sequence & the ACK to the hub, then wait for its ACK
+ *      during 2s (the sequence is sent again after that).
+ *      The writes follow the line rate (~4.2ms per byte at 2400 bauds):
+ *      the TX buffer never fills and process() never blocks.
+ */
+void LumpBridge::sendHubInit(){
+    const uint16_t total = m_initLen + 1;
+
+    if (m_hubPos < total) {
+        uint32_t allowed = _(uint32_t)(millis() - m_hubTick) * 240 / 1000 + 1;
+        if (allowed > total)
+            allowed = total;
+        if (m_hubPos < m_initLen) {
+            const uint16_t end = (allowed < m_initLen) ? allowed : m_initLen;
+            m_hub.write(&m_init[m_hubPos], end - m_hubPos);
+            m_hubPos = end;
+        }
+        if (allowed == total && m_hubPos == m_initLen) {
+            m_hub.write(BRIDGE_ACK);
+            m_hubPos  = total;
+            m_hubTick = millis();
+        }
+        return;
+    }
+
+    while (m_hub.available() > 0) {
+        if (m_hub.read() == BRIDGE_ACK) {
+            m_hub.flush();
+            m_hub.begin(m_speed);
+            m_state   = BRIDGE_CONNECTED;
+            m_hubTick = millis();
+            INFO_PRINTLN(F("Bridge: connected"));
+            return;
+        }
+    }
+    if (millis() - m_hubTick > 2000)
+        startHubSync();
+}
+
+
+/**
+ * @brief Send NACKs to the device while the hub doesn't.
+ */
+void LumpBridge::keepDeviceAlive(){
+    if (millis() - m_keepAliveTick < LUMP_BRIDGE_KEEPALIVE_PERIOD)
+        return;
+    m_device.write(BRIDGE_NACK);
+    m_keepAliveTick = millis();
+}
+
+
+/**
+ * @brief Forward the frames of the device to the hub, byte by byte.
+ *      The data of the device is dropped while an added mode is selected
+ *      (or the hub is not connected). An EXT_MODE message is inserted
+ *      before a DATA message if the hub has another extended mode.
+ */
+void LumpBridge::forwardDeviceToHub(){
+    int available = m_device.available();
+    if (available <= 0)
+        return;
+    m_deviceTick = millis();
+
+    while (available-- > 0) {
+        const uint8_t byte = m_device.read();
+
+        if (m_devRemaining == 0) {
+            // Header
+            m_devRemaining = frameSize(byte);
+            if (m_devRemaining <= 1) {
+                // SYS messages are not expected from the device
+                m_devRemaining = 0;
+                continue;
+            }
+            m_devHeader  = byte;
+            m_devForward = (m_state == BRIDGE_CONNECTED);
+
+            const bool isData = (byte & LUMP_MSG_TYPE_MASK) == LUMP_MSG_TYPE_DATA;
+            if (isData || byte == BRIDGE_EXT_MODE)
+                m_devForward = m_devForward && !isAddedMode(m_selectedMode);
+            if (m_devForward && isData && m_hubExtMode != m_deviceExtMode)
+                sendExtMode(m_deviceExtMode);
+        } else if (m_devHeader == BRIDGE_EXT_MODE && m_devRemaining == 2) {
+            // Payload of EXT_MODE
+            m_deviceExtMode = byte;
+        }
+
+        if (m_devForward)
+            m_hub.write(byte);
+
+        if (--m_devRemaining == 0 && m_devForward) {
+            if (m_devHeader == BRIDGE_EXT_MODE)
+                m_hubExtMode = m_deviceExtMode;
+            recordLatency(BRIDGE_TO_HUB);
+        }
+    }
+}
+
+
+/**
+ * @brief Forward the frames of the hub to the device, byte by byte.
+ *      SELECT & EXT_MODE messages, and the DATA messages for the added
+ *      modes, are held until complete (see handleHubFrame()).
+ */
+void LumpBridge::forwardHubToDevice(){
+    while (m_hub.available() > 0) {
+        const uint8_t byte = m_hub.read();
+
+        if (m_hubLen == 0) {
+            // Header
+            if (byte == BRIDGE_NACK) {
+                m_hubTick = millis();
+                // Keep the device alive in all cases
+                m_device.write(byte);
+                recordLatency(BRIDGE_TO_DEVICE);
+                if (isAddedMode(m_selectedMode))
+                    sendModeData();
+                continue;
+            }
+            m_hubSize = frameSize(byte);
+            if (m_hubSize <= 1)
+                continue;
+
+            const bool isData = (byte & LUMP_MSG_TYPE_MASK) == LUMP_MSG_TYPE_DATA;
+            m_hubHold = (byte == BRIDGE_SELECT) || (byte == BRIDGE_EXT_MODE) ||
+                        (isData && isAddedMode((byte & LUMP_MSG_CMD_MASK) + m_writeExtMode));
+            if (!m_hubHold && m_extPending) {
+                // EXT_MODE of a write to a mode of the device
+                m_device.write(m_hubExt, 3);
+                m_extPending = false;
+            }
+        }
+
+        m_hubFrame[m_hubLen++] = byte;
+        if (!m_hubHold)
+            m_device.write(byte);
+
+        if (m_hubLen == m_hubSize) {
+            if (m_hubHold)
+                handleHubFrame();
+            else
+                recordLatency(BRIDGE_TO_DEVICE);
+            m_hubLen = 0;
+        }
+    }
+}
+
+
+/**
+ * @brief Handle a complete frame of the hub held by forwardHubToDevice().
+ */
+void LumpBridge::handleHubFrame(){
+    if (checksum(m_hubFrame, m_hubSize - 1) != m_hubFrame[m_hubSize - 1]) {
+        // Dropped like the devices do; the hub sends it again
+        DEBUG_PRINTLN(F("Bridge: bad checksum from hub"));
+        return;
+    }
+
+    const uint8_t header = m_hubFrame[0];
+    if (header == BRIDGE_EXT_MODE) {
+        // Held until the next frame; sent to the device if it's not a write
+        // to an added mode
+        if (m_extPending)
+            m_device.write(m_hubExt, 3);
+        memcpy(m_hubExt, m_hubFrame, 3);
+        m_writeExtMode = m_hubFrame[1];
+        m_extPending   = true;
+        return;
+    }
+    if (header == BRIDGE_SELECT) {
+        m_selectedMode = m_hubFrame[1];
+        DEBUG_PRINT(F("Bridge: mode "));
+        DEBUG_PRINTLN(m_selectedMode);
+        if (isAddedMode(m_selectedMode)) {
+            // Immediate response, like the devices
+            sendModeData();
+            return;
+        }
+        if (m_extPending) {
+            m_device.write(m_hubExt, 3);
+            m_extPending = false;
+        }
+        m_device.write(m_hubFrame, m_hubSize);
+        recordLatency(BRIDGE_TO_DEVICE);
+        return;
+    }
+
+    // Write to an added mode: the EXT_MODE message is consumed
+    m_extPending = false;
+    const Mode& added = m_modes[(header & LUMP_MSG_CMD_MASK) + m_writeExtMode - m_deviceModes];
+    if (added.write)
+        added.write(&m_hubFrame[1], LUMP_MSG_SIZE(header));
+}
+
+
+/**
+ * @brief Send EXT_MODE message to the hub.
+ */
+void LumpBridge::sendExtMode(uint8_t extMode){
+    const uint8_t frame[3] = { BRIDGE_EXT_MODE, extMode, _(uint8_t)(0xFF ^ BRIDGE_EXT_MODE ^ extMode) };
+    m_hub.write(frame, 3);
+    m_hubExtMode = extMode;
+}
+
+
+/**
+ * @brief Send the data of the selected added mode to the hub;
+ *      preceded by EXT_MODE for the modes >= 8, like the devices.
+ */
+void LumpBridge::sendModeData(){
+    const Mode& added = m_modes[m_selectedMode - m_deviceModes];
+    if (!added.read)
+        return;
+
+    uint8_t payload[32];
+    uint8_t size = added.read(payload);
+    if (!size)
+        return;
+    if (size > 32)
+        size = 32;
+
+    const uint8_t extMode = (m_selectedMode >= 8) ? LUMP_EXT_MODE_8 : LUMP_EXT_MODE_0;
+    if (extMode == LUMP_EXT_MODE_8 || m_hubExtMode != extMode)
+        sendExtMode(extMode);
+
+    uint8_t frame[LUMP_MAX_MSG_SIZE];
+    const uint8_t length = writeFrame(frame, LUMP_MSG_TYPE_DATA | (m_selectedMode & LUMP_MSG_CMD_MASK), payload, size);
+    m_hub.write(frame, length);
+}
+
+
+bool LumpBridge::isAddedMode(uint8_t mode){
+    return mode >= m_deviceModes && mode < m_deviceModes + m_modeCount;
+}
+
+
+/**
+ * @brief Add the latency of a forwarded frame to the statistics.
+ * @see BridgeLatencyStats
+ */
+void LumpBridge::recordLatency(uint8_t direction){
+    const unsigned long latency = micros() - m_previousPollTick;
+    BridgeLatencyStats& stats   = m_stats[direction];
+
+    stats.count++;
+    if (latency > stats.maxUs)
+        stats.maxUs = latency;
+    uint8_t bucket = 0;
+    for (unsigned long bound = latency >> 5; bound && bucket < LUMP_BRIDGE_LATENCY_BUCKETS - 1; bound >>= 1)
+        bucket++;
+    stats.buckets[bucket]++;
+}
+
+
+/**
+ * @brief Get the size of a message from its header.
+ * @return Size with header & checksum; 1 for SYS messages, 0 for an invalid size.
+ */
+uint8_t LumpBridge::frameSize(uint8_t header){
+    const uint8_t type = header & LUMP_MSG_TYPE_MASK;
+    if (type == LUMP_MSG_TYPE_SYS)
+        return 1;
+    if ((header & LUMP_MSG_SIZE_MASK) > LUMP_MSG_SIZE_32)
+        return 0;
+    return LUMP_MSG_SIZE(header) + ((type == LUMP_MSG_TYPE_INFO) ? 3 : 2);
+}
+
+
+/**
+ * @brief Get the size bits of a header for a payload (padded to a power of 2).
+ */
+uint8_t LumpBridge::sizeCode(uint8_t size){
+    uint8_t code = 0;
+    while ((1 << code) < size && code < 5)
+        code++;
+    return code << 3;
+}
+
+
+/**
+ * @brief Get checksum of a message.
+ * @param length Size of the message without the checksum.
+ */
+uint8_t LumpBridge::checksum(const uint8_t *frame, uint8_t length){
+    uint8_t ret = 0xFF;
+    for (uint8_t i = 0; i < length; i++)
+        ret ^= frame[i];
+    return ret;
+}
+
+
+/**
+ * @brief Build a message; the payload is padded with zeros.
+ * @param buffer Output buffer; nullptr to get the size only.
+ * @param header Header without the size bits.
+ * @param infoType Info type of INFO messages; -1 for the other types.
+ * @return Size of the message.
+ */
+uint8_t LumpBridge::writeFrame(uint8_t *buffer, uint8_t header, const uint8_t *payload, uint8_t size,
+                               int16_t infoType){
+    const uint8_t code   = sizeCode(size);
+    const uint8_t padded = LUMP_MSG_SIZE(code);
+    const uint8_t length = padded + ((infoType >= 0) ? 3 : 2);
+    if (!buffer)
+        return length;
+
+    uint8_t pos = 0;
+    buffer[pos++] = header | code;
+    if (infoType >= 0)
+        buffer[pos++] = _(uint8_t)(infoType);
+    memcpy(&buffer[pos], payload, size);
+    memset(&buffer[pos + size], 0, padded - size);
+    pos += padded;
+    buffer[pos] = checksum(buffer, pos);
+    return length;
+}
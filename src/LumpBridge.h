@@ -0,0 +1,272 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LUMPBRIDGE_H
+#define LUMPBRIDGE_H
+
+#include "global.h"
+#include "lego_uart.h"
+#include "Arduino.h"
+
+#if defined(MOB_HOST)
+// Host tests: both sides are emulated UARTs (see extras/host)
+#include "UartEventSerial.h"
+typedef UartEventSerial LumpBridgeSerial;
+#else
+typedef HardwareSerial LumpBridgeSerial;
+#endif
+
+// Max number of modes added to the ones of the device
+#ifndef LUMP_BRIDGE_MAX_MODES
+#define LUMP_BRIDGE_MAX_MODES          4
+#endif
+// Buffer of the init sequence (Color & Distance sensor: ~600 bytes + added modes)
+#ifndef LUMP_BRIDGE_INIT_SIZE
+#define LUMP_BRIDGE_INIT_SIZE          1024
+#endif
+// The device is reset if it doesn't send anything during this delay (ms)
+#define LUMP_BRIDGE_DEVICE_TIMEOUT     500
+// Period of the NACKs sent to the device while the hub is not connected (ms)
+#define LUMP_BRIDGE_KEEPALIVE_PERIOD   100
+// Bucket i counts the latencies in [2^(i+4); 2^(i+5)[ µs; 1st and last buckets are open
+#define LUMP_BRIDGE_LATENCY_BUCKETS    10
+
+
+/**
+ * @brief Description of a mode added by the bridge; used to build its
+ *      INFO messages. See the init sequences of the sensors for examples.
+ *
+ * @param name Name of the mode (11 chars max).
+ * @param raw, pct, si Ranges of the raw values, in percent & in SI units.
+ * @param symbol Unit of the SI values (4 chars max).
+ * @param inputFlags, outputFlags Mapping flags (writable modes need
+ *      output flags).
+ * @param count Number of values of the DATA messages.
+ * @param type Type of the values (::lump_data_type_t).
+ * @param figures, decimals Display format of the values.
+ */
+struct LumpModeInfo {
+    const char *name;
+    float      raw[2];
+    float      pct[2];
+    float      si[2];
+    const char *symbol;
+    uint8_t    inputFlags;
+    uint8_t    outputFlags;
+    uint8_t    count;
+    uint8_t    type;
+    uint8_t    figures;
+    uint8_t    decimals;
+};
+
+/**
+ * @brief Callback filling the payload of a DATA message of an added mode.
+ * @param payload Buffer of 32 bytes.
+ * @return Size of the payload; 0: no message sent.
+ */
+typedef uint8_t (*LumpModeReadFunc)(uint8_t *payload);
+
+/**
+ * @brief Callback receiving the payload written by the hub to an added mode.
+ */
+typedef void (*LumpModeWriteFunc)(const uint8_t *payload, uint8_t size);
+
+/**
+ * @brief Distribution of the latencies added by the bridge to the frames.
+ *
+ *    The latency of a frame is measured from the previous call of process()
+ *    (its last byte was not received then: this is an upper bound of the
+ *    time spent in the RX buffer) to the write of its last byte on the
+ *    other side.
+ *
+ * @param count Number of frames forwarded.
+ * @param maxUs Worst latency in µs.
+ * @param buckets Histogram of latencies with power of 2 bounds (see LUMP_BRIDGE_LATENCY_BUCKETS).
+ */
+struct BridgeLatencyStats {
+    uint32_t count;
+    uint32_t maxUs;
+    uint32_t buckets[LUMP_BRIDGE_LATENCY_BUCKETS];
+};
+
+
+/**
+ * @brief Proxy between a LEGO PoweredUp device and the hub, adding modes
+ *      emulated by the microcontroller to the ones of the device.
+ *
+ *    The microcontroller is a hub for the device on one UART, and a device
+ *    for the hub on another UART:
+ *      - The init sequence of the device is captured at 2400 bauds, then
+ *        acknowledged; the device is kept alive with NACKs.
+ *      - The sequence is sent to the hub with the added modes: their INFO
+ *        messages are inserted before the ones of the device (the modes are
+ *        numbered after the modes of the device), and CMD_MODES is rewritten.
+ *      - Once connected, the frames are forwarded byte by byte as soon as
+ *        they are received, without buffering (cut-through). Only the
+ *        commands of the hub addressed to the added modes (SELECT, EXT_MODE
+ *        & DATA of a write) are held until their mode is known.
+ *
+ *    The hub decodes the mode of a DATA message with the last EXT_MODE
+ *    message received; the bridge tracks it and inserts an EXT_MODE message
+ *    before the data of the device when the hub has another value (after
+ *    the data of an added mode >= 8 for example).
+ *    When an added mode is selected, the NACKs are still forwarded to keep
+ *    the device alive but its data is dropped; the bridge answers with the
+ *    data of the read callback of the mode.
+ *    The mode combinations of the device are not modified; the added modes
+ *    can't be combined.
+ *
+ *    Example (ESP32, see examples/lump_bridge):
+ *      LumpBridge bridge(Serial1, Serial2);
+ *      bridge.addMode(&distanceMode, readDistance, nullptr);
+ *      // loop()
+ *      bridge.process();
+ *
+ * @param m_device, m_hub Serial ports of the device & the hub.
+ * @param m_state Step of the connection; see State.
+ * @param m_modes, m_modeCount Added modes.
+ * @param m_init Init sequence of the device, then the one sent to the hub.
+ * @param m_initLen Size of the sequence.
+ * @param m_infoStart Offset of the first INFO message of the sequence.
+ * @param m_modesOffset Offset of the CMD_MODES message of the sequence.
+ * @param m_frameLen, m_frameSize Position & size of the frame being received.
+ * @param m_deviceType, m_deviceModes, m_deviceViews, m_speed Identity of
+ *      the device (from its init sequence).
+ * @param m_deviceTick Time of the last byte received from the device (ms).
+ * @param m_hubTick Time of the start of the init sequence sent to the hub,
+ *      then of the last NACK (ms).
+ * @param m_keepAliveTick Time of the last NACK sent to the device (ms).
+ * @param m_hubPos Bytes of the init sequence sent to the hub.
+ * @param m_selectedMode Mode selected by the hub.
+ * @param m_deviceExtMode Last EXT_MODE sent by the device.
+ * @param m_hubExtMode Last EXT_MODE received by the hub.
+ * @param m_writeExtMode Last EXT_MODE sent by the hub.
+ * @param m_devHeader, m_devRemaining, m_devForward Frame of the device
+ *      being forwarded.
+ * @param m_hubFrame, m_hubLen, m_hubSize, m_hubHold Frame of the hub being
+ *      forwarded (m_hubHold: held until complete).
+ * @param m_extPending The EXT_MODE message of the hub in m_hubExt is held
+ *      until the next frame.
+ * @param m_previousPollTick, m_lastPollTick Times in µs of the 2 last calls of process().
+ * @param m_stats Latencies for each direction; see Direction.
+ */
+class LumpBridge {
+
+public:
+    enum State {
+        BRIDGE_IDLE,        // process() not called yet
+        BRIDGE_DEVICE_SYNC, // Reception of the init sequence of the device
+        BRIDGE_HUB_SYNC,    // Transmission of the init sequence to the hub
+        BRIDGE_CONNECTED,   // Forwarding of the frames
+    };
+
+    enum Direction {
+        BRIDGE_TO_HUB    = 0,
+        BRIDGE_TO_DEVICE = 1,
+    };
+
+    LumpBridge(LumpBridgeSerial& deviceSerial, LumpBridgeSerial& hubSerial);
+
+    int8_t addMode(const LumpModeInfo *info, LumpModeReadFunc readFunc, LumpModeWriteFunc writeFunc);
+    void process();
+    State getState();
+    bool isConnected();
+    uint8_t getDeviceType();
+    uint8_t getDeviceModes();
+    uint8_t getSelectedMode();
+    BridgeLatencyStats getLatencyStats(uint8_t direction);
+    void resetLatencyStats();
+
+private:
+    struct Mode {
+        const LumpModeInfo *info;
+        LumpModeReadFunc   read;
+        LumpModeWriteFunc  write;
+    };
+
+    // Handshakes
+    void startDeviceSync();
+    void readDeviceInit();
+    void parseInitFrame(const uint8_t *frame);
+    bool rewriteInitSequence();
+    uint16_t writeModeInfo(uint8_t *buffer, uint8_t mode, const LumpModeInfo *info);
+    void startHubSync();
+    void sendHubInit();
+    void keepDeviceAlive();
+
+    // Forwarding
+    void forwardDeviceToHub();
+    void forwardHubToDevice();
+    void handleHubFrame();
+    void sendExtMode(uint8_t extMode);
+    void sendModeData();
+    bool isAddedMode(uint8_t mode);
+    void recordLatency(uint8_t direction);
+
+    // Frames
+    static uint8_t frameSize(uint8_t header);
+    static uint8_t sizeCode(uint8_t size);
+    static uint8_t checksum(const uint8_t *frame, uint8_t length);
+    static uint8_t writeFrame(uint8_t *buffer, uint8_t header, const uint8_t *payload, uint8_t size,
+                              int16_t infoType = -1);
+
+    LumpBridgeSerial& m_device;
+    LumpBridgeSerial& m_hub;
+    State             m_state;
+
+    Mode    m_modes[LUMP_BRIDGE_MAX_MODES];
+    uint8_t m_modeCount;
+
+    uint8_t  m_init[LUMP_BRIDGE_INIT_SIZE];
+    uint16_t m_initLen;
+    uint16_t m_infoStart;
+    uint16_t m_modesOffset;
+    uint8_t  m_frameLen;
+    uint8_t  m_frameSize;
+
+    uint8_t  m_deviceType;
+    uint8_t  m_deviceModes;
+    uint8_t  m_deviceViews;
+    uint32_t m_speed;
+
+    unsigned long m_deviceTick;
+    unsigned long m_hubTick;
+    unsigned long m_keepAliveTick;
+    uint16_t      m_hubPos;
+
+    uint8_t m_selectedMode;
+    uint8_t m_deviceExtMode;
+    uint8_t m_hubExtMode;
+    uint8_t m_writeExtMode;
+
+    uint8_t m_devHeader;
+    uint8_t m_devRemaining;
+    bool    m_devForward;
+
+    uint8_t m_hubFrame[LUMP_MAX_MSG_SIZE];
+    uint8_t m_hubLen;
+    uint8_t m_hubSize;
+    bool    m_hubHold;
+    uint8_t m_hubExt[3];
+    bool    m_extPending;
+
+    unsigned long      m_previousPollTick;
+    unsigned long      m_lastPollTick;
+    BridgeLatencyStats m_stats[2];
+};
+
+#endif // LUMPBRIDGE_H
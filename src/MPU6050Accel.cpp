@@ -0,0 +1,169 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "MPU6050Accel.h"
+
+#if defined(__AVR__) || defined(ARDUINO)
+
+
+MPU6050Accel::MPU6050Accel(uint8_t address) :
+    m_device(address),
+    m_engine(nullptr),
+    m_state(MPU_IDLE),
+    m_configValues(),
+    m_countBuffer(),
+    m_fifoBuffer(),
+    m_resetValue(0),
+    m_available(0),
+    m_readIndex(0),
+    m_overflows(0)
+{}
+
+
+/**
+ * @brief Attach the chip to the engine and queue its configuration:
+ *      accelerometer ±2g, low-pass filter at 44Hz, FIFO of the accelerometer.
+ * @param rate Sample rate (Hz): 4 to 1000 (1kHz / integer divider).
+ * @param engine Started engine of the bus; the chip must be attached once.
+ */
+void MPU6050Accel::begin(uint16_t rate, AsyncI2C& engine){
+    static const uint8_t registers[MPU6050_CONFIG_WRITES] = {
+        MPU6050_PWR_MGMT_1, MPU6050_PWR_MGMT_2, MPU6050_SMPLRT_DIV, MPU6050_CONFIG,
+        MPU6050_ACCEL_CONFIG, MPU6050_FIFO_EN, MPU6050_USER_CTRL
+    };
+    if (rate == 0 || rate > 1000)
+        rate = 1000;
+    uint16_t divider = 1000 / rate;
+    if (divider > 256)
+        divider = 256;
+
+    m_configValues[0] = 0x00;                      // Wake up, internal 8MHz oscillator
+    m_configValues[1] = 0x07;                      // Standby of the 3 gyroscopes
+    m_configValues[2] = _(uint8_t)(divider - 1);   // Sample rate: 1kHz / (1 + SMPLRT_DIV)
+    m_configValues[3] = 0x03;                      // DLPF 44Hz (1kHz internal rate)
+    m_configValues[4] = 0x00;                      // ±2g
+    m_configValues[5] = 0x08;                      // ACCEL_FIFO_EN
+    m_configValues[6] = 0x44;                      // FIFO_EN | FIFO_RESET
+
+    m_engine = &engine;
+    engine.attach(m_device);
+    for (uint8_t i = 0; i < MPU6050_CONFIG_WRITES; i++) {
+        m_configWrites[i].setWrite(registers[i], &m_configValues[i], 1);
+        engine.submit(m_device, m_configWrites[i]);
+    }
+    m_state     = MPU_IDLE;
+    m_available = 0;
+    m_readIndex = 0;
+}
+
+
+/**
+ * @brief Queue a reset of the FIFO.
+ */
+void MPU6050Accel::resetFIFO(){
+    m_overflows++;
+    m_resetValue = 0x44; // FIFO_EN | FIFO_RESET
+    m_fifoReset.setWrite(MPU6050_USER_CTRL, &m_resetValue, 1);
+    m_engine->submit(m_device, m_fifoReset);
+}
+
+
+/**
+ * @brief Advance the reading of the FIFO; never blocks.
+ *      A new burst is read once the previous one is consumed by readSamples().
+ */
+void MPU6050Accel::poll(){
+    if (!m_engine)
+        return;
+
+    switch (m_state) {
+        case MPU_IDLE:
+            if (m_readIndex < m_available || m_fifoReset.isPending())
+                return;
+            // FIFO_COUNTH, FIFO_COUNTL
+            m_countRead.setRead(MPU6050_FIFO_COUNTH, m_countBuffer, 2);
+            if (m_engine->submit(m_device, m_countRead))
+                m_state = MPU_COUNT;
+            return;
+
+        case MPU_COUNT: {
+            if (m_countRead.isPending())
+                return;
+            m_state = MPU_IDLE;
+            if (m_countRead.status != I2CTransaction::I2C_DONE)
+                return;
+
+            const uint16_t count = (m_countBuffer[0] << 8) | m_countBuffer[1];
+            if (count >= MPU6050_FIFO_SIZE) {
+                // Overflow: the oldest samples are already lost
+                resetFIFO();
+                return;
+            }
+            uint8_t samples = _(uint8_t)((count / MPU6050_SAMPLE_SIZE < MPU6050_BURST_SAMPLES) ?
+                                         count / MPU6050_SAMPLE_SIZE : MPU6050_BURST_SAMPLES);
+            if (!samples)
+                return;
+            m_fifoRead.setRead(MPU6050_FIFO_R_W, m_fifoBuffer, samples * MPU6050_SAMPLE_SIZE);
+            if (m_engine->submit(m_device, m_fifoRead))
+                m_state = MPU_DATA;
+            return;
+        }
+
+        case MPU_DATA:
+            if (m_fifoRead.isPending())
+                return;
+            m_state = MPU_IDLE;
+            if (m_fifoRead.status != I2CTransaction::I2C_DONE) {
+                // The FIFO is no longer aligned on the samples
+                resetFIFO();
+                return;
+            }
+            m_available = m_fifoRead.length / MPU6050_SAMPLE_SIZE;
+            m_readIndex = 0;
+            return;
+
+        default:
+            return;
+    }
+}
+
+
+/**
+ * @brief Take the samples of the last burst read (big endian X, Y, Z).
+ */
+uint8_t MPU6050Accel::readSamples(AccelSample *samples, uint8_t maxSamples){
+    uint8_t count = 0;
+    while (count < maxSamples && m_readIndex < m_available) {
+        const uint8_t *data = &m_fifoBuffer[m_readIndex * MPU6050_SAMPLE_SIZE];
+        samples[count].x = _(int16_t)((data[0] << 8) | data[1]);
+        samples[count].y = _(int16_t)((data[2] << 8) | data[3]);
+        samples[count].z = _(int16_t)((data[4] << 8) | data[5]);
+        count++;
+        m_readIndex++;
+    }
+    return count;
+}
+
+
+/**
+ * @brief Number of overflows (or failed reads) of the FIFO since begin().
+ */
+uint16_t MPU6050Accel::getOverflows(){
+    return m_overflows;
+}
+
+#endif // __AVR__ || ARDUINO
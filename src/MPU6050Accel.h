@@ -0,0 +1,117 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MPU6050ACCEL_H
+#define MPU6050ACCEL_H
+
+#include "global.h"
+#include "Arduino.h"
+#include "AsyncI2C.h"
+#include "utilities/tilt_estimator.hpp"
+
+#if defined(__AVR__) || defined(ARDUINO)
+
+#define MPU6050_ADDRESS          0x68 // AD0 low; 0x69 if high
+// Registers
+#define MPU6050_SMPLRT_DIV       0x19
+#define MPU6050_CONFIG           0x1A
+#define MPU6050_ACCEL_CONFIG     0x1C
+#define MPU6050_FIFO_EN          0x23
+#define MPU6050_USER_CTRL        0x6A
+#define MPU6050_PWR_MGMT_1       0x6B
+#define MPU6050_PWR_MGMT_2       0x6C
+#define MPU6050_FIFO_COUNTH      0x72
+#define MPU6050_FIFO_R_W         0x74
+// FIFO of the chip (bytes) & size of a sample of the accelerometer
+#define MPU6050_FIFO_SIZE        1024
+#define MPU6050_SAMPLE_SIZE      6
+// Samples taken by a burst read of the FIFO
+#define MPU6050_BURST_SAMPLES    8
+// Number of registers written by begin()
+#define MPU6050_CONFIG_WRITES    7
+
+
+/**
+ * @brief Accelerometer of MPU6050 (MPU6000, MPU9250...) read through its FIFO.
+ *
+ *    The accelerometer is sampled by the chip at a fixed rate (up to 1kHz)
+ *    and its samples are stacked in the FIFO; the gyroscopes are in standby.
+ *    poll() reads the FIFO level then the available samples with a burst
+ *    read of up to MPU6050_BURST_SAMPLES samples, through AsyncI2C: the
+ *    bus is shared with the other chips and loop() never waits for it.
+ *    The samples are then taken with readSamples() (see Accelerometer).
+ *    If the FIFO overflows (poll() not called for 1024 / 6 samples), it is
+ *    reset and the stacked samples are lost.
+ *
+ *    Example:
+ *      MPU6050Accel imu;
+ *      // Setup
+ *      I2CEngine.begin();
+ *      imu.begin(500);
+ *      // In loop()
+ *      I2CEngine.poll();
+ *      imu.poll();
+ *      tilt.poll(imu);
+ *
+ * @param m_device Chip on the bus; attached to the engine by begin().
+ * @param m_engine Engine of the bus.
+ * @param m_state Current step: idle, reading of the level, of the samples.
+ * @param m_configWrites, m_configValues Writes of the registers for begin().
+ * @param m_countRead, m_countBuffer Reading of the level of the FIFO.
+ * @param m_fifoRead, m_fifoBuffer Burst read of the samples.
+ * @param m_fifoReset, m_resetValue Reset of the FIFO after an overflow.
+ * @param m_available Number of samples in m_fifoBuffer.
+ * @param m_readIndex Index of the next sample to be taken from m_fifoBuffer.
+ * @param m_overflows Number of overflows of the FIFO.
+ */
+class MPU6050Accel : public Accelerometer {
+
+public:
+    explicit MPU6050Accel(uint8_t address = MPU6050_ADDRESS);
+
+    void begin(uint16_t rate = 500, AsyncI2C& engine = I2CEngine);
+    void poll();
+    virtual uint8_t readSamples(AccelSample *samples, uint8_t maxSamples);
+    uint16_t getOverflows();
+
+private:
+    enum State : uint8_t {
+        MPU_IDLE,
+        MPU_COUNT,
+        MPU_DATA
+    };
+
+    void resetFIFO();
+
+    I2CDevice      m_device;
+    AsyncI2C       *m_engine;
+    uint8_t        m_state;
+    I2CTransaction m_configWrites[MPU6050_CONFIG_WRITES];
+    uint8_t        m_configValues[MPU6050_CONFIG_WRITES];
+    I2CTransaction m_countRead;
+    uint8_t        m_countBuffer[2];
+    I2CTransaction m_fifoRead;
+    uint8_t        m_fifoBuffer[MPU6050_BURST_SAMPLES * MPU6050_SAMPLE_SIZE];
+    I2CTransaction m_fifoReset;
+    uint8_t        m_resetValue;
+    uint8_t        m_available;
+    uint8_t        m_readIndex;
+    uint16_t       m_overflows;
+};
+
+#endif // __AVR__ || ARDUINO
+#endif // MPU6050ACCEL_H
@@ -25,6 +25,19 @@
 #include "ColorDistanceSensor.h"
 #include "TiltSensor.h"
 #include "ColorSensor.h"
+#include "LumpBridge.h"
 #include "utilities/color_detection_methods.hpp"
+#include "utilities/filters.hpp"
+#include "utilities/profiler.hpp"
+#include "utilities/proximity_counter.hpp"
+#include "utilities/snapshot.hpp"
+#include "utilities/range_mapper.hpp"
+#include "utilities/startup_sequencer.hpp"
+#include "utilities/tcs34725_autorange.hpp"
+#include "utilities/tilt_estimator.hpp"
+#include "utilities/tilt_events.hpp"
+#include "AsyncI2C.h"
+#include "PFTransmitter.h"
+#include "MPU6050Accel.h"
 
 #endif // MyOwnBricks_h
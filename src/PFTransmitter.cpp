@@ -0,0 +1,535 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "PFTransmitter.h"
+
+#if defined(__AVR__) && defined(PF_TRANSMITTER)
+#include <avr/interrupt.h>
+
+// Timer1 TOP for the carrier (fast PWM) and duty cycle of 1/3
+#define PF_CARRIER_TOP     (F_CPU / PF_CARRIER_FREQUENCY - 1)
+// Ticks of Timer1 during the gaps (prescaler 1024) for a carrier period,
+// in 1/256 units (64µs per tick at 16MHz)
+#define PF_GAP_TICKS_256   ((F_CPU / 1024) * 256 / PF_CARRIER_FREQUENCY)
+
+PFTransmitter PFIRTransmitter;
+#endif
+
+
+PFTransmitter::PFTransmitter()
+#if defined(__AVR__) && defined(PF_TRANSMITTER)
+    : m_frame(0),
+    m_symbol(0),
+    m_mark(false),
+    m_count(0),
+    m_busy(false)
+#endif
+{}
+
+
+/**
+ * @brief Replace the last nibble of a message by its LRC checksum:
+ *      0xF xor nibble 1 xor nibble 2 xor nibble 3.
+ *      The hub may or may not fill it; it is always recomputed.
+ * @param message Power Functions message (16 bits, MSB first).
+ */
+uint16_t PFTransmitter::encode(uint16_t message){
+    const uint8_t lrc = 0xF ^ (message >> 12) ^ (message >> 8) ^ (message >> 4);
+    return (message & 0xFFF0) | (lrc & 0x0F);
+}
+
+
+/**
+ * @brief Get the channel (1..4) of a message.
+ */
+uint8_t PFTransmitter::getChannel(uint16_t frame){
+    return ((frame >> 12) & 0x03) + 1;
+}
+
+
+/**
+ * @brief Get the duration of a message in carrier periods.
+ */
+uint16_t PFTransmitter::getFramePeriods(uint16_t frame){
+    // Start & stop bits + 16 bits
+    uint16_t periods = 18 * PF_MARK_PERIODS + 2 * PF_START_STOP_PERIODS;
+    for (uint8_t i = 0; i < 16; i++)
+        periods += ((frame >> i) & 1) ? PF_HIGH_PERIODS : PF_LOW_PERIODS;
+    return periods;
+}
+
+
+/**
+ * @brief Get the time between the start of a transmission and the start of
+ *      the previous one (or the call of send() for the first one).
+ * @param frame Message.
+ * @param repeat Index of the transmission (0..PF_REPEATS - 1).
+ * @return Time in ms.
+ */
+uint16_t PFTransmitter::getRepeatDelay(uint16_t frame, uint8_t repeat){
+    const uint8_t channel = getChannel(frame);
+    if (repeat == 0)
+        return (4 - channel) * PF_MESSAGE_TIME;
+    if (repeat <= 2)
+        return 5 * PF_MESSAGE_TIME;
+    return (6 + 2 * channel) * PF_MESSAGE_TIME;
+}
+
+
+PFCommandQueue::PFCommandQueue() :
+    m_slots(),
+    m_relative(),
+    m_relativeCount(0),
+    m_channel(PF_CHANNELS - 1),
+    m_output(),
+    m_stats()
+{}
+
+
+/**
+ * @brief Get the outputs driven by a message.
+ *      Single pin (mode 01O) & single output (mode 1xO) modes: output O;
+ *      extended mode: output A or B for the functions of 1 output;
+ *      combo modes: both outputs.
+ * @return PF_BOTH_OUTPUTS, PF_OUTPUT_A or PF_OUTPUT_B.
+ */
+uint8_t PFCommandQueue::getTarget(uint16_t frame){
+    const uint8_t mode = (frame >> 8) & 0x07;
+    const uint8_t data = (frame >> 4) & 0x0F;
+
+    if (frame & 0x4000) {
+        // Escape: combo PWM mode
+        return PF_BOTH_OUTPUTS;
+    }
+    if (mode == 0) {
+        // Extended mode: brake/increment/decrement A, toggle B, address...
+        if (data <= 2)
+            return PF_OUTPUT_A;
+        return (data == 4) ? PF_OUTPUT_B : PF_BOTH_OUTPUTS;
+    }
+    if (mode == 1) {
+        // Combo direct mode
+        return PF_BOTH_OUTPUTS;
+    }
+    return (mode & 0x01) ? PF_OUTPUT_B : PF_OUTPUT_A;
+}
+
+
+/**
+ * @brief Tell if a message is relative to the current state of its outputs:
+ *      the repeated messages of a burst are all steps, not a new value.
+ *      Extended mode: increment/decrement A, toggle B, toggle address bit;
+ *      single output mode 11O: toggles & increments/decrements.
+ */
+bool PFCommandQueue::isRelative(uint16_t frame){
+    const uint8_t mode = (frame >> 8) & 0x07;
+    const uint8_t data = (frame >> 4) & 0x0F;
+
+    if (frame & 0x4000)
+        return false;
+    if (mode == 0)
+        return data == 1 || data == 2 || data == 4 || data == 6;
+    if ((mode & 0x06) == 0x06) {
+        // 6, 7: full forward/backward; 9, A, C, D: clear/set C1/C2
+        return data <= 5 || data == 0x8 || data == 0xB || data >= 0xE;
+    }
+    return false;
+}
+
+
+void PFCommandQueue::clear(Slot& slot){
+    if (!slot.remaining)
+        return;
+    if (slot.remaining == PF_REPEATS)
+        m_stats.coalesced++;
+    else
+        m_stats.dropped++;
+    slot.remaining = 0;
+}
+
+
+/**
+ * @brief Remove the pending relative commands of a target (all the targets
+ *      of the channel for PF_BOTH_OUTPUTS).
+ */
+void PFCommandQueue::clearRelative(uint8_t channel, uint8_t target){
+    for (uint8_t i = 0; i < m_relativeCount; i++) {
+        Slot& slot = m_relative[i];
+        if (PFTransmitter::getChannel(slot.frame) - 1 == channel &&
+            (target == PF_BOTH_OUTPUTS || getTarget(slot.frame) == target))
+            clear(slot);
+    }
+    compactRelative();
+}
+
+
+/**
+ * @brief Remove the relative commands without remaining transmission;
+ *      the FIFO order is kept.
+ */
+void PFCommandQueue::compactRelative(){
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < m_relativeCount; i++) {
+        if (m_relative[i].remaining)
+            m_relative[kept++] = m_relative[i];
+    }
+    m_relativeCount = kept;
+}
+
+
+/**
+ * @brief Queue a command; replace the pending command of the same target.
+ *      Relative commands are appended to their FIFO (see isRelative()).
+ * @param frame Encoded message (see PFTransmitter::encode()).
+ * @param tick Reception time (ms).
+ */
+void PFCommandQueue::push(uint16_t frame, uint16_t tick){
+    const uint8_t channel = PFTransmitter::getChannel(frame) - 1;
+    const uint8_t target  = getTarget(frame);
+    Slot          *slots  = m_slots[channel];
+
+    m_stats.received++;
+    if (isRelative(frame)) {
+        if (m_relativeCount == PF_RELATIVE_SLOTS) {
+            m_stats.overflowed++;
+            return;
+        }
+        Slot& slot     = m_relative[m_relativeCount++];
+        slot.frame     = frame;
+        slot.remaining = PF_REPEATS;
+        slot.tick      = tick;
+        return;
+    }
+    if (target == PF_BOTH_OUTPUTS) {
+        clear(slots[PF_OUTPUT_A]);
+        clear(slots[PF_OUTPUT_B]);
+    }
+    clear(slots[target]);
+    clearRelative(channel, target);
+    slots[target].frame     = frame;
+    slots[target].remaining = PF_REPEATS;
+    slots[target].tick      = tick;
+}
+
+
+/**
+ * @brief Get the pending command of a target: the absolute one, then the
+ *      oldest relative one.
+ * @return nullptr if there is none.
+ */
+PFCommandQueue::Slot *PFCommandQueue::getPending(uint8_t channel, uint8_t target){
+    if (m_slots[channel][target].remaining)
+        return &m_slots[channel][target];
+    for (uint8_t i = 0; i < m_relativeCount; i++) {
+        if (PFTransmitter::getChannel(m_relative[i].frame) - 1 == channel &&
+            getTarget(m_relative[i].frame) == target)
+            return &m_relative[i];
+    }
+    return nullptr;
+}
+
+
+/**
+ * @brief Select the slot of the next frame to transmit.
+ *      Channels are served in round-robin; on a channel, a command for both
+ *      outputs first, otherwise outputs A and B alternately.
+ * @return false if the queue is empty.
+ */
+bool PFCommandQueue::select(uint8_t& channel, uint8_t& target){
+    for (uint8_t i = 1; i <= PF_CHANNELS; i++) {
+        channel = (m_channel + i) % PF_CHANNELS;
+        if (getPending(channel, PF_BOTH_OUTPUTS)) {
+            target = PF_BOTH_OUTPUTS;
+            return true;
+        }
+        // The other output first
+        target = (m_output[channel] == PF_OUTPUT_A) ? PF_OUTPUT_B : PF_OUTPUT_A;
+        if (getPending(channel, target))
+            return true;
+        target = (target == PF_OUTPUT_A) ? PF_OUTPUT_B : PF_OUTPUT_A;
+        if (getPending(channel, target))
+            return true;
+    }
+    return false;
+}
+
+
+/**
+ * @brief Get the next frame to transmit, without taking it: it can still
+ *      be replaced by a newer command.
+ * @param frame Frame to transmit.
+ * @param repeat Index of its transmission (0..PF_REPEATS - 1).
+ * @return false if the queue is empty.
+ */
+bool PFCommandQueue::peek(uint16_t& frame, uint8_t& repeat){
+    uint8_t channel, target;
+    if (!select(channel, target))
+        return false;
+    const Slot *slot = getPending(channel, target);
+    frame  = slot->frame;
+    repeat = PF_REPEATS - slot->remaining;
+    return true;
+}
+
+
+/**
+ * @brief Take the next frame to transmit (see peek()).
+ * @param tick Reception time of the command (ms).
+ */
+bool PFCommandQueue::next(uint16_t& frame, uint8_t& repeat, uint16_t& tick){
+    uint8_t channel, target;
+    if (!select(channel, target))
+        return false;
+    Slot& slot = *getPending(channel, target);
+
+    m_channel = channel;
+    if (target != PF_BOTH_OUTPUTS)
+        m_output[channel] = target;
+    frame  = slot.frame;
+    repeat = PF_REPEATS - slot.remaining;
+    tick   = slot.tick;
+    slot.remaining--;
+    // Last repeat of a relative command: remove it from the FIFO
+    if (!slot.remaining && &slot >= m_relative && &slot < m_relative + PF_RELATIVE_SLOTS)
+        compactRelative();
+    return true;
+}
+
+
+bool PFCommandQueue::isEmpty(){
+    if (m_relativeCount)
+        return false;
+    for (uint8_t channel = 0; channel < PF_CHANNELS; channel++) {
+        for (uint8_t target = 0; target < PF_TARGETS; target++) {
+            if (m_slots[channel][target].remaining)
+                return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief Update the worst latency with the one of a 1st transmission.
+ * @param latency Time between the reception and the transmission (ms).
+ */
+void PFCommandQueue::recordLatency(uint16_t latency){
+    if (latency > m_stats.maxLatency)
+        m_stats.maxLatency = latency;
+}
+
+
+PFQueueStats PFCommandQueue::getStats(){
+    return m_stats;
+}
+
+
+void PFCommandQueue::resetStats(){
+    m_stats = PFQueueStats();
+}
+
+
+#if defined(__AVR__) && defined(PF_TRANSMITTER)
+/**
+ * @brief Configure the output pin (OC1A); the carrier is off.
+ */
+void PFTransmitter::begin(){
+    // OC1A: PB5 on ATmega32U4, PB1 on ATmega328P
+#if defined(__AVR_ATmega32U4__)
+    DDRB  |= _BV(PB5);
+    PORTB &= ~_BV(PB5);
+#else
+    DDRB  |= _BV(PB1);
+    PORTB &= ~_BV(PB1);
+#endif
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TIMSK1 = 0;
+}
+
+
+/**
+ * @brief Transmit a message 5 times in the background.
+ *      The message is queued (see PFCommandQueue): it replaces the pending
+ *      message of its channel and outputs (the latest message wins);
+ *      relative messages (increments, toggles) are all transmitted, in order.
+ * @param message Power Functions message (16 bits); the LRC is computed here.
+ */
+void PFTransmitter::send(uint16_t message){
+    const uint16_t frame = encode(message);
+    const uint8_t  sreg  = SREG;
+    cli();
+    m_queue.push(frame, _(uint16_t)(millis()));
+    if (!m_busy) {
+        m_busy = true;
+        scheduleNext(0);
+    }
+    SREG = sreg;
+}
+
+
+/**
+ * @brief A message is being transmitted (a frame or the gaps between frames).
+ */
+bool PFTransmitter::isBusy(){
+    return m_busy;
+}
+
+
+/**
+ * @brief Get the counters of the queue (coalesced & dropped commands, latency).
+ */
+PFQueueStats PFTransmitter::getStats(){
+    const uint8_t sreg = SREG;
+    cli();
+    PFQueueStats stats = m_queue.getStats();
+    SREG = sreg;
+    return stats;
+}
+
+
+void PFTransmitter::resetStats(){
+    const uint8_t sreg = SREG;
+    cli();
+    m_queue.resetStats();
+    SREG = sreg;
+}
+
+
+/**
+ * @brief Wait before the next frame of the queue, or stop the timer if it's empty.
+ *      The frame is taken at the end of the gap: a command received
+ *      meanwhile still replaces it.
+ * @param previousPeriods Duration of the frame just transmitted (carrier
+ *      periods); 0 if the transmitter was idle.
+ */
+void PFTransmitter::scheduleNext(uint16_t previousPeriods){
+    uint16_t frame;
+    uint8_t  repeat;
+
+    if (!m_queue.peek(frame, repeat)) {
+        TCCR1B = 0;
+        TCCR1A = 0;
+        TIMSK1 = 0;
+        m_busy = false;
+        return;
+    }
+    // Time between the starts of 2 frames; 1 message time at least
+    uint16_t delay = getRepeatDelay(frame, repeat);
+    if (previousPeriods && delay < PF_MESSAGE_TIME)
+        delay = PF_MESSAGE_TIME;
+    waitFor(_(uint16_t)(delay * (PF_CARRIER_FREQUENCY / 1000) - previousPeriods));
+}
+
+
+/**
+ * @brief Wait before the next frame; the timer is used in CTC mode with
+ *      a 1024 prescaler (1 interrupt at the end of the gap).
+ * @param periods Duration in carrier periods.
+ */
+void PFTransmitter::waitFor(uint16_t periods){
+    const uint32_t ticks = (_(uint32_t)(periods) * PF_GAP_TICKS_256) >> 8;
+    TCCR1B = 0;
+    TIMSK1 = 0;
+    if (ticks == 0) {
+        startFrame();
+        return;
+    }
+    TCCR1A = 0;
+    TCNT1  = 0;
+    OCR1A  = _(uint16_t)(ticks);
+    TIFR1  = _BV(OCF1A);
+    TIMSK1 = _BV(OCIE1A);
+    TCCR1B = _BV(WGM12) | _BV(CS12) | _BV(CS10);
+}
+
+
+/**
+ * @brief Take the next frame of the queue and start the carrier
+ *      (fast PWM, TOP = ICR1) with the mark of the start bit.
+ */
+void PFTransmitter::startFrame(){
+    TCCR1B = 0;
+    TCNT1  = 0;
+    ICR1   = PF_CARRIER_TOP;
+    OCR1A  = PF_CARRIER_TOP / 3;
+
+    uint16_t frame;
+    uint8_t  repeat;
+    uint16_t tick;
+    // The queue is not empty: the commands are only replaced
+    m_queue.next(frame, repeat, tick);
+    if (repeat == 0)
+        m_queue.recordLatency(_(uint16_t)(millis()) - tick);
+
+    m_frame  = frame;
+    m_symbol = 0;
+    m_mark   = true;
+    m_count  = PF_MARK_PERIODS;
+
+    TIFR1  = _BV(TOV1);
+    TIMSK1 = _BV(TOIE1);
+    TCCR1A = _BV(COM1A1) | _BV(WGM11);
+    TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS10);
+}
+
+
+/**
+ * @brief End of a carrier period: advance the marks & spaces of the frame.
+ */
+void PFTransmitter::handleOverflow(){
+    if (--m_count)
+        return;
+
+    if (m_mark) {
+        // Carrier off; OC1A goes back to the (low) PORT value
+        TCCR1A  &= ~_BV(COM1A1);
+        m_mark   = false;
+        if (m_symbol == 0 || m_symbol == 17)
+            m_count = PF_START_STOP_PERIODS;
+        else
+            m_count = ((m_frame >> (16 - m_symbol)) & 1) ? PF_HIGH_PERIODS : PF_LOW_PERIODS;
+        return;
+    }
+    if (++m_symbol > 17) {
+        // End of the frame
+        scheduleNext(getFramePeriods(m_frame));
+        return;
+    }
+    TCCR1A |= _BV(COM1A1);
+    m_mark  = true;
+    m_count = PF_MARK_PERIODS;
+}
+
+
+/**
+ * @brief End of a gap between 2 frames.
+ */
+void PFTransmitter::handleCompare(){
+    startFrame();
+}
+
+
+ISR(TIMER1_OVF_vect) {
+    PFIRTransmitter.handleOverflow();
+}
+
+
+ISR(TIMER1_COMPA_vect) {
+    PFIRTransmitter.handleCompare();
+}
+#endif // __AVR__ && PF_TRANSMITTER
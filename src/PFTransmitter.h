@@ -0,0 +1,214 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PFTRANSMITTER_H
+#define PFTRANSMITTER_H
+
+#include "global.h"
+#include "Arduino.h"
+
+// Power Functions RC protocol (LEGO Power Functions RC v1.20)
+// Durations in periods of the 38kHz carrier
+#define PF_CARRIER_FREQUENCY    38000
+#define PF_MARK_PERIODS         6
+#define PF_LOW_PERIODS          10  // Space of a 0 bit
+#define PF_HIGH_PERIODS         21  // Space of a 1 bit
+#define PF_START_STOP_PERIODS   39  // Space of the start & stop bits
+// Max length of a message (ms): unit of the repeat schedule
+#define PF_MESSAGE_TIME         16
+// Number of transmissions of a message
+#define PF_REPEATS              5
+
+
+// Commands queue: 1 slot per channel & target (both outputs, output A, output B)
+#define PF_CHANNELS             4
+#define PF_TARGETS              3
+// FIFO of the relative commands (increments, toggles), shared by all the channels
+#define PF_RELATIVE_SLOTS       8
+
+
+/**
+ * @brief Counters of PFCommandQueue.
+ * @param received Number of commands given to the queue.
+ * @param coalesced Commands replaced by a newer one for the same target
+ *      before their 1st transmission.
+ * @param dropped Commands replaced by a newer one for the same target
+ *      during their repeats: the remaining repeats are dropped.
+ * @param overflowed Relative commands lost because their FIFO was full.
+ * @param maxLatency Worst time between the reception of a command and the
+ *      start of its 1st transmission (ms).
+ */
+struct PFQueueStats {
+    uint16_t received;
+    uint16_t coalesced;
+    uint16_t dropped;
+    uint16_t overflowed;
+    uint16_t maxLatency;
+};
+
+
+/**
+ * @brief Bounded queue of Power Functions commands with latest-wins coalescing.
+ *
+ *    There is 1 slot per channel and target: output A, output B, or both
+ *    outputs (combo modes, extended mode). A new command replaces the
+ *    pending command of its slot; a command for both outputs also
+ *    replaces the pending commands of output A and B of its channel.
+ *    A burst of commands from the hub (Ex: speed ramp) is then reduced to
+ *    its last value, and the queue can't grow (12 slots).
+ *
+ *    Relative commands (increment/decrement of the speed, toggles) can't be
+ *    coalesced: each one is a step. They are queued in a FIFO of
+ *    PF_RELATIVE_SLOTS entries, served after the absolute command pending
+ *    for their target (which was received before them). A new absolute
+ *    command of a target still replaces its pending relative commands.
+ *
+ *    Each command is transmitted PF_REPEATS times. The frames are
+ *    interleaved between the channels (round-robin, 1 frame per turn),
+ *    and between output A and B of a channel. A command for both outputs
+ *    is transmitted alone on its channel until its last repeat, so the
+ *    single output commands received after it are applied after it.
+ *
+ * @param m_slots Pending commands: frame, remaining transmissions
+ *      (0: empty slot) and reception time (ms, 16 bits).
+ * @param m_relative, m_relativeCount Pending relative commands, oldest first.
+ * @param m_channel Channel served last.
+ * @param m_output Output (A or B) served last on each channel.
+ * @param m_stats Counters.
+ */
+class PFCommandQueue {
+
+public:
+    enum Target : uint8_t {
+        PF_BOTH_OUTPUTS,
+        PF_OUTPUT_A,
+        PF_OUTPUT_B
+    };
+
+    PFCommandQueue();
+
+    static uint8_t getTarget(uint16_t frame);
+    static bool isRelative(uint16_t frame);
+
+    void push(uint16_t frame, uint16_t tick);
+    bool peek(uint16_t& frame, uint8_t& repeat);
+    bool next(uint16_t& frame, uint8_t& repeat, uint16_t& tick);
+    bool isEmpty();
+    void recordLatency(uint16_t latency);
+    PFQueueStats getStats();
+    void resetStats();
+
+private:
+    struct Slot {
+        uint16_t frame;
+        uint8_t  remaining;
+        uint16_t tick;
+    };
+
+    void clear(Slot& slot);
+    void clearRelative(uint8_t channel, uint8_t target);
+    void compactRelative();
+    Slot *getPending(uint8_t channel, uint8_t target);
+    bool select(uint8_t& channel, uint8_t& target);
+
+    Slot         m_slots[PF_CHANNELS][PF_TARGETS];
+    Slot         m_relative[PF_RELATIVE_SLOTS];
+    uint8_t      m_relativeCount;
+    uint8_t      m_channel;
+    uint8_t      m_output[PF_CHANNELS];
+    PFQueueStats m_stats;
+};
+
+
+/**
+ * @brief Non-blocking transmitter of Power Functions IR messages.
+ *
+ *    A message (16 bits: Toggle|Escape|Channel, Address|Mode, Data, LRC)
+ *    is encoded once by send(), with its LRC checksum nibble, queued in a
+ *    PFCommandQueue, then transmitted 5 times in the background following
+ *    the schedule of the protocol (times between the starts of 2 messages):
+ *      - before the 1st: (4 - Ch) * Tm
+ *      - 1 to 2, 2 to 3: 5 * Tm
+ *      - 3 to 4, 4 to 5: (6 + 2 * Ch) * Tm
+ *    With Tm = 16ms and Ch the channel 1..4. The 5 messages take from
+ *    ~0.3s (channel 1) to ~0.5s (channel 4): process() keeps running.
+ *    When several commands are pending, their frames are interleaved
+ *    (see PFCommandQueue) and the delays apply between consecutive frames.
+ *
+ *    AVR, with PF_TRANSMITTER defined in global.h (the interrupt vectors of
+ *    Timer1 are then reserved): Timer1 generates the carrier on OC1A (pin 9 on Pro Micro & Uno);
+ *    the marks and spaces are counted in carrier periods by the overflow
+ *    interrupt (only during the 16ms of a message), and the gaps between
+ *    the messages are waited with a single compare interrupt.
+ *    Timer1 must not be used by something else (Servo, PWM on pins 9/10).
+ *    Other boards: only the encoding, schedule and queue are available.
+ *
+ *    Example:
+ *      void IRCallback(const uint16_t value) {
+ *          PFIRTransmitter.send(value);
+ *      }
+ *      // Setup
+ *      PFIRTransmitter.begin();
+ *      myDevice.setIRCallback(&IRCallback);
+ *
+ * @param m_queue Pending commands; shared with the interrupts.
+ * @param m_frame Message being transmitted (with its LRC).
+ * @param m_symbol Index of the current symbol: 0 start, 1..16 bits, 17 stop.
+ * @param m_mark The current symbol is in its mark (carrier on) phase.
+ * @param m_count Remaining carrier periods of the current phase.
+ * @param m_busy A message is being transmitted (frames or gaps).
+ */
+class PFTransmitter {
+
+public:
+    PFTransmitter();
+
+    static uint16_t encode(uint16_t message);
+    static uint8_t getChannel(uint16_t frame);
+    static uint16_t getFramePeriods(uint16_t frame);
+    static uint16_t getRepeatDelay(uint16_t frame, uint8_t repeat);
+
+#if defined(__AVR__) && defined(PF_TRANSMITTER)
+    void begin();
+    void send(uint16_t message);
+    bool isBusy();
+    PFQueueStats getStats();
+    void resetStats();
+
+    // Internal: interrupt handlers of Timer1
+    void handleOverflow();
+    void handleCompare();
+
+private:
+    void scheduleNext(uint16_t previousPeriods);
+    void startFrame();
+    void waitFor(uint16_t periods);
+
+    PFCommandQueue    m_queue;
+    volatile uint16_t m_frame;
+    volatile uint8_t  m_symbol;
+    volatile bool     m_mark;
+    volatile uint8_t  m_count;
+    volatile bool     m_busy;
+#endif
+};
+
+#if defined(__AVR__) && defined(PF_TRANSMITTER)
+extern PFTransmitter PFIRTransmitter;
+#endif
+
+#endif // PFTRANSMITTER_H
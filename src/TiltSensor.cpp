@@ -23,8 +23,12 @@
  * @brief Default constructor
  */
 TiltSensor::TiltSensor(){
-    m_sensorTiltX = nullptr;
-    m_sensorTiltY = nullptr;
+    m_sensorTiltX       = nullptr;
+    m_sensorTiltY       = nullptr;
+    m_sensorDirection   = nullptr;
+    m_sensorCrashCount  = nullptr;
+    m_sensorCalibration = nullptr;
+    m_currentMode       = PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__ANGLE;
 }
 
 
@@ -33,7 +37,7 @@ TiltSensor::TiltSensor(){
  * @param pSensorTiltX
  * @param pSensorTiltY
  */
-TiltSensor::TiltSensor(int8_t *pSensorTiltX, int8_t *pSensorTiltY){
+TiltSensor::TiltSensor(int8_t *pSensorTiltX, int8_t *pSensorTiltY) : TiltSensor(){
     m_sensorTiltX = pSensorTiltX;
     m_sensorTiltY = pSensorTiltY;
 }
@@ -57,6 +61,33 @@ void TiltSensor::setSensorTiltY(int8_t *pData){
 }
 
 
+/**
+ * @brief Setter for m_sensorDirection
+ * @param pData
+ */
+void TiltSensor::setSensorDirection(uint8_t *pData){
+    m_sensorDirection = pData;
+}
+
+
+/**
+ * @brief Setter for m_sensorCrashCount
+ * @param pData Array of 3 counters (X, Y, Z).
+ */
+void TiltSensor::setSensorCrashCount(uint8_t *pData){
+    m_sensorCrashCount = pData;
+}
+
+
+/**
+ * @brief Setter for m_sensorCalibration
+ * @param pData Array of 3 values (X, Y, Z).
+ */
+void TiltSensor::setSensorCalibration(int8_t *pData){
+    m_sensorCalibration = pData;
+}
+
+
 /**
  * @brief Send initialization sequences for the current sensor.
  * @see https://github.com/pybricks/pybricks-micropython/lib/pbio/test/src/uartdev.c
@@ -109,7 +140,7 @@ void TiltSensor::commSendInitSequence(){
 
     SerialTTL.write("\x04", 1); // ACK
     SerialTTL.flush();
-    delay(5);
+    commWait(5);
 }
 
 
@@ -128,25 +159,48 @@ void TiltSensor::handleModes(){
 
     if (header == 0x02) {  // NACK
         m_lastAckTick = millis();
+        NACK_LATENCY_START();
 
-        // Send default mode: 0 (angles data)
-        this->sensorAngleMode();
+        // Send the data of the selected mode (default: 0, angles data)
+        this->sendModeData(m_currentMode);
     } else if (header == 0x43) {
         // "Get value" commands (3 bytes message: header, mode, checksum)
         size_t ret = SerialTTL.readBytes(m_rxBuf, 2);
         if (ret < 2) {
             // check if all expected bytes are received without timeout
-            DEBUG_PRINT("incomplete 0x43 message");
+            TRACE_EVENT(TRACE_INCOMPLETE_MESSAGE, 0x43);
             return;
         }
 
-        switch (m_rxBuf[0]) {
-            case TiltSensor::PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__ANGLE:
-                this->sensorAngleMode();
-                break;
-            default:
-                break;
+        if (m_rxBuf[0] > PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__CAL) {
+            TRACE_EVENT(TRACE_UNKNOWN_R_MODE, m_rxBuf[0]);
+            return;
         }
+        m_currentMode = m_rxBuf[0];
+        this->sendModeData(m_currentMode);
+    }
+}
+
+
+/**
+ * @brief Send the data of the given mode.
+ */
+void TiltSensor::sendModeData(uint8_t mode){
+    switch (mode) {
+        case TiltSensor::PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__ANGLE:
+            this->sensorAngleMode();
+            break;
+        case TiltSensor::PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__DIR:
+            this->sensorDirectionMode();
+            break;
+        case TiltSensor::PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__CNT:
+            this->sensorCrashMode();
+            break;
+        case TiltSensor::PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__CAL:
+            this->sensorCalibrationMode();
+            break;
+        default:
+            break;
     }
 }
 
@@ -161,3 +215,45 @@ void TiltSensor::sensorAngleMode(){
     m_txBuf[2] = _(uint8_t)(*m_sensorTiltY); // Y/pitch
     sendUARTBuffer(2);
 }
+
+
+/**
+ * @brief Mode 1 response (read): Send the direction of the tilt.
+ *      Neutral if m_sensorDirection is not set.
+ */
+void TiltSensor::sensorDirectionMode(){
+    // Mode 1
+    m_txBuf[0] = 0xC1;                       // header (LUMP_MSG_TYPE_DATA, mode 1, size 1)
+    m_txBuf[1] = (m_sensorDirection) ? *m_sensorDirection : 0; // [0, 3, 5, 7, 9]
+    sendUARTBuffer(1);
+}
+
+
+/**
+ * @brief Mode 2 response (read): Send the counters of impacts (X, Y, Z).
+ *      Zeros if m_sensorCrashCount is not set.
+ * @note 3 bytes payload padded to 4 (power of 2 size).
+ */
+void TiltSensor::sensorCrashMode(){
+    // Mode 2
+    m_txBuf[0] = 0xD2;                       // header (LUMP_MSG_TYPE_DATA, mode 2, size 4)
+    for (uint8_t i = 0; i < 3; i++)
+        m_txBuf[i + 1] = (m_sensorCrashCount) ? m_sensorCrashCount[i] : 0; // 0..100
+    m_txBuf[4] = 0;                                                     // Padding
+    sendUARTBuffer(4);
+}
+
+
+/**
+ * @brief Mode 3 response (read): Send the gravity on the X, Y, Z axes.
+ *      Zeros if m_sensorCalibration is not set.
+ * @note 3 bytes payload padded to 4 (power of 2 size).
+ */
+void TiltSensor::sensorCalibrationMode(){
+    // Mode 3
+    m_txBuf[0] = 0xD3;                       // header (LUMP_MSG_TYPE_DATA, mode 3, size 4)
+    for (uint8_t i = 0; i < 3; i++)
+        m_txBuf[i + 1] = (m_sensorCalibration) ? _(uint8_t)(m_sensorCalibration[i]) : 0; // -45..45
+    m_txBuf[4] = 0;                                                                      // Padding
+    sendUARTBuffer(4);
+}
@@ -29,19 +29,27 @@
  *
  * @param m_sensorTiltX Angle value in degrees for rotation along x-axis
  *      also called roll/roulis.
- *      Continuous values ??...??
+ *      Continuous values -45...45.
  * @param m_sensorTiltY Angle value in degrees for rotation along y-axis
  *      also called pitch/tangage.
- *      Continuous values ??...??
+ *      Continuous values -45...45.
+ * @param m_sensorDirection Direction of the tilt; Available values:
+ *      TILT_DIRECTION_NEUTRAL, TILT_DIRECTION_BACKWARD, TILT_DIRECTION_RIGHT,
+ *      TILT_DIRECTION_LEFT, TILT_DIRECTION_FORWARD (see utilities/tilt_events.hpp).
+ * @param m_sensorCrashCount Array of 3 counters of impacts (X, Y, Z axes).
+ *      Continuous values 0...100.
+ * @param m_sensorCalibration Array of 3 values: gravity on the X, Y, Z axes.
+ *      Continuous values -45...45.
+ * @param m_currentMode Mode selected by the hub, sent after each NACK.
  */
-class TiltSensor : BaseSensor {
+class TiltSensor : public BaseSensor {
     // LEGO POWERED UP WEDO 2.0 Tilt sensor modes
     // https://github.com/pybricks/pybricks-micropython/blob/master/pybricks/util_pb/pb_device.h
     enum {
         PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__ANGLE  = 0,  // read 2x int8_t
-        //PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__DIR    = 1,  // read 1x int8_t
-        //PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__CNT    = 2,  // read 3x int8_t
-        //PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__CAL    = 2,  // read 3x int8_t
+        PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__DIR    = 1,  // read 1x int8_t
+        PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__CNT    = 2,  // read 3x int8_t
+        PBIO_IODEV_MODE_PUP_WEDO2_TILT_SENSOR__CAL    = 3,  // read 3x int8_t
     };
 
 public:
@@ -50,16 +58,27 @@ public:
 
     void setSensorTiltX(int8_t *pData);
     void setSensorTiltY(int8_t *pData);
+    void setSensorDirection(uint8_t *pData);
+    void setSensorCrashCount(uint8_t *pData);
+    void setSensorCalibration(int8_t *pData);
 
     void sensorAngleMode();
+    void sensorDirectionMode();
+    void sensorCrashMode();
+    void sensorCalibrationMode();
 
 private:
     // Process queries from/to hub
     virtual void handleModes();
     virtual void commSendInitSequence();
+    void sendModeData(uint8_t mode);
 
-    int8_t *m_sensorTiltX;
-    int8_t *m_sensorTiltY;
+    int8_t  *m_sensorTiltX;
+    int8_t  *m_sensorTiltY;
+    uint8_t *m_sensorDirection;
+    uint8_t *m_sensorCrashCount;
+    int8_t  *m_sensorCalibration;
+    uint8_t m_currentMode;
 };
 
 #endif
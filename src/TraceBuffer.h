@@ -0,0 +1,209 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TRACEBUFFER_H
+#define TRACEBUFFER_H
+
+#include "global.h"
+#include "Arduino.h"
+
+// Number of events kept in RAM (power of 2, <= 128); 8 bytes per event
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE    16
+#endif
+// Frame sent by drain(): sync, id, arg0, arg1 (LE), timestamp (LE), checksum
+#define TRACE_FRAME_SIZE     10
+#define TRACE_SYNC           0xA5
+
+/**
+ * @brief Ids of the trace events. The messages (after //) are the ones
+ *      printed by the host decoder (my_own_bricks/trace_decoder.py) and
+ *      MUST be kept in sync with its TRACE_MESSAGES table.
+ *      arg0 (8 bits) and arg1 (16 bits) are the values appended to them.
+ */
+enum trace_event_t : uint8_t {
+    TRACE_OVERFLOW           = 0,  // "Trace overflow; events lost: " arg1
+    TRACE_HEADER             = 1,  // "<\tHeader " arg0 (hex)
+    TRACE_INCOMPLETE_MESSAGE = 2,  // "incomplete message: " arg0 (hex header)
+    TRACE_ASKED_MODE         = 3,  // "<\tAsked mode " arg0
+    TRACE_UNKNOWN_R_MODE     = 4,  // "unknown R mode: " arg0 (hex)
+    TRACE_UNKNOWN_W_MODE     = 5,  // "unknown W mode: " arg0 (hex)
+    TRACE_LED_COLOR_SET      = 6,  // "LEDcolor set: " arg0 (hex)
+    TRACE_IR_DATA_SET        = 7,  // "IR data set: " arg1 (hex)
+    TRACE_CONFIG_SET         = 8,  // "Config set: " arg1
+    TRACE_MODE_SENT          = 9,  // "Mode " arg0
+    TRACE_LED_BRIGHTNESSES   = 10, // "LEDBrightnesses set (Left,Bottom,Right): " arg0, arg1 MSB, arg1 LSB (hex)
+    TRACE_DEFAULT_COMBOS     = 11, // "Default combos mode"
+    TRACE_DISCONNECT         = 12, // "Disconnect; Too much time since last NACK - " arg1
+};
+
+/**
+ * @brief Event of the trace (8 bytes).
+ * @param tick Time of the event (µs).
+ * @param id Event id; see ::trace_event_t.
+ * @param arg0, arg1 Values of the event.
+ */
+struct TraceEvent {
+    uint32_t tick;
+    uint8_t  id;
+    uint8_t  arg0;
+    uint16_t arg1;
+};
+
+
+/**
+ * @brief Ring buffer of binary trace events, replacing the prints of the
+ *      hot paths (handleModes(), etc.).
+ *
+ *    A print of DEBUG/INFO takes longer than the 200ms window of the
+ *    protocol when the debug serial is saturated, causing the disconnections
+ *    being debugged. Here record() only copies 8 bytes into RAM; the
+ *    events are sent later by drain(), without blocking: only what fits in
+ *    the TX buffer of the serial port is written.
+ *    When the buffer is full, new events are dropped and counted; the count
+ *    is sent as a TRACE_OVERFLOW event.
+ *
+ *    With TRACE defined in global.h, the library records its events in
+ *    MobTrace, drained to DbgSerial by BaseSensor::process(). The frames are
+ *    decoded on the host with:
+ *      python -m my_own_bricks.trace_decoder /dev/ttyACM0
+ *
+ *    1 producer and 1 consumer (the same task in the library; record()
+ *    must not be called from an ISR).
+ *
+ * @param m_events Events; the buffer is full when 1 slot remains.
+ * @param m_head Index of the next event to write (producer).
+ * @param m_tail Index of the next event to send (consumer).
+ * @param m_dropped Number of events lost since the last TRACE_OVERFLOW.
+ */
+class TraceBuffer {
+public:
+    TraceBuffer() : m_head(0), m_tail(0), m_dropped(0) {}
+
+    /**
+     * @brief Record an event (producer side).
+     */
+    void record(uint8_t id, uint8_t arg0 = 0, uint16_t arg1 = 0) {
+        const uint8_t head = m_head;
+        const uint8_t next = (head + 1) & INDEX_MASK;
+        if (next == __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE)) {
+            if (m_dropped < 0xFFFF)
+                m_dropped++;
+            return;
+        }
+        TraceEvent& event = m_events[head];
+        event.tick = micros();
+        event.id   = id;
+        event.arg0 = arg0;
+        event.arg1 = arg1;
+        __atomic_store_n(&m_head, next, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * @brief Send the pending events (consumer side), as long as the TX buffer
+     *      of the serial port has room for a whole frame.
+     * @param serial Any stream with availableForWrite() and write(buffer, size).
+     * @return Number of frames sent.
+     */
+    template <typename S>
+    uint8_t drain(S& serial) {
+        uint8_t frame[TRACE_FRAME_SIZE];
+        uint8_t count = 0;
+
+        if (m_dropped &&
+            _(size_t)(serial.availableForWrite()) >= TRACE_FRAME_SIZE) {
+            TraceEvent overflow;
+            overflow.tick = micros();
+            overflow.id   = TRACE_OVERFLOW;
+            overflow.arg0 = 0;
+            // Same task as record(): a plain read-and-clear is enough
+            overflow.arg1 = m_dropped;
+            m_dropped     = 0;
+            serial.write(frame, encode(overflow, frame));
+            count++;
+        }
+
+        uint8_t tail = m_tail;
+        while (tail != __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) &&
+               _(size_t)(serial.availableForWrite()) >= TRACE_FRAME_SIZE) {
+            serial.write(frame, encode(m_events[tail], frame));
+            tail = (tail + 1) & INDEX_MASK;
+            __atomic_store_n(&m_tail, tail, __ATOMIC_RELEASE);
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Number of events waiting to be sent.
+     */
+    uint8_t pending() {
+        return (__atomic_load_n(&m_head, __ATOMIC_ACQUIRE) - m_tail) & INDEX_MASK;
+    }
+
+    /**
+     * @brief Serialize an event into a frame of TRACE_FRAME_SIZE bytes
+     *      (multi-byte values in Little-Endian); the checksum is
+     *      0xFF XOR all the previous bytes, like the LUMP messages.
+     * @return Size of the frame.
+     */
+    static uint8_t encode(const TraceEvent& event, uint8_t *frame) {
+        frame[0] = TRACE_SYNC;
+        frame[1] = event.id;
+        frame[2] = event.arg0;
+        frame[3] = event.arg1 & 0xFF;
+        frame[4] = event.arg1 >> 8;
+        for (uint8_t i = 0; i < 4; i++)
+            frame[5 + i] = (event.tick >> (i * 8)) & 0xFF;
+
+        uint8_t checksum = 0xFF;
+        for (uint8_t i = 0; i < TRACE_FRAME_SIZE - 1; i++)
+            checksum ^= frame[i];
+        frame[TRACE_FRAME_SIZE - 1] = checksum;
+        return TRACE_FRAME_SIZE;
+    }
+
+private:
+    static const uint8_t INDEX_MASK = TRACE_BUFFER_SIZE - 1;
+    static_assert((TRACE_BUFFER_SIZE & INDEX_MASK) == 0 && TRACE_BUFFER_SIZE <= 128,
+                  "TRACE_BUFFER_SIZE must be a power of 2 <= 128");
+
+    TraceEvent m_events[TRACE_BUFFER_SIZE];
+    uint8_t    m_head;
+    uint8_t    m_tail;
+    uint16_t   m_dropped;
+};
+
+/**
+ * Trace directives
+ */
+#if (defined(TRACE) && defined(DbgSerial))
+    extern TraceBuffer MobTrace;
+    #define TRACE_EVENT(...)    MobTrace.record(__VA_ARGS__)
+    #define TRACE_DRAIN()       MobTrace.drain(DbgSerial)
+#else
+    /**
+     * If TRACE, record the event (id, arg0, arg1), otherwise do nothing.
+     */
+    #define TRACE_EVENT(...) void()
+    /**
+     * If TRACE, send the recorded events to DbgSerial, otherwise do nothing.
+     */
+    #define TRACE_DRAIN() void()
+#endif
+
+#endif // TRACEBUFFER_H
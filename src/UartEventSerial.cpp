@@ -0,0 +1,236 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "UartEventSerial.h"
+
+#if defined(ESP32)
+
+// Sizes of the RX ring buffer of the driver and of its event queue
+#define UART_EVENT_RX_BUFFER_SIZE    256
+#define UART_EVENT_QUEUE_SIZE        16
+
+UartEventSerial EventSerialTTL(UART_NUM_2, 16, 17);
+
+
+UartEventSerial::UartEventSerial(uart_port_t port, int rxPin, int txPin) :
+    m_port(port),
+    m_rxPin(rxPin),
+    m_txPin(txPin),
+    m_events(nullptr),
+    m_timeout(1000)
+{}
+
+
+/**
+ * @brief Install the UART driver, or just change the baudrate if it
+ *      is already installed (2400 -> 115200 bauds after the handshake).
+ */
+void UartEventSerial::begin(unsigned long baud){
+    if (m_events) {
+        uart_set_baudrate(m_port, baud);
+        return;
+    }
+    uart_config_t config = {};
+    config.baud_rate = baud;
+    config.data_bits = UART_DATA_8_BITS;
+    config.parity    = UART_PARITY_DISABLE;
+    config.stop_bits = UART_STOP_BITS_1;
+    config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+
+    uart_param_config(m_port, &config);
+    uart_set_pin(m_port, m_txPin, m_rxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    uart_driver_install(m_port, UART_EVENT_RX_BUFFER_SIZE, 0, UART_EVENT_QUEUE_SIZE, &m_events, 0);
+    // 1 byte in the FIFO is enough to generate an UART_DATA event
+    uart_set_rx_full_threshold(m_port, 1);
+}
+
+
+/**
+ * @brief Uninstall the driver; the pins can be driven manually
+ *      (see BaseSensor::commWaitForHubIdle()).
+ */
+void UartEventSerial::end(){
+    if (!m_events)
+        return;
+    uart_driver_delete(m_port);
+    m_events = nullptr;
+}
+
+
+int UartEventSerial::available(){
+    size_t size = 0;
+    if (m_events)
+        uart_get_buffered_data_len(m_port, &size);
+    return _(int)(size);
+}
+
+
+int UartEventSerial::read(){
+    uint8_t byte;
+    if (!m_events || uart_read_bytes(m_port, &byte, 1, 0) != 1)
+        return -1;
+    return byte;
+}
+
+
+/**
+ * @brief Read the given number of bytes; wait at most m_timeout ms.
+ * @return Number of bytes read.
+ */
+size_t UartEventSerial::readBytes(uint8_t *buffer, size_t length){
+    if (!m_events)
+        return 0;
+    int ret = uart_read_bytes(m_port, buffer, length, pdMS_TO_TICKS(m_timeout));
+    return (ret < 0) ? 0 : _(size_t)(ret);
+}
+
+
+size_t UartEventSerial::write(const uint8_t *buffer, size_t size){
+    if (!m_events)
+        return 0;
+    int ret = uart_write_bytes(m_port, reinterpret_cast<const char *>(buffer), size);
+    return (ret < 0) ? 0 : _(size_t)(ret);
+}
+
+
+/**
+ * @brief Wait for the end of the transmission.
+ */
+void UartEventSerial::flush(){
+    if (m_events)
+        uart_wait_tx_done(m_port, portMAX_DELAY);
+}
+
+
+/**
+ * @brief Block the calling task until bytes are available.
+ * @param timeout Maximum waiting time in ms.
+ * @return true if bytes are available.
+ */
+bool UartEventSerial::waitForData(unsigned long timeout){
+    if (!m_events) {
+        vTaskDelay(pdMS_TO_TICKS(timeout));
+        return false;
+    }
+    const TickType_t start = xTaskGetTickCount();
+    const TickType_t ticks = pdMS_TO_TICKS(timeout);
+    uart_event_t     event;
+
+    while (available() == 0) {
+        const TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= ticks)
+            return false;
+        if (xQueueReceive(m_events, &event, ticks - elapsed) != pdTRUE)
+            return false;
+        if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL) {
+            // Data is lost anyway; the hub will resend its query
+            INFO_PRINTLN(F("UART overflow"));
+            uart_flush_input(m_port);
+            xQueueReset(m_events);
+        }
+        // Events of already consumed bytes are skipped by the loop condition
+    }
+    return true;
+}
+
+#elif defined(MOB_HOST)
+
+#include <chrono>
+
+UartEventSerial::UartEventSerial() :
+    m_timeout(1000)
+{}
+
+
+void UartEventSerial::begin(unsigned long){}
+
+
+void UartEventSerial::end(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rx.clear();
+}
+
+
+int UartEventSerial::available(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return _(int)(m_rx.size());
+}
+
+
+int UartEventSerial::read(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_rx.empty())
+        return -1;
+    const uint8_t byte = m_rx.front();
+    m_rx.pop_front();
+    return byte;
+}
+
+
+size_t UartEventSerial::readBytes(uint8_t *buffer, size_t length){
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_rxEvent.wait_for(lock, std::chrono::milliseconds(m_timeout),
+                       [&]() { return m_rx.size() >= length; });
+    size_t count = 0;
+    for (; count < length && !m_rx.empty(); count++) {
+        buffer[count] = m_rx.front();
+        m_rx.pop_front();
+    }
+    return count;
+}
+
+
+size_t UartEventSerial::write(const uint8_t *buffer, size_t size){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tx.insert(m_tx.end(), buffer, buffer + size);
+    return size;
+}
+
+
+void UartEventSerial::flush(){}
+
+
+bool UartEventSerial::waitForData(unsigned long timeout){
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_rxEvent.wait_for(lock, std::chrono::milliseconds(timeout),
+                              [&]() { return !m_rx.empty(); });
+}
+
+
+/**
+ * @brief Emulate the reception of bytes from the hub; wake up the waiting task.
+ */
+void UartEventSerial::injectRx(const uint8_t *buffer, size_t size){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rx.insert(m_rx.end(), buffer, buffer + size);
+    }
+    m_rxEvent.notify_all();
+}
+
+
+/**
+ * @brief Get and clear the bytes sent to the hub.
+ */
+std::vector<uint8_t> UartEventSerial::takeTx(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<uint8_t> tx;
+    tx.swap(m_tx);
+    return tx;
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef UARTEVENTSERIAL_H
+#define UARTEVENTSERIAL_H
+
+#include "global.h"
+#include "Arduino.h"
+
+#if defined(ESP32) || defined(MOB_HOST)
+
+#if defined(ESP32)
+#include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#else
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#endif
+
+
+/**
+ * @brief Serial port for the hub, driven by UART events instead of polling.
+ *
+ *    Same API as the subset of HardwareSerial used by the library
+ *    (begin, end, available, read, readBytes, write, flush, setTimeout),
+ *    so it can replace SerialTTL (see UART_EVENT_SERIAL in global.h).
+ *
+ *    waitForData() blocks the calling task until bytes are received;
+ *    the protocol task (BaseSensor::startProtocolTask()) sleeps there
+ *    instead of polling available() every tick.
+ *
+ *    Backends:
+ *      - ESP32: ESP-IDF UART driver and its event queue. The RX FIFO
+ *        threshold is set to 1 byte: every byte (a NACK is 1 byte)
+ *        generates an event without waiting for the RX timeout.
+ *      - Host (MOB_HOST, see extras/host): a queue protected by a mutex;
+ *        the bytes of the hub are injected with injectRx() and the
+ *        responses are taken with takeTx(). Used by the tests on Linux.
+ *
+ * @param m_port, m_rxPin, m_txPin (ESP32 only) UART & pins used.
+ * @param m_events (ESP32 only) Event queue of the UART driver;
+ *      nullptr while the driver is not installed.
+ * @param m_rx, m_tx, m_mutex, m_rxEvent (Host only) Emulated UART.
+ * @param m_timeout Timeout of readBytes() in ms (default: 1000, like Stream).
+ */
+class UartEventSerial {
+
+public:
+#if defined(ESP32)
+    UartEventSerial(uart_port_t port, int rxPin, int txPin);
+#else
+    UartEventSerial();
+#endif
+
+    void begin(unsigned long baud);
+    void end();
+    int available();
+    int read();
+    size_t readBytes(uint8_t *buffer, size_t length);
+    size_t readBytes(char *buffer, size_t length) {
+        return readBytes(reinterpret_cast<uint8_t *>(buffer), length);
+    }
+    size_t write(uint8_t byte) {
+        return write(&byte, 1);
+    }
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *buffer, size_t size) {
+        return write(reinterpret_cast<const uint8_t *>(buffer), size);
+    }
+    void flush();
+    void setTimeout(unsigned long timeout) {
+        m_timeout = timeout;
+    }
+    bool waitForData(unsigned long timeout);
+
+#if defined(MOB_HOST)
+    void injectRx(const uint8_t *buffer, size_t size);
+    std::vector<uint8_t> takeTx();
+#endif
+
+private:
+#if defined(ESP32)
+    uart_port_t   m_port;
+    int           m_rxPin;
+    int           m_txPin;
+    QueueHandle_t m_events;
+#else
+    std::deque<uint8_t>     m_rx;
+    std::vector<uint8_t>    m_tx;
+    std::mutex              m_mutex;
+    std::condition_variable m_rxEvent;
+#endif
+    unsigned long m_timeout;
+};
+
+#if defined(ESP32)
+// UART2, default pins; replaces SerialTTL if UART_EVENT_SERIAL is defined
+extern UartEventSerial EventSerialTTL;
+#endif
+
+#endif // ESP32 || MOB_HOST
+#endif // UARTEVENTSERIAL_H
@@ -22,10 +22,23 @@
 #include <cinttypes>
 #endif
 
+// ESP32: hub on UART2 (RX: GPIO16, TX: GPIO17), UART0 (USB) left for debugging.
+// By default the hub is on Serial, as on the other boards.
+//#define ESP32_SERIAL2
+// ESP32: drive UART2 with the UART events of ESP-IDF (see UartEventSerial.h).
+// The hub is then on UART2 as with ESP32_SERIAL2.
+//#define UART_EVENT_SERIAL
+
 // Enable Serial CDC (USB) for Atmega32u4 (Pro-Micro only for now ?)
 #if defined(ARDUINO_AVR_PROMICRO)
 #define SerialTTL    Serial1
 #define DbgSerial    Serial
+#elif defined(ESP32) && defined(UART_EVENT_SERIAL)
+#define SerialTTL    EventSerialTTL
+#define DbgSerial    Serial
+#elif defined(ESP32) && defined(ESP32_SERIAL2)
+#define SerialTTL    Serial2
+#define DbgSerial    Serial
 #else
 #define SerialTTL    Serial
 #endif
@@ -42,6 +55,38 @@
 // Add facultative mode 2 "occurrence counter" to Color & Distance Sensor
 //#define COLOR_DISTANCE_COUNTER
 
+// Add facultative mode 11 "CONFIG" to Color & Distance Sensor: acquisition
+// settings written by the hub (see ColorDistanceSensor::setConfigCallback())
+//#define COLOR_DISTANCE_CONFIG
+
+// Record binary trace events instead of the prints of the hot paths, sent
+// to DbgSerial without blocking (see TraceBuffer.h)
+//#define TRACE
+
+// Measure the time taken to respond to the NACK messages of the hub
+// See BaseSensor::getNackLatencyStats()
+//#define NACK_LATENCY_STATS
+
+// AVR: advance AsyncI2C from the TWI interrupt instead of poll() (see AsyncI2C.h)
+// Wire MUST NOT be used with this option: it also defines the TWI interrupt.
+//#define ASYNC_I2C_ISR
+
+// AVR: Power Functions IR transmitter driven by Timer1 (see PFTransmitter.h)
+// Timer1 interrupts are then used by the library (incompatible with Servo).
+//#define PF_TRANSMITTER
+
+/**
+ * Busy waits of the handshake with the hub (see BaseSensor::connectToHub())
+ */
+#if defined(ESP32)
+    // Don't starve the other tasks of the core (idle task watchdog)
+    #define MOB_YIELD()    vTaskDelay(1)
+#else
+    // yield() of the Arduino core (empty on AVR); host builds: implemented by
+    // the program, the simulation advances its clock there (see extras/host/simulation.h)
+    #define MOB_YIELD()    yield()
+#endif
+
 /**
  * Debug directives
  */
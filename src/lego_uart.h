@@ -116,6 +116,30 @@ typedef enum {
  */
 #define LUMP_MSG_CMD_MASK 0x07
 
+/**
+ * Max size of a message: header, info type (INFO messages), payload, checksum.
+ */
+#define LUMP_MAX_MSG_SIZE (1 + 1 + 32 + 1)
+
+/**
+ * System message types.
+ *
+ * This value is encoded at ::LUMP_MSG_CMD_MASK when ::lump_msg_type_t is
+ * ::LUMP_MSG_TYPE_SYS.
+ */
+typedef enum {
+    /** Synchronization message (device, start of the init sequence). */
+    LUMP_SYS_SYNC = 0x0,
+
+    /** Keep-alive message sent by the hub; the device answers with data. */
+    LUMP_SYS_NACK = 0x2,
+
+    /** End of the init sequence (device), then acknowledgement (hub). */
+    LUMP_SYS_ACK = 0x4,
+
+    /** Escape (not used). */
+    LUMP_SYS_ESC = 0x6,
+} lump_sys_t;
 
 
 
@@ -126,6 +150,18 @@ typedef enum {
  * ::LUMP_MSG_TYPE_CMD.
  */
 typedef enum {
+    /** Type id of the device (::LUMP_MSG_SIZE_1). */
+    LUMP_CMD_TYPE = 0x0,
+
+    /** Number of modes and views of the device. */
+    LUMP_CMD_MODES = 0x1,
+
+    /** Baud rate used after the init sequence (32-bit little endian). */
+    LUMP_CMD_SPEED = 0x2,
+
+    /** Selection of the mode, sent by the hub. */
+    LUMP_CMD_SELECT = 0x3,
+
     /**
      * Write command.
      *
@@ -141,7 +177,78 @@ typedef enum {
      */
     LUMP_CMD_WRITE = 0x4,
 
+    /**
+     * Mode offset (::lump_ext_mode_t) of the next DATA message.
+     *
+     * Sent before the DATA messages of the modes 8 to 15, which only have
+     * 3 bits in the header.
+     */
+    LUMP_CMD_EXT_MODE = 0x6,
 
+    /** Firmware and hardware versions. */
+    LUMP_CMD_VERSION = 0x7,
 } lump_cmd_t;
 
+/**
+ * Payload of ::LUMP_CMD_EXT_MODE messages.
+ */
+typedef enum {
+    /** Modes 0 to 7. */
+    LUMP_EXT_MODE_0 = 0x00,
+
+    /** Modes 8 to 15. */
+    LUMP_EXT_MODE_8 = 0x08,
+} lump_ext_mode_t;
+
+/**
+ * Info types.
+ *
+ * First byte of the payload when ::lump_msg_type_t is ::LUMP_MSG_TYPE_INFO.
+ */
+typedef enum {
+    /** Name of the mode. */
+    LUMP_INFO_NAME = 0x00,
+
+    /** Range of the raw values. */
+    LUMP_INFO_RAW = 0x01,
+
+    /** Range of the values in percent. */
+    LUMP_INFO_PCT = 0x02,
+
+    /** Range of the values in SI units. */
+    LUMP_INFO_SI = 0x03,
+
+    /** Units of the mode. */
+    LUMP_INFO_UNITS = 0x04,
+
+    /** Input & output mapping flags. */
+    LUMP_INFO_MAPPING = 0x05,
+
+    /** Mode combinations. */
+    LUMP_INFO_MODE_COMBOS = 0x06,
+
+    /** Flag: the mode of the header is mode + 8. */
+    LUMP_INFO_MODE_PLUS_8 = 0x20,
+
+    /** Format of the DATA messages of the mode (::lump_data_type_t). */
+    LUMP_INFO_FORMAT = 0x80,
+} lump_info_t;
+
+/**
+ * Data types of the values of DATA messages (::LUMP_INFO_FORMAT).
+ */
+typedef enum {
+    /** 8-bit signed integer. */
+    LUMP_DATA_TYPE_DATA8 = 0x00,
+
+    /** 16-bit little-endian signed integer. */
+    LUMP_DATA_TYPE_DATA16 = 0x01,
+
+    /** 32-bit little-endian signed integer. */
+    LUMP_DATA_TYPE_DATA32 = 0x02,
+
+    /** 32-bit little-endian IEEE 754 floating point. */
+    LUMP_DATA_TYPE_DATAF = 0x03,
+} lump_data_type_t;
+
 #endif // LEGO_UART_H
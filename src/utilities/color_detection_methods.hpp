@@ -54,6 +54,8 @@ uint8_t detectColor(const uint16_t &red, const uint16_t &green, const uint16_t &
     } else if ((blue > red) && (blue > green)) {
         return COLOR_BLUE;
     }
+    // Equal channels
+    return COLOR_NONE;
 }
 #endif
 
@@ -94,50 +96,134 @@ const uint8_t SAMPLES_MAP[] = {
 // Number of samples
 const uint8_t samplesCount = sizeof(SAMPLES) / sizeof(SAMPLES[0]);
 
+#ifdef COLOR_DETECTION_STATS
+/**
+ * @brief Cost counters of detectColor(), for benchmarks purposes.
+ *
+ * @param calls Number of calls.
+ * @param channels Number of channel distances computed (3 per full evaluation).
+ * @param fullEvaluations Number of samples whose 3 channels were computed.
+ * @param worstChannels Highest number of channel distances in a single call.
+ */
+struct ColorDetectionStats {
+    uint32_t calls;
+    uint32_t channels;
+    uint32_t fullEvaluations;
+    uint16_t worstChannels;
+};
+ColorDetectionStats colorDetectionStats = { 0, 0, 0, 0 };
+    #define COLOR_STATS_CHANNEL()    (callChannels++)
+#else
+    #define COLOR_STATS_CHANNEL()    void()
+#endif
+
+/**
+ * @brief Nearest neighbour search of the given color among SAMPLES.
+ *
+ *    The search is a branch and bound:
+ *      - The best distance is bounded from the start by the acceptance threshold;
+ *      - The distance of a sample is accumulated channel by channel, and
+ *      the sample is dropped as soon as the partial sum exceeds the best distance
+ *      (each term is positive, it can't win anymore);
+ *      - Samples are visited in the order of their last detection
+ *      (move-to-front): the previous winner is evaluated first and quickly
+ *      gives a tight bound for the others.
+ *
+ *    For a stable color, the cost is about 1 full evaluation + 1 channel per
+ *    remaining sample, instead of 3 channels for every sample.
+ *    Note: With equal distances the retained sample is the first visited one,
+ *    not the first one in SAMPLES.
+ */
 uint8_t detectColor(const uint16_t &red, const uint16_t &green, const uint16_t &blue) {
+    // Visit order of the samples; the most recently detected first
+    static uint8_t samplesOrder[samplesCount];
+    static bool    samplesOrderInitialized = false;
+
+    if (!samplesOrderInitialized) {
+        for (uint8_t i = 0; i < samplesCount; i++) {
+            samplesOrder[i] = i;
+        }
+        samplesOrderInitialized = true;
+    }
+
+    // Arbitrary threshold to avoid erroneous identifications:
+    // no need to consider samples beyond it.
 #ifdef MANHATTAN
-    uint16_t minDist = 10000;
+    uint16_t minDist = 100;
     uint16_t expDist;
 #else
-    float minDist = 3;
+    float minDist = 1.9; // Red color is quite difficult to identify even with this high threashold
     float expDist;
 #endif
-    uint8_t bestSampleIndex = 0;
+    bool    found        = false;
+    uint8_t bestOrderPos = 0;
+#ifdef COLOR_DETECTION_STATS
+    uint16_t callChannels = 0;
+#endif
 
-    for (uint8_t i = 0; i < samplesCount; i++) {
+    for (uint8_t pos = 0; pos < samplesCount; pos++) {
+        const uint16_t *sample = SAMPLES[samplesOrder[pos]];
 #ifdef MANHATTAN
-        expDist = abs(static_cast<int16_t>(red - SAMPLES[i][0]))
-                  + abs(static_cast<int16_t>(green - SAMPLES[i][1]))
-                  + abs(static_cast<int16_t>(blue - SAMPLES[i][2]));
+        COLOR_STATS_CHANNEL();
+        expDist = abs(static_cast<int16_t>(red - sample[0]));
+        if (expDist > minDist)
+            continue;
+        COLOR_STATS_CHANNEL();
+        expDist += abs(static_cast<int16_t>(green - sample[1]));
+        if (expDist > minDist)
+            continue;
+        COLOR_STATS_CHANNEL();
+        expDist += abs(static_cast<int16_t>(blue - sample[2]));
 #else
         // Yeah it's ugly but abs() of Arduino is a macro different from the stl implementation
         // moreover the parameter must be explicitly signed.
         // The numerator or denominator must be a float.
         // https://www.best-microcontroller-projects.com/arduino-absolute-value.html
         // https://github.com/arduino/reference-en/issues/362
-        expDist = (abs(static_cast<int16_t>(red - SAMPLES[i][0])) / static_cast<float>(red + SAMPLES[i][0]))
-                  + (abs(static_cast<int16_t>(green - SAMPLES[i][1])) / static_cast<float>(green + SAMPLES[i][1]))
-                  + (abs(static_cast<int16_t>(blue - SAMPLES[i][2])) / static_cast<float>(blue + SAMPLES[i][2]));
+        COLOR_STATS_CHANNEL();
+        expDist = abs(static_cast<int16_t>(red - sample[0])) / static_cast<float>(red + sample[0]);
+        if (expDist > minDist)
+            continue;
+        COLOR_STATS_CHANNEL();
+        expDist += abs(static_cast<int16_t>(green - sample[1])) / static_cast<float>(green + sample[1]);
+        if (expDist > minDist)
+            continue;
+        COLOR_STATS_CHANNEL();
+        expDist += abs(static_cast<int16_t>(blue - sample[2])) / static_cast<float>(blue + sample[2]);
+#endif
+#ifdef COLOR_DETECTION_STATS
+        colorDetectionStats.fullEvaluations++;
 #endif
-        if (expDist < minDist) {
-            bestSampleIndex = i;
-            minDist         = expDist;
+        // The threshold itself is an acceptable distance
+        if ((expDist < minDist) || (!found && expDist == minDist)) {
+            bestOrderPos = pos;
+            minDist      = expDist;
+            found        = true;
         }
     }
-    DEBUG_PRINTLN(expDist);
+    DEBUG_PRINTLN(minDist);
 
-    // Arbitrary threshold to avoid erroneous identifications
-#ifdef MANHATTAN
-    if (minDist > 100) {
-#else
-    if (minDist > 1.9) { // Red color is quite difficult to identify even with this high threashold
+#ifdef COLOR_DETECTION_STATS
+    colorDetectionStats.calls++;
+    colorDetectionStats.channels += callChannels;
+    if (callChannels > colorDetectionStats.worstChannels)
+        colorDetectionStats.worstChannels = callChannels;
 #endif
+
+    if (!found) {
         // Matching is not acceptable
         return COLOR_NONE;
     }
+
+    // Move the winner to the front of the visit order
+    const uint8_t bestSampleIndex = samplesOrder[bestOrderPos];
+    for (uint8_t pos = bestOrderPos; pos > 0; pos--) {
+        samplesOrder[pos] = samplesOrder[pos - 1];
+    }
+    samplesOrder[0] = bestSampleIndex;
+
     // Get color value expected by the hub
     return SAMPLES_MAP[bestSampleIndex];
 }
 
-
 #endif
@@ -0,0 +1,253 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_FILTERS_HPP
+#define MOB_FILTERS_HPP
+
+#include "Arduino.h"
+#include "../global.h"
+
+/**
+ * @brief Streaming filters for the values sent to the hub.
+ *
+ *    All filters work sample by sample: `update()` takes the new raw sample
+ *    and returns the filtered value. Their state is bounded and statically
+ *    allocated (no heap, no history rescan), so they can be called directly
+ *    from the "sample ready" path of a sketch (handleRGBSensorData(), etc.).
+ *
+ *    Filters:
+ *      - MovingMedian: Median of the last N samples; removes spikes.
+ *          The cost of a sample is bounded by N (compile-time constant),
+ *          only the oldest sample leaves the sorted window.
+ *      - ExponentialAverage: Integer low-pass filter; smooths noise.
+ *          The strength can be modified at runtime.
+ *      - ColorHysteresis: For discrete values (detected color);
+ *          a new value is published only when it is observed for
+ *          a given number of consecutive samples.
+ *      - FilterChain: Compose 2 filters (chains can be nested).
+ *
+ *    Example: Median of 3 samples followed by an average, for the red channel:
+ *
+ *      FilterChain<MovingMedian<uint16_t, 3>, ExponentialAverage<uint16_t> > redFilter;
+ *      red = redFilter.update(rgb_sensor.r_comp >> 6);
+ */
+
+
+/**
+ * @brief Moving median over a ring buffer of the N last samples.
+ *
+ * @param m_ring Ring buffer of samples in their arrival order.
+ * @param m_sorted Same samples sorted in ascending order.
+ * @param m_head Index of the oldest sample in m_ring.
+ * @param m_count Number of samples received (saturated to N).
+ */
+template <typename T, uint8_t N>
+class MovingMedian {
+    static_assert(N > 0, "The window of the median must not be empty");
+
+public:
+    MovingMedian() : m_head(0), m_count(0) {}
+
+    /**
+     * @brief Add a sample to the window and return the new median.
+     */
+    T update(const T& sample) {
+        uint8_t i;
+        if (m_count < N) {
+            // Window not full yet: just insert the sample
+            m_ring[m_count] = sample;
+            i = m_count;
+            m_count++;
+        } else {
+            // Remove the oldest sample from the sorted window
+            const T oldest = m_ring[m_head];
+            for (i = 0; m_sorted[i] != oldest; i++) {}
+            for (; i < N - 1; i++) {
+                m_sorted[i] = m_sorted[i + 1];
+            }
+            m_ring[m_head] = sample;
+            m_head = (m_head + 1 < N) ? m_head + 1 : 0;
+            i = N - 1;
+        }
+        // Insert the new sample at its place (insertion sort step)
+        while (i > 0 && m_sorted[i - 1] > sample) {
+            m_sorted[i] = m_sorted[i - 1];
+            i--;
+        }
+        m_sorted[i] = sample;
+        return value();
+    }
+
+    /**
+     * @brief Get the current median (0 if no sample was received).
+     */
+    T value() const {
+        return (m_count) ? m_sorted[(m_count - 1) / 2] : T();
+    }
+
+    /**
+     * @brief Forget all the samples.
+     */
+    void reset() {
+        m_head  = 0;
+        m_count = 0;
+    }
+
+private:
+    T       m_ring[N];
+    T       m_sorted[N];
+    uint8_t m_head;
+    uint8_t m_count;
+};
+
+
+/**
+ * @brief Exponential moving average on integers:
+ *      y += (x - y) / 2^strength
+ *
+ *    The accumulator keeps `strength` fractional bits, so small variations
+ *    are not lost by the integer division.
+ *    Strength 0 disables the filter; each step doubles the time constant
+ *    (strength 2 ~ average of 4 samples, 3 ~ 8 samples, etc.).
+ *
+ * @param m_acc Accumulator: filtered value << m_strength.
+ * @param m_strength Strength of the filter; see setStrength().
+ * @param m_primed Flag set after the first sample.
+ */
+template <typename T>
+class ExponentialAverage {
+public:
+    explicit ExponentialAverage(uint8_t strength = 2) :
+        m_acc(0),
+        m_strength(strength),
+        m_primed(false)
+    {}
+
+    /**
+     * @brief Add a sample and return the new average.
+     *      The first sample initializes the average.
+     */
+    T update(const T& sample) {
+        if (!m_primed) {
+            m_acc    = _(int32_t)(sample) << m_strength;
+            m_primed = true;
+        } else {
+            m_acc += _(int32_t)(sample) - (m_acc >> m_strength);
+        }
+        return value();
+    }
+
+    T value() const {
+        return _(T)(m_acc >> m_strength);
+    }
+
+    /**
+     * @brief Set the strength of the filter at runtime;
+     *      The current average is kept.
+     * @param strength 0 to 8.
+     */
+    void setStrength(uint8_t strength) {
+        if (strength > 8)
+            strength = 8;
+        const T current = value();
+        m_strength = strength;
+        m_acc      = _(int32_t)(current) << m_strength;
+    }
+
+    void reset() {
+        m_primed = false;
+    }
+
+private:
+    int32_t m_acc;
+    uint8_t m_strength;
+    bool    m_primed;
+};
+
+
+/**
+ * @brief Hysteresis for discrete values like colors:
+ *      A new value replaces the published one only after being seen
+ *      `threshold` times in a row.
+ *
+ * @param m_current Published value.
+ * @param m_candidate Last value different from m_current.
+ * @param m_candidateCount Number of consecutive occurrences of m_candidate.
+ * @param m_threshold Number of consecutive occurrences required.
+ */
+template <typename T>
+class ColorHysteresis {
+public:
+    explicit ColorHysteresis(const T& initial, uint8_t threshold = 3) :
+        m_current(initial),
+        m_candidate(initial),
+        m_candidateCount(0),
+        m_threshold(threshold)
+    {}
+
+    /**
+     * @brief Add a sample and return the published value.
+     */
+    T update(const T& sample) {
+        if (sample == m_current) {
+            m_candidateCount = 0;
+            return m_current;
+        }
+        if (sample != m_candidate) {
+            m_candidate      = sample;
+            m_candidateCount = 0;
+        }
+        if (++m_candidateCount >= m_threshold) {
+            m_current        = sample;
+            m_candidateCount = 0;
+        }
+        return m_current;
+    }
+
+    T value() const {
+        return m_current;
+    }
+
+    void setThreshold(uint8_t threshold) {
+        m_threshold = threshold;
+    }
+
+private:
+    T       m_current;
+    T       m_candidate;
+    uint8_t m_candidateCount;
+    uint8_t m_threshold;
+};
+
+
+/**
+ * @brief Compose 2 filters: the output of the 1st is the input of the 2nd.
+ *      Both filters stay accessible for their settings.
+ */
+template <class First, class Second>
+class FilterChain {
+public:
+    template <typename T>
+    T update(const T& sample) {
+        return second.update(first.update(sample));
+    }
+
+    First  first;
+    Second second;
+};
+
+#endif // MOB_FILTERS_HPP
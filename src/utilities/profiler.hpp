@@ -0,0 +1,231 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_PROFILER_HPP
+#define MOB_PROFILER_HPP
+
+#include "Arduino.h"
+#include "../global.h"
+
+// Clock of the profiler: cycle counter on ESP32, micros() elsewhere
+#ifndef MOB_PROFILER_CLOCK
+#if defined(ESP32)
+#define MOB_PROFILER_CLOCK()          ESP.getCycleCount()
+#define MOB_PROFILER_TICKS_PER_US     getCpuFrequencyMhz()
+#else
+#define MOB_PROFILER_CLOCK()          micros()
+#define MOB_PROFILER_TICKS_PER_US     1
+#endif
+#endif
+
+// Bucket i counts the durations in [2^i; 2^(i+1)[ ticks; 1st and last buckets are open
+#ifndef MOB_PROFILER_BUCKETS
+#if defined(ESP32)
+#define MOB_PROFILER_BUCKETS          28  // ~1s at 240MHz
+#else
+#define MOB_PROFILER_BUCKETS          16  // ~65ms
+#endif
+#endif
+
+#define MOB_PROFILE_CONCAT_(a, b)     a##b
+#define MOB_PROFILE_CONCAT(a, b)      MOB_PROFILE_CONCAT_(a, b)
+/**
+ * Time the rest of the current scope in the given ProfileSection.
+ */
+#define MOB_PROFILE(section) \
+    ProfileScope MOB_PROFILE_CONCAT(mobProfileScope, __LINE__)(section)
+
+
+/**
+ * @brief Distribution of the durations of a section, in ticks of
+ *      MOB_PROFILER_CLOCK (see ProfileSection::toMicros()).
+ *
+ * @param count Number of executions.
+ * @param min, max Shortest & longest durations.
+ * @param buckets Histogram of durations with power of 2 bounds
+ *      (see MOB_PROFILER_BUCKETS); the counts saturate at 65535.
+ */
+struct ProfileStats {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint16_t buckets[MOB_PROFILER_BUCKETS];
+};
+
+
+/**
+ * @brief Named section of code timed by ProfileScope objects; the stats
+ *      are kept in the object itself (declare it as a global: no heap).
+ *
+ *    All the sections are chained at construction, so that they can be
+ *    dumped together. They are meant to be used from the loop (or 1 task),
+ *    not from ISRs.
+ *
+ *    Overhead of a scope: 2 reads of the clock, a few comparisons and the
+ *    bucket lookup (__builtin_clz); on AVR, the 2 calls of micros() dominate
+ *    (micros() has a resolution of 4µs at 16MHz).
+ *
+ *    Example:
+ *      ProfileSection rgbProfile("RGB");
+ *      // loop()
+ *      {
+ *          MOB_PROFILE(rgbProfile);
+ *          handleRGBSensorData();
+ *      }
+ *      ...
+ *      if (Serial.read() == 'p')
+ *          ProfileSection::dumpAll(Serial);
+ *
+ * @param m_name Name printed by dump().
+ * @param m_next Next section of the chain.
+ * @param m_stats Durations of the section.
+ */
+class ProfileSection {
+public:
+    explicit ProfileSection(const char *name) : m_name(name), m_next(nullptr) {
+        reset();
+        // Append to the chain: sections are dumped in their declaration order
+        ProfileSection **last = &head();
+        while (*last)
+            last = &(*last)->m_next;
+        *last = this;
+    }
+
+    /**
+     * @brief Add a duration to the stats.
+     * @param ticks Duration in ticks of MOB_PROFILER_CLOCK.
+     */
+    void record(uint32_t ticks) {
+        m_stats.count++;
+        if (ticks < m_stats.min)
+            m_stats.min = ticks;
+        if (ticks > m_stats.max)
+            m_stats.max = ticks;
+
+        uint8_t bucket = 0;
+        if (ticks) {
+            // Index of the most significant bit
+            bucket = (sizeof(unsigned long) == 4) ? 31 - __builtin_clzl(ticks)
+                                                  : 31 - __builtin_clz(ticks);
+            if (bucket >= MOB_PROFILER_BUCKETS)
+                bucket = MOB_PROFILER_BUCKETS - 1;
+        }
+        if (m_stats.buckets[bucket] < 0xFFFF)
+            m_stats.buckets[bucket]++;
+    }
+
+    /**
+     * @brief Clear the stats.
+     */
+    void reset() {
+        m_stats = ProfileStats();
+        m_stats.min = 0xFFFFFFFF;
+    }
+
+    const ProfileStats& getStats() const { return m_stats; }
+    const char *getName() const { return m_name; }
+    ProfileSection *getNext() const { return m_next; }
+
+    /**
+     * @brief First section of the chain; nullptr if there is no section.
+     */
+    static ProfileSection *first() { return head(); }
+
+    /**
+     * @brief Convert ticks of MOB_PROFILER_CLOCK to µs.
+     */
+    static uint32_t toMicros(uint32_t ticks) {
+        return ticks / MOB_PROFILER_TICKS_PER_US;
+    }
+
+    /**
+     * @brief Print the stats (µs) & the non-empty buckets of the histogram.
+     * @param serial Any stream with print() & println().
+     */
+    template <typename S>
+    void dump(S& serial) const {
+        serial.print(m_name);
+        serial.print(F(": count "));
+        serial.print(m_stats.count);
+        if (m_stats.count) {
+            serial.print(F(", min (us) "));
+            serial.print(toMicros(m_stats.min));
+            serial.print(F(", max (us) "));
+            serial.print(toMicros(m_stats.max));
+        }
+        serial.println();
+        for (uint8_t i = 0; i < MOB_PROFILER_BUCKETS; i++) {
+            if (!m_stats.buckets[i])
+                continue;
+            serial.print(F("  < "));
+            // Upper bound; the last bucket is open
+            if (i == MOB_PROFILER_BUCKETS - 1)
+                serial.print(F("inf"));
+            else
+                serial.print(toMicros(2UL << i));
+            serial.print(F(" us: "));
+            serial.println(m_stats.buckets[i]);
+        }
+    }
+
+    /**
+     * @brief Print the stats of all the sections.
+     */
+    template <typename S>
+    static void dumpAll(S& serial) {
+        for (ProfileSection *section = head(); section; section = section->m_next)
+            section->dump(serial);
+    }
+
+    /**
+     * @brief Clear the stats of all the sections.
+     */
+    static void resetAll() {
+        for (ProfileSection *section = head(); section; section = section->m_next)
+            section->reset();
+    }
+
+private:
+    static ProfileSection*& head() {
+        static ProfileSection *first = nullptr;
+        return first;
+    }
+
+    const char     *m_name;
+    ProfileSection *m_next;
+    ProfileStats   m_stats;
+};
+
+
+/**
+ * @brief Time its own lifetime (a scope) in a ProfileSection;
+ *      see MOB_PROFILE().
+ */
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileSection& section) :
+        m_section(section), m_start(MOB_PROFILER_CLOCK()) {}
+    ~ProfileScope() {
+        m_section.record(MOB_PROFILER_CLOCK() - m_start);
+    }
+
+private:
+    ProfileSection& m_section;
+    uint32_t        m_start;
+};
+
+#endif // MOB_PROFILER_HPP
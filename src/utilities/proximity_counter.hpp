@@ -0,0 +1,114 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_PROXIMITY_COUNTER_HPP
+#define MOB_PROXIMITY_COUNTER_HPP
+
+#include "Arduino.h"
+#include "../global.h"
+#include "snapshot.hpp"
+
+// Distance given to ProximityCounter::update() when there is no target
+#define PROXIMITY_COUNTER_FAR    0xFFFF
+
+/**
+ * @brief Counter of the objects passing in front of the distance sensor
+ *      (mode 2 "COUNT" of the Color & Distance sensor).
+ *
+ *    A detection is counted when the distance goes below the near threshold;
+ *    the next one is counted only once the distance went above the far
+ *    threshold: the jitter of the measurements around a single threshold
+ *    would count the same object several times.
+ *
+ *    update() must see every sample: call it where the measurements are
+ *    read (data ready ISR, acquisition task, or the loop if it reads all of
+ *    them). The 32 bits count is published with a Snapshot: count() never
+ *    returns a half-written value, even if update() interrupts it or runs on
+ *    another core (1 producer, 1 consumer).
+ *
+ *    Example:
+ *      ProximityCounter detections(50, 60); // mm
+ *      myDevice.setDetectionCounter(&detections);
+ *      // Each new range; no target: PROXIMITY_COUNTER_FAR
+ *      detections.update(rangeMm);
+ *
+ * @param m_near, m_far Thresholds of the hysteresis (m_near <= m_far).
+ * @param m_isNear An object is in front of the sensor.
+ * @param m_count Detections counted (producer side).
+ * @param m_published Last count published for the consumer.
+ * @param m_lastCount Last count read (consumer side).
+ */
+class ProximityCounter {
+public:
+    ProximityCounter(uint16_t nearThreshold, uint16_t farThreshold) :
+        m_near(nearThreshold), m_far(farThreshold), m_isNear(false),
+        m_count(0), m_lastCount(0) {}
+
+    /**
+     * @brief Process a new sample (producer side).
+     * @param distance Distance to the nearest object; PROXIMITY_COUNTER_FAR
+     *      if there is none (out of range, error status, etc.).
+     * @return true if a new detection is counted.
+     */
+    bool update(uint16_t distance) {
+        if (m_isNear) {
+            if (distance > m_far)
+                m_isNear = false;
+            return false;
+        }
+        if (distance > m_near)
+            return false;
+        m_isNear = true;
+        m_count++;
+        m_published.write(m_count);
+        return true;
+    }
+
+    /**
+     * @brief Restart the count from 0 (producer side).
+     */
+    void reset() {
+        m_isNear = false;
+        m_count  = 0;
+        m_published.write(m_count);
+    }
+
+    /**
+     * @brief Get the number of detections (consumer side).
+     */
+    uint32_t count() {
+        m_published.read(m_lastCount);
+        return m_lastCount;
+    }
+
+    /**
+     * @brief Tell if an object is in front of the sensor (producer side).
+     */
+    bool isNear() {
+        return m_isNear;
+    }
+
+private:
+    uint16_t           m_near;
+    uint16_t           m_far;
+    bool               m_isNear;
+    uint32_t           m_count;
+    Snapshot<uint32_t> m_published;
+    uint32_t           m_lastCount;
+};
+
+#endif // MOB_PROXIMITY_COUNTER_HPP
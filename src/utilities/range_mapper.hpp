@@ -0,0 +1,119 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_RANGE_MAPPER_HPP
+#define MOB_RANGE_MAPPER_HPP
+
+#include "Arduino.h"
+#include "../global.h"
+
+/**
+ * @brief Map raw values of sensors to the ranges expected by the hub
+ *      (percentages, etc.) with a calibrated linear equation: y = ax + b
+ *
+ *    Weights of the equation must be calculated empirically;
+ *    System to solve:
+ *      100% = MaxRawValue * a + b
+ *      0% = MinRawValue * a + b
+ *
+ *    Coefficients are converted at compile time to fixed-point integers,
+ *    so a conversion costs 1 multiplication, 1 addition, 1 shift and the
+ *    clamping to the output range (no float on AVR).
+ *    The number of fractional bits is chosen at compile time: the highest
+ *    one (up to 24) for which the computation fits in 32 bits for any
+ *    16 bits raw value.
+ *
+ *    Precision: the coefficients are rounded to 1/2 LSB of the fixed-point
+ *    format, so the result only differs from the truncated float equation
+ *    where ax + b is within (raw + 1) / 2^(shift + 1) of an integer, by 1.
+ *    On AVR, double is a 32 bits float: the coefficients are computed at
+ *    compile time with 24 significant bits, which adds a relative error of
+ *    6e-8 (1e-5 on a 0-100 result). With the coefficients of the examples,
+ *    the results are identical for 8 bits raw values, and differ by 1 for
+ *    at most 36 of the 65536 16 bits raw values (see
+ *    extras/tests/range_mapper_test.cpp).
+ *
+ *    Example:
+ *      #define LUX_TO_PERCENTAGE(val)    (MOB_RANGE_MAPPER(0.0105, -0.0843)::map(val))
+ *      ambientLight = LUX_TO_PERCENTAGE(lux);
+ */
+
+// Max number of fractional bits of the coefficients
+#define MOB_FIXED_MAX_SHIFT    24
+
+/**
+ * @brief Convert a floating coefficient to a fixed-point integer
+ *      with the given number of fractional bits (rounded to the nearest).
+ */
+#define MOB_FIXED(value, shift) \
+    (_(int32_t)((value) * (1L << (shift)) + (((value) < 0) ? -0.5 : 0.5)))
+
+/**
+ * @brief Type of the mapper for the given float coefficients.
+ */
+#define MOB_RANGE_MAPPER(a_coef, b_coef)                       \
+    RangeMapper<MOB_FIXED(a_coef, mobFixedShift(a_coef, b_coef)), \
+                MOB_FIXED(b_coef, mobFixedShift(a_coef, b_coef)), \
+                mobFixedShift(a_coef, b_coef)>
+
+
+constexpr double mobFixedAbs(double value) {
+    return (value < 0) ? -value : value;
+}
+
+/**
+ * @brief Get the highest number of fractional bits usable for the
+ *      coefficients: (65535 * |a| + |b|) * 2^shift must fit in an int32_t.
+ */
+constexpr uint8_t mobFixedShift(double a_coef, double b_coef, uint8_t shift = MOB_FIXED_MAX_SHIFT) {
+    return (shift == 0 ||
+            (mobFixedAbs(a_coef) * 65535.0 + mobFixedAbs(b_coef)) * (1L << shift) < 2147483647.0) ?
+           shift : mobFixedShift(a_coef, b_coef, shift - 1);
+}
+
+
+/**
+ * @brief Saturating linear mapping with fixed-point coefficients.
+ *
+ * @tparam A_FP Coefficient a, with SHIFT fractional bits.
+ * @tparam B_FP Coefficient b, with SHIFT fractional bits.
+ * @tparam SHIFT Number of fractional bits.
+ * @tparam OUT_MIN, OUT_MAX Output range (default: 0 to 100).
+ */
+template <int32_t A_FP, int32_t B_FP, uint8_t SHIFT, uint8_t OUT_MIN = 0, uint8_t OUT_MAX = 100>
+struct RangeMapper {
+    static_assert(SHIFT <= MOB_FIXED_MAX_SHIFT, "Too many fractional bits");
+    static_assert(OUT_MIN <= OUT_MAX, "Empty output range");
+    static_assert(65535LL * (A_FP < 0 ? -_(int64_t)(A_FP) : A_FP) +
+                  (B_FP < 0 ? -_(int64_t)(B_FP) : B_FP) <= 2147483647LL,
+                  "Coefficients too large: the mapping overflows 32 bits");
+
+    /**
+     * @brief Map the raw value; the result is clamped to [OUT_MIN; OUT_MAX].
+     *      Like the former float implementation, the result is truncated.
+     */
+    static uint8_t map(const uint16_t rawValue) {
+        const int32_t value = (_(int32_t)(rawValue) * A_FP + B_FP) >> SHIFT;
+        if (value > OUT_MAX)
+            return OUT_MAX;
+        if (value < OUT_MIN)
+            return OUT_MIN;
+        return _(uint8_t)(value);
+    }
+};
+
+#endif // MOB_RANGE_MAPPER_HPP
@@ -0,0 +1,89 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_SNAPSHOT_HPP
+#define MOB_SNAPSHOT_HPP
+
+#include "Arduino.h"
+#include "../global.h"
+
+/**
+ * @brief Lock-free snapshot of the latest sample (triple buffer),
+ *      for 1 producer and 1 consumer running concurrently
+ *      (tasks on different cores, or an ISR and the main loop).
+ *
+ *    The producer always writes in a buffer that the consumer can't see,
+ *    then publishes it by swapping its index with the "middle" buffer.
+ *    The consumer takes the middle buffer only if it contains a new sample.
+ *    None of them can block the other; intermediate samples are overwritten
+ *    (only the latest one matters for the hub).
+ *
+ *    Example:
+ *      Snapshot<ColorSample> colorSnapshot;
+ *      // Acquisition task
+ *      colorSnapshot.write(sample);
+ *      // Protocol task
+ *      if (colorSnapshot.read(sample))
+ *          sensorColor = sample.color;
+ *
+ * @param m_buffers The 3 buffers; each side owns one, the 3rd is shared.
+ * @param m_middle Index of the shared buffer + NEW_DATA flag. Only accessed
+ *      through atomic exchanges.
+ * @param m_writeIndex Buffer owned by the producer.
+ * @param m_readIndex Buffer owned by the consumer.
+ */
+template <typename T>
+class Snapshot {
+public:
+    Snapshot() : m_middle(1), m_writeIndex(0), m_readIndex(2) {}
+
+    /**
+     * @brief Publish a new sample (producer side).
+     */
+    void write(const T& sample) {
+        m_buffers[m_writeIndex] = sample;
+        const uint8_t previous = __atomic_exchange_n(
+            &m_middle, _(uint8_t)(m_writeIndex | NEW_DATA), __ATOMIC_ACQ_REL);
+        m_writeIndex = previous & INDEX_MASK;
+    }
+
+    /**
+     * @brief Get the latest sample (consumer side).
+     * @param sample Reference updated only if a new sample was published
+     *      since the last call.
+     * @return true if a new sample was read.
+     */
+    bool read(T& sample) {
+        if (!(__atomic_load_n(&m_middle, __ATOMIC_ACQUIRE) & NEW_DATA))
+            return false;
+        const uint8_t previous = __atomic_exchange_n(&m_middle, m_readIndex, __ATOMIC_ACQ_REL);
+        m_readIndex = previous & INDEX_MASK;
+        sample      = m_buffers[m_readIndex];
+        return true;
+    }
+
+private:
+    static const uint8_t INDEX_MASK = 0x03;
+    static const uint8_t NEW_DATA   = 0x04;
+
+    T       m_buffers[3];
+    uint8_t m_middle;
+    uint8_t m_writeIndex;
+    uint8_t m_readIndex;
+};
+
+#endif // MOB_SNAPSHOT_HPP
@@ -0,0 +1,125 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_STARTUP_SEQUENCER_HPP
+#define MOB_STARTUP_SEQUENCER_HPP
+
+#include "Arduino.h"
+#include "../global.h"
+
+/**
+ * @brief Result of a step of StartupSequencer.
+ *      STEP_WAIT: call the step again later (device not ready yet).
+ *      STEP_DONE: go to the next step.
+ *      STEP_RETRY: call the step again later, from a new start time
+ *          (Ex: device not found, try again after a while).
+ */
+enum StepResult : uint8_t {
+    STEP_WAIT,
+    STEP_DONE,
+    STEP_RETRY
+};
+
+/**
+ * @brief Step of a startup sequence.
+ * @param elapsed Time in ms since the beginning of the step (or its last retry).
+ */
+typedef StepResult (*StartupStep)(unsigned long elapsed);
+
+
+/**
+ * @brief Non-blocking bring-up of the chips of a sensor.
+ *
+ *    Each step polls the ready/status registers of a device instead of
+ *    sleeping for a fixed time, and returns immediately. poll() can then be
+ *    called from BaseSensor::setIdleCallback() so that the bring-up overlaps
+ *    the handshake with the hub, and from loop() until isDone().
+ *    A step that needs a delay compares elapsed to it.
+ *
+ *    Example:
+ *      StepResult powerUp(unsigned long elapsed) {
+ *          if (!chip.begin())
+ *              return (elapsed > 200) ? STEP_RETRY : STEP_WAIT;
+ *          return STEP_DONE;
+ *      }
+ *      const StartupStep steps[] = { powerUp, configure };
+ *      StartupSequencer<2> sequencer(steps);
+ *
+ * @param m_steps Steps executed in order.
+ * @param m_index Index of the current step; N when the sequence is done.
+ * @param m_stepTick Start time of the current step (ms).
+ * @param m_started The current step was already called once.
+ * @param m_doneTick Time of the end of the sequence (ms since power-on).
+ */
+template <uint8_t N>
+class StartupSequencer {
+public:
+    explicit StartupSequencer(const StartupStep (&steps)[N]) :
+        m_steps(steps), m_index(0), m_stepTick(0), m_doneTick(0), m_started(false)
+    {}
+
+    /**
+     * @brief Run the current step once.
+     * @return true if the sequence is done.
+     */
+    bool poll() {
+        if (m_index >= N)
+            return true;
+        if (!m_started) {
+            m_stepTick = millis();
+            m_started  = true;
+        }
+
+        switch (m_steps[m_index](millis() - m_stepTick)) {
+            case STEP_DONE:
+                m_index++;
+                m_started = false;
+                if (m_index >= N) {
+                    m_doneTick = millis();
+                    return true;
+                }
+                break;
+            case STEP_RETRY:
+                m_stepTick = millis();
+                break;
+            default:
+                break;
+        }
+        return false;
+    }
+
+    bool isDone() const {
+        return m_index >= N;
+    }
+
+    /**
+     * @brief Get the time from power-on to the end of the sequence.
+     * @return Time in ms; 0 if the sequence is not done.
+     */
+    unsigned long getDoneTime() const {
+        return m_doneTick;
+    }
+
+private:
+    const StartupStep *m_steps;
+    uint8_t           m_index;
+    unsigned long     m_stepTick;
+    unsigned long     m_doneTick;
+    bool              m_started;
+};
+
+#endif // MOB_STARTUP_SEQUENCER_HPP
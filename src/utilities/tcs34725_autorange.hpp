@@ -0,0 +1,253 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_TCS34725_AUTORANGE_HPP
+#define MOB_TCS34725_AUTORANGE_HPP
+
+#include "Arduino.h"
+#include "../global.h"
+
+// Registers of TCS34725 written by the sketch when the settings change
+// (the command bit 0x80 must be added)
+#define TCS_AUTORANGE_ATIME_REG      0x01
+#define TCS_AUTORANGE_CONTROL_REG    0x0F
+// Sensitivity of the reference settings (gain 4x, 64 cycles: 154ms) to
+// which the readings are scaled
+#define TCS_AUTORANGE_REF_SENSITIVITY    (4 * 64)
+// Number of settings; see TCS34725AutoRange::getSetting()
+#define TCS_AUTORANGE_LEVELS         6
+// Below this clear count, the readings are too noisy (most sensitive level excepted)
+#define TCS_AUTORANGE_MIN_COUNTS     100
+
+/**
+ * @brief Gain & integration time of TCS34725.
+ * @param control Value of the CONTROL register (AGAIN).
+ * @param gain Gain factor.
+ * @param cycles Number of integration cycles of 2.4ms (ATIME = 256 - cycles).
+ */
+struct TCSSetting {
+    uint8_t  control;
+    uint8_t  gain;
+    uint16_t cycles;
+};
+
+
+/**
+ * @brief Automatic gain & integration time control of TCS34725.
+ *
+ *    The settings are ordered by sensitivity (gain * cycles). For a given
+ *    sensitivity, the shortest integration time is used (2.4ms * 10 = 24ms,
+ *    ~40 samples/s) and the time is only increased in the dark, when the
+ *    max gain is reached.
+ *    After each reading, the clear channel selects the next setting:
+ *      - Above 75% of the full scale of the current setting: less sensitive.
+ *      - Below 40% of the full scale of the more sensitive setting, once
+ *        converted to it: more sensitive. The gap between both thresholds
+ *        prevents oscillations.
+ *    The first reading after a change mixes both settings and is discarded.
+ *    The integration time can be capped (see setMaxIntegrationTime()) to keep
+ *    a minimal sample rate in the dark, at the cost of the sensitivity.
+ *
+ *    The readings are scaled to the reference settings (gain 4x, 154ms:
+ *    the former fixed settings), so the calibrations of the colors,
+ *    of the lux and the 10 bits values sent to the hub (>> 6) do not
+ *    depend on the current setting. Scenes too bright for the 16 bits of
+ *    the reference settings (least sensitive setting only) give invalid
+ *    readings.
+ *
+ *    Example:
+ *      TCS34725AutoRange autorange;
+ *      // Setup
+ *      tcs.write8(TCS34725_ATIME, autorange.getATime());
+ *      tcs.write8(TCS34725_CONTROL, autorange.getControl());
+ *      // Reading of raw channels
+ *      if (autorange.update(c_raw)) {
+ *          // Write ATIME & CONTROL registers
+ *      }
+ *      red = autorange.scale(r_raw) >> 6;
+ *      // Checked once all the channels are scaled
+ *      if (autorange.isValid())
+ *          ...
+ *
+ * @param m_level Index of the current setting.
+ * @param m_maxLevel Index of the most sensitive setting allowed.
+ * @param m_sampleLevel Setting of the last reading (for scale()).
+ * @param m_skip Number of readings to discard.
+ * @param m_valid The last reading is usable.
+ */
+class TCS34725AutoRange {
+public:
+    explicit TCS34725AutoRange(uint8_t level = 2) :
+        m_level((level < TCS_AUTORANGE_LEVELS) ? level : TCS_AUTORANGE_LEVELS - 1),
+        m_maxLevel(TCS_AUTORANGE_LEVELS - 1),
+        m_sampleLevel(m_level),
+        m_skip(0),
+        m_valid(false)
+    {}
+
+    /**
+     * @brief Settings from the least to the most sensitive.
+     */
+    static TCSSetting getSetting(uint8_t level) {
+        static const TCSSetting settings[TCS_AUTORANGE_LEVELS] = {
+            { 0x00, 1,  10 },  // 1x, 24ms
+            { 0x01, 4,  10 },  // 4x, 24ms
+            { 0x02, 16, 10 },  // 16x, 24ms
+            { 0x03, 60, 10 },  // 60x, 24ms
+            { 0x03, 60, 42 },  // 60x, 101ms
+            { 0x03, 60, 256 }, // 60x, 614ms
+        };
+        return settings[level];
+    }
+
+    /**
+     * @brief Max count of a channel: 1024 per cycle, 65535 max.
+     */
+    static uint16_t getFullScale(uint8_t level) {
+        const uint32_t counts = _(uint32_t)(getSetting(level).cycles) * 1024;
+        return (counts > 65535) ? 65535 : _(uint16_t)(counts);
+    }
+
+    static uint16_t getSensitivity(uint8_t level) {
+        const TCSSetting setting = getSetting(level);
+        return setting.gain * setting.cycles;
+    }
+
+    /**
+     * @brief Handle a new reading.
+     * @param clear Raw value of the clear channel.
+     * @return true if the settings changed: ATIME & CONTROL registers
+     *      must be written (see getATime(), getControl()).
+     */
+    bool update(uint16_t clear) {
+        m_sampleLevel = m_level;
+        if (m_skip) {
+            m_skip--;
+            m_valid = false;
+            return false;
+        }
+
+        const uint16_t fullScale = getFullScale(m_level);
+        const bool     saturated = clear >= fullScale - (fullScale >> 2);
+
+        m_valid = !saturated && !isOutOfScale(clear) &&
+                  (clear >= TCS_AUTORANGE_MIN_COUNTS || m_level >= m_maxLevel);
+
+        uint8_t level = m_level;
+        if (level > m_maxLevel) {
+            // The cap was lowered since the last reading
+            level = m_maxLevel;
+        } else if (saturated) {
+            if (level > 0)
+                level--;
+        } else if (level < m_maxLevel) {
+            // Clear count with the next setting
+            const uint32_t next = _(uint32_t)(clear) * getSensitivity(level + 1) / getSensitivity(level);
+            if (next < _(uint32_t)(getFullScale(level + 1)) * 2 / 5)
+                level++;
+        }
+        if (level == m_level)
+            return false;
+
+        m_level = level;
+        m_skip  = 1;
+        return true;
+    }
+
+    /**
+     * @brief The last reading is usable: not saturated, not taken during
+     *      a change of settings, not too dark and its channels scaled so far
+     *      fit in 16 bits (see scale()).
+     */
+    bool isValid() const {
+        return m_valid;
+    }
+
+    /**
+     * @brief Scale a raw value of the last reading to the reference settings
+     *      (gain 4x, 154ms).
+     *      Saturated to 65535; the ratios of the channels are then lost and
+     *      the reading is marked as invalid.
+     */
+    uint16_t scale(uint16_t raw) {
+        if (isOutOfScale(raw)) {
+            m_valid = false;
+            return 65535;
+        }
+        return _(uint16_t)(_(uint32_t)(raw) * TCS_AUTORANGE_REF_SENSITIVITY / getSensitivity(m_sampleLevel));
+    }
+
+    uint8_t getLevel() const {
+        return m_level;
+    }
+
+    /**
+     * @brief Cap the integration time of the settings used in the dark.
+     *      The current setting is left by the next update() if needed.
+     * @param ms Max integration time in ms; 0 removes the cap. The settings
+     *      of the shortest integration time are always allowed.
+     */
+    void setMaxIntegrationTime(uint16_t ms) {
+        m_maxLevel = 0;
+        for (uint8_t level = 1; level < TCS_AUTORANGE_LEVELS; level++) {
+            if (ms == 0 || getSetting(level).cycles <= getSetting(0).cycles ||
+                    getIntegrationTime(level) <= ms)
+                m_maxLevel = level;
+        }
+    }
+
+    /**
+     * @brief Value of the ATIME register for the current setting.
+     */
+    uint8_t getATime() const {
+        return _(uint8_t)(256 - getSetting(m_level).cycles);
+    }
+
+    /**
+     * @brief Value of the CONTROL register for the current setting.
+     */
+    uint8_t getControl() const {
+        return getSetting(m_level).control;
+    }
+
+    /**
+     * @brief Integration time of the current setting in ms.
+     */
+    uint16_t getIntegrationTime() const {
+        return getIntegrationTime(m_level);
+    }
+
+    static uint16_t getIntegrationTime(uint8_t level) {
+        return _(uint16_t)((getSetting(level).cycles * 24 + 5) / 10);
+    }
+
+private:
+    /**
+     * @brief The raw value of the last reading exceeds 16 bits once scaled.
+     */
+    bool isOutOfScale(uint16_t raw) const {
+        return _(uint32_t)(raw) * TCS_AUTORANGE_REF_SENSITIVITY / getSensitivity(m_sampleLevel) > 65535;
+    }
+
+    uint8_t m_level;
+    uint8_t m_maxLevel;
+    uint8_t m_sampleLevel;
+    uint8_t m_skip;
+    bool    m_valid;
+};
+
+#endif // MOB_TCS34725_AUTORANGE_HPP
@@ -0,0 +1,273 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_TILT_ESTIMATOR_HPP
+#define MOB_TILT_ESTIMATOR_HPP
+
+#include "Arduino.h"
+#include "../global.h"
+#include "filters.hpp"
+
+// Range of the angles of the Tilt sensor (degrees)
+#define MOB_TILT_MAX_ANGLE       45
+// Samples taken from the accelerometer per read in TiltEstimator::poll()
+#define MOB_TILT_READ_SAMPLES    8
+
+
+/**
+ * @brief Integer approximation of atan2(y, x), without float.
+ *
+ *    The ratio of the smallest to the largest component, z in [0; 1], is
+ *    computed in Q15, then:
+ *      atan(z) ~ 45z + z(1 - z)(14.02 + 3.80z) degrees
+ *    (max error ~0.1°), and the result is moved to its octant.
+ *    Costs 1 division and 3 multiplications.
+ *
+ * @return Angle in 1/100 degrees (-18000 to 18000); 0 for (0, 0).
+ */
+inline int16_t mobAtan2(int32_t y, int32_t x) {
+    uint32_t ax = (x < 0) ? -_(uint32_t)(x) : _(uint32_t)(x);
+    uint32_t ay = (y < 0) ? -_(uint32_t)(y) : _(uint32_t)(y);
+    if (ax == 0 && ay == 0)
+        return 0;
+
+    const bool swap = ay > ax;
+    uint32_t   num  = (swap) ? ax : ay;
+    uint32_t   den  = (swap) ? ay : ax;
+    // num << 15 must fit in 32 bits
+    while (den >= (1UL << 16)) {
+        num >>= 1;
+        den >>= 1;
+    }
+    const uint32_t z = (num << 15) / den;
+
+    const uint32_t correction = ((32768 - z) * (1402 + ((380 * z) >> 15))) >> 15;
+    int16_t        angle      = _(int16_t)((z * (4500 + correction)) >> 15);
+
+    if (swap)
+        angle = 9000 - angle;
+    if (x < 0)
+        angle = 18000 - angle;
+    return (y < 0) ? -angle : angle;
+}
+
+
+/**
+ * @brief Integer square root (floor), bit by bit.
+ */
+inline uint16_t mobSqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit  = 1UL << 30;
+
+    while (bit > value)
+        bit >>= 2;
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root   = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return _(uint16_t)(root);
+}
+
+
+/**
+ * @brief Raw sample of a 3 axis accelerometer (any full scale).
+ */
+struct AccelSample {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+};
+
+
+/**
+ * @brief Interface of the accelerometers read by TiltEstimator::poll().
+ *      The samples are buffered by the device (FIFO, burst reads) and
+ *      consumed by batches.
+ */
+class Accelerometer {
+public:
+    /**
+     * @brief Take the buffered samples, oldest first.
+     * @return Number of samples copied (0 if none is available).
+     */
+    virtual uint8_t readSamples(AccelSample *samples, uint8_t maxSamples) = 0;
+};
+
+
+/**
+ * @brief Roll & pitch of the Tilt sensor from an accelerometer.
+ *
+ *    Each sample of the 3 axes goes through a low-pass filter
+ *    (ExponentialAverage) at the rate of the accelerometer; the angles are
+ *    computed from the filtered gravity vector when they are read:
+ *      roll  = atan2(y, z)
+ *      pitch = atan2(-x, sqrt(y² + z²))
+ *    With a sample rate of several hundred Hz, the filter removes the
+ *    vibrations and the noise with a small delay (strength 4 at 500Hz:
+ *    time constant ~32ms). No float nor trigonometry function is used.
+ *
+ *    Example:
+ *      MPU6050Accel      imu;
+ *      TiltEstimator     tilt;
+ *      // In loop()
+ *      imu.poll();
+ *      tilt.poll(imu);
+ *      sensorX = tilt.getRoll();
+ *      sensorY = tilt.getPitch();
+ *
+ * @param m_x, m_y, m_z Filters of the axes.
+ * @param m_samples Number of samples received (saturated).
+ * @param m_pSamplefunc Callback receiving the raw samples read by poll()
+ *      (Ex: ImpactDetector); Optional.
+ */
+class TiltEstimator {
+public:
+    explicit TiltEstimator(uint8_t strength = 4) :
+        m_x(strength),
+        m_y(strength),
+        m_z(strength),
+        m_samples(0),
+        m_pSamplefunc(nullptr)
+    {}
+
+    /**
+     * @brief Add a sample of the accelerometer.
+     */
+    void update(const AccelSample& sample) {
+        m_x.update(sample.x);
+        m_y.update(sample.y);
+        m_z.update(sample.z);
+        if (m_samples < 255)
+            m_samples++;
+    }
+
+    /**
+     * @brief Process all the samples buffered by the accelerometer.
+     * @return Number of samples processed.
+     */
+    uint16_t poll(Accelerometer& device) {
+        AccelSample samples[MOB_TILT_READ_SAMPLES];
+        uint16_t    total = 0;
+        uint8_t     count;
+        do {
+            count = device.readSamples(samples, MOB_TILT_READ_SAMPLES);
+            for (uint8_t i = 0; i < count; i++) {
+                update(samples[i]);
+                if (m_pSamplefunc)
+                    m_pSamplefunc(samples[i]);
+            }
+            total += count;
+        } while (count == MOB_TILT_READ_SAMPLES);
+        return total;
+    }
+
+    /**
+     * @brief Set the callback receiving the raw samples read by poll().
+     */
+    void setSampleCallback(void(pfunc)(const AccelSample&)) {
+        m_pSamplefunc = pfunc;
+    }
+
+    /**
+     * @brief Angle along the x-axis (roll) in 1/100 degrees.
+     */
+    int16_t getRollCenti() const {
+        return mobAtan2(m_y.value(), m_z.value());
+    }
+
+    /**
+     * @brief Angle along the y-axis (pitch) in 1/100 degrees.
+     */
+    int16_t getPitchCenti() const {
+        const int32_t y = m_y.value();
+        const int32_t z = m_z.value();
+        return mobAtan2(-_(int32_t)(m_x.value()), mobSqrt(_(uint32_t)(y * y) + _(uint32_t)(z * z)));
+    }
+
+    /**
+     * @brief Roll in degrees, rounded & clamped to ±MOB_TILT_MAX_ANGLE.
+     */
+    int8_t getRoll() const {
+        return toDegrees(getRollCenti());
+    }
+
+    /**
+     * @brief Pitch in degrees, rounded & clamped to ±MOB_TILT_MAX_ANGLE.
+     */
+    int8_t getPitch() const {
+        return toDegrees(getPitchCenti());
+    }
+
+    /**
+     * @brief Direction of the gravity on the X, Y, Z axes, 1g = MOB_TILT_MAX_ANGLE
+     *      (mode 3 of the Tilt sensor, LPF2-CAL).
+     * @param values 3 values from -MOB_TILT_MAX_ANGLE to MOB_TILT_MAX_ANGLE.
+     */
+    void getCalibration(int8_t *values) const {
+        const int32_t  axes[3] = { m_x.value(), m_y.value(), m_z.value() };
+        const uint16_t norm    = mobSqrt(_(uint32_t)(axes[0] * axes[0]) + _(uint32_t)(axes[1] * axes[1]) +
+                                         _(uint32_t)(axes[2] * axes[2]));
+        for (uint8_t i = 0; i < 3; i++)
+            values[i] = (norm) ? _(int8_t)(axes[i] * MOB_TILT_MAX_ANGLE / norm) : 0;
+    }
+
+    /**
+     * @brief At least 1 sample was received.
+     */
+    bool isValid() const {
+        return m_samples != 0;
+    }
+
+    /**
+     * @brief Set the strength of the filters (see ExponentialAverage).
+     */
+    void setStrength(uint8_t strength) {
+        m_x.setStrength(strength);
+        m_y.setStrength(strength);
+        m_z.setStrength(strength);
+    }
+
+    void reset() {
+        m_x.reset();
+        m_y.reset();
+        m_z.reset();
+        m_samples = 0;
+    }
+
+    static int8_t toDegrees(int16_t centi) {
+        int16_t degrees = (centi + ((centi < 0) ? -50 : 50)) / 100;
+        if (degrees > MOB_TILT_MAX_ANGLE)
+            return MOB_TILT_MAX_ANGLE;
+        if (degrees < -MOB_TILT_MAX_ANGLE)
+            return -MOB_TILT_MAX_ANGLE;
+        return _(int8_t)(degrees);
+    }
+
+private:
+    ExponentialAverage<int16_t> m_x;
+    ExponentialAverage<int16_t> m_y;
+    ExponentialAverage<int16_t> m_z;
+    uint8_t                     m_samples;
+    void                        (*m_pSamplefunc)(const AccelSample&);
+};
+
+#endif // MOB_TILT_ESTIMATOR_HPP
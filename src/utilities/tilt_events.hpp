@@ -0,0 +1,223 @@
+/*
+ * MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+ * Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MOB_TILT_EVENTS_HPP
+#define MOB_TILT_EVENTS_HPP
+
+#include "Arduino.h"
+#include "../global.h"
+#include "tilt_estimator.hpp"
+
+// Directions of the Tilt sensor (mode 1, LPF2-TILT; WeDo 2.0 values)
+#define TILT_DIRECTION_NEUTRAL     0
+#define TILT_DIRECTION_BACKWARD    3
+#define TILT_DIRECTION_RIGHT       5
+#define TILT_DIRECTION_LEFT        7
+#define TILT_DIRECTION_FORWARD     9
+// Max value of the crash counters (mode 2, LPF2-CRASH)
+#define TILT_MAX_CRASH_COUNT       100
+
+
+/**
+ * @brief Discrete direction of the Tilt sensor from its angles, with hysteresis.
+ *
+ *    The direction is given by the axis of the largest angle and its sign,
+ *    through a lookup table:
+ *      roll > 0: RIGHT, roll < 0: LEFT, pitch > 0: FORWARD, pitch < 0: BACKWARD.
+ *    A direction is entered above the `enter` angle and left below the
+ *    `exit` angle (back to NEUTRAL); a direction on the other axis
+ *    replaces it only if its angle is larger by (enter - exit). Noisy
+ *    angles around a threshold or a diagonal don't make it flicker.
+ *
+ *    Example:
+ *      TiltDirection direction;
+ *      sensorDirection = direction.update(tilt.getRoll(), tilt.getPitch());
+ *
+ * @param m_current Index of the current direction in the lookup table
+ *      ((axis << 1) | negative); TILT_NO_DIRECTION for NEUTRAL.
+ * @param m_enter, m_exit Thresholds (degrees).
+ */
+class TiltDirection {
+    enum : uint8_t { TILT_NO_DIRECTION = 0xFF };
+
+public:
+    explicit TiltDirection(uint8_t enter = 20, uint8_t exit = 10) :
+        m_current(TILT_NO_DIRECTION),
+        m_enter(enter),
+        m_exit((exit < enter) ? exit : enter)
+    {}
+
+    /**
+     * @brief Update the direction with the current angles (degrees).
+     * @return TILT_DIRECTION_NEUTRAL, _BACKWARD, _RIGHT, _LEFT or _FORWARD.
+     */
+    uint8_t update(int8_t roll, int8_t pitch) {
+        const int16_t angles[2] = { roll, pitch };
+
+        // Largest angle
+        const uint8_t axis      = (abs(angles[1]) > abs(angles[0])) ? 1 : 0;
+        const uint8_t candidate = _(uint8_t)((axis << 1) | (angles[axis] < 0));
+        const int16_t magnitude = abs(angles[axis]);
+
+        if (m_current != TILT_NO_DIRECTION) {
+            // Angle in the current direction
+            int16_t current = angles[m_current >> 1];
+            if (m_current & 0x01)
+                current = -current;
+
+            if (current < m_exit)
+                m_current = TILT_NO_DIRECTION;
+            else if (candidate != m_current && magnitude >= current + (m_enter - m_exit))
+                m_current = candidate;
+        }
+        if (m_current == TILT_NO_DIRECTION && magnitude >= m_enter)
+            m_current = candidate;
+        return value();
+    }
+
+    uint8_t value() const {
+        static const uint8_t directions[4] = {
+            TILT_DIRECTION_RIGHT, TILT_DIRECTION_LEFT, TILT_DIRECTION_FORWARD, TILT_DIRECTION_BACKWARD
+        };
+        return (m_current == TILT_NO_DIRECTION) ? TILT_DIRECTION_NEUTRAL : directions[m_current];
+    }
+
+    void reset() {
+        m_current = TILT_NO_DIRECTION;
+    }
+
+private:
+    uint8_t m_current;
+    uint8_t m_enter;
+    uint8_t m_exit;
+};
+
+
+/**
+ * @brief Streaming detector of impacts (crashes) on the 3 axes.
+ *
+ *    The baseline of each axis (gravity & slow movements) is the mean of
+ *    the last N samples, kept in a ring buffer with its running sum: a
+ *    sample costs 1 addition & 1 subtraction per axis, the history is
+ *    never rescanned. An impact is detected when a sample deviates from
+ *    the baseline by more than the threshold; it is counted on the axis
+ *    of the largest deviation. The detector is then blind for `holdoff`
+ *    samples (rebounds of the same impact), and the baseline is frozen
+ *    meanwhile so that the impact doesn't pollute it.
+ *    The counters saturate at TILT_MAX_CRASH_COUNT (range of the mode).
+ *
+ *    Example:
+ *      ImpactDetector<16> impacts(8192);   // 0.5g at ±2g full scale
+ *      void onAccelSample(const AccelSample& sample) {
+ *          impacts.update(sample);
+ *      }
+ *      // Setup
+ *      myOwnTilt.setSensorCrashCount(impacts.getCounts());
+ *      tilt.setSampleCallback(&onAccelSample);
+ *
+ * @tparam N Number of samples of the baseline (power of 2 recommended).
+ * @param m_ring Last samples of the 3 axes.
+ * @param m_sums Sums of the samples of m_ring for each axis.
+ * @param m_head Index of the oldest sample in m_ring.
+ * @param m_count Number of samples in m_ring (saturated to N).
+ * @param m_threshold Deviation of an impact (raw unit of the accelerometer).
+ * @param m_holdoff, m_blind Duration of the blind period & remaining samples.
+ * @param m_counts Impacts on the X, Y, Z axes.
+ */
+template <uint8_t N>
+class ImpactDetector {
+    static_assert(N > 0, "The window of the baseline must not be empty");
+
+public:
+    explicit ImpactDetector(uint16_t threshold, uint8_t holdoff = N) :
+        m_ring(),
+        m_sums(),
+        m_head(0),
+        m_count(0),
+        m_threshold(threshold),
+        m_holdoff(holdoff),
+        m_blind(0),
+        m_counts()
+    {}
+
+    /**
+     * @brief Add a sample.
+     * @return true if an impact is detected.
+     */
+    bool update(const AccelSample& sample) {
+        const int16_t values[3] = { sample.x, sample.y, sample.z };
+
+        if (m_blind) {
+            m_blind--;
+            return false;
+        }
+        if (m_count == N) {
+            // Baseline complete: look for a deviation
+            uint8_t  axis = 0;
+            uint16_t peak = 0;
+            for (uint8_t i = 0; i < 3; i++) {
+                const int32_t  delta     = _(int32_t)(values[i]) * N - m_sums[i];
+                const uint32_t deviation = ((delta < 0) ? -_(uint32_t)(delta) : _(uint32_t)(delta)) / N;
+                if (deviation > peak) {
+                    peak = (deviation > 0xFFFF) ? 0xFFFF : _(uint16_t)(deviation);
+                    axis = i;
+                }
+            }
+            if (peak > m_threshold) {
+                if (m_counts[axis] < TILT_MAX_CRASH_COUNT)
+                    m_counts[axis]++;
+                m_blind = m_holdoff;
+                return true;
+            }
+        }
+        // Replace the oldest sample in the baseline
+        for (uint8_t i = 0; i < 3; i++) {
+            m_sums[i]        += values[i] - m_ring[m_head][i];
+            m_ring[m_head][i] = values[i];
+        }
+        m_head = (m_head + 1 < N) ? m_head + 1 : 0;
+        if (m_count < N)
+            m_count++;
+        return false;
+    }
+
+    /**
+     * @brief Counters of the impacts on the X, Y, Z axes (3 bytes).
+     */
+    uint8_t *getCounts() {
+        return m_counts;
+    }
+
+    /**
+     * @brief Reset the counters; the baseline is kept.
+     */
+    void resetCounts() {
+        m_counts[0] = m_counts[1] = m_counts[2] = 0;
+    }
+
+private:
+    int16_t  m_ring[N][3];
+    int32_t  m_sums[3];
+    uint8_t  m_head;
+    uint8_t  m_count;
+    uint16_t m_threshold;
+    uint8_t  m_holdoff;
+    uint8_t  m_blind;
+    uint8_t  m_counts[3];
+};
+
+#endif // MOB_TILT_EVENTS_HPP
@@ -0,0 +1,217 @@
+# MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+# Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Test the binary captures, their index and the replay"""
+# Standard imports
+import os
+import select
+import time
+import tty
+import pytest
+import serial
+
+# Custom imports
+from my_own_bricks.capture import *
+import my_own_bricks.uart_handler as uart_handler
+
+
+def write_capture(path, count=1000, step=16):
+    """Capture of a NACK every 100ms, answered by the device 1ms later"""
+    with CaptureWriter(str(path), step=step) as capture:
+        for i in range(count // 2):
+            capture.write(HUB_TO_DEVICE, b"\x02", 115200, timestamp=i * 100000)
+            capture.write(DEVICE_TO_HUB, bytes([0xC0, i % 100, 0x3F ^ (i % 100)]),
+                          115200, timestamp=i * 100000 + 1000)
+    return str(path)
+
+
+def test_read_write(tmp_path):
+    """Records are read back in order, by number or by time"""
+    path = write_capture(tmp_path / "session.mobcap")
+    with CaptureReader(path) as capture:
+        assert len(capture) == 1000
+        # Sparse index
+        assert len(capture._index_numbers) == 1000 // 16 + 1
+
+        records = list(capture)
+        assert [record.number for record in records] == list(range(1000))
+        assert records[0] == (0, HUB_TO_DEVICE, 0, 115200, b"\x02")
+        assert records[3].data == b"\xC0\x01\x3E"
+
+        assert capture[517].timestamp == 258 * 100000 + 1000
+        assert capture[-1].number == 999
+        with pytest.raises(IndexError):
+            capture[1000]
+
+        assert [record.number for record in capture.records(40, 43)] == [40, 41, 42]
+        assert capture.find_time(0) == 0
+        assert capture.find_time(258 * 100000) == 516
+        assert capture.find_time(258 * 100000 + 1) == 517
+        assert capture.find_time(10 ** 9) == 1000
+
+
+def test_missing_index(tmp_path):
+    """The index is rebuilt, an interrupted capture is readable"""
+    path = write_capture(tmp_path / "session.mobcap")
+    os.remove(index_path(path))
+    with CaptureReader(path) as capture:
+        assert len(capture) == 1000
+        assert capture.find_time(258 * 100000) == 516
+
+    # Truncated record at the end of the capture
+    path = write_capture(tmp_path / "truncated.mobcap")
+    with open(path, "r+b") as file:
+        file.truncate(os.path.getsize(path) - 1)
+    with CaptureReader(path) as capture:
+        assert len(capture) == 999
+        assert capture[-1].number == 998
+
+
+def test_not_a_capture(tmp_path):
+    """Other files are rejected"""
+    path = tmp_path / "other.bin"
+    path.write_bytes(b"\x00" * 16)
+    with pytest.raises(ValueError):
+        CaptureReader(str(path))
+
+
+def test_recording_serial(tmp_path):
+    """Bytes exchanged through a serial handler are recorded"""
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    try:
+        path = str(tmp_path / "session.mobcap")
+        with CaptureWriter(path) as capture:
+            handler = RecordingSerial(serial.Serial(os.ttyname(slave), 115200, timeout=0.5), capture)
+            handler.write(b"\x43\x01\xBD")
+            assert os.read(master, 3) == b"\x43\x01\xBD"
+            os.write(master, b"\xC1\x05\x3B")
+            assert handler.read(3) == b"\xC1\x05\x3B"
+            # Settings are forwarded to the handler
+            handler.baudrate = 2400
+            handler.write(b"\x04")
+            handler.close()
+
+        with CaptureReader(path) as capture:
+            assert [(record.direction, record.baudrate, record.data) for record in capture] == [
+                (HUB_TO_DEVICE, 115200, b"\x43\x01\xBD"),
+                (DEVICE_TO_HUB, 115200, b"\xC1\x05\x3B"),
+                (HUB_TO_DEVICE, 2400, b"\x04"),
+            ]
+    finally:
+        os.close(master)
+        os.close(slave)
+
+
+def test_recording_handshake(tmp_path, monkeypatch):
+    """The init sequence and the ACK of the handshake are recorded"""
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    init_sequence = uart_handler.colour_expected_init_seq
+
+    def get_serial_handler(path, baudrate):
+        """Open the pty; the device sends its init sequence"""
+        handler = serial.Serial(os.ttyname(slave), baudrate, timeout=0.2)
+        os.write(master, init_sequence)
+        return handler
+
+    monkeypatch.setattr(uart_handler, "get_serial_handler", get_serial_handler)
+    try:
+        path = str(tmp_path / "session.mobcap")
+        with CaptureWriter(path) as capture:
+            handler = uart_handler.autoconnect(capture=capture)
+            assert handler.baudrate == uart_handler.BAUDRATE
+            handler.write(b"\x02")
+            handler.close()
+
+        with CaptureReader(path) as capture:
+            records = list(capture)
+        received = b"".join(record.data for record in records if record.direction == DEVICE_TO_HUB)
+        assert received == init_sequence
+        assert all(record.baudrate == uart_handler.BAUDRATE_INIT for record in records[:-1])
+        assert [(record.direction, record.baudrate, record.data) for record in records[-2:]] == [
+            (HUB_TO_DEVICE, uart_handler.BAUDRATE_INIT, b"\x04"),
+            (HUB_TO_DEVICE, uart_handler.BAUDRATE, b"\x02"),
+        ]
+    finally:
+        os.close(master)
+        os.close(slave)
+
+
+class FakeEndpoint:
+    """Endpoint recording the send times"""
+
+    def __init__(self):
+        self.baudrate = 115200
+        self.sent = []
+
+    def write(self, data):
+        self.sent.append((time.monotonic(), self.baudrate, data))
+
+
+def test_replay_timing(tmp_path):
+    """Hub queries are sent with their original timing, or faster"""
+    path = write_capture(tmp_path / "session.mobcap", count=12)
+    with CaptureReader(path) as capture:
+        endpoint = FakeEndpoint()
+        count, _ = replay(capture, endpoint)
+        assert count == 6
+        assert all(data == b"\x02" for _, _, data in endpoint.sent)
+        times = [send_time for send_time, _, _ in endpoint.sent]
+        # Absolute deadlines: no drift
+        assert abs((times[-1] - times[0]) - 0.5) < 0.02
+
+        endpoint = FakeEndpoint()
+        count, _ = replay(capture, endpoint, speed=5, direction=DEVICE_TO_HUB, start=4)
+        assert count == 4
+        assert endpoint.sent[0][2] == b"\xC0\x02\x3D"
+        times = [send_time for send_time, _, _ in endpoint.sent]
+        assert abs((times[-1] - times[0]) - 0.06) < 0.02
+
+
+def test_replay_baudrate(tmp_path):
+    """The endpoint follows the baudrate of the records"""
+    path = str(tmp_path / "session.mobcap")
+    with CaptureWriter(path) as capture:
+        capture.write(HUB_TO_DEVICE, b"\x04", 2400, timestamp=0)
+        capture.write(HUB_TO_DEVICE, b"\x02", 115200, timestamp=10000)
+
+    with CaptureReader(path) as capture:
+        endpoint = FakeEndpoint()
+        replay(capture, endpoint, speed=10)
+    assert [(baudrate, data) for _, baudrate, data in endpoint.sent] == [
+        (2400, b"\x04"), (115200, b"\x02")
+    ]
+
+
+def test_replay_pty(tmp_path):
+    """Replay into a pseudo-terminal"""
+    path = write_capture(tmp_path / "session.mobcap", count=20)
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    try:
+        with CaptureReader(path) as capture:
+            handler = serial.Serial(os.ttyname(slave), 115200)
+            count, _ = replay(capture, handler, speed=10)
+            handler.close()
+        assert count == 10
+        # The pty may deliver the bytes in several reads
+        received = b""
+        while len(received) < 10 and select.select([master], [], [], 1)[0]:
+            received += os.read(master, 100)
+        assert received == b"\x02" * 10
+    finally:
+        os.close(master)
+        os.close(slave)
@@ -0,0 +1,114 @@
+# MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+# Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Test the streaming decoder of captures"""
+import pytest
+from my_own_bricks.capture_decoder import *
+from my_own_bricks.capture_decoder import _MAX_SIZE
+
+
+@pytest.fixture()
+def capture():
+    """Synthetic capture of a Color & Distance sensor"""
+    return synthetic_capture(2000)
+
+
+def decode(capture, chunk_size):
+    """Decode the capture fed by chunks of the given size"""
+    decoder = CaptureDecoder()
+    records = []
+    view = memoryview(capture)
+    for pos in range(0, len(view), chunk_size):
+        records += decoder.feed(view[pos:pos + chunk_size])
+        # Only the incomplete message is kept
+        assert len(decoder._tail) < _MAX_SIZE
+    return decoder, records
+
+
+def test_init_sequence(capture):
+    """Type, speed and formats learned from the init sequence"""
+    decoder, records = decode(capture, len(capture))
+
+    assert decoder.type_id == 0x25
+    assert decoder.speed == 115200
+    assert sorted(decoder.formats) == [0, 2, 6, 8]
+    assert decoder.checksum_errors == 0
+
+    assert records[0] == Record(0, "LUMP_MSG_TYPE_CMD", "LUMP_CMD_TYPE", None, b"\x25", 0x25)
+    info_records = [record for record in records if record.msg_type == "LUMP_MSG_TYPE_INFO"]
+    assert [record.mode for record in info_records] == [0, 2, 6, 8]
+    assert info_records[2].values == (3, 1, 5, 0)
+
+
+def test_data_messages(capture):
+    """DATA messages are decoded with the formats of their mode (EXT_MODE included)"""
+    _, records = decode(capture, len(capture))
+    data = [(record.mode, record.values) for record in records
+            if record.msg_type == "LUMP_MSG_TYPE_DATA"]
+
+    assert data[:4] == [(0, (9,)), (2, (1234,)), (6, (272, 544, 816)), (8, (9, 25, 58, 0))]
+    # Same pattern repeated
+    assert data[4:8] == data[:4]
+    # Offsets are positions in the whole stream
+    for record in records:
+        if record.msg_type == "LUMP_MSG_TYPE_DATA":
+            assert capture[record.offset] == 0xC0 | (record.mode & 0x07) | (capture[record.offset] & 0x38)
+
+
+@pytest.mark.parametrize("chunk_size", [1, 2, 3, 7, 64, 1000])
+def test_chunk_boundaries(capture, chunk_size):
+    """Messages split between chunks are decoded like the whole capture"""
+    _, expected = decode(capture, len(capture))
+    decoder, records = decode(capture, chunk_size)
+    assert records == expected
+    assert decoder.offset == len(capture)
+
+
+def test_unknown_format():
+    """DATA messages of modes without format keep their raw payload"""
+    decoder = CaptureDecoder()
+    records = list(decoder.feed(forge_message(0xC3, b"\x2A")))
+    assert records == [Record(0, "LUMP_MSG_TYPE_DATA", 3, None, b"\x2A", None)]
+
+
+def test_resynchronization():
+    """Bad checksums are counted, the next messages are found"""
+    decoder = CaptureDecoder()
+    corrupted = bytearray(forge_message(0xC1, b"\x2A"))
+    corrupted[1] ^= 0x01
+    stream = b"\x02" + bytes(corrupted) + b"\x13" + forge_message(0xC3, b"\x09")
+    records = list(decoder.feed(stream))
+
+    assert decoder.checksum_errors == 1
+    assert [(record.msg_type, record.offset) for record in records] == [
+        ("LUMP_MSG_TYPE_SYS", 0),
+        ("LUMP_MSG_TYPE_DATA", 5),
+    ]
+    assert records[-1].payload == b"\x09"
+
+
+def test_reset(capture):
+    """The learned formats are forgotten"""
+    decoder, _ = decode(capture, len(capture))
+    decoder.reset()
+    assert not decoder.formats
+    assert decoder.offset == 0
+
+
+def test_benchmark():
+    """Smoke test of the benchmark (see `make decoder_benchmark`)"""
+    count, throughput = benchmark(100000, chunk_size=4096)
+    assert count > 10000
+    assert throughput > 0
@@ -0,0 +1,243 @@
+# MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+# Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Build and run the host (Linux) test programs of the C++ library
+
+The programs are in extras/tests; they are compiled against the minimal Arduino
+replacement of extras/host and return a non-zero code on failure.
+The examples are only compiled, against the declarations of extras/tests/fake_arduino.
+"""
+import os
+import shutil
+import signal
+import subprocess
+import time
+import tty
+from pathlib import Path
+import pytest
+
+ROOT_DIR = Path(__file__).resolve().parent.parent
+CXX = shutil.which("g++") or shutil.which("clang++")
+CXXFLAGS = ["-std=gnu++11", "-O2", "-Wall", "-Wextra", "-pthread",
+            "-I" + str(ROOT_DIR / "extras/host"), "-I" + str(ROOT_DIR / "src")]
+
+# Test program: sources (from the root of the repository) & specific flags
+HOST_PROGRAMS = {
+    "async_i2c_test": [
+        "-D__AVR__", "-I" + str(ROOT_DIR / "extras/tests/fake_avr"),
+        "extras/tests/async_i2c_test.cpp",
+        "src/AsyncI2C.cpp",
+    ],
+    "base_sensor_simulation_test": [
+        "extras/tests/base_sensor_simulation_test.cpp",
+        "extras/host/simulation.cpp",
+        "src/BaseSensor.cpp",
+        "src/ColorDistanceSensor.cpp",
+    ],
+    "filters_test": [
+        "extras/tests/filters_test.cpp",
+    ],
+    "lump_analyzer_test": [
+        "-I" + str(ROOT_DIR / "extras/sniffer"),
+        "extras/tests/lump_analyzer_test.cpp",
+        "extras/sniffer/lump_analyzer.cpp",
+    ],
+    "lump_bridge_test": [
+        "extras/tests/lump_bridge_test.cpp",
+        "src/LumpBridge.cpp",
+        "src/UartEventSerial.cpp",
+    ],
+    "pf_transmitter_test": [
+        "-D__AVR__", "-DPF_TRANSMITTER", "-I" + str(ROOT_DIR / "extras/tests/fake_avr"),
+        "extras/tests/pf_transmitter_test.cpp",
+        "src/PFTransmitter.cpp",
+    ],
+    "profiler_test": [
+        "extras/tests/profiler_test.cpp",
+    ],
+    "proximity_counter_test": [
+        "-DCOLOR_DISTANCE_COUNTER",
+        "extras/tests/proximity_counter_test.cpp",
+        "extras/host/simulation.cpp",
+        "src/BaseSensor.cpp",
+        "src/ColorDistanceSensor.cpp",
+    ],
+    "range_mapper_test": [
+        "extras/tests/range_mapper_test.cpp",
+    ],
+    "tcs34725_autorange_test": [
+        "extras/tests/tcs34725_autorange_test.cpp",
+    ],
+    "tilt_events_test": [
+        "extras/tests/tilt_events_test.cpp",
+    ],
+    "tilt_estimator_test": [
+        "extras/tests/tilt_estimator_test.cpp",
+    ],
+    "trace_buffer_test": [
+        "extras/tests/trace_buffer_test.cpp",
+    ],
+    "uart_event_serial_test": [
+        "extras/tests/uart_event_serial_test.cpp",
+        "src/UartEventSerial.cpp",
+    ],
+}
+
+
+@pytest.mark.skipif(CXX is None, reason="No C++ compiler found")
+@pytest.mark.parametrize("program", sorted(HOST_PROGRAMS))
+def test_host_program(program, tmp_path):
+    """Compile & run a test program; it must exit with 0"""
+    binary = tmp_path / program
+    sources = [
+        arg if arg.startswith("-") else str(ROOT_DIR / arg)
+        for arg in HOST_PROGRAMS[program]
+    ]
+
+    subprocess.run([CXX, *CXXFLAGS, *sources, "-o", str(binary)], check=True)
+    ret = subprocess.run([str(binary)], capture_output=True, text=True, timeout=60)
+    print(ret.stdout)
+    assert ret.returncode == 0, ret.stderr
+
+
+# Syntax builds of the examples for the Pro Micro, against the declarations of
+# extras/tests/fake_arduino (Arduino core & sensor libraries)
+EXAMPLE_CXXFLAGS = [
+    "-std=gnu++11", "-Wall", "-Wextra", "-Werror", "-fsyntax-only", "-x", "c++",
+    "-D__AVR__", "-DARDUINO_AVR_PROMICRO",
+    "-I" + str(ROOT_DIR / "extras/tests/fake_arduino"),
+    "-I" + str(ROOT_DIR / "extras/tests/fake_avr"),
+    "-I" + str(ROOT_DIR / "src"),
+]
+
+# Configurations of the color_distance_sensor example:
+# specific flags & defines of the sketch to comment
+COLOR_DISTANCE_CONFIGS = {
+    "dist_sensor_als": (
+        ["-DCOLOR_DISTANCE_CONFIG", "-DCOLOR_DISTANCE_COUNTER"], []
+    ),
+    "dist_sensor_als_info": (["-DINFO"], []),
+    "tcs_lux": (
+        ["-DCOLOR_DISTANCE_CONFIG", "-DCOLOR_DISTANCE_COUNTER"], ["DIST_SENSOR_ALS"]
+    ),
+    "tcs_lux_info": (["-DINFO"], ["DIST_SENSOR_ALS"]),
+}
+
+
+@pytest.mark.skipif(CXX is None, reason="No C++ compiler found")
+@pytest.mark.parametrize("config", sorted(COLOR_DISTANCE_CONFIGS))
+def test_color_distance_sensor_example(config, tmp_path):
+    """The color_distance_sensor example must compile in all its configurations"""
+    example_dir = ROOT_DIR / "examples/color_distance_sensor"
+    flags, disabled_defines = COLOR_DISTANCE_CONFIGS[config]
+
+    sketch = (example_dir / "color_distance_sensor.ino").read_text()
+    for define in disabled_defines:
+        assert "\n#define " + define + "\n" in sketch
+        sketch = sketch.replace("\n#define " + define + "\n", "\n//#define " + define + "\n")
+    # The headers of the sketch are found with -I
+    sketch_file = tmp_path / "color_distance_sensor.ino"
+    sketch_file.write_text(sketch)
+
+    ret = subprocess.run(
+        [CXX, *EXAMPLE_CXXFLAGS, *flags, "-I" + str(example_dir), str(sketch_file)],
+        capture_output=True, text=True
+    )
+    assert ret.returncode == 0, ret.stderr
+
+
+@pytest.fixture()
+def lump_sniffer(tmp_path):
+    """Build the sniffer of extras/sniffer (see `make lump_sniffer`)"""
+    if CXX is None:
+        pytest.skip("No C++ compiler found")
+    binary = tmp_path / "lump_sniffer"
+    sources = [str(ROOT_DIR / "extras/sniffer" / name)
+               for name in ("lump_sniffer.cpp", "lump_analyzer.cpp")]
+    subprocess.run([CXX, *CXXFLAGS, *sources, "-o", str(binary)], check=True)
+    return str(binary)
+
+
+def session_messages():
+    """Init sequence of a Color & Distance sensor, then NACKs answered in mode 0
+
+    :return: List of (direction, timestamp (µs), bytes)
+    """
+    from my_own_bricks.capture import DEVICE_TO_HUB, HUB_TO_DEVICE
+    from my_own_bricks.uart_handler import colour_expected_init_seq
+
+    messages = [(DEVICE_TO_HUB, 0, colour_expected_init_seq), (HUB_TO_DEVICE, 10000, b"\x04")]
+    for i in range(20):
+        timestamp = 50000 + i * 100000
+        messages.append((HUB_TO_DEVICE, timestamp, b"\x02"))
+        messages.append((DEVICE_TO_HUB, timestamp + 1500, b"\xC0\x09\x36"))
+    return messages
+
+
+def test_lump_sniffer_replay(lump_sniffer, tmp_path):
+    """Replay of a capture of the Python tooling, without hardware"""
+    from my_own_bricks.capture import CaptureWriter
+
+    path = str(tmp_path / "session.mobcap")
+    with CaptureWriter(path) as capture:
+        for direction, timestamp, data in session_messages():
+            capture.write(direction, data, 115200, timestamp=timestamp)
+
+    ret = subprocess.run([lump_sniffer, "-r", path], capture_output=True, text=True, timeout=10)
+    print(ret.stdout)
+    assert ret.returncode == 0, ret.stderr
+    assert "type 0x25, 11 modes" in ret.stdout
+    assert "mode 10 CALIB       8 x int16" in ret.stdout
+    assert "0 checksum errors" in ret.stdout
+    assert "NACK period  n=19      mean= 100.000" in ret.stdout
+    assert "mode 0       n=20      mean=   1.500" in ret.stdout
+
+
+def test_lump_sniffer_live(lump_sniffer, tmp_path):
+    """Sniffing of 2 pseudo-terminals; the traffic is recorded"""
+    from my_own_bricks.capture import CaptureReader, HUB_TO_DEVICE
+
+    taps = [os.openpty(), os.openpty()]  # hub, device
+    for _, slave in taps:
+        tty.setraw(slave)
+    path = str(tmp_path / "session.mobcap")
+    process = subprocess.Popen(
+        [lump_sniffer, os.ttyname(taps[0][1]), os.ttyname(taps[1][1]), "-w", path],
+        stdout=subprocess.PIPE, text=True
+    )
+    try:
+        time.sleep(0.3)
+        start = time.monotonic()
+        for direction, timestamp, data in session_messages()[:12]:
+            delay = start + timestamp / 1e6 - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            master = taps[0][0] if direction == HUB_TO_DEVICE else taps[1][0]
+            os.write(master, data)
+        time.sleep(0.2)
+    finally:
+        process.send_signal(signal.SIGINT)
+        stdout, _ = process.communicate(timeout=5)
+        for master, slave in taps:
+            os.close(master)
+            os.close(slave)
+
+    print(stdout)
+    assert process.returncode == 0
+    assert "type 0x25, 11 modes" in stdout
+    assert "mode 0       n=5 " in stdout
+    with CaptureReader(path) as capture:
+        assert b"".join(record.data for record in capture if record.direction == HUB_TO_DEVICE) \
+            == b"\x04" + b"\x02" * 5
@@ -0,0 +1,250 @@
+# MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+# Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Test the asyncio hub emulator against fake devices on pseudo-terminals"""
+# Standard imports
+import asyncio
+import os
+import tty
+import pytest
+
+# Custom imports
+from my_own_bricks.hub_emulator import HubEmulator, DeviceEndpoint
+from my_own_bricks.header_checksum import get_cheksum
+
+# Type 0x22 (Tilt), 4 modes, 115200 bauds, then ACK
+INIT_SEQUENCE = b"\x00\x40\x22\x9D\x49\x03\x02\xB7\x52\x00\xC2\x01\x00\x6E\x04"
+
+
+def data_frame(mode, value):
+    """DATA frame of 1 byte"""
+    frame = bytes([0xC0 | mode, value])
+    return frame + bytes([get_cheksum(frame)])
+
+
+class FakeDevice:
+    """Device on the slave side of a pty: answers the NACKs with the data
+    of the selected mode, and the select queries immediately.
+    """
+
+    def __init__(self, silent=False):
+        self.master, self.slave = os.openpty()
+        tty.setraw(self.slave)
+        os.set_blocking(self.slave, False)
+        self.silent = silent
+        self.mode = 0
+        self.counter = 0
+        self.buffer = bytearray()
+        self.acked = False
+
+    def start(self):
+        """Send the init sequence and serve the hub"""
+        if self.silent:
+            return
+        os.write(self.slave, INIT_SEQUENCE)
+        asyncio.get_running_loop().add_reader(self.slave, self.on_readable)
+
+    def send_data(self):
+        self.counter = (self.counter + 1) % 100
+        os.write(self.slave, data_frame(self.mode, self.mode * 100 + self.counter))
+
+    def on_readable(self):
+        try:
+            self.buffer += os.read(self.slave, 1024)
+        except BlockingIOError:
+            return
+        while self.buffer:
+            header = self.buffer[0]
+            if header == 0x04:
+                self.acked = True
+                del self.buffer[:1]
+            elif header == 0x02:
+                del self.buffer[:1]
+                self.send_data()
+            elif header == 0x43:
+                if len(self.buffer) < 3:
+                    return
+                self.mode = self.buffer[1]
+                del self.buffer[:3]
+                self.send_data()
+            else:
+                del self.buffer[:1]
+
+    def close(self):
+        try:
+            asyncio.get_running_loop().remove_reader(self.slave)
+        except RuntimeError:
+            pass
+        os.close(self.slave)
+        os.close(self.master)
+
+
+def test_endpoint_frames():
+    """Frames split between reads, SYS messages, bad checksums and EXT_MODE"""
+    async def session():
+        read_fd, write_fd = os.pipe()
+        endpoint = DeviceEndpoint(fd=read_fd)
+        endpoint._incoming = asyncio.Queue()
+        stream = data_frame(1, 42) + b"\x04" + data_frame(2, 7)
+        for i in range(len(stream)):
+            os.write(write_fd, stream[i:i + 1])
+            endpoint._on_readable()
+
+        # Corrupted payload: the frame is dropped, the next one is found
+        corrupted = bytearray(data_frame(1, 42))
+        corrupted[1] ^= 0x01
+        ext_mode = b"\x46\x08" + bytes([get_cheksum(b"\x46\x08")])
+        os.write(write_fd, bytes(corrupted) + data_frame(3, 9) + ext_mode + data_frame(0, 5))
+        endpoint._on_readable()
+        os.close(write_fd)
+        os.close(read_fd)
+
+        frames = []
+        while not endpoint._incoming.empty():
+            frames.append(endpoint._incoming.get_nowait())
+        return endpoint, frames
+
+    endpoint, frames = asyncio.run(session())
+    assert [(frame.msg_type, frame.mode, frame.payload) for frame in frames[:3]] == [
+        ("LUMP_MSG_TYPE_DATA", 1, b"\x2A"),
+        ("LUMP_MSG_TYPE_SYS", 0x04, b""),
+        ("LUMP_MSG_TYPE_DATA", 2, b"\x07"),
+    ]
+    assert (frames[-3].mode, frames[-3].payload) == (3, b"\x09")
+    assert frames[-2].mode == "LUMP_CMD_EXT_MODE"
+    assert (frames[-1].mode, frames[-1].payload) == (8, b"\x05")
+    assert endpoint.checksum_errors >= 1
+
+
+def test_multiple_devices():
+    """2 devices served concurrently: handshake, NACK cadence, queries, latencies"""
+    async def session():
+        devices = [FakeDevice(), FakeDevice()]
+        hub = HubEmulator([DeviceEndpoint(fd=device.master, name="dev%d" % i)
+                           for i, device in enumerate(devices)])
+        for device in devices:
+            device.start()
+
+        frames = [[], []]
+
+        async def collect(index):
+            async for frame in hub.devices[index].frames():
+                frames[index].append(frame)
+
+        try:
+            await hub.start()
+            collectors = [asyncio.ensure_future(collect(i)) for i in range(2)]
+            await asyncio.sleep(0.3)
+            hub.devices[1].query(1)
+            await asyncio.sleep(0.35)
+            await hub.stop()
+            # The iterators end with the session
+            await asyncio.wait_for(asyncio.gather(*collectors), 1)
+        finally:
+            for device in devices:
+                device.close()
+        return hub, devices, frames
+
+    hub, devices, frames = asyncio.run(session())
+
+    for index, device in enumerate(hub.devices):
+        assert devices[index].acked
+        assert device.type_id == 0x22
+        assert device.speed == 115200
+        assert len(device.info_frames) == 3
+        assert device.checksum_errors == 0
+        assert device.disconnections == 0
+
+        stats = device.get_stats()
+        # ~6 NACKs in 0.65s, every 100ms
+        assert len(device.nack_times) >= 6
+        assert abs(stats["nack_mean_ms"] - 100) < 5
+        assert stats["nack_jitter_ms"] < 30
+        assert device.latencies["nack"]
+        # All the frames are data frames of the device
+        assert len(frames[index]) >= 6
+        assert all(frame.msg_type == "LUMP_MSG_TYPE_DATA" for frame in frames[index])
+
+    # Mode selected on the 2nd device only
+    assert {frame.mode for frame in frames[0]} == {0}
+    assert {frame.mode for frame in frames[1]} == {0, 1}
+    assert frames[1][-1].mode == 1
+    assert frames[1][-1].payload[0] >= 100
+    assert len(hub.devices[1].latencies[1]) == 1
+    assert hub.devices[1].latencies[1][0] < 0.05
+
+
+def test_device_closed():
+    """The device closes its side: the endpoint stops polling it and the
+    frames iterator ends
+    """
+    async def session():
+        device = FakeDevice()
+        endpoint = DeviceEndpoint(fd=device.master)
+        hub = HubEmulator([endpoint])
+        device.start()
+        frames = []
+
+        async def collect():
+            async for frame in endpoint.frames():
+                frames.append(frame)
+
+        try:
+            await hub.start()
+            collector = asyncio.ensure_future(collect())
+            await asyncio.sleep(0.25)
+            loop = asyncio.get_running_loop()
+            loop.remove_reader(device.slave)
+            os.close(device.slave)
+            await asyncio.wait_for(collector, 1)
+            # Not registered anymore
+            registered = loop.remove_reader(device.master)
+            await hub.stop()
+        finally:
+            os.close(device.master)
+        return endpoint, frames, registered
+
+    endpoint, frames, registered = asyncio.run(session())
+    assert frames
+    assert endpoint.closed
+    assert not endpoint.connected
+    assert endpoint.disconnections == 1
+    assert not registered
+
+
+def test_handshake_timeout():
+    """A silent device is reported, the other endpoints are released"""
+    async def session():
+        devices = [FakeDevice(), FakeDevice(silent=True)]
+        hub = HubEmulator([DeviceEndpoint(fd=device.master) for device in devices], timeout=0.3)
+        for device in devices:
+            device.start()
+        try:
+            with pytest.raises(asyncio.TimeoutError):
+                await hub.start()
+        finally:
+            for device in devices:
+                device.close()
+        return hub
+
+    hub = asyncio.run(session())
+    assert not hub.devices[0]._tasks
+    assert not hub.devices[1]._tasks
+
+
+def test_endpoint_arguments():
+    """A path or a file descriptor is required"""
+    with pytest.raises(ValueError):
+        DeviceEndpoint()
@@ -0,0 +1,86 @@
+# MyOwnBricks is a library for the emulation of PoweredUp sensors on microcontrollers
+# Copyright (C) 2021-2023 Ysard - <ysard@users.noreply.github.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+"""Test the decoder of the binary trace events"""
+import re
+from pathlib import Path
+import pytest
+from my_own_bricks.trace_decoder import *
+
+
+@pytest.fixture()
+def stream():
+    """Frames of a few events with a text print of the sketch between them"""
+    return (
+        forge_frame(1, 0x43, tick=1000)
+        + forge_frame(3, 8, tick=1050)
+        + b"Connected !\r\n"
+        + forge_frame(10, 0x10, 0x2030, tick=0x12345678)
+        + forge_frame(0, arg1=3, tick=2000)
+    )
+
+
+def decode(stream, chunk_size):
+    """Decode the stream fed by chunks of the given size"""
+    decoder = TraceDecoder()
+    events = []
+    for pos in range(0, len(stream), chunk_size):
+        events += decoder.feed(stream[pos:pos + chunk_size])
+    return decoder, events
+
+
+@pytest.mark.parametrize("chunk_size", [1, 3, 10, 1000])
+def test_events(stream, chunk_size):
+    """Frames split between chunks are decoded; the text is skipped"""
+    decoder, events = decode(stream, chunk_size)
+
+    assert [event.message for event in events] == [
+        "<\tHeader 43",
+        "<\tAsked mode 8",
+        "LEDBrightnesses set (Left,Bottom,Right): 10, 20, 30",
+        "Trace overflow; events lost: 3",
+    ]
+    assert events[2] == TraceEvent(0x12345678, 10, 0x10, 0x2030, events[2].message)
+    assert decoder.skipped == len(b"Connected !\r\n")
+    assert decoder.checksum_errors == 0
+
+
+def test_corrupted_frame():
+    """A frame with a bad checksum is dropped; the next one is decoded"""
+    frame = bytearray(forge_frame(6, 9))
+    frame[2] ^= 0x01
+    decoder, events = decode(bytes(frame) + forge_frame(7, arg1=0x4142), 1000)
+
+    assert [event.message for event in events] == ["IR data set: 4142"]
+    assert decoder.checksum_errors == 1
+
+
+def test_unknown_event():
+    """Unknown ids are reported with their raw values"""
+    _, events = decode(forge_frame(200, 1, 2), 1000)
+
+    assert events[0].message == "unknown event 200: 1, 2"
+
+
+def test_messages_in_sync_with_library():
+    """The ids & messages of TRACE_MESSAGES are the ones of trace_event_t"""
+    header = Path(__file__).parent.parent / "src" / "TraceBuffer.h"
+    pattern = re.compile(r'^\s+TRACE_\w+\s*=\s*(\d+),\s*// "(.*?)"', re.MULTILINE)
+    library = {int(event_id): message.replace("\\t", "\t")
+               for event_id, message in pattern.findall(header.read_text())}
+
+    assert sorted(library) == sorted(TRACE_MESSAGES)
+    for event_id, message in library.items():
+        assert TRACE_MESSAGES[event_id].split("{")[0] == message